@@ -0,0 +1,999 @@
+/** \copyright
+ * Copyright (c) 2026, agent
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are  permitted provided that the following conditions are met:
+ *
+ *  - Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ *  - Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ * \file main.cxx
+ *
+ * Load generator and benchmark for the OpenLCB stack. Creates a number of
+ * virtual train nodes and a driver node, runs workloads from the driver
+ * against the virtual nodes, and prints the throughput, latency and CPU usage
+ * of each workload as one JSON object per line.
+ *
+ * @author agent
+ * @date 19 Oct 2026
+ */
+
+#include <getopt.h>
+#include <stdio.h>
+#include <sys/resource.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <deque>
+#include <memory>
+
+#include "os/os.h"
+#include "nmranet_config.h"
+#include "utils/constants.hxx"
+#include "utils/Hub.hxx"
+#include "utils/GridConnectHub.hxx"
+#include "utils/socket_listener.hxx"
+#include "utils/StringPrintf.hxx"
+#include "executor/Executor.hxx"
+#include "executor/Service.hxx"
+
+#include "openlcb/AliasAllocator.hxx"
+#include "openlcb/DatagramCan.hxx"
+#include "openlcb/DatagramHandlerDefault.hxx"
+#include "openlcb/DefaultNode.hxx"
+#include "openlcb/EventHandlerTemplates.hxx"
+#include "openlcb/EventService.hxx"
+#include "openlcb/IfCan.hxx"
+#include "openlcb/MemoryConfig.hxx"
+#include "openlcb/NodeInitializeFlow.hxx"
+#include "openlcb/TractionDefs.hxx"
+#include "openlcb/TractionTrain.hxx"
+
+// Lets the virtual nodes get their aliases quickly.
+OVERRIDE_CONST(alias_reservation_window, 64);
+
+NO_THREAD nt;
+Executor<1> g_executor(nt);
+Service g_service(&g_executor);
+/// Hub of the virtual nodes. In in-process mode the driver is also here.
+CanHubFlow dut_hub(&g_service);
+/// Hub of the driver in TCP mode.
+CanHubFlow driver_hub(&g_service);
+openlcb::InitializeFlow g_init_flow(&g_service);
+
+namespace openlcb
+{
+Pool *const g_incoming_datagram_allocator = mainBufferPool;
+}
+
+using openlcb::Defs;
+using openlcb::NodeHandle;
+using openlcb::NodeID;
+
+/// Node ID of the driver node.
+static const NodeID DRIVER_NODE_ID = 0x050101011FFFULL;
+/// First event ID of the range used by the PCER workload.
+static const uint64_t PCER_EVENT_BASE = 0x05010101FE000000ULL;
+/// log2 of the PCER event range size.
+static const unsigned PCER_EVENT_BITS = 24;
+/// Memory space read by the datagram workload.
+static const uint8_t BENCH_SPACE = 0xEF;
+/// Size of the memory space read by the datagram workload.
+static const unsigned BENCH_SPACE_SIZE = 256;
+/// Bytes to read in one datagram.
+static const unsigned READ_SIZE = 64;
+/// After how much time without progress a workload is abandoned.
+static const long long STALL_TIMEOUT_NSEC = SEC_TO_NSEC(5);
+
+int port = 12021;
+const char *host = nullptr;
+unsigned num_nodes = 10;
+unsigned request_count = 10000;
+unsigned window = 16;
+uint64_t node_id_base = 0x050101012000ULL;
+string workloads = "pcer,datagram,traction,identify";
+string label;
+FILE *output = stdout;
+
+void usage(const char *e)
+{
+    fprintf(stderr,
+        "Usage: %s [-n nodes] [-w workloads] [-c count] [-W window] "
+        "[-b node_id_base] [-i host [-p port]] [-l label] [-o file]\n\n",
+        e);
+    fprintf(stderr, "Creates a number of virtual train nodes and a driver "
+                    "node, runs workloads between them and prints the "
+                    "results as one JSON object per line.\n\n");
+    fprintf(stderr, "\t-n nodes is the number of virtual nodes. Default 10.\n");
+    fprintf(stderr,
+        "\t-w workloads is a comma separated list from pcer, datagram, "
+        "traction, identify, verify. Default: all but verify.\n"
+        "\t\tpcer: event reports consumed by the virtual nodes;\n"
+        "\t\tdatagram: 64-byte memory config reads from the virtual nodes;\n"
+        "\t\ttraction: set speed commands to the virtual nodes;\n"
+        "\t\tidentify: identify events global, waiting for the is-train "
+        "producer identified reply of every node;\n"
+        "\t\tverify: verify node ID global, waiting for every reply.\n");
+    fprintf(stderr, "\t-c count is the number of requests per workload. The "
+                    "identify and verify workloads make count/nodes rounds. "
+                    "Default 10000.\n");
+    fprintf(stderr, "\t-W window is how many requests may be outstanding at "
+                    "the same time. Default 16.\n");
+    fprintf(stderr, "\t-b node_id_base is the node ID of the first virtual "
+                    "node. Default 0x050101012000.\n");
+    fprintf(stderr, "\t-i host connects the virtual nodes and the driver "
+                    "through a GridConnect TCP hub on this host, with one "
+                    "connection each. Without it the traffic stays in "
+                    "process.\n");
+    fprintf(stderr, "\t-p port is the port of the TCP hub. Default 12021.\n");
+    fprintf(stderr, "\t-l label is copied into each output line, for example "
+                    "a version.\n");
+    fprintf(stderr, "\t-o file appends the output to a file instead of "
+                    "stdout.\n");
+    exit(1);
+}
+
+void parse_args(int argc, char *argv[])
+{
+    int opt;
+    while ((opt = getopt(argc, argv, "hn:w:c:W:b:i:p:l:o:")) >= 0)
+    {
+        switch (opt)
+        {
+            case 'h':
+                usage(argv[0]);
+                break;
+            case 'n':
+                num_nodes = atoi(optarg);
+                break;
+            case 'w':
+                workloads = optarg;
+                break;
+            case 'c':
+                request_count = atoi(optarg);
+                break;
+            case 'W':
+                window = atoi(optarg);
+                break;
+            case 'b':
+                node_id_base = strtoll(optarg, nullptr, 16);
+                break;
+            case 'i':
+                host = optarg;
+                break;
+            case 'p':
+                port = atoi(optarg);
+                break;
+            case 'l':
+                label = optarg;
+                break;
+            case 'o':
+                output = fopen(optarg, "a");
+                if (!output)
+                {
+                    fprintf(stderr, "Cannot open %s\n", optarg);
+                    exit(1);
+                }
+                break;
+            default:
+                fprintf(stderr, "Unknown option %c\n", opt);
+                usage(argv[0]);
+        }
+    }
+    if (num_nodes == 0 || window == 0 || request_count == 0 ||
+        request_count > (1U << PCER_EVENT_BITS))
+    {
+        usage(argv[0]);
+    }
+}
+
+/// Keeps track of the outstanding requests of a workload and collects the
+/// latency of each completed request. The main thread registers the
+/// requests, the stack's executor completes them.
+class Recorder
+{
+public:
+    /// Prepares for a new workload. @param count is the number of requests.
+    void reset(unsigned count)
+    {
+        OSMutexLock h(&lock_);
+        sendTime_.assign(count, 0);
+        pending_.assign(num_nodes, std::deque<unsigned>());
+        latency_.clear();
+        latency_.reserve(count);
+        sent_ = 0;
+        completed_ = 0;
+    }
+
+    /// Registers a request before it is sent. @param seq is the index of the
+    /// request. @param node is the index of the virtual node that will
+    /// complete it with done_node(), or -1 if it will be completed with
+    /// done().
+    void sent(unsigned seq, int node)
+    {
+        OSMutexLock h(&lock_);
+        sendTime_[seq] = os_get_time_monotonic();
+        if (node >= 0)
+        {
+            pending_[node].push_back(seq);
+        }
+        ++sent_;
+    }
+
+    /// Completes a request. @param seq is the index of the request.
+    void done(unsigned seq)
+    {
+        long long now = os_get_time_monotonic();
+        OSMutexLock h(&lock_);
+        complete(seq, now);
+    }
+
+    /// Completes the oldest outstanding request of a node. Used when the
+    /// response does not tell which request it belongs to. @param node is
+    /// the index of the virtual node.
+    void done_node(unsigned node)
+    {
+        long long now = os_get_time_monotonic();
+        OSMutexLock h(&lock_);
+        if (node >= pending_.size() || pending_[node].empty())
+        {
+            return;
+        }
+        unsigned seq = pending_[node].front();
+        pending_[node].pop_front();
+        complete(seq, now);
+    }
+
+    /// Blocks the main thread until fewer than a given number of requests
+    /// are outstanding.
+    /// @param limit is the number of outstanding requests to wait below.
+    /// @return false if there was no progress for STALL_TIMEOUT_NSEC.
+    bool wait_below(unsigned limit)
+    {
+        while (true)
+        {
+            {
+                OSMutexLock h(&lock_);
+                if (sent_ - completed_ < limit)
+                {
+                    return true;
+                }
+            }
+            if (sem_.timedwait(STALL_TIMEOUT_NSEC) != 0)
+            {
+                return false;
+            }
+        }
+    }
+
+    /// @return the number of completed requests.
+    unsigned completed()
+    {
+        OSMutexLock h(&lock_);
+        return completed_;
+    }
+
+    /// Sorts and @return the latencies (nsec) of the completed requests.
+    /// Call only after the workload is finished.
+    const vector<unsigned> &sorted_latencies()
+    {
+        std::sort(latency_.begin(), latency_.end());
+        return latency_;
+    }
+
+private:
+    /// Records the completion of a request. Must be called with lock_ held.
+    /// @param seq is the request. @param now is the completion time.
+    void complete(unsigned seq, long long now)
+    {
+        if (seq >= sendTime_.size() || !sendTime_[seq])
+        {
+            // Unknown or duplicate response.
+            return;
+        }
+        latency_.push_back(now - sendTime_[seq]);
+        sendTime_[seq] = 0;
+        ++completed_;
+        sem_.post();
+    }
+
+    /// Protects all member variables.
+    OSMutex lock_;
+    /// Posted on every completion.
+    OSSem sem_;
+    /// When each request was sent, or 0 if it is not outstanding.
+    vector<long long> sendTime_;
+    /// For each virtual node the outstanding requests in sending order.
+    vector<std::deque<unsigned>> pending_;
+    /// Latency of the completed requests in nsec.
+    vector<unsigned> latency_;
+    /// Number of requests sent so far.
+    unsigned sent_;
+    /// Number of requests completed so far.
+    unsigned completed_;
+} g_recorder;
+
+/// Stack of the virtual nodes.
+openlcb::IfCan *dut_if;
+/// Stack of the driver.
+openlcb::IfCan *driver_if;
+openlcb::CanDatagramService *driver_datagram;
+openlcb::DefaultNode *driver_node;
+vector<openlcb::TrainNode *> dut_nodes;
+
+/// @return the index of a virtual node, or -1 if the node is not one of the
+/// virtual nodes. @param id is the node ID.
+int node_index(NodeID id)
+{
+    if (id < node_id_base || id >= node_id_base + num_nodes)
+    {
+        return -1;
+    }
+    return id - node_id_base;
+}
+
+/// @return the index of the virtual node that sent a message, or -1.
+/// @param src is the source of the message as seen by the driver.
+int node_index(const NodeHandle &src)
+{
+    NodeID id = src.id;
+    if (!id && src.alias)
+    {
+        id = driver_if->remote_aliases()->lookup(src.alias);
+    }
+    return node_index(id);
+}
+
+/// Train implementation of the virtual nodes. Completes a request of the
+/// traction workload when a speed command arrives.
+class BenchTrain : public openlcb::TrainImpl
+{
+public:
+    /// @param index is the index of the virtual node.
+    BenchTrain(unsigned index)
+        : index_(index)
+    {
+    }
+
+    void set_speed(openlcb::SpeedType speed) override
+    {
+        speed_ = speed;
+        g_recorder.done_node(index_);
+    }
+
+    openlcb::SpeedType get_speed() override
+    {
+        return speed_;
+    }
+
+    void set_emergencystop() override
+    {
+        speed_ = 0;
+    }
+
+    void set_fn(uint32_t address, uint16_t value) override
+    {
+    }
+
+    uint16_t get_fn(uint32_t address) override
+    {
+        return 0;
+    }
+
+    uint32_t legacy_address() override
+    {
+        return 1000 + index_;
+    }
+
+    dcc::TrainAddressType legacy_address_type() override
+    {
+        return dcc::TrainAddressType::DCC_LONG_ADDRESS;
+    }
+
+private:
+    unsigned index_;
+    openlcb::SpeedType speed_{0};
+};
+
+/// Consumer of the PCER workload's event range on the virtual nodes' stack.
+class BenchConsumer : public openlcb::SimpleEventHandler
+{
+public:
+    BenchConsumer()
+    {
+        openlcb::EventRegistry::instance()->register_handler(
+            openlcb::EventRegistryEntry(this, PCER_EVENT_BASE),
+            PCER_EVENT_BITS);
+    }
+
+    void handle_event_report(const openlcb::EventRegistryEntry &entry,
+        openlcb::EventReport *event, BarrierNotifiable *done) override
+    {
+        g_recorder.done(event->event - PCER_EVENT_BASE);
+        done->notify();
+    }
+
+    void handle_identify_global(const openlcb::EventRegistryEntry &entry,
+        openlcb::EventReport *event, BarrierNotifiable *done) override
+    {
+        done->notify();
+    }
+};
+
+/// Receives the memory config read responses on the driver and completes
+/// the requests of the datagram workload.
+class ReadResponseHandler : public openlcb::DefaultDatagramHandler
+{
+public:
+    ReadResponseHandler(openlcb::DatagramService *s)
+        : DefaultDatagramHandler(s)
+    {
+    }
+
+    Action entry() override
+    {
+        int idx = node_index(message()->data()->src);
+        if (idx >= 0)
+        {
+            g_recorder.done_node(idx);
+        }
+        return respond_ok(0);
+    }
+};
+
+/// Base class of the workloads. Each workload sends numbered requests from
+/// the main thread; the stack completes them on the Recorder.
+class Workload
+{
+public:
+    virtual ~Workload()
+    {
+    }
+
+    /// @return the name of the workload in the output.
+    virtual const char *name() = 0;
+
+    /// @return how many requests to make.
+    virtual unsigned count()
+    {
+        return request_count;
+    }
+
+    /// @return how many requests may be outstanding.
+    virtual unsigned window()
+    {
+        return ::window;
+    }
+
+    /// @return the index of the virtual node that completes a request with
+    /// Recorder::done_node(), or -1 if the request is completed with
+    /// Recorder::done(). @param seq is the index of the request.
+    virtual int node(unsigned seq)
+    {
+        return -1;
+    }
+
+    /// Sends a request. Called on the main thread.
+    /// @param seq is the index of the request.
+    virtual void send(unsigned seq) = 0;
+
+protected:
+    /// Sends a global message from the driver node. @param mti is the
+    /// message type. @param payload is the message content.
+    void send_global(Defs::MTI mti, const openlcb::Payload &payload)
+    {
+        auto *b = driver_if->global_message_write_flow()->alloc();
+        b->data()->reset(mti, DRIVER_NODE_ID, payload);
+        driver_if->global_message_write_flow()->send(b);
+    }
+
+    /// Sends an addressed message from the driver node. @param mti is the
+    /// message type. @param node is the index of the destination virtual
+    /// node. @param payload is the message content.
+    void send_addressed(
+        Defs::MTI mti, unsigned node, const openlcb::Payload &payload)
+    {
+        auto *b = driver_if->addressed_message_write_flow()->alloc();
+        b->data()->reset(mti, DRIVER_NODE_ID,
+            NodeHandle(node_id_base + node), payload);
+        driver_if->addressed_message_write_flow()->send(b);
+    }
+};
+
+/// Storm of event reports, each consumed by the virtual nodes' stack.
+class PcerWorkload : public Workload
+{
+public:
+    const char *name() override
+    {
+        return "pcer";
+    }
+
+    void send(unsigned seq) override
+    {
+        send_global(
+            Defs::MTI_EVENT_REPORT, openlcb::eventid_to_buffer(
+                                        PCER_EVENT_BASE + seq));
+    }
+};
+
+/// Memory config reads over datagrams. A request completes when the
+/// response datagram arrives at the driver.
+class DatagramWorkload : public Workload
+{
+public:
+    const char *name() override
+    {
+        return "datagram";
+    }
+
+    int node(unsigned seq) override
+    {
+        return seq % num_nodes;
+    }
+
+    unsigned window() override
+    {
+        // There is one datagram client per window slot.
+        return std::min(::window, num_nodes);
+    }
+
+    void send(unsigned seq) override
+    {
+        openlcb::DatagramClient *client =
+            driver_datagram->client_allocator()->next_blocking();
+        Buffer<openlcb::GenMessage> *b;
+        mainBufferPool->alloc(&b);
+        b->data()->reset(Defs::MTI_DATAGRAM, DRIVER_NODE_ID,
+            NodeHandle(node_id_base + node(seq)),
+            openlcb::MemoryConfigDefs::read_datagram(BENCH_SPACE,
+                (seq * READ_SIZE) % BENCH_SPACE_SIZE, READ_SIZE));
+        b->set_done((new ClientReturn(client))->done());
+        client->write_datagram(b);
+    }
+
+private:
+    /// Returns the datagram client to the service once the request datagram
+    /// is acknowledged. The client may only be reused after it exited, so
+    /// this goes through the executor.
+    class ClientReturn : public Executable
+    {
+    public:
+        ClientReturn(openlcb::DatagramClient *client)
+            : client_(client)
+        {
+        }
+
+        /// @return the barrier to put into the datagram buffer.
+        BarrierNotifiable *done()
+        {
+            return done_.reset(this);
+        }
+
+        void notify() override
+        {
+            g_executor.add(this);
+        }
+
+        void run() override
+        {
+            if (!(client_->result() & openlcb::DatagramClient::OPERATION_SUCCESS))
+            {
+                LOG(WARNING, "Datagram failed: %04x", client_->result());
+            }
+            driver_datagram->client_allocator()->typed_insert(client_);
+            delete this;
+        }
+
+    private:
+        openlcb::DatagramClient *client_;
+        BarrierNotifiable done_;
+    };
+};
+
+/// Set speed commands to the virtual train nodes. A request completes when
+/// the train implementation gets the new speed.
+class TractionWorkload : public Workload
+{
+public:
+    const char *name() override
+    {
+        return "traction";
+    }
+
+    int node(unsigned seq) override
+    {
+        return seq % num_nodes;
+    }
+
+    void send(unsigned seq) override
+    {
+        openlcb::Velocity v;
+        v.set_mph(seq % 100);
+        send_addressed(Defs::MTI_TRACTION_CONTROL_COMMAND, node(seq),
+            openlcb::TractionDefs::speed_set_payload(v));
+    }
+};
+
+/// Global requests that every virtual node answers. A request completes when
+/// every virtual node has replied.
+class RoundWorkload : public Workload
+{
+public:
+    /// Constructor. @param request is the global message to send. @param
+    /// reply is the message the virtual nodes answer with.
+    RoundWorkload(Defs::MTI request, Defs::MTI reply)
+        : request_(request)
+        , reply_(reply)
+    {
+        driver_if->dispatcher()->register_handler(
+            &handler_, reply_, Defs::MTI_EXACT);
+    }
+
+    ~RoundWorkload()
+    {
+        driver_if->dispatcher()->unregister_handler(
+            &handler_, reply_, Defs::MTI_EXACT);
+    }
+
+    unsigned count() override
+    {
+        return std::max(1u, request_count / num_nodes);
+    }
+
+    unsigned window() override
+    {
+        return 1;
+    }
+
+    void send(unsigned seq) override
+    {
+        {
+            OSMutexLock h(&lock_);
+            seq_ = seq;
+            seen_.assign(num_nodes, false);
+            remaining_ = num_nodes;
+        }
+        send_global(request_, openlcb::EMPTY_PAYLOAD);
+    }
+
+protected:
+    /// @return the index of the virtual node that a reply came from, or -1
+    /// if it is not a reply to the round. @param m is the reply.
+    virtual int replier(openlcb::GenMessage *m) = 0;
+
+private:
+    /// Handles an incoming reply on the driver.
+    void received(Buffer<openlcb::GenMessage> *b)
+    {
+        int idx = replier(b->data());
+        b->unref();
+        if (idx < 0)
+        {
+            return;
+        }
+        OSMutexLock h(&lock_);
+        if (remaining_ && !seen_[idx])
+        {
+            seen_[idx] = true;
+            if (--remaining_ == 0)
+            {
+                g_recorder.done(seq_);
+            }
+        }
+    }
+
+    openlcb::MessageHandler::GenericHandler handler_{
+        this, &RoundWorkload::received};
+    /// Global message to send.
+    Defs::MTI request_;
+    /// Message type of the replies.
+    Defs::MTI reply_;
+    /// Protects the round state.
+    OSMutex lock_;
+    /// Request index of the current round.
+    unsigned seq_{0};
+    /// Which virtual nodes replied in the current round.
+    vector<bool> seen_;
+    /// How many virtual nodes did not reply yet in the current round.
+    unsigned remaining_{0};
+};
+
+/// Verify node ID global messages, answered with verified node ID.
+class VerifyWorkload : public RoundWorkload
+{
+public:
+    VerifyWorkload()
+        : RoundWorkload(Defs::MTI_VERIFY_NODE_ID_GLOBAL,
+              Defs::MTI_VERIFIED_NODE_ID_NUMBER)
+    {
+    }
+
+    const char *name() override
+    {
+        return "verify";
+    }
+
+protected:
+    int replier(openlcb::GenMessage *m) override
+    {
+        if (m->payload.size() < 6)
+        {
+            return -1;
+        }
+        return node_index(openlcb::buffer_to_node_id(m->payload));
+    }
+};
+
+/// Identify events global messages. Each virtual node answers with the
+/// producer identified message of the is-train event.
+class IdentifyWorkload : public RoundWorkload
+{
+public:
+    IdentifyWorkload()
+        : RoundWorkload(Defs::MTI_EVENTS_IDENTIFY_GLOBAL,
+              Defs::MTI_PRODUCER_IDENTIFIED_UNKNOWN)
+    {
+    }
+
+    const char *name() override
+    {
+        return "identify";
+    }
+
+protected:
+    int replier(openlcb::GenMessage *m) override
+    {
+        if (m->payload.size() != 8 ||
+            openlcb::data_to_eventid(m->payload.data()) !=
+                openlcb::TractionDefs::IS_TRAIN_EVENT)
+        {
+            return -1;
+        }
+        return node_index(m->src);
+    }
+};
+
+/// @return the CPU time used by the process in nsec.
+long long cpu_time()
+{
+    struct rusage u;
+    getrusage(RUSAGE_SELF, &u);
+    return SEC_TO_NSEC((long long)u.ru_utime.tv_sec + u.ru_stime.tv_sec) +
+        USEC_TO_NSEC((long long)u.ru_utime.tv_usec + u.ru_stime.tv_usec);
+}
+
+/// @return s as the body of a JSON string.
+string json_escape(const string &s)
+{
+    string ret;
+    for (char c : s)
+    {
+        if (c == '"' || c == '\\')
+        {
+            ret.push_back('\\');
+        }
+        if ((uint8_t)c >= 0x20)
+        {
+            ret.push_back(c);
+        }
+    }
+    return ret;
+}
+
+/// @return the fields common to every output line.
+string common_fields()
+{
+    return StringPrintf("\"label\":\"%s\",\"transport\":\"%s\",\"nodes\":%u",
+        json_escape(label).c_str(), host ? "tcp" : "inprocess", num_nodes);
+}
+
+/// Runs a workload and prints its results. @param w is the workload.
+/// @param report is false for warming up.
+void run(Workload *w, bool report = true)
+{
+    unsigned count = w->count();
+    unsigned win = w->window();
+    g_recorder.reset(count);
+    long long start = os_get_time_monotonic();
+    long long cpu_start = cpu_time();
+    bool stalled = false;
+    for (unsigned seq = 0; seq < count && !stalled; ++seq)
+    {
+        stalled = !g_recorder.wait_below(win);
+        if (!stalled)
+        {
+            g_recorder.sent(seq, w->node(seq));
+            w->send(seq);
+        }
+    }
+    stalled = stalled || !g_recorder.wait_below(1);
+    long long elapsed = os_get_time_monotonic() - start;
+    long long cpu = cpu_time() - cpu_start;
+    if (stalled)
+    {
+        LOG(WARNING, "Workload %s stalled after %u of %u requests.", w->name(),
+            g_recorder.completed(), count);
+    }
+    if (!report)
+    {
+        return;
+    }
+    const vector<unsigned> &l = g_recorder.sorted_latencies();
+    double avg = 0;
+    for (unsigned x : l)
+    {
+        avg += x;
+    }
+    auto pct = [&l](unsigned p) {
+        return l.empty() ? 0.0
+                         : l[std::min(l.size() - 1, l.size() * p / 100)] / 1000.0;
+    };
+    double sec = elapsed / 1e9;
+    fprintf(output,
+        "{\"workload\":\"%s\",%s,\"window\":%u,\"count\":%u,\"completed\":%u,"
+        "\"elapsed_sec\":%.6f,\"throughput_per_sec\":%.1f,"
+        "\"latency_usec\":{\"p50\":%.1f,\"p99\":%.1f,\"max\":%.1f,"
+        "\"avg\":%.1f},\"cpu_sec\":%.6f,\"cpu_percent\":%.1f}\n",
+        w->name(), common_fields().c_str(), win, count, (unsigned)l.size(),
+        sec, l.size() / sec, pct(50), pct(99),
+        l.empty() ? 0.0 : l.back() / 1000.0,
+        l.empty() ? 0.0 : avg / l.size() / 1000.0, cpu / 1e9,
+        cpu * 100.0 / elapsed);
+    fflush(output);
+}
+
+/** Entry point to application.
+ * @param argc number of command line arguments
+ * @param argv array of command line arguments
+ * @return 0, should never return
+ */
+int appl_main(int argc, char *argv[])
+{
+    parse_args(argc, argv);
+    CanHubFlow *driver_device = &dut_hub;
+    if (host)
+    {
+        int fd = ConnectSocket(host, port);
+        HASSERT(fd >= 0);
+        create_gc_port_for_can_hub(&dut_hub, fd);
+        fd = ConnectSocket(host, port);
+        HASSERT(fd >= 0);
+        create_gc_port_for_can_hub(&driver_hub, fd);
+        driver_device = &driver_hub;
+    }
+
+    // Virtual nodes.
+    // The reserved aliases also take up local alias cache entries.
+    dut_if = new openlcb::IfCan(&g_executor, &dut_hub,
+        num_nodes + config_alias_reservation_window() + 1, 16, num_nodes);
+    new openlcb::AddAliasAllocator(node_id_base, dut_if);
+    dut_if->add_addressed_message_support();
+    new openlcb::EventService(dut_if);
+    auto *dut_datagram = new openlcb::CanDatagramService(dut_if, 4, 2);
+    auto *memcfg = new openlcb::MemoryConfigHandler(dut_datagram, nullptr, 2);
+    static uint8_t space_data[BENCH_SPACE_SIZE];
+    memcfg->registry()->insert(nullptr, BENCH_SPACE,
+        new openlcb::ReadOnlyMemoryBlock(space_data, BENCH_SPACE_SIZE));
+    auto *train_service = new openlcb::TrainService(dut_if);
+    for (unsigned i = 0; i < num_nodes; ++i)
+    {
+        dut_nodes.push_back(new openlcb::TrainNodeWithId(
+            train_service, new BenchTrain(i), node_id_base + i));
+        // Answers the identify workload.
+        new openlcb::FixedEventProducer<openlcb::TractionDefs::IS_TRAIN_EVENT>(
+            dut_nodes.back());
+    }
+    new BenchConsumer();
+
+    // Driver.
+    driver_if = new openlcb::IfCan(
+        &g_executor, driver_device, 3, num_nodes + 16, 1);
+    new openlcb::AddAliasAllocator(DRIVER_NODE_ID, driver_if);
+    driver_if->add_addressed_message_support();
+    driver_datagram = new openlcb::CanDatagramService(driver_if, 2, window);
+    driver_node = new openlcb::DefaultNode(driver_if, DRIVER_NODE_ID);
+    driver_datagram->registry()->insert(driver_node,
+        openlcb::DatagramDefs::CONFIGURATION,
+        new ReadResponseHandler(driver_datagram));
+
+    // Bootstraps the alias allocation processes.
+    openlcb::seed_alias_allocator(dut_if->alias_allocator(), mainBufferPool,
+        config_alias_reservation_window());
+    driver_if->alias_allocator()->send(driver_if->alias_allocator()->alloc());
+
+    long long start = os_get_time_monotonic();
+    long long cpu_start = cpu_time();
+    g_executor.start_thread("g_executor", 0, 2048);
+
+    // Waits for all nodes to be up.
+    while (true)
+    {
+        bool all = driver_node->is_initialized();
+        for (auto *n : dut_nodes)
+        {
+            all = all && n->is_initialized();
+        }
+        if (all)
+        {
+            break;
+        }
+        if (os_get_time_monotonic() - start > SEC_TO_NSEC(120))
+        {
+            LOG(FATAL, "Timeout waiting for the nodes to initialize.");
+            exit(1);
+        }
+        usleep(10000);
+    }
+    long long elapsed = os_get_time_monotonic() - start;
+    fprintf(output,
+        "{\"workload\":\"setup\",%s,\"elapsed_sec\":%.6f,\"cpu_sec\":%.6f}\n",
+        common_fields().c_str(), elapsed / 1e9,
+        (cpu_time() - cpu_start) / 1e9);
+    fflush(output);
+
+    // Teaches the driver the alias of every virtual node.
+    {
+        VerifyWorkload warmup;
+        run(&warmup, false);
+    }
+
+    size_t pos = 0;
+    while (pos <= workloads.size())
+    {
+        size_t end = workloads.find(',', pos);
+        if (end == string::npos)
+        {
+            end = workloads.size();
+        }
+        string name = workloads.substr(pos, end - pos);
+        pos = end + 1;
+        std::unique_ptr<Workload> w;
+        if (name == "pcer")
+        {
+            w.reset(new PcerWorkload);
+        }
+        else if (name == "datagram")
+        {
+            w.reset(new DatagramWorkload);
+        }
+        else if (name == "traction")
+        {
+            w.reset(new TractionWorkload);
+        }
+        else if (name == "identify")
+        {
+            w.reset(new IdentifyWorkload);
+        }
+        else if (name == "verify")
+        {
+            w.reset(new VerifyWorkload);
+        }
+        else
+        {
+            fprintf(stderr, "Unknown workload '%s'\n", name.c_str());
+            exit(1);
+        }
+        run(w.get());
+    }
+
+    exit(0); // do not call destructors.
+    return 0;
+}
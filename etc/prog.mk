@@ -110,8 +110,10 @@ endif
 
 $(EXECUTABLE)$(EXTENTION): cdi.o
 
+# Set CDI_COMPRESS=1 in the application Makefile to store the CDI in flash in
+# LZSS-compressed form. It will be decompressed on the fly when read.
 cdi.o : compile_cdi
-	./compile_cdi > cdi.cxx
+	./compile_cdi $(if $(CDI_COMPRESS),-z) > cdi.cxx
 	$(CXX) $(CXXFLAGS) -x c++ cdi.cxx -o $@
 	mv cdi.cxx cdi.cxxout
 	rm -f cdi.d
@@ -104,8 +104,8 @@ DECLARE_CONST(gridconnect_bridge_max_incoming_packets);
  * lowlevel system (such as TCP socket). */
 DECLARE_CONST(gridconnect_buffer_size);
 
-/** How long (in microsec) to buffer generated gridconnect data before sending
- * off to the lowlevel system (such as a TCP socket). */
+/** How long (in microsec) at most to buffer generated gridconnect data before
+ * sending off to the lowlevel system (such as a TCP socket). */
 DECLARE_CONST(gridconnect_buffer_delay_usec);
 
 /** Number of entries in the remote alias cache */
@@ -117,6 +117,13 @@ DECLARE_CONST(local_alias_cache_size);
 /** Maximum number of local nodes */
 DECLARE_CONST(local_nodes_count);
 
+/** How many alias reservations may be in their 200 msec waiting period at
+ * the same time. */
+DECLARE_CONST(alias_reservation_window);
+
+/** How many aliases the SimpleStack keeps reserved in advance. */
+DECLARE_CONST(reserved_alias_pool_size);
+
 /** Number of datagram registry entries. This is how many datagram handlers can
  * be registered (e.g. memory config protocol is one). */
 DECLARE_CONST(num_datagram_registry_entries);
@@ -125,6 +132,14 @@ DECLARE_CONST(num_datagram_registry_entries);
  * happen concurrently. */
 DECLARE_CONST(num_datagram_clients);
 
+/** Number of multi-frame datagrams that can be reassembled concurrently from
+ * the CAN bus. */
+DECLARE_CONST(can_datagram_reassembly_slots);
+
+/** A partially received multi-frame datagram is dropped if its last frame has
+ * not arrived this many milliseconds after the first frame. */
+DECLARE_CONST(can_datagram_reassembly_timeout_msec);
+
 /** Maximum number of memory spaces that can be registered for the MemoryConfig
  * datagram handler. */
 DECLARE_CONST(num_memory_spaces);
@@ -138,5 +153,20 @@ DECLARE_CONST(enable_all_memory_space);
  * standard. */
 DECLARE_CONST(node_init_identify);
 
+/** How many event handlers to call for an Identify Events message before
+ * letting other event messages through. */
+DECLARE_CONST(event_identify_batch_size);
+
+/** How many producer / consumer identified messages to send for an Identify
+ * Events message before waiting for them to leave the interface. Zero
+ * disables batching; the event handlers then send each message through their
+ * write helpers. */
+DECLARE_CONST(event_identify_write_window);
+
+/** Memory space number at which the SimpleStack exports the raw compressed
+ * CDI blob (if the CDI was compiled in compressed form), for configuration
+ * tools that can decompress it themselves. Zero disables this space. */
+DECLARE_CONST(compressed_cdi_space);
+
 
 #endif /* _nmranet_config_h_ */
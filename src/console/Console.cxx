@@ -137,6 +137,55 @@ Console::CommandStatus Console::quit_command(FILE *fp, int argc, const char *arg
     }
 }
 
+#if EXECUTOR_STATS
+/*
+ * Console::executor_stats_command()
+ */
+Console::CommandStatus Console::executor_stats_command(
+    FILE *fp, int argc, const char *argv[], void *context)
+{
+    ExecutorBase *e = static_cast<ExecutorBase *>(context);
+    if (argc == 0)
+    {
+        fprintf(fp, "print the executor queueing and run time counters;\n%s"
+                    "arguments: on | off | reset\n",
+            argv[1]);
+        return COMMAND_OK;
+    }
+    if (argc == 1)
+    {
+        if (!e->stats())
+        {
+            fprintf(fp, "executor instrumentation is off\n");
+            return COMMAND_OK;
+        }
+        e->stats()->print(fp);
+        return COMMAND_OK;
+    }
+    if (argc != 2)
+    {
+        return COMMAND_ERROR;
+    }
+    if (!strcmp(argv[1], "on"))
+    {
+        e->enable_stats(true);
+    }
+    else if (!strcmp(argv[1], "off"))
+    {
+        e->enable_stats(false);
+    }
+    else if (!strcmp(argv[1], "reset"))
+    {
+        e->reset_stats();
+    }
+    else
+    {
+        return COMMAND_ERROR;
+    }
+    return COMMAND_OK;
+}
+#endif
+
 /*
  * Console::CommandFlow::CommandFlow()
  */
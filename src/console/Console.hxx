@@ -130,6 +130,22 @@ public:
      */
     void add_command(const char *name, Callback callback, void *context = NULL);
 
+#if EXECUTOR_STATS
+    /** Command that prints or controls the instrumentation of an executor
+     * (see ExecutorBase::enable_stats()). Register it with
+     * add_command("executor", Console::executor_stats_command, executor).
+     * Without arguments it prints the counters; the arguments "on", "off"
+     * and "reset" control the collection.
+     * @param fp file pointer to console
+     * @param argc number of arguments including the command itself
+     * @param argv array of arguments starting with the command itself
+     * @param context the ExecutorBase to report on
+     * @return COMMAND_OK, or COMMAND_ERROR for unknown arguments
+     */
+    static CommandStatus executor_stats_command(
+        FILE *fp, int argc, const char *argv[], void *context);
+#endif
+
     /** Default STDIN file descriptor */
     static const int FD_STDIN = 0;
 
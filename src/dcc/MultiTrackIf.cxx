@@ -0,0 +1,552 @@
+/** \copyright
+ * Copyright (c) 2026, agent
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are  permitted provided that the following conditions are met:
+ *
+ *  - Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ *  - Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ * \file MultiTrackIf.cxx
+ *
+ * Command station packet scheduler driving several track outputs (booster
+ * districts, programming track), each with its own refresh loop.
+ *
+ * @author agent
+ * @date 19 Oct 2026
+ */
+
+#include "dcc/MultiTrackIf.hxx"
+
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+#include <algorithm>
+
+#include "dcc/Packet.hxx"
+#include "dcc/PacketSource.hxx"
+#include "utils/RingBuffer.hxx"
+
+namespace dcc
+{
+
+constexpr MultiTrackIf::OutputMask MultiTrackIf::ALL_OUTPUTS;
+
+/// State flow writing the packets of one track output. All members except the
+/// flow state are protected by the lock of the parent.
+class MultiTrackIf::Output : public StateFlowBase
+{
+public:
+    /// Constructor. Starts sending packets.
+    ///
+    /// @param parent owning object.
+    /// @param index output number.
+    /// @param fd device to write to.
+    /// @param min_cycle_msec minimum refresh cycle time.
+    /// @param preamble_bits preamble length on the track.
+    Output(MultiTrackIf *parent, unsigned index, int fd,
+        unsigned min_cycle_msec, unsigned preamble_bits)
+        : StateFlowBase(parent->service_)
+        , port_(parent, OutputMask(1) << index)
+        , queue_(RingBuffer<Packet>::create(parent->queueSize_))
+        , parent_(parent)
+        , index_(index)
+        , minCycle_(MSEC_TO_NSEC(min_cycle_msec))
+        , lastCycleStart_(0)
+        , fd_(fd)
+        , preambleBits_(preamble_bits)
+    {
+        memset(&stats_, 0, sizeof(stats_));
+        start_flow(STATE(fill_packet));
+    }
+
+    ~Output()
+    {
+        queue_->destroy();
+    }
+
+    /// Stops the flow. Must be called on the executor.
+    void shutdown()
+    {
+        shutdown_ = true;
+        auto *e = service()->executor();
+        if (!helper_.is_empty() && e->is_selected(&helper_))
+        {
+            e->unselect(&helper_);
+            // Makes the internal_try_write exit immediately.
+            helper_.remaining_ = 0;
+            notify();
+        }
+        timer_.ensure_triggered();
+    }
+
+    /// @return true if the flow has stopped after shutdown(). Must be called
+    /// on the executor.
+    bool is_stopped()
+    {
+        return stopped_;
+    }
+
+    /// Port for the output() call.
+    Port port_;
+    /// Foreground packets waiting to be sent.
+    RingBuffer<Packet> *queue_;
+    /// Number of entries in the parent's waiting_ list for this output.
+    unsigned waiting_{0};
+    /// Refresh sources of this output, polled in round-robin.
+    std::vector<PacketSource *> sources_;
+    /// Counters.
+    Stats stats_;
+
+private:
+    /// Where the current packet came from.
+    enum Kind
+    {
+        FOREGROUND,
+        REFRESH,
+        IDLE
+    };
+
+    /// Picks the next packet to send. @return next action.
+    Action fill_packet()
+    {
+        if (shutdown_)
+        {
+            return call_immediately(STATE(stop));
+        }
+        if (batchCount_ >= MAX_BATCH)
+        {
+            // Lets other flows run on the executor.
+            end_batch();
+            return yield_and_call(STATE(fill_packet));
+        }
+        next_packet();
+        return call_immediately(STATE(write_packet));
+    }
+
+    /// Tries to write the current packet without blocking. @return next
+    /// action.
+    Action write_packet()
+    {
+        int ret = ::write(fd_, &packet_, sizeof(packet_));
+        if (ret == (int)sizeof(packet_))
+        {
+            return call_immediately(STATE(packet_written));
+        }
+        if (ret < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+        {
+            ret = 0;
+        }
+        end_batch();
+        if (ret < 0)
+        {
+            return call_immediately(STATE(write_error));
+        }
+        // The device is full. Waits until it becomes writable again.
+        helper_.hasError_ = 0;
+        return write_repeated(&helper_, fd_,
+            reinterpret_cast<uint8_t *>(&packet_) + ret,
+            sizeof(packet_) - ret, STATE(async_written));
+    }
+
+    /// Called when the device became writable and took the packet. @return
+    /// next action.
+    Action async_written()
+    {
+        if (shutdown_)
+        {
+            return call_immediately(STATE(stop));
+        }
+        if (helper_.hasError_)
+        {
+            return call_immediately(STATE(write_error));
+        }
+        return call_immediately(STATE(packet_written));
+    }
+
+    /// Accounts for a packet sent to the device. @return next action.
+    Action packet_written()
+    {
+        unsigned usec = packet_usec(packet_, preambleBits_);
+        {
+            AtomicHolder h(parent_);
+            ++stats_.packets;
+            stats_.trackUsec += usec;
+            switch (kind_)
+            {
+                case FOREGROUND:
+                    ++stats_.foreground;
+                    stats_.foregroundUsec += usec;
+                    break;
+                case REFRESH:
+                    ++stats_.refresh;
+                    break;
+                case IDLE:
+                    ++stats_.idle;
+                    break;
+            }
+        }
+        ++batchCount_;
+        return call_immediately(STATE(fill_packet));
+    }
+
+    /// The device refused the packet. The packet is dropped. @return next
+    /// action.
+    Action write_error()
+    {
+        {
+            AtomicHolder h(parent_);
+            ++stats_.errors;
+        }
+        return sleep_and_call(&timer_, MSEC_TO_NSEC(10), STATE(fill_packet));
+    }
+
+    /// Terminal state after shutdown. @return next action.
+    Action stop()
+    {
+        stopped_ = true;
+        return set_terminated();
+    }
+
+    /// Closes the current batch of writes in the counters.
+    void end_batch()
+    {
+        if (batchCount_)
+        {
+            AtomicHolder h(parent_);
+            ++stats_.batches;
+        }
+        batchCount_ = 0;
+    }
+
+    /// Fills packet_ with the next packet: a foreground packet if there is
+    /// one, else the next refresh packet or an idle packet. The refresh source
+    /// is called with the lock held, so that after remove_refresh_source()
+    /// returns the source is not used anymore.
+    void next_packet()
+    {
+        std::vector<Buffer<Packet> *> done;
+        {
+            AtomicHolder h(parent_);
+            if (queue_->get(&packet_, 1))
+            {
+                kind_ = FOREGROUND;
+                if (waiting_)
+                {
+                    parent_->refill(index_, &done);
+                }
+            }
+            else
+            {
+                next_background_packet();
+            }
+        }
+        for (auto *b : done)
+        {
+            b->unref();
+        }
+    }
+
+    /// Fills packet_ with the next refresh packet or an idle packet. Called
+    /// with the lock held.
+    void next_background_packet()
+    {
+        PacketSource *source = nullptr;
+        if (nextRefresh_ >= sources_.size())
+        {
+            nextRefresh_ = 0;
+        }
+        if (nextRefresh_ > 0)
+        {
+            source = sources_[nextRefresh_++];
+        }
+        else if (!sources_.empty())
+        {
+            // A new refresh cycle may only start if the previous one took at
+            // least minCycle_.
+            long long now = os_get_time_monotonic();
+            if (now - lastCycleStart_ >= minCycle_)
+            {
+                lastCycleStart_ = now;
+                source = sources_[nextRefresh_++];
+            }
+        }
+        packet_ = Packet();
+        if (source)
+        {
+            kind_ = REFRESH;
+            source->get_next_packet(0, &packet_);
+        }
+        else
+        {
+            kind_ = IDLE;
+            packet_.set_dcc_idle();
+        }
+    }
+
+    /// Owning object.
+    MultiTrackIf *parent_;
+    /// Output number.
+    unsigned index_;
+    /// Packet being sent.
+    Packet packet_;
+    /// Minimum time of a refresh cycle in nsec.
+    long long minCycle_;
+    /// When the current refresh cycle started.
+    long long lastCycleStart_;
+    /// Index in sources_ to refresh next.
+    size_t nextRefresh_{0};
+    /// Device to write to.
+    int fd_;
+    /// Preamble length for the bandwidth accounting.
+    unsigned preambleBits_;
+    /// Number of packets written in the current executor run.
+    unsigned batchCount_{0};
+    /// Where packet_ came from.
+    Kind kind_{IDLE};
+    /// Set by shutdown().
+    bool shutdown_{false};
+    /// Set when the flow is terminated.
+    bool stopped_{false};
+    /// Helper for waiting for the device to become writable.
+    StateFlowSelectHelper helper_{this};
+    /// Helper for sleeping after an error.
+    StateFlowTimer timer_{this};
+};
+
+MultiTrackIf::MultiTrackIf(Service *service, unsigned queue_size)
+    : service_(service)
+    , queueSize_(queue_size)
+{
+}
+
+MultiTrackIf::~MultiTrackIf()
+{
+    ExecutorBase *e = service_->executor();
+    e->sync_run([this]()
+    {
+        for (Output *o : outputs_)
+        {
+            o->shutdown();
+        }
+    });
+    bool completed = false;
+    while (!completed)
+    {
+        e->sync_run([this, &completed]()
+        {
+            completed = true;
+            for (Output *o : outputs_)
+            {
+                completed = completed && o->is_stopped();
+            }
+        });
+    }
+    for (Output *o : outputs_)
+    {
+        delete o;
+    }
+    for (Waiting &w : waiting_)
+    {
+        if (w.buffer)
+        {
+            w.buffer->unref();
+        }
+    }
+}
+
+unsigned MultiTrackIf::add_output(
+    int fd, unsigned min_cycle_msec, unsigned preamble_bits)
+{
+    AtomicHolder h(this);
+    unsigned index = outputs_.size();
+    HASSERT(index < MAX_OUTPUTS);
+    outputs_.push_back(
+        new Output(this, index, fd, min_cycle_msec, preamble_bits));
+    return index;
+}
+
+bool MultiTrackIf::send(const Packet &pkt, OutputMask outputs)
+{
+    return enqueue(pkt, nullptr, outputs) == 0;
+}
+
+MultiTrackIf::OutputMask MultiTrackIf::enqueue(
+    const Packet &pkt, Buffer<Packet> *b, OutputMask outputs)
+{
+    OutputMask waiting = 0;
+    {
+        AtomicHolder h(this);
+        for (unsigned i = 0; i < outputs_.size(); ++i)
+        {
+            if (!(outputs & (OutputMask(1) << i)))
+            {
+                continue;
+            }
+            Output *o = outputs_[i];
+            // Packets already waiting for this output go first.
+            if (o->waiting_ || !o->queue_->put(&pkt, 1))
+            {
+                waiting |= OutputMask(1) << i;
+                ++o->waiting_;
+                ++o->stats_.waited;
+            }
+        }
+        if (waiting)
+        {
+            waiting_.push_back({b, b ? Packet() : pkt, waiting});
+        }
+    }
+    if (b && !waiting)
+    {
+        b->unref();
+    }
+    return waiting;
+}
+
+void MultiTrackIf::refill(unsigned index, std::vector<Buffer<Packet> *> *done)
+{
+    Output *o = outputs_[index];
+    OutputMask bit = OutputMask(1) << index;
+    for (auto it = waiting_.begin(); it != waiting_.end() && o->waiting_;)
+    {
+        if (!(it->outputs & bit))
+        {
+            ++it;
+            continue;
+        }
+        const Packet &pkt = it->buffer ? *it->buffer->data() : it->packet;
+        if (!o->queue_->put(&pkt, 1))
+        {
+            break;
+        }
+        --o->waiting_;
+        it->outputs &= ~bit;
+        if (it->outputs)
+        {
+            ++it;
+            continue;
+        }
+        if (it->buffer)
+        {
+            done->push_back(it->buffer);
+        }
+        it = waiting_.erase(it);
+    }
+}
+
+PacketFlowInterface *MultiTrackIf::output(unsigned index)
+{
+    AtomicHolder h(this);
+    HASSERT(index < outputs_.size());
+    return &outputs_[index]->port_;
+}
+
+void MultiTrackIf::add_refresh_source(PacketSource *source, OutputMask outputs)
+{
+    AtomicHolder h(this);
+    for (unsigned i = 0; i < outputs_.size(); ++i)
+    {
+        if (!(outputs & (OutputMask(1) << i)))
+        {
+            continue;
+        }
+        auto &sources = outputs_[i]->sources_;
+        if (std::find(sources.begin(), sources.end(), source) == sources.end())
+        {
+            sources.push_back(source);
+        }
+    }
+}
+
+void MultiTrackIf::remove_refresh_source(PacketSource *source)
+{
+    AtomicHolder h(this);
+    for (Output *o : outputs_)
+    {
+        o->sources_.erase(
+            std::remove(o->sources_.begin(), o->sources_.end(), source),
+            o->sources_.end());
+    }
+}
+
+void MultiTrackIf::notify_update(PacketSource *source, unsigned code)
+{
+    OutputMask outputs = 0;
+    {
+        AtomicHolder h(this);
+        for (unsigned i = 0; i < outputs_.size(); ++i)
+        {
+            auto &sources = outputs_[i]->sources_;
+            if (std::find(sources.begin(), sources.end(), source) !=
+                sources.end())
+            {
+                outputs |= OutputMask(1) << i;
+            }
+        }
+    }
+    if (!outputs)
+    {
+        return;
+    }
+    Packet pkt;
+    source->get_next_packet(code, &pkt);
+    send(pkt, outputs);
+}
+
+MultiTrackIf::Stats MultiTrackIf::get_stats(unsigned index)
+{
+    AtomicHolder h(this);
+    HASSERT(index < outputs_.size());
+    return outputs_[index]->stats_;
+}
+
+unsigned MultiTrackIf::packet_usec(const Packet &pkt, unsigned preamble_bits)
+{
+    if (pkt.command_header.is_pkt)
+    {
+        // Meta command for the driver, does not go to the track.
+        return 0;
+    }
+    unsigned usec;
+    if (pkt.packet_header.is_marklin)
+    {
+        // The driver sends every MM packet twice. Each copy has 18 bits, the
+        // first is preceded by 7 and the second by 6 bit times of pause.
+        usec = (7 + 18 + 6 + 18) * MM_BIT_USEC;
+    }
+    else
+    {
+        unsigned ones = 0;
+        for (unsigned i = 0; i < pkt.dlc; ++i)
+        {
+            ones += __builtin_popcount(pkt.payload[i]);
+        }
+        unsigned zeros = 8 * pkt.dlc - ones;
+        // Preamble, end of packet bit and two bits of leadout.
+        ones += preamble_bits + 3;
+        // Packet start bit and the byte separators.
+        zeros += pkt.dlc;
+        usec = ones * DCC_ONE_USEC + zeros * DCC_ZERO_USEC;
+    }
+    return usec * (1 + pkt.packet_header.rept_count);
+}
+
+} // namespace dcc
@@ -0,0 +1,297 @@
+/** \copyright
+ * Copyright (c) 2026, agent
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are  permitted provided that the following conditions are met:
+ *
+ *  - Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ *  - Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ * \file MultiTrackIf.hxx
+ *
+ * Command station packet scheduler driving several track outputs (booster
+ * districts, programming track), each with its own refresh loop.
+ *
+ * @author agent
+ * @date 19 Oct 2026
+ */
+
+#ifndef _DCC_MULTITRACKIF_HXX_
+#define _DCC_MULTITRACKIF_HXX_
+
+#include <stdint.h>
+#include <deque>
+#include <vector>
+
+#include "dcc/PacketFlowInterface.hxx"
+#include "dcc/UpdateLoop.hxx"
+#include "executor/StateFlow.hxx"
+#include "os/OS.hxx"
+
+namespace dcc
+{
+
+class PacketSource;
+
+/// Packet scheduler for a command station with more than one track output.
+///
+/// Every output is a device fd (such as /dev/mainline or /dev/progtrack)
+/// supporting the select() model, and has
+///
+/// - its own queue of foreground packets. Packets may be sent to one output
+///   (output()), to all outputs (broadcast()) or to any set of outputs
+///   (send()). Foreground packets take precedence over refresh. Foreground
+///   packets are never dropped: when the queue of an output is full, they
+///   wait in order until it has room. Buffers sent to output() or broadcast()
+///   are held (not released) while they wait, which throttles the producer.
+///
+/// - its own refresh loop with a round-robin list of packet sources and a
+///   minimum cycle time. When there is nothing else to send, the output sends
+///   idle packets.
+///
+/// - its own write flow. As long as the device accepts packets, the flow
+///   writes them back to back in one executor run (up to MAX_BATCH). A slow
+///   output (e.g. the programming track) does not hold back the others.
+///
+/// - bandwidth accounting: how many packets of each kind were written and how
+///   much track time they take.
+///
+/// This object is also the UpdateLoopBase of the command station, thus the
+/// locomotives in dcc/Loco.hxx register themselves into the refresh loop of
+/// the default outputs. Update notifications (e.g. speed changes) are sent
+/// right away as a foreground packet to every output refreshing that
+/// locomotive.
+class MultiTrackIf : private UpdateLoopBase, private Atomic
+{
+public:
+    /// Bit mask of output indexes.
+    typedef uint32_t OutputMask;
+
+    enum
+    {
+        /// How many outputs can be added.
+        MAX_OUTPUTS = 32,
+        /// Maximum number of packets an output writes in one executor run.
+        MAX_BATCH = 8,
+        /// Default number of preamble bits on the track.
+        DEFAULT_PREAMBLE_BITS = 14,
+        /// Length of a DCC one bit in usec.
+        DCC_ONE_USEC = 116,
+        /// Length of a DCC zero bit in usec.
+        DCC_ZERO_USEC = 200,
+        /// Length of a Marklin-Motorola bit in usec.
+        MM_BIT_USEC = 208,
+    };
+
+    /// Mask selecting all outputs.
+    static constexpr OutputMask ALL_OUTPUTS = 0xFFFFFFFFu;
+
+    /// Counters of one output.
+    struct Stats
+    {
+        /// Total number of packets written to the device.
+        unsigned packets;
+        /// Packets that came from send(), output() or broadcast().
+        unsigned foreground;
+        /// Packets that came from the refresh sources.
+        unsigned refresh;
+        /// Idle packets (nothing else to send, or the refresh cycle was too
+        /// short).
+        unsigned idle;
+        /// Foreground packets that had to wait for room in the output queue.
+        unsigned waited;
+        /// Number of executor runs that wrote packets; packets / batches is
+        /// the average batch size.
+        unsigned batches;
+        /// Number of failed writes to the device.
+        unsigned errors;
+        /// Estimated time on the track of all packets written, in usec.
+        uint64_t trackUsec;
+        /// Estimated track time of the foreground packets, in usec.
+        uint64_t foregroundUsec;
+    };
+
+    /// Constructor.
+    ///
+    /// @param service defines the executor for the output flows. Writes to
+    /// the devices never block.
+    /// @param queue_size how many foreground packets each output can queue.
+    MultiTrackIf(Service *service, unsigned queue_size = 8);
+
+    /// Destructor. Stops all outputs. The fds are not closed.
+    ~MultiTrackIf();
+
+    /// Adds a new track output and starts sending packets to it.
+    ///
+    /// @param fd is the track device, opened in non-blocking mode.
+    /// @param min_cycle_msec the minimum time between two refresh packets to
+    /// the same source on this output. Idle packets are inserted when the
+    /// refresh cycle would be shorter.
+    /// @param preamble_bits length of the preamble this output generates;
+    /// only used for the bandwidth accounting.
+    /// @return the index of the new output, to be used in OutputMask.
+    unsigned add_output(int fd, unsigned min_cycle_msec = 5,
+        unsigned preamble_bits = DEFAULT_PREAMBLE_BITS);
+
+    /// @return the number of outputs added.
+    unsigned num_outputs()
+    {
+        AtomicHolder h(this);
+        return outputs_.size();
+    }
+
+    /// Queues a foreground packet to a set of outputs. Copies the packet.
+    ///
+    /// @param pkt the packet to send.
+    /// @param outputs which outputs to send it to.
+    /// @return false if the queue of any of the selected outputs was full;
+    /// the packet then waits for room on that output. Callers that can wait
+    /// should use output() or broadcast() instead.
+    bool send(const Packet &pkt, OutputMask outputs);
+
+    /// @param index is the output index.
+    /// @return a flow interface that sends packets to one output.
+    PacketFlowInterface *output(unsigned index);
+
+    /// @return a flow interface that sends packets to every output.
+    PacketFlowInterface *broadcast()
+    {
+        return &broadcastPort_;
+    }
+
+    /// Sets which outputs the refresh sources registering through the
+    /// UpdateLoopBase interface (packet_processor_add_refresh_source) will be
+    /// added to. Default is all outputs. @param outputs is the output mask.
+    void set_default_outputs(OutputMask outputs)
+    {
+        AtomicHolder h(this);
+        defaultOutputs_ = outputs;
+    }
+
+    /// Adds a refresh source to the refresh loop of a set of outputs.
+    /// @param source is the packet source. @param outputs is the output mask.
+    void add_refresh_source(PacketSource *source, OutputMask outputs);
+
+    /// Adds a refresh source to the default outputs. @param source is the
+    /// packet source.
+    void add_refresh_source(PacketSource *source) OVERRIDE
+    {
+        add_refresh_source(source, defaultOutputs_);
+    }
+
+    /// Removes a refresh source from all outputs. @param source is the
+    /// packet source.
+    void remove_refresh_source(PacketSource *source) OVERRIDE;
+
+    /// Sends the update packet of a source to all outputs refreshing it.
+    /// @param source is the packet source. @param code tells the source which
+    /// packet to generate.
+    void notify_update(PacketSource *source, unsigned code) OVERRIDE;
+
+    /// @param index is the output index.
+    /// @return a copy of the counters of that output.
+    Stats get_stats(unsigned index);
+
+    /// Estimates how long a packet takes on the track.
+    ///
+    /// @param pkt is the packet.
+    /// @param preamble_bits is the DCC preamble length.
+    /// @return the track time in usec, including repeats and the end of
+    /// packet bits.
+    static unsigned packet_usec(const Packet &pkt, unsigned preamble_bits);
+
+private:
+    class Output;
+
+    /// Flow interface sending packets to a fixed set of outputs.
+    class Port : public PacketFlowInterface
+    {
+    public:
+        /// Constructor. @param parent owning object. @param outputs is the
+        /// output mask.
+        Port(MultiTrackIf *parent, OutputMask outputs)
+            : parent_(parent)
+            , outputs_(outputs)
+        {
+        }
+
+        /// Copies the packet to the outputs and releases the buffer. If an
+        /// output queue is full, the buffer is released only once every
+        /// output took the packet.
+        /// @param b is the packet. @param priority is ignored.
+        void send(Buffer<Packet> *b, unsigned priority = UINT_MAX) OVERRIDE
+        {
+            parent_->enqueue(*b->data(), b, outputs_);
+        }
+
+    private:
+        /// Owning object.
+        MultiTrackIf *parent_;
+        /// Where to send the packets.
+        OutputMask outputs_;
+    };
+
+    /// A foreground packet waiting for room in the queue of some outputs.
+    struct Waiting
+    {
+        /// Buffer holding the packet, released once all outputs took it.
+        /// nullptr if the packet was given to send().
+        Buffer<Packet> *buffer;
+        /// Copy of the packet, if buffer is nullptr.
+        Packet packet;
+        /// Outputs that have not taken the packet yet.
+        OutputMask outputs;
+    };
+
+    /// Puts a packet into the queues of a set of outputs, or into waiting_
+    /// for the outputs whose queue is full.
+    /// @param pkt the packet to send.
+    /// @param b the buffer holding pkt, released when every output took the
+    /// packet; or nullptr to copy pkt if it has to wait.
+    /// @param outputs which outputs to send it to.
+    /// @return the outputs where the packet has to wait.
+    OutputMask enqueue(const Packet &pkt, Buffer<Packet> *b, OutputMask outputs);
+
+    /// Moves waiting packets into the queue of an output that has room.
+    /// Called with the lock held.
+    /// @param index is the output.
+    /// @param done the buffers that every output took are appended here, to
+    /// be released after the lock is released.
+    void refill(unsigned index, std::vector<Buffer<Packet> *> *done);
+
+    /// Executor of the output flows.
+    Service *service_;
+    /// Queue length of each output.
+    unsigned queueSize_;
+    /// Where add_refresh_source(source) puts the sources.
+    OutputMask defaultOutputs_{ALL_OUTPUTS};
+    /// All outputs, indexed by the output number. Owned.
+    std::vector<Output *> outputs_;
+    /// Port for broadcast().
+    Port broadcastPort_{this, ALL_OUTPUTS};
+    /// Foreground packets waiting for room in an output queue, oldest first.
+    std::deque<Waiting> waiting_;
+
+    DISALLOW_COPY_AND_ASSIGN(MultiTrackIf);
+};
+
+} // namespace dcc
+
+#endif // _DCC_MULTITRACKIF_HXX_
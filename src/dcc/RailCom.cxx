@@ -34,6 +34,8 @@
 
 #include <string.h>
 
+#include <algorithm>
+
 #include "dcc/RailCom.hxx"
 
 namespace dcc {
@@ -79,6 +81,71 @@ const uint8_t railcom_decode[256] =
        INV,    INV,    INV,    INV,    INV,    INV,    INV,    INV,
 };
 
+/// Writes packets into a caller-supplied array. Has the same emplace_back
+/// call as std::vector, so that the parser can write into either.
+class RailcomArenaOutput
+{
+public:
+    /// @param output is the array to write to. @param capacity is the number
+    /// of entries in output.
+    RailcomArenaOutput(RailcomPacket *output, size_t capacity)
+        : output_(output)
+        , capacity_(capacity)
+    {
+    }
+
+    /// Appends a packet; counts but drops it if the array is full.
+    void emplace_back(uint8_t hw_channel, uint8_t railcom_channel,
+        uint8_t type, uint32_t argument)
+    {
+        if (size_ < capacity_)
+        {
+            RailcomPacket *p = output_ + size_;
+            p->hw_channel = hw_channel;
+            p->railcom_channel = railcom_channel;
+            p->type = type;
+            p->argument = argument;
+        }
+        ++size_;
+    }
+
+    /// @return the number of packets appended so far (including dropped).
+    size_t size()
+    {
+        return size_;
+    }
+
+private:
+    /// Output array.
+    RailcomPacket *output_;
+    /// Number of entries in output_.
+    size_t capacity_;
+    /// Number of packets appended so far.
+    size_t size_{0};
+};
+
+/// Decodes railcom bytes through the 4-of-8 table.
+///
+/// @param ptr is the raw data from the UART.
+/// @param size is the number of bytes in ptr (at most 8).
+/// @param decoded will be filled with the decoded 6-bit values (or the
+/// special values in RailcomDefs); the bytes after size are zeroed.
+/// @return true if every byte is a valid 6-bit data value, i.e. there is no
+/// ACK, NACK, BUSY or invalid code among them.
+static inline bool decode_bytes(
+    const uint8_t *ptr, unsigned size, uint8_t decoded[8])
+{
+    uint64_t w = 0;
+    for (unsigned i = 0; i < size; ++i)
+    {
+        w |= uint64_t(railcom_decode[ptr[i]]) << (i * 8);
+    }
+    memcpy(decoded, &w, 8);
+    // Every special value has one of the top two bits set, so the whole
+    // buffer is validated in one test.
+    return (w & UINT64_C(0xC0C0C0C0C0C0C0C0)) == 0;
+}
+
 /// Helper function to parse a part of a railcom packet.
 ///
 /// @param fb_channel Which hardware channel did the railcom message arrive
@@ -86,49 +153,52 @@ const uint8_t railcom_decode[256] =
 /// for a multi-channel railcom decoder it's as many as the number of ports.
 /// @param railcom_channel 1 or 2 depending on which part of the cutout window
 /// the data is from.
-/// @param ptr raw railcom data read from the UART.
+/// @param decoded railcom data read from the UART, already decoded by
+/// decode_bytes().
 /// @param size how many bytes were read from the UART
+/// @param all_data the return value of decode_bytes().
 /// @param output where to put the decoded packets (or GARBAGE packets if
 /// decoding fails).
 ///
-void parse_internal(uint8_t fb_channel, uint8_t railcom_channel,
-    const uint8_t *ptr, unsigned size,
-    std::vector<struct RailcomPacket> *output)
+template <class Output>
+static void parse_internal(uint8_t fb_channel, uint8_t railcom_channel,
+    const uint8_t *decoded, unsigned size, bool all_data, Output *output)
 {
-    if (!size)
-        return;
     for (unsigned ofs = 0; ofs < size; ++ofs)
     {
-        uint8_t decoded = railcom_decode[ptr[ofs]];
         uint8_t type = 0xff;
         uint32_t arg = 0;
-        if (decoded == RailcomDefs::ACK)
-        {
-            type = RailcomPacket::ACK;
-        }
-        else if (decoded == RailcomDefs::NACK)
-        {
-            type = RailcomPacket::NACK;
-        }
-        else if (decoded == RailcomDefs::BUSY)
-        {
-            type = RailcomPacket::BUSY;
-        }
-        else if (decoded >= 64)
-        {
-            output->emplace_back(
-                fb_channel, railcom_channel, RailcomPacket::GARBAGE, 0);
-            break;
-        }
-        if (type != 0xff)
+        if (!all_data)
         {
-            output->emplace_back(fb_channel, railcom_channel, type, 0);
-            continue;
+            uint8_t d = decoded[ofs];
+            if (d == RailcomDefs::ACK)
+            {
+                type = RailcomPacket::ACK;
+            }
+            else if (d == RailcomDefs::NACK)
+            {
+                type = RailcomPacket::NACK;
+            }
+            else if (d == RailcomDefs::BUSY)
+            {
+                type = RailcomPacket::BUSY;
+            }
+            else if (d >= 64)
+            {
+                output->emplace_back(
+                    fb_channel, railcom_channel, RailcomPacket::GARBAGE, 0);
+                break;
+            }
+            if (type != 0xff)
+            {
+                output->emplace_back(fb_channel, railcom_channel, type, 0);
+                continue;
+            }
         }
         // Now: we have a packet.
-        uint8_t packet_id = decoded >> 2;
+        uint8_t packet_id = decoded[ofs] >> 2;
         uint8_t len = 2;
-        arg = decoded & 3;
+        arg = decoded[ofs] & 3;
         switch (packet_id)
         {
             case RMOB_ADRHIGH:
@@ -150,7 +220,7 @@ void parse_internal(uint8_t fb_channel, uint8_t railcom_channel,
                     // packet) with four NACK bytes, presumably to report that
                     // it is not actually giving back a 32-bit response but
                     // only an 8-bit response.
-                    && railcom_decode[ptr[2]] < 64)
+                    && decoded[2] < 64)
                 {
                     len = 6;
                 }
@@ -178,23 +248,27 @@ void parse_internal(uint8_t fb_channel, uint8_t railcom_channel,
         for (int i = 1; i < len; ++i, ++ofs)
         {
             arg <<= 6;
-            uint8_t decoded = railcom_decode[ptr[ofs + 1]];
-            if (decoded >= 64)
+            uint8_t d = decoded[ofs + 1];
+            if (d >= 64)
             {
                 type = RailcomPacket::GARBAGE;
             }
-            arg |= decoded;
+            arg |= d;
         }
         output->emplace_back(fb_channel, railcom_channel, type, arg);
     }
 }
 
-void parse_railcom_data(
-    const dcc::Feedback &fb, std::vector<struct RailcomPacket> *output)
+/// Interprets the data from a railcom feedback.
+/// @param fb is the feedback. @param output is where to append the packets.
+template <class Output>
+static void parse_feedback(const dcc::Feedback &fb, Output *output)
 {
-    output->clear();
     if (fb.channel == 0xff)
         return; // Occupancy feedback information
+    if (!fb.ch1Size && !fb.ch2Size)
+        return; // No decoder answered.
+    uint8_t data[8];
     if (fb.ch1Size == 1 && (railcom_decode[fb.ch1Data[0]] != RailcomDefs::INV) && fb.ch2Size >= 1)
     {
         // Railcom channel 1 should have 0 or 2 bytes according to the standard.
@@ -202,28 +276,50 @@ void parse_railcom_data(
         // There is probably a mistake in the placement of the second window
         // (i.e., a timing problem in the decoder). Let's concatenate the two
         // channels and parse them together.
-        uint8_t data[8];
-        memcpy(data, fb.ch1Data, fb.ch1Size);
-        memcpy(data + fb.ch1Size, fb.ch2Data, fb.ch2Size);
-        parse_internal(fb.channel, 2, data, fb.ch1Size + fb.ch2Size, output);
+        uint8_t raw[8];
+        memcpy(raw, fb.ch1Data, fb.ch1Size);
+        memcpy(raw + fb.ch1Size, fb.ch2Data, fb.ch2Size);
+        unsigned size = fb.ch1Size + fb.ch2Size;
+        bool all_data = decode_bytes(raw, size, data);
+        parse_internal(fb.channel, 2, data, size, all_data, output);
         return;
     }
-    for (bool ch1 : {true, false})
+    if (fb.ch1Size)
     {
-        uint8_t size;
-        const uint8_t *ptr;
-        if (ch1)
-        {
-            size = fb.ch1Size;
-            ptr = fb.ch1Data;
-        }
-        else
+        bool all_data = decode_bytes(fb.ch1Data, fb.ch1Size, data);
+        parse_internal(fb.channel, 1, data, fb.ch1Size, all_data, output);
+    }
+    if (fb.ch2Size)
+    {
+        bool all_data = decode_bytes(fb.ch2Data, fb.ch2Size, data);
+        parse_internal(fb.channel, 2, data, fb.ch2Size, all_data, output);
+    }
+}
+
+void parse_railcom_data(
+    const dcc::Feedback &fb, std::vector<struct RailcomPacket> *output)
+{
+    output->clear();
+    parse_feedback(fb, output);
+}
+
+size_t parse_railcom_batch(const dcc::Feedback *fb, unsigned count,
+    RailcomPacket *output, size_t capacity, unsigned *first)
+{
+    RailcomArenaOutput arena(output, capacity);
+    for (unsigned i = 0; i < count; ++i)
+    {
+        if (first)
         {
-            size = fb.ch2Size;
-            ptr = fb.ch2Data;
+            first[i] = std::min(arena.size(), capacity);
         }
-        parse_internal(fb.channel, ch1 ? 1 : 2, ptr, size, output);
+        parse_feedback(fb[i], &arena);
+    }
+    if (first)
+    {
+        first[count] = std::min(arena.size(), capacity);
     }
+    return arena.size();
 }
 
 }  // namespace dcc
@@ -144,6 +144,11 @@ struct RailcomPacket
     uint8_t type;
     /// payload of the railcom packet, justified to LSB.
     uint32_t argument;
+    /// Default constructor, for preallocated arrays of packets (see
+    /// parse_railcom_batch()).
+    RailcomPacket()
+    {
+    }
     /// Constructor.
     ///
     /// @param _hw_channel which detector supplied this data
@@ -166,6 +171,23 @@ struct RailcomPacket
 void parse_railcom_data(
     const dcc::Feedback &fb, std::vector<struct RailcomPacket> *output);
 
+/** Interprets the railcom data of many feedbacks at once, for example the
+ * cutout of every channel of a multi-channel detector. Gives the same packets
+ * as calling parse_railcom_data() for each feedback in turn, but writes them
+ * into a preallocated array, so that no memory is allocated.
+ *
+ * @param fb is the array of feedbacks.
+ * @param count is the number of entries in fb.
+ * @param output is the array to write the packets to.
+ * @param capacity is the number of entries in output. Packets that do not
+ * fit are dropped.
+ * @param first if not null, an array of count + 1 entries. Will be filled so
+ * that the packets of fb[i] are output[first[i]] .. output[first[i+1] - 1].
+ * @return the number of packets decoded. If this is more than capacity, the
+ * output was truncated. */
+size_t parse_railcom_batch(const dcc::Feedback *fb, unsigned count,
+    RailcomPacket *output, size_t capacity, unsigned *first);
+
 }  // namespace dcc
 
 #endif // _DCC_RAILCOM_HXX_
@@ -36,8 +36,11 @@
 #define _DCC_RECEIVER_HXX_
 
 #include <fcntl.h>
+#include <stdint.h>
 #include <unistd.h>
 
+#include <algorithm>
+
 #include "executor/StateFlow.hxx"
 
 namespace dcc
@@ -45,16 +48,35 @@ namespace dcc
 
 /// State machine for decoding a DCC packet flow. Supports both DCC and
 /// Marklin-Motorola packets.
+///
+/// The state machine is table driven. At construction the half-wave lengths
+/// are split into timing classes, i.e. ranges of lengths in which the same
+/// timings match, and the next state and bit action is precomputed for every
+/// state and timing class. Decoding an edge is then a bucket lookup and a
+/// compare to find the class, one table lookup and the bit action.
 class DccDecoder
 {
 public:
+#ifdef configCPU_CLOCK_HZ
+    /// Constructor for measuring the edges in CPU clock cycles.
     DccDecoder()
+        : DccDecoder(configCPU_CLOCK_HZ)
+    {
+    }
+#endif
+
+    /// Constructor.
+    /// @param clock_hz is the frequency of the clock in which the lengths of
+    /// the half-waves are measured.
+    explicit DccDecoder(uint32_t clock_hz)
     {
-        timings_[DCC_ONE].set(52, 64);
-        timings_[DCC_ZERO].set(95, 9900);
-        timings_[MM_PREAMBLE].set(1000, -1);
-        timings_[MM_SHORT].set(20, 32);
-        timings_[MM_LONG].set(200, 216);
+        Timing timings[MAX_TIMINGS];
+        timings[DCC_ONE].set(clock_hz, 52, 64);
+        timings[DCC_ZERO].set(clock_hz, 95, 9900);
+        timings[MM_PREAMBLE].set(clock_hz, 1000, -1);
+        timings[MM_SHORT].set(clock_hz, 20, 32);
+        timings[MM_LONG].set(clock_hz, 200, 216);
+        build_table(timings);
     }
 
     /// Internal states of the decoding state machine.
@@ -73,6 +95,7 @@ public:
         MM_ZERO,
         MM_ONE,
         MM_PACKET_FINISHED,
+        NUM_STATES
     };
 
     /// @return the current decoding state.
@@ -86,192 +109,30 @@ public:
     /// change.
     void process_data(uint32_t value)
     {
-        switch (parseState_)
+        parseState_ = step(parseState_, value);
+    }
+
+    /// Decodes a sequence of edges, e.g. a recorded trace. Stops after the
+    /// edge that finishes a packet, so that the caller can fetch the packet
+    /// with packet_data() before continuing with the rest of the values.
+    /// @param values is the length of each half-wave in clock cycles.
+    /// @param count is the number of entries in values.
+    /// @return the number of values consumed.
+    size_t process_data(const uint32_t *values, size_t count)
+    {
+        // The state stays in a register between the edges.
+        State state = parseState_;
+        size_t i = 0;
+        while (i < count)
         {
-            case DCC_PACKET_FINISHED:
-            case MM_PACKET_FINISHED:
-            case UNKNOWN:
-            {
-                if (timings_[DCC_ONE].match(value))
-                {
-                    parseCount_ = 0;
-                    parseState_ = DCC_PREAMBLE;
-                    return;
-                }
-                if (timings_[MM_PREAMBLE].match(value))
-                {
-                    parseCount_ = 1 << 2;
-                    ofs_ = 0;
-                    data_[ofs_] = 0;
-                    parseState_ = MM_DATA;
-                }
-                break;
-            }
-            case DCC_PREAMBLE:
-            {
-                if (timings_[DCC_ONE].match(value))
-                {
-                    parseCount_++;
-                    return;
-                }
-                if (timings_[DCC_ZERO].match(value) && (parseCount_ >= 16))
-                {
-                    parseState_ = DCC_END_OF_PREAMBLE;
-                    return;
-                }
-                break;
-            }
-            case DCC_END_OF_PREAMBLE:
-            {
-                if (timings_[DCC_ZERO].match(value))
-                {
-                    parseState_ = DCC_DATA;
-                    parseCount_ = 1 << 7;
-                    ofs_ = 0;
-                    data_[ofs_] = 0;
-                    return;
-                }
-                break;
-            }
-            case DCC_DATA:
+            state = step(state, values[i++]);
+            if (state == DCC_PACKET_FINISHED || state == MM_PACKET_FINISHED)
             {
-                if (timings_[DCC_ONE].match(value))
-                {
-                    parseState_ = DCC_DATA_ONE;
-                    return;
-                }
-                if (timings_[DCC_ZERO].match(value))
-                {
-                    parseState_ = DCC_DATA_ZERO;
-                    return;
-                }
-                break;
-            }
-            case DCC_DATA_ONE:
-            {
-                if (timings_[DCC_ONE].match(value))
-                {
-                    if (parseCount_)
-                    {
-                        data_[ofs_] |= parseCount_;
-                        parseCount_ >>= 1;
-                        parseState_ = DCC_DATA;
-                        return;
-                    }
-                    else
-                    {
-                        // end of packet 1 bit.
-                        parseState_ = DCC_MAYBE_CUTOUT;
-                        return;
-                    }
-                    return;
-                }
-                break;
-            }
-            case DCC_DATA_ZERO:
-            {
-                if (timings_[DCC_ZERO].match(value))
-                {
-                    if (parseCount_)
-                    {
-                        // zero bit into data_.
-                        parseCount_ >>= 1;
-                    }
-                    else
-                    {
-                        // end of byte zero bit. Packet is not finished yet.
-                        ofs_++;
-                        HASSERT(ofs_ < sizeof(data_));
-                        data_[ofs_] = 0;
-                        parseCount_ = 1 << 7;
-                    }
-                    parseState_ = DCC_DATA;
-                    return;
-                }
-                break;
-            }
-            case DCC_MAYBE_CUTOUT:
-            {
-                if (value < timings_[DCC_ZERO].min_value)
-                {
-                    parseState_ = DCC_CUTOUT;
-                    return;
-                }
-                parseState_ = DCC_PACKET_FINISHED;
-                return;
-            }
-            case DCC_CUTOUT:
-            {
-                parseState_ = DCC_PACKET_FINISHED;
-                return;
-            }
-            case MM_DATA:
-            {
-                if (timings_[MM_LONG].match(value))
-                {
-                    parseState_ = MM_ZERO;
-                    return;
-                }
-                if (timings_[MM_SHORT].match(value))
-                {
-                    parseState_ = MM_ONE;
-                    return;
-                }
-                break;
-            }
-            case MM_ZERO:
-            {
-                if (timings_[MM_SHORT].match(value))
-                {
-                    // data_[ofs_] |= 0;
-                    parseCount_ >>= 1;
-                    if (!parseCount_)
-                    {
-                        if (ofs_ == 2)
-                        {
-                            parseState_ = MM_PACKET_FINISHED;
-                            return;
-                        }
-                        else
-                        {
-                            ofs_++;
-                            parseCount_ = 1 << 7;
-                            data_[ofs_] = 0;
-                        }
-                    }
-                    parseState_ = MM_DATA;
-                    return;
-                }
-                break;
-            }
-            case MM_ONE:
-            {
-                if (timings_[MM_LONG].match(value))
-                {
-                    data_[ofs_] |= parseCount_;
-                    parseCount_ >>= 1;
-                    if (!parseCount_)
-                    {
-                        if (ofs_ == 2)
-                        {
-                            parseState_ = MM_PACKET_FINISHED;
-                            return;
-                        }
-                        else
-                        {
-                            ofs_++;
-                            parseCount_ = 1 << 7;
-                            data_[ofs_] = 0;
-                        }
-                    }
-                    parseState_ = MM_DATA;
-                    return;
-                }
                 break;
             }
         }
-        parseState_ = UNKNOWN;
-        return;
+        parseState_ = state;
+        return i;
     }
 
     /// Returns true if we are close to the DCC cutout. This situation is
@@ -295,16 +156,67 @@ public:
     }
 
 private:
-    uint32_t parseCount_ = 0;
-    State parseState_ = UNKNOWN;
-    // Payload of current packet.
-    uint8_t data_[6];
-    uint8_t ofs_; // offset inside data_;
+    /// What to do with the packet data when taking a transition. The data
+    /// bit actions come first, see step().
+    enum Action
+    {
+        A_NONE,
+        /// Second half of a DCC zero bit: data bit or byte separator.
+        A_DCC_ZERO,
+        /// Second half of a DCC one bit: data bit or end of packet.
+        A_DCC_ONE,
+        /// First one half-bit of a DCC preamble.
+        A_PREAMBLE_START,
+        /// One half-bit in the DCC preamble.
+        A_PREAMBLE_ONE,
+        /// First half of the packet start bit; checks the preamble length.
+        A_PREAMBLE_END,
+        /// Second half of the packet start bit.
+        A_DCC_DATA_START,
+        /// Marklin-Motorola preamble.
+        A_MM_START,
+        /// Marklin-Motorola zero bit.
+        A_MM_ZERO,
+        /// Marklin-Motorola one bit.
+        A_MM_ONE,
+    };
+
+    /// Indexes the timing array.
+    enum TimingInfo
+    {
+        DCC_ONE = 0,
+        DCC_ZERO,
+        MM_PREAMBLE,
+        MM_SHORT,
+        MM_LONG,
+        MAX_TIMINGS
+    };
+
+    enum
+    {
+        /// A transition table entry has the next state in the low bits and
+        /// the action in the high bits.
+        ACTION_SHIFT = 4,
+        STATE_MASK = (1 << ACTION_SHIFT) - 1,
+        /// Every timing has at most two boundaries.
+        MAX_LIMITS = 2 * MAX_TIMINGS,
+        /// Number of timing classes.
+        NUM_CLASSES = MAX_LIMITS + 1,
+        /// Number of entries in the bucket table of timing_class().
+        NUM_BUCKETS = 32,
+    };
+
+    static_assert(NUM_STATES <= STATE_MASK + 1, "State does not fit the table");
 
     /// Represents the timing of a half-wave of the digital track signal.
     struct Timing
     {
-        void set(int min_usec, int max_usec)
+        /// @param clock_hz is the frequency of the measuring clock.
+        /// @param min_usec is the shortest matching half-wave, or -1 for no
+        /// lower limit.
+        /// @param max_usec is the longest matching half-wave, or -1 for no
+        /// upper limit.
+        void set(uint32_t clock_hz, int min_usec, int max_usec)
         {
             if (min_usec < 0)
             {
@@ -312,15 +224,15 @@ private:
             }
             else
             {
-                min_value = usec_to_clock(min_usec);
+                min_value = usec_to_clock(clock_hz, min_usec);
             }
             if (max_usec < 0)
             {
-                max_usec = UINT_MAX;
+                max_value = UINT32_MAX;
             }
             else
             {
-                max_value = usec_to_clock(max_usec);
+                max_value = usec_to_clock(clock_hz, max_usec);
             }
         }
 
@@ -329,29 +241,332 @@ private:
             return min_value <= value_clocks && value_clocks <= max_value;
         }
 
-        static uint32_t usec_to_clock(int usec)
+        static uint32_t usec_to_clock(uint32_t clock_hz, int usec)
         {
-            return (configCPU_CLOCK_HZ / 1000000) * usec;
+            return (clock_hz / 1000000) * usec;
         }
 
         uint32_t min_value;
         uint32_t max_value;
     };
 
-    /// Indexes the timing array.
-    enum TimingInfo
+    /// @return the timing class of a half-wave, which is the number of class
+    /// boundaries at or below it.
+    /// @param value is the half-wave length in clock cycles.
+    unsigned timing_class(uint32_t value)
     {
-        DCC_ONE = 0,
-        DCC_ZERO,
-        MM_PREAMBLE,
-        MM_SHORT,
-        MM_LONG,
-        MAX_TIMINGS
-    };
-    /// The various timings by the standards.
-    Timing timings_[MAX_TIMINGS];
+        uint32_t bucket = value >> bucketShift_;
+        if (bucket < NUM_BUCKETS)
+        {
+            // There is at most one class boundary inside a bucket.
+            unsigned c = bucketClass_[bucket];
+            return c + (value >= classLimit_[c]);
+        }
+        return timing_class_slow(value);
+    }
+
+    /// @return the timing class of a half-wave by comparing against every
+    /// class boundary. Used for the long half-waves.
+    /// @param value is the half-wave length in clock cycles.
+    unsigned timing_class_slow(uint32_t value)
+    {
+        unsigned c = 0;
+        for (unsigned i = 0; i < MAX_LIMITS; ++i)
+        {
+            c += value >= classLimit_[i];
+        }
+        return c;
+    }
+
+    /// Decodes one half-wave.
+    /// @param state is the current state.
+    /// @param value is the length of the half-wave in clock cycles.
+    /// @return the new state.
+    inline State step(State state, uint32_t value)
+        __attribute__((always_inline))
+    {
+        uint8_t t = table_[timing_class(value)][state];
+        state = (State)(t & STATE_MASK);
+        unsigned action = t >> ACTION_SHIFT;
+        if (action == A_NONE)
+        {
+            return state;
+        }
+        if (action <= A_DCC_ONE && parseCount_)
+        {
+            // Data bit inside a DCC byte; no branch on the bit value.
+            data_[ofs_] |= parseCount_ & (0u - (action == A_DCC_ONE));
+            parseCount_ >>= 1;
+            return state;
+        }
+        return run_action(action, state);
+    }
+
+    /// Executes the part of a transition that is not a DCC data bit.
+    /// @param action is the Action enum.
+    /// @param state is the next state from the transition table.
+    /// @return the new state.
+    State run_action(unsigned action, State state)
+    {
+        switch (action)
+        {
+            case A_DCC_ZERO:
+                // end of byte zero bit. Packet is not finished yet.
+                ofs_++;
+                HASSERT(ofs_ < sizeof(data_));
+                data_[ofs_] = 0;
+                parseCount_ = 1 << 7;
+                break;
+            case A_DCC_ONE:
+                // end of packet 1 bit.
+                return DCC_MAYBE_CUTOUT;
+            case A_PREAMBLE_START:
+                parseCount_ = 0;
+                break;
+            case A_PREAMBLE_ONE:
+                parseCount_++;
+                break;
+            case A_PREAMBLE_END:
+                if (parseCount_ < 16)
+                {
+                    return UNKNOWN;
+                }
+                break;
+            case A_DCC_DATA_START:
+                parseCount_ = 1 << 7;
+                ofs_ = 0;
+                data_[ofs_] = 0;
+                break;
+            case A_MM_START:
+                parseCount_ = 1 << 2;
+                ofs_ = 0;
+                data_[ofs_] = 0;
+                break;
+            case A_MM_ONE:
+                data_[ofs_] |= parseCount_;
+                // fall through
+            case A_MM_ZERO:
+                parseCount_ >>= 1;
+                if (!parseCount_)
+                {
+                    if (ofs_ == 2)
+                    {
+                        return MM_PACKET_FINISHED;
+                    }
+                    ofs_++;
+                    parseCount_ = 1 << 7;
+                    data_[ofs_] = 0;
+                }
+                break;
+        }
+        return state;
+    }
+
+    /// Computes the timing classes and the transition table.
+    /// @param timings are the timings by the standards, indexed by
+    /// TimingInfo.
+    void build_table(const Timing *timings)
+    {
+        unsigned num_limits = 0;
+        for (unsigned i = 0; i < MAX_TIMINGS; ++i)
+        {
+            add_limit(timings[i].min_value, &num_limits);
+            if (timings[i].max_value != UINT32_MAX)
+            {
+                add_limit(timings[i].max_value + 1, &num_limits);
+            }
+        }
+        // Unused limits are never reached, so they do not change the class.
+        for (unsigned i = num_limits; i <= MAX_LIMITS; ++i)
+        {
+            classLimit_[i] = UINT32_MAX;
+        }
+        std::sort(classLimit_, classLimit_ + num_limits);
+        // Uses the widest buckets that still have at most one class boundary
+        // inside, so that the bucket table covers the most half-waves.
+        bucketShift_ = 0;
+        for (unsigned shift = 1; shift < 24; ++shift)
+        {
+            if (buckets_ok(shift))
+            {
+                bucketShift_ = shift;
+            }
+        }
+        for (uint32_t b = 0; b < NUM_BUCKETS; ++b)
+        {
+            bucketClass_[b] = timing_class_slow(b << bucketShift_);
+        }
+        for (unsigned c = 0; c < NUM_CLASSES; ++c)
+        {
+            // Every value in the class behaves the same as its lowest value.
+            uint32_t value = c ? classLimit_[c - 1] : 0;
+            for (unsigned s = 0; s < NUM_STATES; ++s)
+            {
+                table_[c][s] = compute_transition((State)s, timings, value);
+            }
+        }
+    }
+
+    /// @return true if every bucket of the given width has at most one class
+    /// boundary inside.
+    /// @param shift is log2 of the bucket width in clock cycles.
+    bool buckets_ok(unsigned shift)
+    {
+        for (uint32_t b = 0; b < NUM_BUCKETS; ++b)
+        {
+            unsigned lo = timing_class_slow(b << shift);
+            unsigned hi = timing_class_slow(((b + 1) << shift) - 1);
+            if (hi > lo + 1)
+            {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    /// Adds a timing class boundary if it is not there yet.
+    /// @param limit is the lowest value of the class above the boundary.
+    /// @param num_limits is the number of boundaries in classLimit_.
+    void add_limit(uint32_t limit, unsigned *num_limits)
+    {
+        if (limit == 0)
+        {
+            return;
+        }
+        for (unsigned i = 0; i < *num_limits; ++i)
+        {
+            if (classLimit_[i] == limit)
+            {
+                return;
+            }
+        }
+        classLimit_[(*num_limits)++] = limit;
+    }
+
+    /// @return a transition table entry.
+    /// @param next is the State to go to.
+    /// @param action is what to do after setting the state.
+    static uint8_t entry(State next, Action action = A_NONE)
+    {
+        return next | (action << ACTION_SHIFT);
+    }
+
+    /// The decoding rules. Only used to fill in the transition table.
+    /// @param state is the current state.
+    /// @param timings are the timings by the standards, indexed by
+    /// TimingInfo.
+    /// @param value is the length of the half-wave.
+    /// @return the transition table entry.
+    static uint8_t compute_transition(
+        State state, const Timing *timings, uint32_t value)
+    {
+        switch (state)
+        {
+            case DCC_PACKET_FINISHED:
+            case MM_PACKET_FINISHED:
+            case UNKNOWN:
+                if (timings[DCC_ONE].match(value))
+                {
+                    return entry(DCC_PREAMBLE, A_PREAMBLE_START);
+                }
+                if (timings[MM_PREAMBLE].match(value))
+                {
+                    return entry(MM_DATA, A_MM_START);
+                }
+                break;
+            case DCC_PREAMBLE:
+                if (timings[DCC_ONE].match(value))
+                {
+                    return entry(DCC_PREAMBLE, A_PREAMBLE_ONE);
+                }
+                if (timings[DCC_ZERO].match(value))
+                {
+                    return entry(DCC_END_OF_PREAMBLE, A_PREAMBLE_END);
+                }
+                break;
+            case DCC_END_OF_PREAMBLE:
+                if (timings[DCC_ZERO].match(value))
+                {
+                    return entry(DCC_DATA, A_DCC_DATA_START);
+                }
+                break;
+            case DCC_DATA:
+                if (timings[DCC_ONE].match(value))
+                {
+                    return entry(DCC_DATA_ONE);
+                }
+                if (timings[DCC_ZERO].match(value))
+                {
+                    return entry(DCC_DATA_ZERO);
+                }
+                break;
+            case DCC_DATA_ONE:
+                if (timings[DCC_ONE].match(value))
+                {
+                    return entry(DCC_DATA, A_DCC_ONE);
+                }
+                break;
+            case DCC_DATA_ZERO:
+                if (timings[DCC_ZERO].match(value))
+                {
+                    return entry(DCC_DATA, A_DCC_ZERO);
+                }
+                break;
+            case DCC_MAYBE_CUTOUT:
+                if (value < timings[DCC_ZERO].min_value)
+                {
+                    return entry(DCC_CUTOUT);
+                }
+                return entry(DCC_PACKET_FINISHED);
+            case DCC_CUTOUT:
+                return entry(DCC_PACKET_FINISHED);
+            case MM_DATA:
+                if (timings[MM_LONG].match(value))
+                {
+                    return entry(MM_ZERO);
+                }
+                if (timings[MM_SHORT].match(value))
+                {
+                    return entry(MM_ONE);
+                }
+                break;
+            case MM_ZERO:
+                if (timings[MM_SHORT].match(value))
+                {
+                    return entry(MM_DATA, A_MM_ZERO);
+                }
+                break;
+            case MM_ONE:
+                if (timings[MM_LONG].match(value))
+                {
+                    return entry(MM_DATA, A_MM_ONE);
+                }
+                break;
+            case NUM_STATES:
+                break;
+        }
+        return entry(UNKNOWN);
+    }
+
+    uint32_t parseCount_ = 0;
+    State parseState_ = UNKNOWN;
+    // Payload of current packet.
+    uint8_t data_[6];
+    uint8_t ofs_; // offset inside data_;
+    /// log2 of the bucket width in clock cycles.
+    uint8_t bucketShift_;
+    /// Lowest half-wave length of timing classes 1..NUM_CLASSES-1, sorted.
+    /// The unused entries and the last entry are UINT32_MAX.
+    uint32_t classLimit_[MAX_LIMITS + 1];
+    /// Timing class of the lowest half-wave length in each bucket.
+    uint8_t bucketClass_[NUM_BUCKETS];
+    /// Next state and action, indexed by the timing class of the half-wave
+    /// and the current state. Having the state as the last index keeps the
+    /// dependency from one edge to the next a single load.
+    uint8_t table_[NUM_CLASSES][NUM_STATES];
 };
 
+#ifdef __FreeRTOS__
 /// User-space DCC decoding flow. This flow receives a sequence of numbers from
 /// the DCC driver, where each number means a specific number of microseconds
 /// for which the signal was of the same polarity (e.g. for dcc packet it would
@@ -419,6 +634,7 @@ private:
 protected:
     DccDecoder decoder_;
 };
+#endif // __FreeRTOS__
 
 } // namespace dcc
 
@@ -35,6 +35,8 @@
 #ifndef _EXECUTOR_DISPATCHER_HXX_
 #define _EXECUTOR_DISPATCHER_HXX_
 
+#include <algorithm>
+#include <atomic>
 #include <vector>
 
 #include "executor/Notifiable.hxx"
@@ -46,6 +48,13 @@
    invoked.
 
    Handlers are called in no particular order.
+
+   The registrations are compiled into an index of handlers grouped by mask
+   and sorted by identifier, so the cost of dispatching a message is
+   proportional to the number of distinct masks and matching handlers, not
+   the number of registrations. Registering and unregistering only marks the
+   index stale; the flow rebuilds it in place before dispatching the next
+   message, so a burst of registration changes costs one rebuild.
  */
 template <int NUM_PRIO>
 class DispatchFlowBase : public UntypedStateFlow<QList<NUM_PRIO>>
@@ -148,13 +157,16 @@ private:
     /// identifier, mask, handler pointer.
     struct HandlerInfo
     {
-        HandlerInfo() : handler(nullptr)
+        HandlerInfo(ID id, ID mask, UntypedHandler *handler)
+            : id(id)
+            , mask(mask)
+            , handler(handler)
         {
         }
         ID id; ///< Bits that this handler is registered for.
         ID mask; ///< Mask that should be applied for the bits check.
         /// Handler to call. NULL if the handler has been removed.
-        UntypedHandler *handler;
+        std::atomic<UntypedHandler *> handler;
 
         /// Equality comparison function on the handlers. Used for remove()
         /// calls.
@@ -168,21 +180,82 @@ private:
         bool Equals(ID id, ID mask, UntypedHandler *handler)
         {
             return (this->id == id && this->mask == mask &&
-                    this->handler == handler);
+                    this->handler.load(std::memory_order_relaxed) == handler);
         }
     };
 
-    /// Registered handlers.
-    vector<HandlerInfo> handlers_;
+    /// One handler in a mask group of the index.
+    struct IndexEntry
+    {
+        /// id & mask of the handler.
+        ID key;
+        /// The registration.
+        HandlerInfo *info;
+
+        /// Sorting order. @param o is the other entry. @return true if *this
+        /// goes before o.
+        bool operator<(const IndexEntry &o) const
+        {
+            return key < o.key;
+        }
+    };
 
-    /// Index of the next handler to look at.
-    size_t currentIndex_;
+    /// Handlers that have the same mask, sorted by id & mask, so that the
+    /// matching ones can be found with a binary search.
+    struct MaskGroup
+    {
+        /// Mask of every handler in this group.
+        ID mask;
+        /// Handlers sorted by key.
+        vector<IndexEntry> entries;
+    };
+
+    /// Lookup structure built from the registrations. Only the flow reads and
+    /// rebuilds it, between two messages, so the iteration does not need to
+    /// take the lock.
+    struct Index
+    {
+        /// Every registration in order, for the negated match.
+        vector<HandlerInfo *> all;
+        /// Registrations grouped by mask, in the order of first use.
+        vector<MaskGroup> groups;
+    };
+
+    /// Rebuilds index_ from handlers_, reusing its storage, and frees the
+    /// removed registrations. Must be called with lock_ held, from the flow
+    /// when it is not iterating.
+    void rebuild_index_locked();
+
+    /// @return the next handler after the iteration cursor that matches the
+    /// message, or nullptr if there are no more. @param id is the message ID.
+    HandlerInfo *find_next(ID id);
+
+    /// Registered handlers in order of registration. Owned. Protected by
+    /// lock_.
+    vector<HandlerInfo *> handlers_;
+
+    /// The index the flow iterates. Accessed by the flow only.
+    Index index_;
+    /// True if handlers_ changed since index_ was built.
+    std::atomic<bool> indexStale_;
+    /// Removed registrations that index_ may still point to. Owned.
+    /// Protected by lock_.
+    vector<HandlerInfo *> removed_;
+
+    /// Index of the mask group (or for negated match, the position in
+    /// Index::all) the iteration is at.
+    size_t currentGroup_;
+    /// Position in the current mask group's entries; SIZE_MAX if the group was
+    /// not looked up yet.
+    size_t currentEntry_;
+    /// The handler found by the last iteration step.
+    HandlerInfo *nextHandler_;
 
 protected:
     /// If non-NULL we still need to call this handler.
     UntypedHandler *lastHandlerToCall_;
 private:
-    /// Protects handler add / remove against iteration.
+    /// Protects handler add / remove against each other.
     OSMutex lock_;
 };
 
@@ -308,6 +381,7 @@ template <int NUM_PRIO>
 DispatchFlowBase<NUM_PRIO>::DispatchFlowBase(Service *service)
     : UntypedStateFlow<QList<NUM_PRIO>>(service)
     , negateMatch_(false)
+    , indexStale_(false)
 {
 }
 
@@ -315,21 +389,21 @@ template<int NUM_PRIO>
 DispatchFlowBase<NUM_PRIO>::~DispatchFlowBase()
 {
     HASSERT(this->is_waiting());
+    for (HandlerInfo *h : handlers_)
+    {
+        delete h;
+    }
+    for (HandlerInfo *h : removed_)
+    {
+        delete h;
+    }
 }
 
 template<int NUM_PRIO>
 size_t DispatchFlowBase<NUM_PRIO>::size()
 {
     OSMutexLock h(&lock_);
-    size_t ret = 0;
-    for (auto &h : handlers_)
-    {
-        if (h.handler)
-        {
-            ++ret;
-        }
-    }
-    return ret;
+    return handlers_.size();
 }
 
 template<int NUM_PRIO>
@@ -337,18 +411,8 @@ void DispatchFlowBase<NUM_PRIO>::register_handler(UntypedHandler *handler,
                                                   ID id, ID mask)
 {
     OSMutexLock h(&lock_);
-    size_t idx = 0;
-    while (idx < handlers_.size() && handlers_[idx].handler)
-    {
-        ++idx;
-    }
-    if (idx >= handlers_.size())
-    {
-        handlers_.resize(handlers_.size() + 1);
-    }
-    handlers_[idx].handler = handler;
-    handlers_[idx].id = id;
-    handlers_[idx].mask = mask;
+    handlers_.push_back(new HandlerInfo(id, mask, handler));
+    indexStale_ = true;
 }
 
 template<int NUM_PRIO>
@@ -357,23 +421,22 @@ DispatchFlowBase<NUM_PRIO>::unregister_handler(UntypedHandler *handler,
                                                ID id, ID mask)
 {
     OSMutexLock h(&lock_);
-    /// @todo(balazs.racz) optimize by looking at the current index - 1.
     size_t idx = 0;
-    while (idx < handlers_.size() && !handlers_[idx].Equals(id, mask, handler))
+    while (idx < handlers_.size() && !handlers_[idx]->Equals(id, mask, handler))
     {
         ++idx;
     }
     // Checks that we found the thing to unregister.
     HASSERT(idx < handlers_.size() &&
             "Tried to unregister a handler not previously registered.");
-    if (lastHandlerToCall_ == handlers_[idx].handler) {
+    if (lastHandlerToCall_ == handler) {
         lastHandlerToCall_ = nullptr;
     }
-    handlers_[idx].handler = nullptr;
-    if (idx == handlers_.size() - 1)
-    {
-        handlers_.resize(handlers_.size() - 1);
-    }
+    // An iteration in progress may still see this entry in its index.
+    handlers_[idx]->handler.store(nullptr);
+    removed_.push_back(handlers_[idx]);
+    handlers_.erase(handlers_.begin() + idx);
+    indexStale_ = true;
 }
 
 template<int NUM_PRIO>
@@ -381,52 +444,140 @@ void DispatchFlowBase<NUM_PRIO>::unregister_handler_all(
     UntypedHandler *handler)
 {
     OSMutexLock h(&lock_);
+    if (lastHandlerToCall_ == handler) {
+        lastHandlerToCall_ = nullptr;
+    }
+    size_t dst = 0;
     for (size_t i = 0; i < handlers_.size(); ++i)
     {
-        if (handlers_[i].handler == handler)
+        if (handlers_[i]->handler.load(std::memory_order_relaxed) == handler)
+        {
+            handlers_[i]->handler.store(nullptr);
+            removed_.push_back(handlers_[i]);
+        }
+        else
         {
-            handlers_[i].handler = nullptr;
+            handlers_[dst++] = handlers_[i];
         }
     }
-    while (!handlers_.empty() && handlers_.back().handler == nullptr)
+    handlers_.resize(dst);
+    indexStale_ = true;
+}
+
+template<int NUM_PRIO>
+void DispatchFlowBase<NUM_PRIO>::rebuild_index_locked()
+{
+    indexStale_ = false;
+    index_.all = handlers_;
+    for (auto &g : index_.groups)
+    {
+        g.entries.clear();
+    }
+    for (HandlerInfo *h : handlers_)
+    {
+        MaskGroup *g = nullptr;
+        for (auto &gg : index_.groups)
+        {
+            if (gg.mask == h->mask)
+            {
+                g = &gg;
+                break;
+            }
+        }
+        if (!g)
+        {
+            index_.groups.emplace_back();
+            g = &index_.groups.back();
+            g->mask = h->mask;
+        }
+        g->entries.push_back({(ID)(h->id & h->mask), h});
+    }
+    size_t dst = 0;
+    for (size_t i = 0; i < index_.groups.size(); ++i)
+    {
+        if (index_.groups[i].entries.empty())
+        {
+            continue;
+        }
+        if (dst != i)
+        {
+            std::swap(index_.groups[dst], index_.groups[i]);
+        }
+        auto &entries = index_.groups[dst++].entries;
+        // Stable to keep the registration order among equal keys.
+        std::stable_sort(entries.begin(), entries.end());
+    }
+    index_.groups.resize(dst);
+    // The old index was the only one pointing to these.
+    for (HandlerInfo *h : removed_)
     {
-        handlers_.pop_back();
+        delete h;
     }
+    removed_.clear();
 }
 
 template<int NUM_PRIO>
 StateFlowBase::Action DispatchFlowBase<NUM_PRIO>::entry()
 {
-    currentIndex_ = 0;
+    if (indexStale_)
+    {
+        OSMutexLock h(&lock_);
+        rebuild_index_locked();
+    }
+    currentGroup_ = 0;
+    currentEntry_ = SIZE_MAX;
     lastHandlerToCall_ = nullptr;
     return call_immediately(STATE(iterate));
 }
 
 template<int NUM_PRIO>
-StateFlowBase::Action DispatchFlowBase<NUM_PRIO>::iterate()
+typename DispatchFlowBase<NUM_PRIO>::HandlerInfo *
+DispatchFlowBase<NUM_PRIO>::find_next(ID id)
 {
-    ID id = get_message_id();
+    Index *idx = &index_;
+    if (negateMatch_)
     {
-        OSMutexLock l(&lock_);
-        for (; currentIndex_ < handlers_.size(); ++currentIndex_)
+        while (currentGroup_ < idx->all.size())
         {
-            auto &h = handlers_[currentIndex_];
-            if (!h.handler)
-            {
-                continue;
-            }
-            if (negateMatch_ && (id & h.mask) == (h.id & h.mask))
+            HandlerInfo *h = idx->all[currentGroup_++];
+            if ((id & h->mask) != (h->id & h->mask) &&
+                h->handler.load(std::memory_order_relaxed))
             {
-                continue;
+                return h;
             }
-            if ((!negateMatch_) && (id & h.mask) != (h.id & h.mask))
+        }
+        return nullptr;
+    }
+    while (currentGroup_ < idx->groups.size())
+    {
+        auto &g = idx->groups[currentGroup_];
+        IndexEntry key{(ID)(id & g.mask), nullptr};
+        if (currentEntry_ == SIZE_MAX)
+        {
+            currentEntry_ =
+                std::lower_bound(g.entries.begin(), g.entries.end(), key) -
+                g.entries.begin();
+        }
+        while (currentEntry_ < g.entries.size() &&
+            g.entries[currentEntry_].key == key.key)
+        {
+            HandlerInfo *h = g.entries[currentEntry_++].info;
+            if (h->handler.load(std::memory_order_relaxed))
             {
-                continue;
+                return h;
             }
-            break;
         }
+        ++currentGroup_;
+        currentEntry_ = SIZE_MAX;
     }
-    if (currentIndex_ >= handlers_.size())
+    return nullptr;
+}
+
+template<int NUM_PRIO>
+StateFlowBase::Action DispatchFlowBase<NUM_PRIO>::iterate()
+{
+    HandlerInfo *h = find_next(get_message_id());
+    if (!h)
     {
         return call_immediately(STATE(iteration_done));
     }
@@ -434,20 +585,19 @@ StateFlowBase::Action DispatchFlowBase<NUM_PRIO>::iterate()
     if (!lastHandlerToCall_)
     {
         // This was the first we found.
-        lastHandlerToCall_ = handlers_[currentIndex_].handler;
-        ++currentIndex_;
+        lastHandlerToCall_ = h->handler.load(std::memory_order_relaxed);
         return again();
     }
     // Now: we have at least two different handler. We need to clone the
     // message. We use the pool of the last handler to call by default.
+    nextHandler_ = h;
     return allocate_and_clone();
 }
 
 template<int NUM_PRIO>
 StateFlowBase::Action DispatchFlowBase<NUM_PRIO>::clone_done()
 {
-    lastHandlerToCall_ = handlers_[currentIndex_].handler;
-    ++currentIndex_;
+    lastHandlerToCall_ = nextHandler_->handler.load(std::memory_order_relaxed);
     return call_immediately(STATE(iterate));
 }
 
@@ -35,6 +35,7 @@
 #ifndef _EXECUTOR_EXECUTABLE_HXX_
 #define _EXECUTOR_EXECUTABLE_HXX_
 
+#include "executor/ExecutorStats.hxx"
 #include "executor/Notifiable.hxx"
 #include "utils/QMember.hxx"
 
@@ -64,6 +65,13 @@ public:
     {
         HASSERT(0 && "unexpected call to alloc_result");
     }
+
+#if EXECUTOR_STATS
+    /// When this executable was last added to an executor queue
+    /// (os_get_time_monotonic), while the executor's instrumentation was
+    /// on. Used to measure the queueing latency.
+    long long enqueueTime_{0};
+#endif
 };
 
 #endif // _EXECUTOR_EXECUTABLE_HXX_
@@ -172,6 +172,91 @@ void ExecutorBase::sync_run(std::function<void()> fn)
     }
 }
 
+void ExecutorBase::run_executable(Executable *msg, unsigned priority)
+{
+    current_ = msg;
+#if EXECUTOR_STATS
+    ExecutorStats *stats = activeStats_.load(std::memory_order_acquire);
+    if (stats)
+    {
+        long long start = os_get_time_monotonic();
+        long long queued = -1;
+        if (msg->enqueueTime_ >= statsEnabledTime_)
+        {
+            queued = start - msg->enqueueTime_;
+        }
+        msg->enqueueTime_ = 0;
+        auto *entry = stats->record_start(
+            msg, priority, queue_depth(priority), queued);
+        msg->run();
+        stats->record_finish(entry, os_get_time_monotonic() - start);
+        current_ = nullptr;
+        return;
+    }
+#endif
+    msg->run();
+    current_ = nullptr;
+}
+
+#if EXECUTOR_STATS
+void ExecutorBase::enable_stats(bool enabled)
+{
+    if (!enabled)
+    {
+        activeStats_.store(nullptr, std::memory_order_release);
+        return;
+    }
+    if (!stats_)
+    {
+        stats_ = new ExecutorStats;
+    }
+    statsEnabledTime_ = os_get_time_monotonic();
+    activeStats_.store(stats_, std::memory_order_release);
+}
+
+void ExecutorBase::reset_stats()
+{
+    if (stats_)
+    {
+        // The counters are written only on the executor thread.
+        sync_run([this]() { stats_->reset(); });
+    }
+}
+
+void ExecutorBase::print_all_stats(FILE *fp)
+{
+    for (ExecutorBase *e = list; e; e = e->next_)
+    {
+        if (!e->stats_)
+        {
+            continue;
+        }
+        fprintf(fp, "Executor %p (%s), %u executables run:\n", e,
+            e->activeStats_.load() ? "on" : "off", (unsigned)e->sequence());
+        e->stats_->print(fp);
+    }
+}
+#endif
+
+#if EXECUTOR_LOAD_STATS
+uint32_t ExecutorBase::idle_usec()
+{
+    uint32_t seq, start, total;
+    do
+    {
+        seq = idleSeq_.load(std::memory_order_acquire);
+        start = idleStartUsec_.load(std::memory_order_relaxed);
+        total = idleUsec_.load(std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_acquire);
+    } while ((seq & 1) || seq != idleSeq_.load(std::memory_order_relaxed));
+    if (start)
+    {
+        total += (uint32_t)(os_get_time_monotonic() / 1000) - start;
+    }
+    return total;
+}
+#endif
+
 bool ExecutorBase::loop_once()
 {
     unsigned priority;
@@ -187,9 +272,7 @@ bool ExecutorBase::loop_once()
         done_ = 1;
         return false;
     }
-    current_ = msg;
-    msg->run();
-    current_ = nullptr;
+    run_executable(msg, priority);
     return true;
 }
 
@@ -210,9 +293,7 @@ long long ICACHE_FLASH_ATTR  ExecutorBase::loop_some() {
         }
         if (msg != NULL)
         {
-            current_ = msg;
-            msg->run();
-            current_ = nullptr;
+            run_executable(msg, priority);
         }
     }
     // Still stuff pending to run.
@@ -317,9 +398,7 @@ void *ExecutorBase::entry()
         if (msg != NULL)
         {
             ++sequence_;
-            current_ = msg;
-            msg->run();
-            current_ = nullptr;
+            run_executable(msg, priority);
         }
     }
 
@@ -391,7 +470,33 @@ void ExecutorBase::wait_with_select(long long wait_length)
     {
         wait_length = max_sleep;
     }
+#if EXECUTOR_LOAD_STATS
+    uint32_t idle_start = 0;
+    if (wait_length > 0)
+    {
+        // The lowest bit is set so that zero means not waiting.
+        idle_start = (os_get_time_monotonic() / 1000) | 1;
+        idleStartUsec_.store(idle_start, std::memory_order_relaxed);
+    }
+#endif
     int ret = selectHelper_.select(selectNFds_, &fd_r, &fd_w, &fd_x, wait_length);
+#if EXECUTOR_LOAD_STATS
+    if (idle_start)
+    {
+        uint32_t now = os_get_time_monotonic() / 1000;
+        // Both fields change together; idle_usec() retries if it sees an odd
+        // sequence number or the sequence number changed while it was
+        // reading.
+        uint32_t seq = idleSeq_.load(std::memory_order_relaxed);
+        idleSeq_.store(seq + 1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+        idleStartUsec_.store(0, std::memory_order_relaxed);
+        idleUsec_.store(idleUsec_.load(std::memory_order_relaxed) +
+                now - idle_start,
+            std::memory_order_relaxed);
+        idleSeq_.store(seq + 2, std::memory_order_release);
+    }
+#endif
     if (ret <= 0) {
         return; // nothing to do
     }
@@ -434,4 +539,7 @@ ExecutorBase::~ExecutorBase()
     {
         shutdown();
     }
+#if EXECUTOR_STATS
+    delete stats_;
+#endif
 }
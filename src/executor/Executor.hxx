@@ -36,6 +36,7 @@
 #ifndef _EXECUTOR_EXECUTOR_HXX_
 #define _EXECUTOR_EXECUTOR_HXX_
 
+#include <atomic>
 #include <functional>
 
 #include "executor/Executable.hxx"
@@ -155,7 +156,43 @@ public:
     /// @return a number that gets incremented by one every time an executable
     /// runs.
     virtual uint32_t sequence() = 0;
-    
+
+    /// @return the number of executables waiting in a priority band. @param
+    /// priority is the band.
+    virtual size_t queue_depth(unsigned priority) = 0;
+
+#if EXECUTOR_LOAD_STATS
+    /// @return the total time in usec the executor thread spent blocked
+    /// waiting for work, including the wait in progress. Wraps around after
+    /// 71 minutes. May be called from any thread; the value may be off by one
+    /// wait while the executor is waking up.
+    uint32_t idle_usec();
+#endif
+
+#if EXECUTOR_STATS
+    /** Turns the instrumentation of this executor on or off. While on, the
+     * executor records the queue depth and the queueing latency per priority
+     * band, and the run time of each executable. May be called from any
+     * thread. The counters are kept when turned off.
+     * @param enabled true to turn on. */
+    void enable_stats(bool enabled);
+
+    /// Clears the counters of the instrumentation. Must not be called from a
+    /// different executor that this executor is waiting for.
+    void reset_stats();
+
+    /// @return the counters, or nullptr if the instrumentation was never
+    /// turned on.
+    ExecutorStats *stats()
+    {
+        return stats_;
+    }
+
+    /** Prints the counters of every instrumented executor.
+     * @param fp is where to print to. */
+    static void print_all_stats(FILE *fp);
+#endif
+
 protected:
     /** Thread entry point.
      * @return Should never return
@@ -167,6 +204,18 @@ protected:
     /** Helper object for interruptible select calls. */
     OSSelectWakeup selectHelper_;
 
+#if EXECUTOR_STATS
+    /// Records the time an executable is added to the queue, if the
+    /// instrumentation is on. @param msg is the executable being added.
+    void stats_enqueue(Executable *msg)
+    {
+        if (activeStats_.load(std::memory_order_relaxed))
+        {
+            msg->enqueueTime_ = os_get_time_monotonic();
+        }
+    }
+#endif
+
 private:
 #ifndef ESP_NONOS
     /** Wait for an item from the front of the queue.
@@ -191,6 +240,11 @@ private:
      */
     virtual Executable *next(unsigned *priority) = 0;
 
+    /** Runs an executable taken off the queue.
+     * @param msg is the executable.
+     * @param priority is the priority band it was taken from. */
+    void run_executable(Executable *msg, unsigned priority);
+
     /** Executes a select call, and schedules any necessary executables based
      * on the return. Will not sleep at all if not empty, otherwise sleeps at
      * most next_timer_nsec nanoseconds (from now).
@@ -242,6 +296,27 @@ private:
     /** Head of the linked list for the select calls. */
     TypedQueue<Selectable> selectables_;
 
+#if EXECUTOR_STATS
+    /// Counters of the instrumentation. Owned.
+    ExecutorStats *stats_{nullptr};
+    /// Same as stats_ while the instrumentation is on, nullptr otherwise.
+    std::atomic<ExecutorStats *> activeStats_{nullptr};
+    /// When the instrumentation was last turned on. Enqueue times from
+    /// before are stale.
+    long long statsEnabledTime_{0};
+#endif
+
+#if EXECUTOR_LOAD_STATS
+    /// Sequence lock of idleUsec_ and idleStartUsec_. Odd while the executor
+    /// thread is updating them.
+    std::atomic<uint32_t> idleSeq_{0};
+    /// Time spent blocked in select in usec, without the wait in progress.
+    std::atomic<uint32_t> idleUsec_{0};
+    /// Start of the wait in progress in usec, or 0 if the executor is not
+    /// waiting.
+    std::atomic<uint32_t> idleStartUsec_{0};
+#endif
+
     /** Set to 1 when the executor thread has exited and it is safe to delete
      * *this. */
     unsigned done_ : 1;
@@ -317,6 +392,9 @@ public:
      */
     void add(Executable *msg, unsigned priority = UINT_MAX) OVERRIDE
     {
+#if EXECUTOR_STATS
+        stats_enqueue(msg);
+#endif
         queue_.insert(
             msg, priority >= NUM_PRIO ? NUM_PRIO - 1 : priority);
 #ifdef ESP_NONOS
@@ -358,6 +436,11 @@ public:
 
     uint32_t sequence() OVERRIDE { return sequence_; }
 
+    size_t queue_depth(unsigned priority) override
+    {
+        return queue_.pending(priority);
+    }
+
 private:
 #ifndef ESP_NONOS
     /** Wait for an item from the front of the queue.
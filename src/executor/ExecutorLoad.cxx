@@ -0,0 +1,174 @@
+/** \copyright
+ * Copyright (c) 2026, agent
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are  permitted provided that the following conditions are met:
+ *
+ *  - Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ *  - Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ * \file ExecutorLoad.cxx
+ *
+ * Measures how busy the executor threads are.
+ *
+ * @author agent
+ * @date 19 Oct 2026
+ */
+
+#include "executor/ExecutorLoad.hxx"
+
+#include <algorithm>
+#include <string>
+
+#include "utils/StringPrintf.hxx"
+#include "utils/logging.h"
+
+#if EXECUTOR_LOAD_STATS
+
+ExecutorLoad::ExecutorLoad(Service *service, long long period_nsec,
+    long long report_period_nsec, float alpha)
+    : alpha_(alpha)
+    , lastSampleTime_(os_get_time_monotonic())
+    , reportPeriod_(report_period_nsec)
+    , lastReportTime_(lastSampleTime_)
+    , timer_(this, service->executor()->active_timers())
+{
+    add(service->executor());
+    timer_.start(period_nsec);
+}
+
+ExecutorLoad::~ExecutorLoad()
+{
+    timer_.cancel();
+}
+
+void ExecutorLoad::add(ExecutorBase *executor)
+{
+    OSMutexLock h(&lock_);
+    for (auto &e : entries_)
+    {
+        if (e.executor == executor)
+        {
+            return;
+        }
+    }
+    entries_.emplace_back(executor, alpha_);
+}
+
+uint8_t ExecutorLoad::get_load()
+{
+    OSMutexLock h(&lock_);
+    float max = 0;
+    for (auto &e : entries_)
+    {
+        max = std::max(max, e.load.avg());
+    }
+    return max * 100 + 0.5;
+}
+
+uint8_t ExecutorLoad::get_load(ExecutorBase *executor)
+{
+    OSMutexLock h(&lock_);
+    for (auto &e : entries_)
+    {
+        if (e.executor == executor)
+        {
+            return e.load.avg() * 100 + 0.5;
+        }
+    }
+    return 0;
+}
+
+void ExecutorLoad::sample()
+{
+    long long now = os_get_time_monotonic();
+    long long elapsed_usec = (now - lastSampleTime_) / 1000;
+    lastSampleTime_ = now;
+    if (elapsed_usec <= 0)
+    {
+        return;
+    }
+    {
+        OSMutexLock h(&lock_);
+        for (auto &e : entries_)
+        {
+            uint32_t idle = e.executor->idle_usec();
+            uint32_t idle_diff = idle - e.lastIdleUsec;
+            e.lastIdleUsec = idle;
+            float busy = 1.0f - (float)idle_diff / elapsed_usec;
+            // The idle time of the wait in progress is read without a lock,
+            // which can put a sample slightly out of range.
+            busy = std::min(1.0f, std::max(0.0f, busy));
+            if (e.sampled)
+            {
+                e.load.add_value(busy);
+            }
+            else
+            {
+                e.load.reset_state(busy);
+                e.sampled = true;
+            }
+        }
+    }
+    if (reportPeriod_ > 0 && now - lastReportTime_ >= reportPeriod_)
+    {
+        lastReportTime_ = now;
+        string line;
+        {
+            OSMutexLock h(&lock_);
+            for (auto &e : entries_)
+            {
+                char buf[16];
+                line += StringPrintf(" %s %u%%", name(e.executor, buf),
+                    (unsigned)(e.load.avg() * 100 + 0.5));
+            }
+        }
+        LOG(INFO, "Executor load:%s", line.c_str());
+    }
+}
+
+void ExecutorLoad::print(FILE *fp)
+{
+    OSMutexLock h(&lock_);
+    fprintf(fp, "Executor load:");
+    for (auto &e : entries_)
+    {
+        char buf[16];
+        fprintf(fp, " %s %u%%", name(e.executor, buf),
+            (unsigned)(e.load.avg() * 100 + 0.5));
+    }
+    fprintf(fp, "\n");
+}
+
+const char *ExecutorLoad::name(ExecutorBase *e, char buf[16])
+{
+#if defined(__linux__)
+    // Executors running on a donated thread have no handle.
+    if (e->thread_handle() &&
+        pthread_getname_np(e->thread_handle(), buf, 16) == 0 && buf[0])
+    {
+        return buf;
+    }
+#endif
+    snprintf(buf, 16, "%p", e);
+    return buf;
+}
+
+#endif // EXECUTOR_LOAD_STATS
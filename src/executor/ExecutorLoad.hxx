@@ -0,0 +1,170 @@
+/** \copyright
+ * Copyright (c) 2026, agent
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are  permitted provided that the following conditions are met:
+ *
+ *  - Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ *  - Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ * \file ExecutorLoad.hxx
+ *
+ * Measures how busy the executor threads are.
+ *
+ * @author agent
+ * @date 19 Oct 2026
+ */
+
+#ifndef _EXECUTOR_EXECUTORLOAD_HXX_
+#define _EXECUTOR_EXECUTORLOAD_HXX_
+
+#include <stdint.h>
+#include <stdio.h>
+#include <vector>
+
+#include "executor/Executor.hxx"
+#include "executor/Service.hxx"
+#include "executor/Timer.hxx"
+#include "os/OS.hxx"
+#include "utils/Ewma.hxx"
+#include "utils/Singleton.hxx"
+
+#if EXECUTOR_LOAD_STATS
+
+/// Singleton class that records the load of executor threads. This is the
+/// portable counterpart of CpuLoad: instead of looking at the running task
+/// from a timer interrupt, it samples how much time each executor spent
+/// blocked waiting for work (ExecutorBase::idle_usec()). The rest of the
+/// wall time counts as busy, including when the thread was runnable but
+/// preempted. Available when the tree is built with EXECUTOR_LOAD_STATS=1.
+///
+/// Usage:
+///
+/// . create a single (global) instance of this class. It samples the
+///   executor of the service given to the constructor, and any executor
+///   added with add().
+///
+/// . retrieve the load when desired from the object of this class or via
+///   Singleton<ExecutorLoad>::instance(), or set a report period to get it
+///   printed in the log.
+class ExecutorLoad : public Singleton<ExecutorLoad>
+{
+public:
+    /// Constructor.
+    ///
+    /// @param service the sampling timer runs on this service's executor,
+    /// which is also sampled.
+    /// @param period_nsec how often to sample the executors.
+    /// @param report_period_nsec how often to print the load of the executors
+    /// into the log; 0 to never print.
+    /// @param alpha coefficient of the rolling average per sample. The higher
+    /// it is, the slower the load follows changes.
+    ExecutorLoad(Service *service, long long period_nsec = MSEC_TO_NSEC(100),
+        long long report_period_nsec = 0, float alpha = 0.9);
+
+    /// Destructor. Must be called on the service's executor, or when that
+    /// executor is not running.
+    ~ExecutorLoad();
+
+    /// Starts sampling an executor. May be called from any thread. @param
+    /// executor must stay alive as long as *this.
+    void add(ExecutorBase *executor);
+
+    /// @returns the load of the busiest executor as an integer between 0 and
+    /// 100, averaged over the past short amount of time.
+    uint8_t get_load();
+
+    /// @returns the load of an executor as an integer between 0 and 100,
+    /// averaged over the past short amount of time. 0 if the executor is not
+    /// sampled. @param executor is the executor to query.
+    uint8_t get_load(ExecutorBase *executor);
+
+    /// Prints the load of every sampled executor in one line.
+    /// @param fp is where to print to.
+    void print(FILE *fp);
+
+private:
+    /// Sampling state of one executor.
+    struct Entry
+    {
+        Entry(ExecutorBase *e, float alpha)
+            : executor(e)
+            , lastIdleUsec(e->idle_usec())
+            , load(alpha)
+        {
+        }
+
+        /// The sampled executor.
+        ExecutorBase *executor;
+        /// idle_usec() at the previous sample.
+        uint32_t lastIdleUsec;
+        /// Rolling average of the busy fraction, 0..1.
+        AbsEwma load;
+        /// false until the first sample, which seeds the average.
+        bool sampled{false};
+    };
+
+    /// Calls back the parent periodically.
+    class SampleTimer : public ::Timer
+    {
+    public:
+        /// @param parent is the owner.
+        SampleTimer(ExecutorLoad *parent, ActiveTimers *timers)
+            : ::Timer(timers)
+            , parent_(parent)
+        {
+        }
+
+        long long timeout() override
+        {
+            parent_->sample();
+            return RESTART;
+        }
+
+    private:
+        ExecutorLoad *parent_;
+    };
+
+    /// Takes a sample of every executor. Called on the service's executor.
+    void sample();
+
+    /// @return the thread name of an executor for the report. @param e is
+    /// the executor. @param buf is storage for the name.
+    static const char *name(ExecutorBase *e, char buf[16]);
+
+    /// Protects entries_.
+    OSMutex lock_;
+    /// Sampled executors.
+    std::vector<Entry> entries_;
+    /// Coefficient of the rolling averages.
+    float alpha_;
+    /// When the previous sample was taken.
+    long long lastSampleTime_;
+    /// How often to print the load; 0 for never.
+    long long reportPeriod_;
+    /// When the load was last printed.
+    long long lastReportTime_;
+    /// Periodic sampling.
+    SampleTimer timer_;
+};
+
+#endif // EXECUTOR_LOAD_STATS
+
+#endif // _EXECUTOR_EXECUTORLOAD_HXX_
@@ -0,0 +1,285 @@
+/** \copyright
+ * Copyright (c) 2026, agent
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are  permitted provided that the following conditions are met:
+ *
+ *  - Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ *  - Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ * \file ExecutorStats.cxx
+ *
+ * Optional instrumentation of the executor: queue depths, queueing latency
+ * and run time of the executables.
+ *
+ * @author agent
+ * @date 19 Oct 2026
+ */
+
+#include "executor/ExecutorStats.hxx"
+
+#include <algorithm>
+#include <stdlib.h>
+#include <string.h>
+#ifdef __GXX_RTTI
+#include <cxxabi.h>
+#include <typeinfo>
+#endif
+
+#include "executor/Executable.hxx"
+
+ExecutorStats::ExecutorStats()
+{
+    reset();
+}
+
+void ExecutorStats::AtomicHistogram::add(long long nsec)
+{
+    uint32_t usec = nsec < 0 ? 0 : (uint32_t)std::min(nsec / 1000, 0xFFFFFFFFLL);
+    unsigned bucket = usec ? 32 - __builtin_clz(usec) : 0;
+    if (bucket >= NUM_BUCKETS)
+    {
+        bucket = NUM_BUCKETS - 1;
+    }
+    // There is only one writer, so load + store is enough.
+    buckets[bucket].store(buckets[bucket].load(std::memory_order_relaxed) + 1,
+        std::memory_order_relaxed);
+    count.store(count.load(std::memory_order_relaxed) + 1,
+        std::memory_order_relaxed);
+    totalUsec.store(totalUsec.load(std::memory_order_relaxed) + usec,
+        std::memory_order_relaxed);
+    if (usec > maxUsec.load(std::memory_order_relaxed))
+    {
+        maxUsec.store(usec, std::memory_order_relaxed);
+    }
+}
+
+void ExecutorStats::AtomicHistogram::copy(Histogram *h)
+{
+    h->count = count.load(std::memory_order_relaxed);
+    h->totalUsec = totalUsec.load(std::memory_order_relaxed);
+    h->maxUsec = maxUsec.load(std::memory_order_relaxed);
+    for (unsigned i = 0; i < NUM_BUCKETS; ++i)
+    {
+        h->buckets[i] = buckets[i].load(std::memory_order_relaxed);
+    }
+}
+
+void ExecutorStats::AtomicHistogram::clear()
+{
+    count.store(0, std::memory_order_relaxed);
+    totalUsec.store(0, std::memory_order_relaxed);
+    maxUsec.store(0, std::memory_order_relaxed);
+    for (unsigned i = 0; i < NUM_BUCKETS; ++i)
+    {
+        buckets[i].store(0, std::memory_order_relaxed);
+    }
+}
+
+void ExecutorStats::reset()
+{
+    for (unsigned i = 0; i < MAX_PRIO; ++i)
+    {
+        priority_[i].depth.store(0, std::memory_order_relaxed);
+        priority_[i].maxDepth.store(0, std::memory_order_relaxed);
+        priority_[i].latency.clear();
+    }
+    for (unsigned i = 0; i < MAX_EXECUTABLES; ++i)
+    {
+        entries_[i].executable.store(nullptr, std::memory_order_relaxed);
+        entries_[i].typeName = nullptr;
+        entries_[i].runTime.clear();
+    }
+    other_.executable.store(nullptr, std::memory_order_relaxed);
+    other_.typeName = nullptr;
+    other_.runTime.clear();
+    numEntries_ = 0;
+}
+
+ExecutorStats::AtomicEntry *ExecutorStats::lookup(Executable *e)
+{
+    unsigned pos = (((uintptr_t)e) >> 3) % MAX_EXECUTABLES;
+    for (unsigned i = 0; i < MAX_EXECUTABLES; ++i)
+    {
+        AtomicEntry *entry = &entries_[pos];
+        const Executable *key =
+            entry->executable.load(std::memory_order_relaxed);
+        if (key == e)
+        {
+            return entry;
+        }
+        if (!key)
+        {
+            // Keep a quarter of the table free so that lookups stay short.
+            if (numEntries_ >= MAX_EXECUTABLES * 3 / 4)
+            {
+                break;
+            }
+            ++numEntries_;
+#ifdef __GXX_RTTI
+            entry->typeName = typeid(*e).name();
+#endif
+            // Publishes the type name together with the key.
+            entry->executable.store(e, std::memory_order_release);
+            return entry;
+        }
+        pos = (pos + 1) % MAX_EXECUTABLES;
+    }
+    return &other_;
+}
+
+ExecutorStats::AtomicEntry *ExecutorStats::record_start(
+    Executable *e, unsigned priority, unsigned depth, long long queued_nsec)
+{
+    if (priority >= MAX_PRIO)
+    {
+        priority = MAX_PRIO - 1;
+    }
+    AtomicPriority *p = &priority_[priority];
+    p->depth.store(depth, std::memory_order_relaxed);
+    if (depth > p->maxDepth.load(std::memory_order_relaxed))
+    {
+        p->maxDepth.store(depth, std::memory_order_relaxed);
+    }
+    if (queued_nsec >= 0)
+    {
+        p->latency.add(queued_nsec);
+    }
+    return lookup(e);
+}
+
+void ExecutorStats::record_finish(AtomicEntry *entry, long long run_nsec)
+{
+    if (entry != &other_ && !entry->executable.load(std::memory_order_relaxed))
+    {
+        // The counters were reset while this executable was running.
+        return;
+    }
+    entry->runTime.add(run_nsec);
+}
+
+void ExecutorStats::snapshot(Snapshot *s)
+{
+    for (unsigned i = 0; i < MAX_PRIO; ++i)
+    {
+        s->priority[i].depth =
+            priority_[i].depth.load(std::memory_order_relaxed);
+        s->priority[i].maxDepth =
+            priority_[i].maxDepth.load(std::memory_order_relaxed);
+        priority_[i].latency.copy(&s->priority[i].latency);
+    }
+    s->executables.clear();
+    for (unsigned i = 0; i < MAX_EXECUTABLES; ++i)
+    {
+        const Executable *e =
+            entries_[i].executable.load(std::memory_order_acquire);
+        if (!e)
+        {
+            continue;
+        }
+        s->executables.emplace_back();
+        Entry &out = s->executables.back();
+        out.executable = e;
+        out.typeName = entries_[i].typeName;
+        entries_[i].runTime.copy(&out.runTime);
+    }
+    Entry other;
+    other.executable = nullptr;
+    other.typeName = nullptr;
+    other_.runTime.copy(&other.runTime);
+    if (other.runTime.count)
+    {
+        s->executables.push_back(other);
+    }
+    std::sort(s->executables.begin(), s->executables.end(),
+        [](const Entry &a, const Entry &b) {
+            return a.runTime.totalUsec > b.runTime.totalUsec;
+        });
+}
+
+void ExecutorStats::print(FILE *fp)
+{
+    Snapshot s;
+    snapshot(&s);
+    print(fp, s);
+}
+
+/// Prints the bucket counts of a histogram.
+static void print_buckets(FILE *fp, const ExecutorStats::Histogram &h)
+{
+    for (unsigned i = 0; i < ExecutorStats::NUM_BUCKETS; ++i)
+    {
+        fprintf(fp, " %u", (unsigned)h.buckets[i]);
+    }
+    fprintf(fp, "\n");
+}
+
+void ExecutorStats::print(FILE *fp, const Snapshot &s)
+{
+    fprintf(fp, "prio depth max  count  avg_us  max_us | latency buckets "
+                "(<1us, <2us, <4us, ...)\n");
+    for (unsigned i = 0; i < MAX_PRIO; ++i)
+    {
+        const Priority &p = s.priority[i];
+        if (!p.latency.count && !p.maxDepth)
+        {
+            continue;
+        }
+        fprintf(fp, "%4u %5u %3u %6u %7u %7u |", i, (unsigned)p.depth,
+            (unsigned)p.maxDepth, (unsigned)p.latency.count,
+            p.latency.count ? (unsigned)(p.latency.totalUsec / p.latency.count)
+                            : 0u,
+            (unsigned)p.latency.maxUsec);
+        print_buckets(fp, p.latency);
+    }
+    fprintf(fp, "executable       runs  total_us  max_us | run time buckets; "
+                "type\n");
+    for (const Entry &e : s.executables)
+    {
+        const Histogram &h = e.runTime;
+        if (e.executable)
+        {
+            fprintf(fp, "%14p", e.executable);
+        }
+        else
+        {
+            fprintf(fp, "%14s", "(other)");
+        }
+        fprintf(fp, " %6u %9u %7u |", (unsigned)h.count,
+            (unsigned)h.totalUsec, (unsigned)h.maxUsec);
+        for (unsigned i = 0; i < NUM_BUCKETS; ++i)
+        {
+            fprintf(fp, " %u", (unsigned)h.buckets[i]);
+        }
+        if (e.typeName)
+        {
+#ifdef __GXX_RTTI
+            int status = -1;
+            char *name =
+                abi::__cxa_demangle(e.typeName, nullptr, nullptr, &status);
+            fprintf(fp, "; %s", status == 0 ? name : e.typeName);
+            free(name);
+#else
+            fprintf(fp, "; %s", e.typeName);
+#endif
+        }
+        fprintf(fp, "\n");
+    }
+}
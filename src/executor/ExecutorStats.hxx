@@ -0,0 +1,207 @@
+/** \copyright
+ * Copyright (c) 2026, agent
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are  permitted provided that the following conditions are met:
+ *
+ *  - Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ *  - Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ * \file ExecutorStats.hxx
+ *
+ * Optional instrumentation of the executor: queue depths, queueing latency
+ * and run time of the executables.
+ *
+ * @author agent
+ * @date 19 Oct 2026
+ */
+
+#ifndef _EXECUTOR_EXECUTORSTATS_HXX_
+#define _EXECUTOR_EXECUTORSTATS_HXX_
+
+/// Set to 1 (e.g. -DEXECUTOR_STATS=1 for the whole build) to compile the
+/// executor instrumentation in. It adds a field to every Executable. When
+/// compiled in, it still has to be turned on with ExecutorBase::enable_stats().
+#ifndef EXECUTOR_STATS
+#define EXECUTOR_STATS 0
+#endif
+
+/// Set to 1 (e.g. -DEXECUTOR_LOAD_STATS=1 for the whole build) to compile in
+/// the idle time accounting of the executors, which ExecutorLoad samples.
+#ifndef EXECUTOR_LOAD_STATS
+#define EXECUTOR_LOAD_STATS 0
+#endif
+
+#include <atomic>
+#include <stdint.h>
+#include <stdio.h>
+#include <vector>
+
+class Executable;
+
+/// Counters collected by an executor about the executables it runs. Written
+/// only by the executor thread; any thread may take a snapshot. The counters
+/// are independent relaxed atomics, so a snapshot taken while the executor is
+/// running may be off by the executable currently being recorded.
+class ExecutorStats
+{
+public:
+    /// Number of priority bands tracked. Higher priorities are counted in the
+    /// last band.
+    static constexpr unsigned MAX_PRIO = 8;
+    /// Number of histogram buckets. Bucket 0 counts durations below 1 usec,
+    /// bucket i counts [2^(i-1), 2^i) usec, the last bucket everything above.
+    static constexpr unsigned NUM_BUCKETS = 16;
+    /// Number of executables whose run time is tracked separately. The rest
+    /// is counted together.
+    static constexpr unsigned MAX_EXECUTABLES = 64;
+
+    /// Copy of a histogram.
+    struct Histogram
+    {
+        /// Number of samples.
+        uint32_t count;
+        /// Sum of the samples in usec. Wraps around after 71 minutes.
+        uint32_t totalUsec;
+        /// Largest sample in usec.
+        uint32_t maxUsec;
+        /// Number of samples per bucket.
+        uint32_t buckets[NUM_BUCKETS];
+    };
+
+    /// Copy of the counters of one priority band.
+    struct Priority
+    {
+        /// Number of executables that were waiting in this band when the
+        /// last one was taken off the queue.
+        uint32_t depth;
+        /// Largest depth seen.
+        uint32_t maxDepth;
+        /// Time from Executor::add() to starting run().
+        Histogram latency;
+    };
+
+    /// Copy of the counters of one executable.
+    struct Entry
+    {
+        /// The executable. May not exist anymore. nullptr for the entry
+        /// counting every executable that did not fit into the table.
+        const Executable *executable;
+        /// Mangled type name of the executable, or nullptr if not known.
+        const char *typeName;
+        /// Duration of the run() calls.
+        Histogram runTime;
+    };
+
+    /// Copy of all counters.
+    struct Snapshot
+    {
+        /// Per priority band.
+        Priority priority[MAX_PRIO];
+        /// Per executable, ordered by decreasing total run time.
+        std::vector<Entry> executables;
+    };
+
+    /// Counters of one executable. Opaque to the users.
+    struct AtomicEntry;
+
+    ExecutorStats();
+
+    /// Records that an executable is about to run. Called on the executor
+    /// thread.
+    /// @param e is the executable taken off the queue.
+    /// @param priority is the band it was taken from.
+    /// @param depth is how many executables are still waiting in that band.
+    /// @param queued_nsec is the time since it was added to the queue, or
+    /// negative if not known.
+    /// @return handle to pass to record_finish. (The executable may delete
+    /// itself in run().)
+    AtomicEntry *record_start(
+        Executable *e, unsigned priority, unsigned depth, long long queued_nsec);
+
+    /// Records the run time of an executable.
+    /// @param entry is what record_start returned.
+    /// @param run_nsec is how long run() took.
+    void record_finish(AtomicEntry *entry, long long run_nsec);
+
+    /// Copies all counters. @param s is where to copy to.
+    void snapshot(Snapshot *s);
+
+    /// Clears all counters. Must be called on the executor thread, or when
+    /// the instrumentation is turned off.
+    void reset();
+
+    /// Prints a human-readable table of the counters.
+    /// @param fp is where to print to.
+    void print(FILE *fp);
+
+    /// Prints a snapshot. @param fp is where to print to. @param s is the
+    /// snapshot.
+    static void print(FILE *fp, const Snapshot &s);
+
+private:
+    /// Histogram of durations with atomic counters.
+    struct AtomicHistogram
+    {
+        std::atomic<uint32_t> count;
+        std::atomic<uint32_t> totalUsec;
+        std::atomic<uint32_t> maxUsec;
+        std::atomic<uint32_t> buckets[NUM_BUCKETS];
+
+        /// Adds a sample. Single writer. @param nsec is the sample.
+        void add(long long nsec);
+        /// Copies the counters. @param h is where to copy to.
+        void copy(Histogram *h);
+        /// Zeroes the counters.
+        void clear();
+    };
+
+    /// Counters of a priority band.
+    struct AtomicPriority
+    {
+        std::atomic<uint32_t> depth;
+        std::atomic<uint32_t> maxDepth;
+        AtomicHistogram latency;
+    };
+
+public:
+    /// Counters of an executable.
+    struct AtomicEntry
+    {
+        /// Key of the open addressing table. nullptr if the entry is free.
+        std::atomic<const Executable *> executable;
+        const char *typeName;
+        AtomicHistogram runTime;
+    };
+
+private:
+    /// @return the table entry for an executable; allocates one if needed.
+    AtomicEntry *lookup(Executable *e);
+
+    AtomicPriority priority_[MAX_PRIO];
+    /// Open addressing hash table of the executables.
+    AtomicEntry entries_[MAX_EXECUTABLES];
+    /// Executables that did not fit into the table.
+    AtomicEntry other_;
+    /// Number of used entries.
+    unsigned numEntries_;
+};
+
+#endif // _EXECUTOR_EXECUTORSTATS_HXX_
@@ -77,6 +77,7 @@ void StateFlowBase::run()
     HASSERT(state_);
     do
     {
+        STATEFLOW_TRACE_STATE(this, state_);
         Action action = (this->*state_)();
         if (!action.next_state())
         {
@@ -95,6 +96,7 @@ StateFlowBase::Action StateFlowWithQueue::wait_for_message()
     currentMessage_ = static_cast<BufferBase *>(queue_next(&priority));
     if (currentMessage_)
     {
+        STATEFLOW_TRACE_DEQUEUE(this, currentMessage_);
         isWaiting_ = 0;
         currentPriority_ = priority;
         queueSize_--;
@@ -41,6 +41,7 @@
 #include <sys/stat.h>
 
 #include "executor/Service.hxx"
+#include "executor/StateFlowTrace.hxx"
 #include "executor/Timer.hxx"
 #include "utils/Buffer.hxx"
 #include "utils/Queue.hxx"
@@ -1204,6 +1205,7 @@ protected:
      */
     void send(BufferBase *msg, unsigned priority = UINT_MAX)
     {
+        STATEFLOW_TRACE_SEND(this, msg, priority);
         AtomicHolder h(this);
         queue_.insert(msg, priority);
         queueSize_ = queue_.size();
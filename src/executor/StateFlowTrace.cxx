@@ -0,0 +1,382 @@
+/** \copyright
+ * Copyright (c) 2026, agent
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are  permitted provided that the following conditions are met:
+ *
+ *  - Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ *  - Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ * \file StateFlowTrace.cxx
+ *
+ * Tracing of state flow execution and message passing, with export to the
+ * Chrome trace event format (chrome://tracing, ui.perfetto.dev).
+ *
+ * @author agent
+ * @date 19 Oct 2026
+ */
+
+#include "executor/StateFlowTrace.hxx"
+
+#ifdef STATEFLOW_TRACE_SUPPORTED
+
+#include <algorithm>
+#include <map>
+#include <mutex>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string>
+#include <utility>
+#include <vector>
+#ifdef __GXX_RTTI
+#include <cxxabi.h>
+#endif
+
+namespace stateflow_trace
+{
+
+std::atomic<bool> g_enabled{false};
+
+/// What happened.
+enum EventType : uint8_t
+{
+    /// A state function ran.
+    STATE,
+    /// A message was added to the queue of a flow.
+    SEND,
+    /// A flow took a message off its queue.
+    DEQUEUE,
+};
+
+/// One recorded event.
+struct Event
+{
+    /// When it happened (for STATE: when it started), in nsec.
+    long long time;
+    /// The state flow.
+    const void *flow;
+    /// Dynamic type of the flow (STATE, SEND).
+    const char *typeName;
+    /// Message buffer (SEND, DEQUEUE) or state function address (STATE).
+    uintptr_t arg;
+    /// Duration in nsec (STATE) or message priority (SEND).
+    uint32_t value;
+    /// Which field is which.
+    EventType type;
+};
+
+/// Events of one thread. Written only by that thread.
+struct Ring
+{
+    /// Number of events written since the last clear. The event n is at
+    /// index n % RING_SIZE.
+    std::atomic<uint32_t> count{0};
+    /// Set when the owning thread exited.
+    std::atomic<bool> orphaned{false};
+    /// Sequential id of the thread, used as tid in the output.
+    unsigned tid;
+    /// Name of the thread.
+    char name[16];
+    /// Next ring in the list of all rings.
+    Ring *next{nullptr};
+    /// Event storage.
+    Event events[RING_SIZE];
+};
+
+/// Protects g_rings.
+static std::mutex g_rings_lock;
+/// All rings.
+static Ring *g_rings = nullptr;
+/// Next tid to assign.
+static unsigned g_next_tid = 1;
+
+/// Owns the ring of a thread; marks the ring orphaned when the thread exits.
+/// The ring stays around until the next clear, so the events of exited
+/// threads can still be written out.
+struct ThreadRing
+{
+    ~ThreadRing()
+    {
+        if (ring)
+        {
+            ring->orphaned.store(true);
+        }
+    }
+
+    /// The ring of this thread, or nullptr if it did not record yet.
+    Ring *ring{nullptr};
+};
+
+static thread_local ThreadRing t_ring;
+
+/// @return the ring of the calling thread; creates it on first use.
+static Ring *thread_ring()
+{
+    Ring *r = t_ring.ring;
+    if (!r)
+    {
+        r = new Ring;
+        r->name[0] = 0;
+        pthread_getname_np(pthread_self(), r->name, sizeof(r->name));
+        std::lock_guard<std::mutex> l(g_rings_lock);
+        r->tid = g_next_tid++;
+        r->next = g_rings;
+        g_rings = r;
+        t_ring.ring = r;
+    }
+    return r;
+}
+
+/// Appends an event to the ring of the calling thread. The event is filled
+/// in before the count is published, so a concurrent reader never sees a
+/// half-written event.
+/// @param event is what to record.
+static void add_event(const Event &event)
+{
+    Ring *r = thread_ring();
+    uint32_t c = r->count.load(std::memory_order_relaxed);
+    r->events[c % RING_SIZE] = event;
+    r->count.store(c + 1, std::memory_order_release);
+}
+
+void record_state(
+    const void *flow, const char *type_name, uintptr_t state, long long start)
+{
+    long long now = os_get_time_monotonic();
+    add_event({start, flow, type_name, state,
+        (uint32_t)std::min(now - start, 0xFFFFFFFFLL), STATE});
+}
+
+void record_send(
+    const void *flow, const char *type_name, const void *msg, unsigned priority)
+{
+    add_event({os_get_time_monotonic(), flow, type_name, (uintptr_t)msg,
+        priority, SEND});
+}
+
+void record_dequeue(const void *flow, const void *msg)
+{
+    add_event(
+        {os_get_time_monotonic(), flow, nullptr, (uintptr_t)msg, 0, DEQUEUE});
+}
+
+/// Writes a string as a JSON string literal. @param fp is the output. @param s
+/// is the string.
+static void write_json_string(FILE *fp, const char *s)
+{
+    fputc('"', fp);
+    for (; *s; ++s)
+    {
+        if (*s == '"' || *s == '\\')
+        {
+            fputc('\\', fp);
+            fputc(*s, fp);
+        }
+        else if ((unsigned char)*s < 0x20)
+        {
+            fprintf(fp, "\\u%04x", (unsigned char)*s);
+        }
+        else
+        {
+            fputc(*s, fp);
+        }
+    }
+    fputc('"', fp);
+}
+
+/// Writes the (demangled) type name of a flow as a JSON string. @param fp is
+/// the output. @param type_name is the mangled name or nullptr.
+static void write_type_name(FILE *fp, const char *type_name)
+{
+    if (!type_name)
+    {
+        write_json_string(fp, "StateFlow");
+        return;
+    }
+#ifdef __GXX_RTTI
+    int status = -1;
+    char *name = abi::__cxa_demangle(type_name, nullptr, nullptr, &status);
+    write_json_string(fp, status == 0 ? name : type_name);
+    free(name);
+#else
+    write_json_string(fp, type_name);
+#endif
+}
+
+/// Writes the common fields of an event. @param fp is the output. @param
+/// ph is the event phase. @param tid is the thread. @param time is the event
+/// time in nsec.
+static void write_header(FILE *fp, const char *ph, unsigned tid, long long time)
+{
+    fprintf(fp, "\"ph\":\"%s\",\"pid\":1,\"tid\":%u,\"ts\":%lld.%03u", ph, tid,
+        time / 1000, (unsigned)(time % 1000));
+}
+
+/// An event together with the thread it came from.
+struct SortedEvent
+{
+    const Event *event;
+    unsigned tid;
+    /// For STATE: the message the flow was working on.
+    uintptr_t msg;
+};
+
+} // namespace stateflow_trace
+
+using namespace stateflow_trace;
+
+void stateflow_trace_start()
+{
+    g_enabled.store(true);
+}
+
+void stateflow_trace_stop()
+{
+    g_enabled.store(false);
+}
+
+void stateflow_trace_clear()
+{
+    std::lock_guard<std::mutex> l(g_rings_lock);
+    Ring **rp = &g_rings;
+    while (*rp)
+    {
+        Ring *r = *rp;
+        if (r->orphaned.load())
+        {
+            *rp = r->next;
+            delete r;
+            continue;
+        }
+        r->count.store(0);
+        rp = &r->next;
+    }
+}
+
+void stateflow_trace_write_json(FILE *fp)
+{
+    std::vector<SortedEvent> events;
+    fprintf(fp, "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[\n");
+    bool first = true;
+    {
+        std::lock_guard<std::mutex> l(g_rings_lock);
+        for (Ring *r = g_rings; r; r = r->next)
+        {
+            fprintf(fp, "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,"
+                        "\"tid\":%u,\"args\":{\"name\":",
+                first ? "" : ",\n", r->tid);
+            first = false;
+            write_json_string(fp, r->name[0] ? r->name : "thread");
+            fprintf(fp, "}}");
+            uint32_t count = r->count.load(std::memory_order_acquire);
+            uint32_t begin = count > RING_SIZE ? count - RING_SIZE : 0;
+            // A flow runs on a single thread, so the message a flow is
+            // working on can be followed in the order of that thread's
+            // events. The DEQUEUE is recorded inside the wait_for_message
+            // state, before that state's own event.
+            std::map<const void *, uintptr_t> current;
+            for (uint32_t i = begin; i != count; ++i)
+            {
+                const Event *e = &r->events[i % RING_SIZE];
+                uintptr_t msg = 0;
+                if (e->type == DEQUEUE)
+                {
+                    current[e->flow] = e->arg;
+                }
+                else if (e->type == STATE)
+                {
+                    auto it = current.find(e->flow);
+                    if (it != current.end())
+                    {
+                        msg = it->second;
+                    }
+                }
+                events.push_back({e, r->tid, msg});
+            }
+        }
+        // The rings are not freed while we hold pointers into them.
+        std::stable_sort(events.begin(), events.end(),
+            [](const SortedEvent &a, const SortedEvent &b) {
+                return a.event->time < b.event->time;
+            });
+        // Pending sends, keyed by (receiving flow, message), with the id of
+        // the arrow.
+        std::map<std::pair<const void *, uintptr_t>, unsigned> pending;
+        unsigned next_id = 1;
+        for (const SortedEvent &se : events)
+        {
+            const Event *e = se.event;
+            switch (e->type)
+            {
+                case STATE:
+                    fprintf(fp, ",\n{\"name\":");
+                    write_type_name(fp, e->typeName);
+                    fprintf(fp, ",\"cat\":\"state\",");
+                    write_header(fp, "X", se.tid, e->time);
+                    fprintf(fp,
+                        ",\"dur\":%u.%03u,\"args\":{\"flow\":\"%p\","
+                        "\"state\":\"%p\"",
+                        e->value / 1000, e->value % 1000, e->flow,
+                        (void *)e->arg);
+                    if (se.msg)
+                    {
+                        fprintf(fp, ",\"msg\":\"%p\"", (void *)se.msg);
+                    }
+                    fprintf(fp, "}}");
+                    break;
+                case SEND:
+                {
+                    unsigned id = next_id++;
+                    pending[std::make_pair(e->flow, e->arg)] = id;
+                    fprintf(fp, ",\n{\"name\":\"send\",\"cat\":\"send\",");
+                    write_header(fp, "i", se.tid, e->time);
+                    fprintf(fp, ",\"s\":\"t\",\"args\":{\"to\":");
+                    write_type_name(fp, e->typeName);
+                    fprintf(fp,
+                        ",\"flow\":\"%p\",\"msg\":\"%p\",\"priority\":%u}}",
+                        e->flow, (void *)e->arg, e->value);
+                    fprintf(fp, ",\n{\"name\":\"msg\",\"cat\":\"msg\",");
+                    write_header(fp, "s", se.tid, e->time);
+                    fprintf(fp, ",\"id\":%u}", id);
+                    break;
+                }
+                case DEQUEUE:
+                {
+                    auto it = pending.find(std::make_pair(e->flow, e->arg));
+                    if (it == pending.end())
+                    {
+                        // The send was overwritten in the ring.
+                        break;
+                    }
+                    // Binds to the enclosing slice, which is the
+                    // wait_for_message state of the receiving flow.
+                    fprintf(fp, ",\n{\"name\":\"msg\",\"cat\":\"msg\",");
+                    write_header(fp, "f", se.tid, e->time);
+                    fprintf(fp, ",\"bp\":\"e\",\"id\":%u}", it->second);
+                    pending.erase(it);
+                    break;
+                }
+            }
+        }
+    }
+    fprintf(fp, "\n]}\n");
+}
+
+#endif // STATEFLOW_TRACE_SUPPORTED
@@ -0,0 +1,244 @@
+/** \copyright
+ * Copyright (c) 2026, agent
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are  permitted provided that the following conditions are met:
+ *
+ *  - Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ *  - Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ * \file StateFlowTrace.hxx
+ *
+ * Tracing of state flow execution and message passing, with export to the
+ * Chrome trace event format (chrome://tracing, ui.perfetto.dev).
+ *
+ * The hooks in the state flow code are compiled in only when the whole build
+ * has -DSTATEFLOW_TRACE=1. The recorder itself is part of the library on host
+ * platforms, but it does not get linked into binaries that have no hooks.
+ *
+ * @author agent
+ * @date 19 Oct 2026
+ */
+
+#ifndef _EXECUTOR_STATEFLOWTRACE_HXX_
+#define _EXECUTOR_STATEFLOWTRACE_HXX_
+
+/// Set to 1 (for the entire build) to compile the tracing hooks into the
+/// state flows. When compiled in, tracing still has to be turned on with
+/// stateflow_trace_start().
+#ifndef STATEFLOW_TRACE
+#define STATEFLOW_TRACE 0
+#endif
+
+#if defined(__linux__) || defined(__MACH__)
+#define STATEFLOW_TRACE_SUPPORTED
+#elif STATEFLOW_TRACE
+#error "StateFlow tracing is only supported on host platforms."
+#endif
+
+#ifdef STATEFLOW_TRACE_SUPPORTED
+
+#include <atomic>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#ifdef __GXX_RTTI
+#include <typeinfo>
+#endif
+
+#include "os/os.h"
+
+namespace stateflow_trace
+{
+
+/// Number of events kept per thread. When a thread records more, the oldest
+/// ones are overwritten.
+static constexpr unsigned RING_SIZE = 8192;
+
+/// True when the events are recorded.
+extern std::atomic<bool> g_enabled;
+
+/// Records that a state function ran.
+/// @param flow is the state flow.
+/// @param type_name is the mangled type name of the flow, or nullptr.
+/// @param state is the address of the state function.
+/// @param start_nsec is when the state function was called.
+void record_state(const void *flow, const char *type_name, uintptr_t state,
+    long long start_nsec);
+
+/// Records that a message was added to the queue of a state flow.
+/// @param flow is the receiving state flow.
+/// @param type_name is the mangled type name of the flow, or nullptr.
+/// @param msg is the message buffer.
+/// @param priority is the priority of the message.
+void record_send(
+    const void *flow, const char *type_name, const void *msg, unsigned priority);
+
+/// Records that a state flow took a message off its queue.
+/// @param flow is the state flow.
+/// @param msg is the message buffer.
+void record_dequeue(const void *flow, const void *msg);
+
+/// @return the mangled dynamic type name of an object, or nullptr if there
+/// is no RTTI.
+template <class T> const char *type_name(const T *obj)
+{
+#ifdef __GXX_RTTI
+    return typeid(*obj).name();
+#else
+    return nullptr;
+#endif
+}
+
+/// Computes the code address that a pointer-to-member-function would call.
+/// Follows the Itanium C++ ABI, including the ARM variant.
+/// @param obj is the object the function would be called on.
+/// @param fn is the pointer to member function.
+/// @return the code address, usable with addr2line.
+template <class T, class Fn> uintptr_t state_address(const T *obj, Fn fn)
+{
+    static_assert(sizeof(fn) == 2 * sizeof(uintptr_t), "Itanium ABI");
+    uintptr_t parts[2];
+    memcpy(parts, &fn, sizeof(parts));
+#if defined(__arm__) || defined(__aarch64__)
+    bool is_virtual = parts[1] & 1;
+    intptr_t adj = ((intptr_t)parts[1]) >> 1;
+#else
+    bool is_virtual = parts[0] & 1;
+    intptr_t adj = parts[1];
+#endif
+    if (!is_virtual)
+    {
+        return parts[0];
+    }
+    const char *vptr = *(const char *const *)((const char *)obj + adj);
+#if defined(__arm__) || defined(__aarch64__)
+    return *(const uintptr_t *)(vptr + parts[0]);
+#else
+    return *(const uintptr_t *)(vptr + parts[0] - 1);
+#endif
+}
+
+/// Records the execution of one state function. Create it right before
+/// calling the state function; the destructor records the event. Nothing
+/// about the flow is accessed after construction, because the state function
+/// may delete the flow.
+class StateScope
+{
+public:
+    /// Constructor. @param flow is the state flow. @param state is the state
+    /// function about to be called.
+    template <class T, class Fn>
+    StateScope(const T *flow, Fn state)
+    {
+        if (!g_enabled.load(std::memory_order_relaxed))
+        {
+            flow_ = nullptr;
+            return;
+        }
+        flow_ = flow;
+        typeName_ = type_name(flow);
+        state_ = state_address(flow, state);
+        start_ = os_get_time_monotonic();
+    }
+
+    ~StateScope()
+    {
+        if (flow_)
+        {
+            record_state(flow_, typeName_, state_, start_);
+        }
+    }
+
+private:
+    /// The flow, nullptr if not recording.
+    const void *flow_;
+    /// Dynamic type of the flow.
+    const char *typeName_;
+    /// Code address of the state function.
+    uintptr_t state_;
+    /// When the state function was called.
+    long long start_;
+};
+
+} // namespace stateflow_trace
+
+/// Starts recording state flow events. Has an effect only if the state flows
+/// were compiled with STATEFLOW_TRACE.
+void stateflow_trace_start();
+
+/// Stops recording state flow events. The recorded events are kept.
+void stateflow_trace_stop();
+
+/// Discards all recorded events.
+void stateflow_trace_clear();
+
+/// Writes the recorded events in the Chrome trace event JSON format. State
+/// functions become slices on the thread (executor) they ran on; sends
+/// become instant events with an arrow to the state flow that took the
+/// message off its queue. Stop the tracing before calling this, otherwise
+/// the events being recorded concurrently may come out garbled.
+/// @param fp is where to write to.
+void stateflow_trace_write_json(FILE *fp);
+
+#endif // STATEFLOW_TRACE_SUPPORTED
+
+#if STATEFLOW_TRACE
+
+/// Records the execution of the state function the flow is about to call.
+#define STATEFLOW_TRACE_STATE(flow, state)                                     \
+    ::stateflow_trace::StateScope stateflow_trace_scope(flow, state)
+
+/// Records that a message was added to the queue of a state flow.
+#define STATEFLOW_TRACE_SEND(flow, msg, priority)                              \
+    do                                                                         \
+    {                                                                          \
+        if (::stateflow_trace::g_enabled.load(std::memory_order_relaxed))      \
+        {                                                                      \
+            ::stateflow_trace::record_send(flow,                               \
+                ::stateflow_trace::type_name(flow), msg, priority);            \
+        }                                                                      \
+    } while (0)
+
+/// Records that a state flow took a message off its queue.
+#define STATEFLOW_TRACE_DEQUEUE(flow, msg)                                     \
+    do                                                                         \
+    {                                                                          \
+        if (::stateflow_trace::g_enabled.load(std::memory_order_relaxed))      \
+        {                                                                      \
+            ::stateflow_trace::record_dequeue(flow, msg);                      \
+        }                                                                      \
+    } while (0)
+
+#else
+
+#define STATEFLOW_TRACE_STATE(flow, state)
+#define STATEFLOW_TRACE_SEND(flow, msg, priority)                              \
+    do                                                                         \
+    {                                                                          \
+    } while (0)
+#define STATEFLOW_TRACE_DEQUEUE(flow, msg)                                     \
+    do                                                                         \
+    {                                                                          \
+    } while (0)
+
+#endif // STATEFLOW_TRACE
+
+#endif // _EXECUTOR_STATEFLOWTRACE_HXX_
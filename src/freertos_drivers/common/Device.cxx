@@ -319,6 +319,27 @@ int Device::fcntl(int fd, int cmd, unsigned long data)
     }
 }
 
+/** Writes any data buffered by the device driver to the storage.
+ * @param fd file descriptor
+ * @return 0 upon success, -1 upon failure with errno containing the cause
+ */
+int Device::fsync(int fd)
+{
+    File* f = file_lookup(fd);
+    if (!f)
+    {
+        /* errno should already be set appropriately */
+        return -1;
+    }
+    int result = f->dev->fsync(f);
+    if (result < 0)
+    {
+        errno = -result;
+        return -1;
+    }
+    return result;
+}
+
 /** Seek method.
  * @param f file reference for this device
  * @param offset offset in bytes from whence directive
@@ -369,6 +390,15 @@ int Device::fcntl(File *file, int cmd, unsigned long data)
     }
 }
 
+/** Writes any data buffered by the device driver to the storage.
+ * @param file file reference for this device
+ * @return 0 upon success or negative error number upon error.
+ */
+int Device::fsync(File *)
+{
+    return 0;
+}
+
 /** Allocate a free file descriptor.
  * @return file number on success, else -1 on failure
  */
@@ -158,6 +158,12 @@ public:
      */
     static int fcntl(int fd, int cmd, unsigned long data);
 
+    /** Writes any data buffered by the device driver to the storage.
+     * @param fd file descriptor
+     * @return 0 upon success, -1 upon failure with errno containing the cause
+     */
+    static int fsync(int fd);
+
 protected:
     /** Open method. @return negative errno on failure, or positive fd on
      * success. */
@@ -209,6 +215,13 @@ protected:
      */
     virtual int fcntl(File *file, int cmd, unsigned long data);
 
+    /** Writes any data buffered by the device driver to the storage. Default
+     * implementation does nothing.
+     * @param file file reference for this device
+     * @return 0 upon success or negative error number upon error.
+     */
+    virtual int fsync(File *file);
+
     /** Device select method. Default impementation returns true.
      * @param file reference to the file
      * @param mode FREAD for read active, FWRITE for write active, 0 for
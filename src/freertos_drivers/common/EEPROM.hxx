@@ -83,6 +83,25 @@ protected:
         return fileSize;
     }
 
+public:
+    /** Writes all data that the driver buffered in RAM to the storage. This
+     * is what fsync() and closing the last file handle of the device do. */
+    void sync()
+    {
+        OSMutexLock l(&lock_);
+        flush_buffers();
+    }
+
+protected:
+    /** Writes the data that the driver buffered in RAM to the storage. The
+     * default implementation does nothing, as write() is synchronous. Unlike
+     * for other devices, pending data is written out instead of being
+     * dropped, because dropping it would lose configuration updates. Called
+     * with lock_ held. */
+    void flush_buffers() OVERRIDE
+    {
+    }
+
 private:
     size_t fileSize; /**< Maximum file size we can grow to */
 
@@ -120,11 +139,25 @@ private:
      */
     off_t lseek(File* file, off_t offset, int whence) OVERRIDE;
 
+    /** Writes buffered data to the storage.
+     * @param file file reference for this device
+     * @return 0 upon success
+     */
+    int fsync(File *file) OVERRIDE
+    {
+        sync();
+        return 0;
+    }
+
     void enable() OVERRIDE {} /**< function to enable device */
-    void disable() OVERRIDE {}; /**< function to disable device */
 
-    /** Discards all pending buffers. Called after disable(). */
-    void flush_buffers() OVERRIDE {}
+    /** Called when the last file handle is closed. Writes buffered data to
+     * the storage, so that closing the device after a batch of updates is
+     * enough to persist them. */
+    void disable() OVERRIDE
+    {
+        flush_buffers();
+    }
 
     /** Default constructor.
      */
@@ -35,6 +35,8 @@
 
 #include <cstring>
 
+#include "executor/StateFlow.hxx"
+
 const size_t EEPROMEmulation::HEADER_BLOCK_COUNT = 3;
 
 const uint32_t EEPROMEmulation::MAGIC_DIRTY = 0xaa55aa55;
@@ -58,6 +60,80 @@ EEPROMEmulation::EEPROMEmulation(const char *name, size_t file_size)
     HASSERT((BLOCK_SIZE % 4) == 0); // block size must be on 4 byte boundary
 }
 
+/** Writes the write cache of an EEPROMEmulation to flash a fixed time after
+ * the first write into the empty cache. */
+class EEPROMEmulation::FlushFlow : public StateFlowBase
+{
+public:
+    /** Constructor.
+     * @param service defines the executor to run on
+     * @param parent the eeprom whose cache to flush
+     * @param delay_msec how long to wait after the first pending write
+     */
+    FlushFlow(Service *service, EEPROMEmulation *parent, unsigned delay_msec)
+        : StateFlowBase(service)
+        , parent_(parent)
+        , delayNsec_(MSEC_TO_NSEC(delay_msec))
+    {
+        start_flow(STATE(idle));
+    }
+
+    /** Starts the timer unless it is running already. Must be called with
+     * the eeprom lock held. */
+    void kick()
+    {
+        if (!pending_)
+        {
+            pending_ = true;
+            notify();
+        }
+    }
+
+private:
+    /** Waits for the cache to become dirty. */
+    Action idle()
+    {
+        OSMutexLock h(&parent_->lock_);
+        if (parent_->cacheUsed_)
+        {
+            // Data was written before we got here the first time.
+            return call_immediately(STATE(delay));
+        }
+        pending_ = false;
+        return wait_and_call(STATE(delay));
+    }
+
+    /** Starts the timer. */
+    Action delay()
+    {
+        return sleep_and_call(&timer_, delayNsec_, STATE(flush));
+    }
+
+    /** Writes the cache to flash. */
+    Action flush()
+    {
+        parent_->sync();
+        return call_immediately(STATE(idle));
+    }
+
+    /// The eeprom whose cache we are writing.
+    EEPROMEmulation *parent_;
+    /// How long to wait after the first pending write.
+    long long delayNsec_;
+    /// Helper for sleeping.
+    StateFlowTimer timer_{this};
+    /// True if the flow was notified or is on its way to flushing. Protected
+    /// by the lock of the eeprom.
+    bool pending_{true};
+};
+
+/** Destructor.
+ */
+EEPROMEmulation::~EEPROMEmulation()
+{
+    delete flushFlow_;
+}
+
 /** Mount the EEPROM file.
  */
 void EEPROMEmulation::mount()
@@ -103,6 +179,14 @@ void EEPROMEmulation::mount()
         }
     }
 
+    if (WRITE_CACHE_BLOCKS && !cacheIndex_)
+    {
+        cacheIndex_ = new uint16_t[WRITE_CACHE_BLOCKS];
+        cacheData_ = new uint8_t[WRITE_CACHE_BLOCKS * BYTES_PER_BLOCK];
+    }
+    cacheUsed_ = 0;
+    memset(&stats_, 0, sizeof(stats_));
+
     /* do we shadow_ the data in RAM to speed up reads */
     if (SHADOW_IN_RAM)
     {
@@ -149,7 +233,7 @@ void EEPROMEmulation::write(unsigned int index, const void *buf, size_t len)
             {
                 /* at least some data has changed */
                 memcpy(data + lsa, byte_data, write_size);
-                write_fblock(index / BYTES_PER_BLOCK, data);
+                commit_fblock(index / BYTES_PER_BLOCK, data);
             }
 
             index     += write_size;
@@ -166,7 +250,7 @@ void EEPROMEmulation::write(unsigned int index, const void *buf, size_t len)
             {
                 /* at least some data has changed */
                 memcpy(data, byte_data, len);
-                write_fblock(index / BYTES_PER_BLOCK, data);
+                commit_fblock(index / BYTES_PER_BLOCK, data);
             }
 
             len = 0;
@@ -181,7 +265,7 @@ void EEPROMEmulation::write(unsigned int index, const void *buf, size_t len)
             {
                 /* at least some data has changed */
                 memcpy(data, byte_data, BYTES_PER_BLOCK);
-                write_fblock(index / BYTES_PER_BLOCK, data);
+                commit_fblock(index / BYTES_PER_BLOCK, data);
             }
 
             index     += BYTES_PER_BLOCK;
@@ -196,6 +280,77 @@ void EEPROMEmulation::write(unsigned int index, const void *buf, size_t len)
     }
 }
 
+/** Stores a changed block, either into the write cache, or if that is
+ * disabled, directly into the journal.
+ * @param index block within EEPROM address space to write
+ * @param data data to write, array size must be @ref BYTES_PER_BLOCK large
+ */
+void EEPROMEmulation::commit_fblock(unsigned int index, const uint8_t data[])
+{
+    if (!cacheIndex_)
+    {
+        write_fblock(index, data);
+        return;
+    }
+    uint8_t *cached = cached_fblock(index);
+    if (cached)
+    {
+        memcpy(cached, data, BYTES_PER_BLOCK);
+        ++stats_.blocksCoalesced;
+        return;
+    }
+    if (cacheUsed_ >= WRITE_CACHE_BLOCKS)
+    {
+        flush_buffers();
+    }
+    cacheIndex_[cacheUsed_] = index;
+    memcpy(cacheData_ + cacheUsed_ * BYTES_PER_BLOCK, data, BYTES_PER_BLOCK);
+    if (cacheUsed_++ == 0 && flushFlow_)
+    {
+        flushFlow_->kick();
+    }
+}
+
+/** Writes all entries of the write cache to the journal and empties the
+ * cache.
+ */
+void EEPROMEmulation::flush_buffers()
+{
+    if (!cacheUsed_)
+    {
+        return;
+    }
+    ++stats_.flushes;
+    for (unsigned i = 0; i < cacheUsed_; ++i)
+    {
+        const uint8_t *data = cacheData_ + i * BYTES_PER_BLOCK;
+        uint8_t current[BYTES_PER_BLOCK];
+        // A compaction earlier in this loop may have already copied this
+        // block's new data into the fresh sector.
+        if (read_journal_fblock(cacheIndex_[i], current) &&
+            memcmp(current, data, BYTES_PER_BLOCK) == 0)
+        {
+            continue;
+        }
+        write_fblock(cacheIndex_[i], data);
+    }
+    cacheUsed_ = 0;
+}
+
+/** Turns on writing the write cache to flash automatically.
+ * @param service the timer and the flash writes run on this service
+ * @param delay_msec how long to wait after the first pending write
+ */
+void EEPROMEmulation::start_flush_timer(Service *service, unsigned delay_msec)
+{
+    if (!cacheIndex_ || flushFlow_)
+    {
+        return;
+    }
+    OSMutexLock h(&lock_);
+    flushFlow_ = new FlushFlow(service, this, delay_msec);
+}
+
 /** Write to the EEPROM on a native block boundary.
  * @param index block within EEPROM address space to write
  * @param data data to write, array size must be @ref BYTES_PER_BLOCK large
@@ -214,6 +369,7 @@ void EEPROMEmulation::write_fblock(unsigned int index, const uint8_t data[])
         }
         flash_program(activeSector_, rawBlockCount_ - availableSlots_, slot_data, BLOCK_SIZE);
         --availableSlots_;
+        ++stats_.blocksWritten;
     }
     else
     {
@@ -223,6 +379,8 @@ void EEPROMEmulation::write_fblock(unsigned int index, const uint8_t data[])
 
         /* prep the new block */
         flash_erase(new_sector);
+        ++stats_.sectorErases;
+        ++stats_.compactions;
         flash_program(new_sector, MAGIC_DIRTY_INDEX, magic, BLOCK_SIZE);
 
         /* reset the available count */
@@ -260,6 +418,7 @@ void EEPROMEmulation::write_fblock(unsigned int index, const uint8_t data[])
             /* commit the write */
             flash_program(new_sector, rawBlockCount_ - available_slots, slot_data, BLOCK_SIZE);
             --available_slots;
+            ++stats_.blocksWritten;
         }
         /* finalize the data move and write */
         magic[0] = MAGIC_INTACT;
@@ -331,6 +490,25 @@ void EEPROMEmulation::read(unsigned int offset, void *buf, size_t len)
         }
         memcpy(byte_data + bufofs, data + slotofs, copylen);
     }
+
+    /* pending writes in the cache are newer than anything in the journal */
+    for (unsigned i = 0; i < cacheUsed_; ++i)
+    {
+        unsigned slot_offset = cacheIndex_[i] * BYTES_PER_BLOCK;
+        unsigned start = slot_offset > offset ? slot_offset : offset;
+        unsigned end = slot_offset + BYTES_PER_BLOCK;
+        if (end > offset + len)
+        {
+            end = offset + len;
+        }
+        if (start >= end)
+        {
+            continue;
+        }
+        memcpy(byte_data + (start - offset),
+            cacheData_ + i * BYTES_PER_BLOCK + (start - slot_offset),
+            end - start);
+    }
 }
 
 /** Read from the EEPROM on a native block boundary.
@@ -354,25 +532,43 @@ bool EEPROMEmulation::read_fblock(unsigned int index, uint8_t data[])
     }
     else
     {
-        /* default data value if not found */
-        memset(data, 0xFF, BYTES_PER_BLOCK);
+        const uint8_t *cached = cached_fblock(index);
+        if (cached)
+        {
+            memcpy(data, cached, BYTES_PER_BLOCK);
+            return true;
+        }
+        return read_journal_fblock(index, data);
+    }
+}
 
-        /* look for data */
-        for (unsigned raw_block = slot_last();
-             raw_block >= slot_first();
-             --raw_block)
+/** Read a block from the flash journal, bypassing the shadow and the write
+ * cache.
+ * @param index block within EEPROM address space to read
+ * @param data location to place read data, array size must be @ref
+ *           BYTES_PER_BLOCK large
+ * @param return true if the block was found in the journal, else return false
+ */
+bool EEPROMEmulation::read_journal_fblock(unsigned int index, uint8_t data[])
+{
+    /* default data value if not found */
+    memset(data, 0xFF, BYTES_PER_BLOCK);
+
+    /* look for data */
+    for (unsigned raw_block = slot_last();
+         raw_block >= slot_first();
+         --raw_block)
+    {
+        const uint32_t* address = block(activeSector_, raw_block);
+        if (index == (*address >> 16))
         {
-        	const uint32_t* address = block(activeSector_, raw_block);
-            if (index == (*address >> 16))
+            /* found the data */
+            for (unsigned int i = 0; i < BLOCK_SIZE / sizeof(uint32_t); ++i)
             {
-                /* found the data */
-                for (unsigned int i = 0; i < BLOCK_SIZE / sizeof(uint32_t); ++i)
-                {
-                    data[(i * 2) + 0] = (address[i] >> 0) & 0xFF;
-                    data[(i * 2) + 1] = (address[i] >> 8) & 0xFF;
-                }
-                return true;
+                data[(i * 2) + 0] = (address[i] >> 0) & 0xFF;
+                data[(i * 2) + 1] = (address[i] >> 8) & 0xFF;
             }
+            return true;
         }
     }
 
@@ -36,6 +36,8 @@
 
 #include "EEPROM.hxx"
 
+class Service;
+
 #ifndef FLASH_SIZE
 /// Linker-defined symbol where in the memory space (flash) the eeprom
 /// emulation data starts.
@@ -128,6 +130,19 @@ extern const char __eeprom_end;
  *
  * The file size is limited to 64k - BLOCK_SIZE because the address is stored
  * on 2 bytes in each block.
+ *
+ * Write-back cache:
+ *
+ * If WRITE_CACHE_BLOCKS is nonzero, a RAM buffer of that many data blocks is
+ * allocated at mount time. Writes are collected in this buffer, and multiple
+ * writes to the same block (e.g. a config tool writing a string one datagram
+ * at a time, or a factory reset rewriting every event ID) are coalesced into a
+ * single journal entry. The buffer is written to flash when it gets full, or
+ * when sync() or fsync() is called, or when the last file handle is closed.
+ * Data in the buffer is lost upon power failure, so the application should
+ * call sync() after a batch of updates (for example upon the Update Complete
+ * command), or call start_flush_timer() once to have the buffer written out
+ * automatically a fixed time after the first pending write.
  */
 class EEPROMEmulation : public EEPROM
 {
@@ -140,15 +155,57 @@ protected:
 
     /** Destructor.
      */
-    ~EEPROMEmulation()
-    {
-    }
+    ~EEPROMEmulation();
 
     /** Mount the EEPROM file.  Should be called during construction of the
      * derived class.
      */
     void mount();
 
+public:
+    /** Counters about the flash usage of the emulation. They are reset upon
+     * mount. */
+    struct Stats
+    {
+        /** Number of data blocks programmed into flash. */
+        uint32_t blocksWritten;
+        /** Number of block writes that were absorbed by the write cache
+         * because a pending write to the same block already existed. */
+        uint32_t blocksCoalesced;
+        /** Number of times the journal overflowed and the data was compacted
+         * into a new sector. */
+        uint32_t compactions;
+        /** Number of sector erase operations. */
+        uint32_t sectorErases;
+        /** Number of times the write cache was written to flash. */
+        uint32_t flushes;
+    };
+
+    /** @return the flash usage counters. */
+    const Stats &stats()
+    {
+        return stats_;
+    }
+
+    /** @return the number of data blocks that are waiting in the write cache
+     * to be written to flash. */
+    unsigned dirty_blocks()
+    {
+        return cacheUsed_;
+    }
+
+    /** Turns on writing the write cache to flash automatically. A timer is
+     * started by the first write that goes into an empty cache, and when it
+     * expires, all pending data is written to flash. Should be called once,
+     * after mount(). A no-op if the write cache is disabled.
+     * @param service the timer and the flash writes run on the executor of
+     * this service.
+     * @param delay_msec how long to wait after the first pending write
+     * before writing the cache to flash.
+     */
+    void start_flush_timer(Service *service, unsigned delay_msec);
+
+protected:
     /** Sector size in bytes */
     static const size_t SECTOR_SIZE;
 
@@ -196,6 +253,12 @@ private:
      */
     static const bool SHADOW_IN_RAM;
 
+    /** Number of data blocks to buffer in RAM before writing them to flash.
+     * Zero disables the write cache and every write goes straight to the
+     * journal. Each entry uses BYTES_PER_BLOCK + 2 bytes of RAM.
+     */
+    static const size_t WRITE_CACHE_BLOCKS;
+
 protected:
     /** magic marker for an intact block */
     static const uint32_t MAGIC_INTACT;
@@ -237,6 +300,43 @@ private:
      */
     bool read_fblock(unsigned int index, uint8_t data[]);
 
+    /** Read a block from the flash journal, bypassing the shadow and the
+     * write cache.
+     * @param index block within EEPROM address space to read
+     * @param data location to place read data, array size must be @ref
+     *           BYTES_PER_BLOCK large
+     * @return true if the block was found in the journal, else return false
+     */
+    bool read_journal_fblock(unsigned int index, uint8_t data[]);
+
+    /** Stores a changed block, either into the write cache, or if that is
+     * disabled, directly into the journal.
+     * @param index block within EEPROM address space to write
+     * @param data data to write, array size must be @ref BYTES_PER_BLOCK large
+     */
+    void commit_fblock(unsigned int index, const uint8_t data[]);
+
+    /** Writes all entries of the write cache to the journal and empties the
+     * cache. Must be called with the lock held. */
+    void flush_buffers() OVERRIDE;
+
+    /** Looks up a block in the write cache.
+     * @param index block within EEPROM address space
+     * @return pointer to the cached data (BYTES_PER_BLOCK bytes), or nullptr
+     * if the block has no pending write.
+     */
+    uint8_t *cached_fblock(unsigned int index)
+    {
+        for (unsigned i = 0; i < cacheUsed_; ++i)
+        {
+            if (cacheIndex_[i] == index)
+            {
+                return cacheData_ + i * BYTES_PER_BLOCK;
+            }
+        }
+        return nullptr;
+    }
+
     /** Get the next active sector pointer.
      * @return sector index for the next sector to use.
      */
@@ -324,6 +424,25 @@ protected:
     /** pointer to RAM for shadowing EEPROM. */
     uint8_t *shadow_{nullptr};
 
+    /** Block indexes of the entries in the write cache. */
+    uint16_t *cacheIndex_{nullptr};
+
+    /** Data payload of the entries in the write cache, BYTES_PER_BLOCK bytes
+     * each. */
+    uint8_t *cacheData_{nullptr};
+
+    /** Number of valid entries in the write cache. */
+    unsigned cacheUsed_{0};
+
+    /** Flash usage counters. */
+    Stats stats_{0, 0, 0, 0, 0};
+
+    /** State flow that writes the write cache to flash after a delay. */
+    class FlushFlow;
+
+    /** Writes the write cache to flash after a delay, or nullptr if
+     * start_flush_timer() was not called. */
+    FlushFlow *flushFlow_{nullptr};
 
     /** Default constructor.
      */
@@ -37,3 +37,4 @@
 // emulation implementation to prevent GCC from mistakenly optimizing away the
 // constant into a linker reference.
 const bool __attribute__((weak)) EEPROMEmulation::SHADOW_IN_RAM = false;
+const size_t __attribute__((weak)) EEPROMEmulation::WRITE_CACHE_BLOCKS = 0;
@@ -178,4 +178,13 @@ int fcntl(int fd, int cmd, ...)
     return result;
 }
 
+/** Synchronize a file's in-core state with storage device.
+ * @param fd file descriptor
+ * @return 0 upon success, -1 upon failure with errno containing the cause
+ */
+int fsync(int fd)
+{
+    return Device::fsync(fd);
+}
+
 }
@@ -33,6 +33,8 @@
  */
 
 #include "openlcb/AliasAllocator.hxx"
+
+#include "nmranet_config.h"
 #include "openlcb/CanDefs.hxx"
 
 namespace openlcb
@@ -47,7 +49,11 @@ AliasAllocator::AliasAllocator(NodeID if_id, IfCan *if_can)
     , if_id_(if_id)
     , cid_frame_sequence_(0)
     , conflict_detected_(0)
+    , waiting_for_slot_(0)
+    , finish_all_(0)
+    , timer_running_(0)
 {
+    pending_.reserve(config_alias_reservation_window());
     reinit_seed();
     // Moves all the allocated alias buffers over to the input queue for
     // allocation.
@@ -61,13 +67,6 @@ void AliasAllocator::reinit_seed()
     seed_ ^= uint16_t(if_id_ >> 42) | uint16_t(if_id_ << 6);
 }
 
-/** Helper function to instruct the async alias allocator to pre-allocate N
- * aliases.
- *
- * @param aliases is the async alias allocator to use.
- * @param pool is the pool from where we take the buffers for the aliases.
- * @param n is how many aliases we pre-allocate.
- */
 void seed_alias_allocator(AliasAllocator* aliases, Pool* pool, int n) {
     for (int i = 0; i < n; i++)
     {
@@ -106,6 +105,13 @@ AliasAllocator::~AliasAllocator()
 
 StateFlowBase::Action AliasAllocator::entry()
 {
+    if (pending_.size() >= (unsigned)config_alias_reservation_window())
+    {
+        // Too many reservations are in the waiting period. We will be woken
+        // up when one of them finishes.
+        waiting_for_slot_ = 1;
+        return wait();
+    }
     cid_frame_sequence_ = 7;
     conflict_detected_ = 0;
     HASSERT(pending_alias()->state == AliasInfo::STATE_EMPTY);
@@ -151,8 +157,8 @@ StateFlowBase::Action AliasAllocator::handle_allocate_for_cid_frame()
     }
     else
     {
-        // All CID frames are sent, let's wait.
-        return sleep_and_call(&timer_, MSEC_TO_NSEC(200), STATE(wait_done));
+        // All CID frames are sent.
+        return call_immediately(STATE(wait_done));
     }
 }
 
@@ -195,55 +201,112 @@ StateFlowBase::Action AliasAllocator::wait_done()
     {
         return call_immediately(STATE(handle_alias_conflict));
     }
-    // grab a frame buffer for the RID frame.
-    return allocate_and_call(if_can()->frame_write_flow(),
-                             STATE(send_rid_frame));
+    // Parks the alias for the 200 msec waiting period and goes on with the
+    // next one. The conflict handler keeps watching the alias.
+    pending_alias()->state = AliasInfo::STATE_CHECKING;
+    long long deadline = os_get_time_monotonic() + MSEC_TO_NSEC(200);
+    pending_.push_back({transfer_message(), deadline});
+    if (!timer_running_)
+    {
+        timer_running_ = 1;
+        timer_.start(MSEC_TO_NSEC(200));
+    }
+    return exit();
 }
 
-StateFlowBase::Action AliasAllocator::send_rid_frame()
+long long AliasAllocator::finish_pending()
 {
-    LOG(VERBOSE, "Sending RID frame for alias %03x", pending_alias()->alias);
-    auto *b = get_allocation_result(if_can()->frame_write_flow());
-    struct can_frame *f = b->data()->mutable_frame();
-    CanDefs::control_init(*f, pending_alias()->alias, CanDefs::RID_FRAME, 0);
-    if (conflict_detected_)
+    long long now = os_get_time_monotonic();
+    unsigned num_done = 0;
+    while (num_done < pending_.size() &&
+        (finish_all_ || pending_[num_done].deadline <= now))
     {
-        b->unref();
-        return call_immediately(STATE(handle_alias_conflict));
+        complete_reservation(pending_[num_done].buffer);
+        ++num_done;
     }
-    if_can()->frame_write_flow()->send(b);
+    pending_.erase(pending_.begin(), pending_.begin() + num_done);
+    finish_all_ = 0;
+    notify_slot_free();
+    if (pending_.empty())
+    {
+        timer_running_ = 0;
+        return ::Timer::NONE;
+    }
+    long long next = pending_[0].deadline - now;
+    // Small values would be interpreted as RESTART.
+    return next > ::Timer::RESTART ? next : ::Timer::RESTART + 1;
+}
+
+void AliasAllocator::complete_reservation(Buffer<AliasInfo> *b)
+{
+    NodeAlias alias = b->data()->alias;
+    LOG(VERBOSE, "Sending RID frame for alias %03x", alias);
+    // This is synchronous allocation, which is not nice.
+    auto *f = if_can()->frame_write_flow()->alloc();
+    CanDefs::control_init(
+        *f->data()->mutable_frame(), alias, CanDefs::RID_FRAME, 0);
+    if_can()->frame_write_flow()->send(f);
     // The alias is reserved, put it into the freelist.
-    pending_alias()->state = AliasInfo::STATE_RESERVED;
+    b->data()->state = AliasInfo::STATE_RESERVED;
     if_can()->frame_dispatcher()->unregister_handler(
-        &conflictHandler_, pending_alias()->alias, ~0x1FFFF000U);
-    if_can()->local_aliases()->add(AliasCache::RESERVED_ALIAS_NODE_ID,
-                                   pending_alias()->alias);
-    reserved_alias_pool_.insert(transfer_message());
-    return release_and_exit();
+        &conflictHandler_, alias, ~0x1FFFF000U);
+    if_can()->local_aliases()->add(AliasCache::RESERVED_ALIAS_NODE_ID, alias);
+    reserved_alias_pool_.insert(b);
+    ++stats_.reserved;
+}
+
+void AliasAllocator::drop_pending(unsigned idx)
+{
+    Buffer<AliasInfo> *b = pending_[idx].buffer;
+    pending_.erase(pending_.begin() + idx);
+    if_can()->frame_dispatcher()->unregister_handler(
+        &conflictHandler_, b->data()->alias, ~0x1FFFF000U);
+    // Burns up the alias and restarts the lookup. The timer will find out by
+    // itself if pending_ became empty.
+    b->data()->alias = 0;
+    b->data()->state = AliasInfo::STATE_EMPTY;
+    send(b);
+    notify_slot_free();
+}
+
+void AliasAllocator::notify_slot_free()
+{
+    if (waiting_for_slot_ &&
+        pending_.size() < (unsigned)config_alias_reservation_window())
+    {
+        waiting_for_slot_ = 0;
+        notify();
+    }
 }
 
 void AliasAllocator::ConflictHandler::send(Buffer<CanMessageData> *message,
                                                 unsigned priority)
 {
+    NodeAlias alias = CanDefs::get_src(GET_CAN_FRAME_ID_EFF(*message->data()));
+    message->unref();
+    for (unsigned i = 0; i < parent_->pending_.size(); ++i)
+    {
+        if (parent_->pending_[i].buffer->data()->alias == alias)
+        {
+            ++parent_->stats_.conflicts;
+            g_alias_test_conflicts++;
+            parent_->drop_pending(i);
+            return;
+        }
+    }
+    // The alias must be the one whose CID frames are being sent.
     if (parent_->conflict_detected_) {
-        message->unref();
         return;
     }
     parent_->conflict_detected_ = 1;
+    ++parent_->stats_.conflicts;
     g_alias_test_conflicts++;
-    if (parent_->is_state(static_cast<StateFlowBase::Callback>(&AliasAllocator::wait_done))) {
-        /* Wakes up the actual flow to not have to wait all the 200 ms of
-         * sleep. This will request the timer callback to be issued
-         * immediately, which avoids race condition between the trigger and the
-         * regular timeout call. */
-        parent_->timer_.trigger();
-    }
-    message->unref();
 }
 
 void AliasAllocator::TEST_finish_pending_allocation() {
-    if (is_state(STATE(wait_done))) {
-        timer_.trigger();
+    if (timer_running_) {
+        finish_all_ = 1;
+        timer_.ensure_triggered();
     }
 }
 
@@ -35,6 +35,8 @@
 #ifndef _NMRANET_ALIASALLOCATOR_HXX_
 #define _NMRANET_ALIASALLOCATOR_HXX_
 
+#include <vector>
+
 #include "openlcb/IfCan.hxx"
 #include "openlcb/Defs.hxx"
 #include "executor/StateFlow.hxx"
@@ -91,6 +93,15 @@ struct AliasInfo
  *
  * Users who need an allocated alias should get it from the queue in
  * reserved_aliases().
+ *
+ * Multiple reservations are in progress concurrently: after the CID frames of
+ * an alias are sent, the buffer is parked in a list of pending reservations
+ * and the flow goes on to the next incoming buffer. A single timer finishes
+ * the pending reservations as their 200 msec waiting period expires. The
+ * number of concurrently pending reservations is limited by
+ * config_alias_reservation_window(). The number of reserved aliases kept in
+ * stock is the number of buffers sent to this flow, because users return the
+ * buffers after taking the alias (see seed_alias_allocator()).
  */
 class AliasAllocator : public StateFlow<Buffer<AliasInfo>, QList<1>>
 {
@@ -134,7 +145,33 @@ public:
         @param alias the next allocated alias to add.
     */
     void TEST_add_allocated_alias(NodeAlias alias, bool repeat=false);
-    
+
+    /** @return true if the flow is idle and there are no pending
+     * reservations. Hides the base class version, which does not know about
+     * the pending reservations. */
+    bool is_waiting()
+    {
+        return pending_.empty() &&
+            StateFlow<Buffer<AliasInfo>, QList<1>>::is_waiting();
+    }
+
+    /// Counters about the alias reservations.
+    struct Stats
+    {
+        /// Number of aliases successfully reserved.
+        unsigned reserved{0};
+        /// Number of aliases given up due to a conflict.
+        unsigned conflicts{0};
+    };
+
+    /// @return counters about the reservations done so far. The reservation
+    /// throughput is the change of stats().reserved over time; the conflict
+    /// rate is conflicts / (reserved + conflicts).
+    const Stats &stats()
+    {
+        return stats_;
+    }
+
 private:
     /** Listens to incoming CAN frames and handles alias conflicts. */
     class ConflictHandler : public IncomingFrameHandler
@@ -151,6 +188,36 @@ private:
 
     friend class ConflictHandler;
 
+    /** Timer that finishes the pending reservations when their waiting period
+     * expires. */
+    class ReservationTimer : public ::Timer
+    {
+    public:
+        ReservationTimer(AliasAllocator *parent)
+            : Timer(parent->service()->executor()->active_timers())
+            , parent_(parent)
+        {
+        }
+
+        long long timeout() override
+        {
+            return parent_->finish_pending();
+        }
+
+    private:
+        AliasAllocator *parent_;
+    };
+
+    /// An alias for which the CID frames are out and we are waiting for
+    /// conflicts.
+    struct PendingReservation
+    {
+        /// Buffer holding the alias.
+        Buffer<AliasInfo> *buffer;
+        /// Monotonic time (nsec) when the reservation can be completed.
+        long long deadline;
+    };
+
     AliasInfo *pending_alias()
     {
         return message()->data();
@@ -160,17 +227,36 @@ private:
     Action handle_allocate_for_cid_frame();
     Action send_cid_frame();
     Action wait_done();
-    Action send_rid_frame();
 
     Action handle_alias_conflict();
 
+    /** Completes the pending reservations whose waiting period is over.
+     * Called from the timer on the interface executor.
+     * @return the timer period to wait for the next pending reservation. */
+    long long finish_pending();
+
+    /** Sends the RID frame for a pending reservation and puts the alias into
+     * the reserved alias pool. @param b is the buffer holding the alias. */
+    void complete_reservation(Buffer<AliasInfo> *b);
+
+    /** Gives up a pending reservation upon a conflict. @param idx is the
+     * index in pending_. */
+    void drop_pending(unsigned idx);
+
+    /// Wakes up the flow if it is waiting for a free slot in pending_.
+    void notify_slot_free();
+
     /// Generates the next alias to check in the seed_ variable.
     void next_seed();
 
     friend class AsyncAliasAllocatorTest;
     friend class AsyncIfTest;
 
-    StateFlowTimer timer_;
+    /// Finishes the pending reservations.
+    ReservationTimer timer_;
+
+    /// Reservations with the CID frames sent, in the order of deadline.
+    std::vector<PendingReservation> pending_;
 
     /** Freelist of reserved aliases that can be used by virtual nodes. The
         AliasAllocatorFlow will post successfully reserved aliases to this
@@ -191,6 +277,13 @@ private:
     unsigned cid_frame_sequence_ : 3;
     /// Set to 1 if an incoming frame signals an alias conflict.
     unsigned conflict_detected_ : 1;
+    /// Set to 1 if the flow is waiting for a slot in pending_ to free up.
+    unsigned waiting_for_slot_ : 1;
+    /// Set to 1 if the next timer callback should finish all pending
+    /// reservations regardless of their deadline.
+    unsigned finish_all_ : 1;
+    /// Set to 1 while the timer is scheduled.
+    unsigned timer_running_ : 1;
 
     /// Seed for generating random-looking alias numbers.
     unsigned seed_ : 12;
@@ -198,10 +291,19 @@ private:
     /// Notifiable used for tracking outgoing frames.
     BarrierNotifiable n_;
 
-    /// Timer needed for sleeping the control flow.
-    // SleepData sleep_helper_;
+    /// Counters.
+    Stats stats_;
 };
 
+/** Helper function to instruct the async alias allocator to pre-allocate N
+ * aliases.
+ *
+ * @param aliases is the async alias allocator to use.
+ * @param pool is the pool from where we take the buffers for the aliases.
+ * @param n is how many aliases we pre-allocate.
+ */
+void seed_alias_allocator(AliasAllocator* aliases, Pool* pool, int n);
+
 /** Create this object statically to add an alias allocator to an already
  * statically allocated interface. */
 class AddAliasAllocator
@@ -96,6 +96,16 @@ public:
             EventRegistryEntry(this, event, entry_bits), 0);
     }
 
+    /// Allows answering an identify all message with range identified
+    /// messages where the entries cover contiguous event IDs. Range
+    /// identified messages carry no event state, so this is only useful if
+    /// the other nodes do not need the state of these events.
+    /// @param allow true to allow ranges.
+    void set_range_identify(bool allow)
+    {
+        rangeIdentify_ = allow;
+    }
+
     void handle_event_report(const EventRegistryEntry &entry, EventReport *event,
         BarrierNotifiable *done) override
     {
@@ -143,8 +153,8 @@ protected:
     {
         EventState state = stateHandler_(entry, event);
         Defs::MTI mti = Defs::MTI_PRODUCER_IDENTIFIED_VALID + state;
-        event_write_helper1.WriteAsync(node_, mti, WriteHelper::global(),
-            eventid_to_buffer(entry.event), done->new_child());
+        send_identified(event, &event_write_helper1, node_, mti, entry.event,
+            done, range_flags());
     }
 
     void SendConsumerIdentified(const EventRegistryEntry &entry,
@@ -152,14 +162,22 @@ protected:
     {
         EventState state = stateHandler_(entry, event);
         Defs::MTI mti = Defs::MTI_CONSUMER_IDENTIFIED_VALID + state;
-        event_write_helper3.WriteAsync(node_, mti, WriteHelper::global(),
-            eventid_to_buffer(entry.event), done->new_child());
+        send_identified(event, &event_write_helper3, node_, mti, entry.event,
+            done, range_flags());
+    }
+
+    /// @return the flags for send_identified.
+    unsigned range_flags()
+    {
+        return rangeIdentify_ ? EventIdentifyBatch::RANGE_OK : 0;
     }
 
 private:
     EventReportHandlerFn reportHandler_;
     EventStateHandlerFn stateHandler_;
     Node *node_;
+    /// True if identify all may be answered with range identified messages.
+    bool rangeIdentify_{false};
 };
 
 } // namespace openlcb
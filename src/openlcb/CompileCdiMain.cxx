@@ -6,9 +6,11 @@ using std::string;
 #include "config.hxx"
 
 #include "utils/StringPrintf.cxx"
+#include "utils/Lzss.cxx"
 #include "utils/FileUtils.hxx"
 
 bool raw_render = false;
+bool compress_render = false;
 
 // openlcb::ConfigDef def(0);
 
@@ -32,6 +34,35 @@ void render_cdi_helper(const CdiType &t, string ns, string name)
             filename.c_str());
         write_string_to_file(filename, payload);
     }
+    else if (compress_render)
+    {
+        // The terminating null is part of the exported memory space.
+        string compressed;
+        lzss_compress(payload.c_str(), payload.size() + 1, &compressed);
+        printf("namespace %s {\n\n", ns.c_str());
+        printf("// Compressed %s: %d bytes -> %d bytes.\n", name.c_str(),
+            (int)payload.size() + 1, (int)compressed.size());
+        printf("extern const char %s_DATA[];\n", name.c_str());
+        printf("const char %s_DATA[] = \"\";\n", name.c_str());
+        printf("extern const size_t %s_SIZE;\n", name.c_str());
+        printf("const size_t %s_SIZE = %d;\n", name.c_str(),
+            (int)payload.size() + 1);
+        printf("extern const uint8_t %s_COMPRESSED_DATA[];\n", name.c_str());
+        printf("const uint8_t %s_COMPRESSED_DATA[] = {", name.c_str());
+        for (unsigned i = 0; i < compressed.size(); ++i)
+        {
+            if (i % 16 == 0)
+            {
+                printf("\n  ");
+            }
+            printf("0x%02x, ", (uint8_t)compressed[i]);
+        }
+        printf("\n};\n");
+        printf("extern const size_t %s_COMPRESSED_SIZE;\n", name.c_str());
+        printf("const size_t %s_COMPRESSED_SIZE = sizeof(%s_COMPRESSED_DATA);\n",
+            name.c_str(), name.c_str());
+        printf("\n}  // namespace %s\n\n", ns.c_str());
+    }
     else
     {
         printf("namespace %s {\n\nextern const char %s_DATA[];\n", ns.c_str(),
@@ -54,6 +85,10 @@ int main(int argc, char *argv[])
     }
     else
     {
+        if (argc > 1 && string(argv[1]) == "-z")
+        {
+            compress_render = true;
+        }
         printf(R"(
 /* Generated code based off of config.hxx */
 
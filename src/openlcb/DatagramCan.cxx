@@ -36,6 +36,7 @@
 
 #include "openlcb/DatagramDefs.hxx"
 #include "openlcb/IfCanImpl.hxx"
+#include "nmranet_config.h"
 
 namespace openlcb
 {
@@ -400,11 +401,200 @@ private:
     unsigned hasResponse_ : 1;
 };
 
+/** Fixed-capacity table of the multi-frame datagrams being received. All
+ * slots, including their payload storage, are allocated at construction, so
+ * receiving a datagram does not allocate. The payload is copied out of the
+ * slot when the datagram is complete. Lookup by the (dst,
+ * src) alias pair goes through an open-addressing hash index. A slot whose
+ * last frame did not arrive in time is expired when it is looked up, or when
+ * a new datagram needs a slot and the table is full. */
+class DatagramReassemblyTable
+{
+public:
+    /// A datagram being received.
+    struct Slot
+    {
+        /// (dst alias << 12) | src alias; FREE_KEY if the slot is unused.
+        uint32_t key;
+        /// When the first frame arrived (os_get_time_monotonic).
+        long long started;
+        /// Number of payload bytes received so far.
+        uint8_t size;
+        /// Payload bytes received so far.
+        uint8_t data[DatagramDefs::MAX_SIZE];
+    };
+
+    /// @param capacity is the number of slots.
+    /// @param timeout_nsec is how long a slot may wait for the last frame.
+    DatagramReassemblyTable(unsigned capacity, long long timeout_nsec)
+        : capacity_(capacity)
+        , timeout_(timeout_nsec)
+    {
+        HASSERT(capacity > 0 && capacity < 0x8000);
+        while (indexSize_ < capacity * 2)
+        {
+            indexSize_ <<= 1;
+        }
+        index_ = new uint16_t[indexSize_];
+        memset(index_, 0, indexSize_ * sizeof(index_[0]));
+        slots_ = new Slot[capacity];
+        freeSlots_.reserve(capacity);
+        for (unsigned i = capacity; i > 0; --i)
+        {
+            slots_[i - 1].key = FREE_KEY;
+            freeSlots_.push_back(i - 1);
+        }
+    }
+
+    ~DatagramReassemblyTable()
+    {
+        delete[] index_;
+        delete[] slots_;
+    }
+
+    /// @return the slot of a datagram being received, or nullptr if there is
+    /// none (or it expired). @param key is the alias pair. @param now is the
+    /// current time.
+    Slot *find(uint32_t key, long long now)
+    {
+        unsigned pos = probe(key);
+        if (!index_[pos])
+        {
+            return nullptr;
+        }
+        Slot *s = &slots_[index_[pos] - 1];
+        if (now - s->started > timeout_)
+        {
+            ++stats_.expired;
+            remove(s);
+            return nullptr;
+        }
+        return s;
+    }
+
+    /// Allocates a slot for a new datagram. The key must not be present.
+    /// @param key is the alias pair. @param now is the current time. @return
+    /// the new slot, or nullptr if all slots are in use.
+    Slot *insert(uint32_t key, long long now)
+    {
+        if (freeSlots_.empty())
+        {
+            expire_all(now);
+            if (freeSlots_.empty())
+            {
+                ++stats_.rejected;
+                return nullptr;
+            }
+        }
+        uint16_t idx = freeSlots_.back();
+        freeSlots_.pop_back();
+        Slot *s = &slots_[idx];
+        s->key = key;
+        s->size = 0;
+        s->started = now;
+        index_[probe(key)] = idx + 1;
+        ++stats_.inFlight;
+        return s;
+    }
+
+    /// Releases a slot. @param s is a slot returned by find or insert.
+    void remove(Slot *s)
+    {
+        unsigned i = probe(s->key);
+        HASSERT(index_[i] == (s - slots_) + 1);
+        // Backward shift deletion: moves entries after the hole that would
+        // not be found anymore.
+        unsigned mask = indexSize_ - 1;
+        unsigned j = i;
+        while (true)
+        {
+            j = (j + 1) & mask;
+            if (!index_[j])
+            {
+                break;
+            }
+            unsigned home = hash(slots_[index_[j] - 1].key);
+            if (((j - home) & mask) >= ((j - i) & mask))
+            {
+                index_[i] = index_[j];
+                i = j;
+            }
+        }
+        index_[i] = 0;
+        s->key = FREE_KEY;
+        freeSlots_.push_back(s - slots_);
+        --stats_.inFlight;
+    }
+
+    /// @return counters.
+    const DatagramReassemblyStats &stats()
+    {
+        return stats_;
+    }
+
+private:
+    /// Key of unused slots.
+    static constexpr uint32_t FREE_KEY = 0xFFFFFFFFu;
+
+    /// @return the home position of key in the index.
+    unsigned hash(uint32_t key)
+    {
+        return ((key * 0x9E3779B1u) >> 16) & (indexSize_ - 1);
+    }
+
+    /// @return the position of key in the index, or of the empty entry where
+    /// it should be inserted.
+    unsigned probe(uint32_t key)
+    {
+        unsigned pos = hash(key);
+        while (index_[pos] && slots_[index_[pos] - 1].key != key)
+        {
+            pos = (pos + 1) & (indexSize_ - 1);
+        }
+        return pos;
+    }
+
+    /// Releases all slots that waited too long for their last frame.
+    void expire_all(long long now)
+    {
+        for (unsigned i = 0; i < capacity_; ++i)
+        {
+            Slot *s = &slots_[i];
+            if (s->key != FREE_KEY && now - s->started > timeout_)
+            {
+                ++stats_.expired;
+                remove(s);
+            }
+        }
+    }
+
+    /// Number of slots.
+    unsigned capacity_;
+    /// Number of entries in index_. Power of two.
+    unsigned indexSize_{1};
+    /// How long a slot may wait for its last frame.
+    long long timeout_;
+    /// Hash index; values are slot number + 1, zero means empty.
+    uint16_t *index_;
+    /// Storage of the datagrams.
+    Slot *slots_;
+    /// Slot numbers not in use.
+    std::vector<uint16_t> freeSlots_;
+    /// Counters.
+    DatagramReassemblyStats stats_;
+};
+
 /** Frame handler that assembles incoming datagram fragments into a single
  * datagram message. (That is, datagrams addressed to local nodes.) */
 class CanDatagramParser : public CanFrameStateFlow
 {
 public:
+    /// @return counters of the datagram reassembly.
+    const DatagramReassemblyStats &stats()
+    {
+        return pendingBuffers_.stats();
+    }
+
     enum
     {
         CAN_FILTER = CanMessageData::CAN_EXT_FRAME_FILTER |
@@ -450,37 +640,36 @@ public:
             return release_and_exit();
         }
 
-        DatagramPayload *buf = nullptr;
+        DatagramReassemblyTable::Slot *slot = nullptr;
         bool last_frame = true;
 
         switch (can_frame_type)
         {
             case 2:
-                // Single-frame datagram. Let's allocate one small buffer for
-                // it.
-                localBuffer_.clear();
-                localBuffer_.reserve(f->can_dlc);
-                buf = &localBuffer_;
+                // Single-frame datagram.
                 break;
             case 3:
             {
                 // Datagram first frame
-                auto it = pendingBuffers_.find(buffer_key);
-                if (it != pendingBuffers_.end())
+                long long now = os_get_time_monotonic();
+                slot = pendingBuffers_.find(buffer_key, now);
+                if (slot)
                 {
-                    pendingBuffers_.erase(it);
+                    pendingBuffers_.remove(slot);
+                    slot = nullptr;
                     /** Frames came out of order or more than one datagram is
                      * being sent to the same dst. */
                     errorCode_ = DatagramClient::RESEND_OK |
                                  DatagramClient::OUT_OF_ORDER;
                     break;
                 }
-
-                buf = &pendingBuffers_[buffer_key];
-                buf->clear();
-
-                // Datagram first frame. Get a full buffer.
-                buf->reserve(72);
+                slot = pendingBuffers_.insert(buffer_key, now);
+                if (!slot)
+                {
+                    // Too many datagrams are being received concurrently.
+                    errorCode_ = DatagramClient::RESEND_OK |
+                                 DatagramClient::BUFFER_UNAVAILABLE;
+                }
                 last_frame = false;
                 break;
             }
@@ -491,19 +680,11 @@ public:
             case 5:
             {
                 // Datagram last frame
-                auto it = pendingBuffers_.find(buffer_key);
-                if (it != pendingBuffers_.end())
+                slot = pendingBuffers_.find(buffer_key, os_get_time_monotonic());
+                if (!slot)
                 {
-                    buf = &it->second;
-                    if (last_frame)
-                    {
-                        localBuffer_.clear();
-                        // Moves ownership of the allocated data to the local
-                        // buffer.
-                        localBuffer_.swap(*buf);
-                        buf = &localBuffer_;
-                        pendingBuffers_.erase(it);
-                    }
+                    errorCode_ =
+                        DatagramClient::RESEND_OK | DatagramClient::OUT_OF_ORDER;
                 }
                 break;
             }
@@ -512,22 +693,16 @@ public:
                 return release_and_exit();
         }
 
-        if (!buf)
-        {
-            errorCode_ =
-                DatagramClient::RESEND_OK | DatagramClient::OUT_OF_ORDER;
-        }
-        else if (buf->size() + f->can_dlc > DatagramDefs::MAX_SIZE)
+        if (slot && slot->size + f->can_dlc > DatagramDefs::MAX_SIZE)
         {
             // Too long datagram arrived.
             LOG(WARNING, "AsyncDatagramCan: too long incoming datagram arrived."
                          " Size: %d",
-                (int)(buf->size() + f->can_dlc));
+                (int)(slot->size + f->can_dlc));
             errorCode_ = DatagramClient::PERMANENT_ERROR;
             // Since we reject the datagram, let's not keep the buffer
-            // around. This call should not crash if the buffer was already
-            // deleted.
-            pendingBuffers_.erase(buffer_key);
+            // around.
+            pendingBuffers_.remove(slot);
         }
 
         if (errorCode_)
@@ -538,12 +713,26 @@ public:
                                      STATE(send_rejection));
         }
 
-        // Copies new data into buf.
-        buf->append(reinterpret_cast<const char *>(&f->data[0]), f->can_dlc);
+        // Copies new data into the buffer.
+        if (!slot)
+        {
+            localBuffer_.assign(
+                reinterpret_cast<const char *>(&f->data[0]), f->can_dlc);
+        }
+        else
+        {
+            memcpy(slot->data + slot->size, &f->data[0], f->can_dlc);
+            slot->size += f->can_dlc;
+            if (last_frame)
+            {
+                localBuffer_.assign(
+                    reinterpret_cast<const char *>(slot->data), slot->size);
+                pendingBuffers_.remove(slot);
+            }
+        }
         release();
         if (last_frame)
         {
-            HASSERT(buf == &localBuffer_);
             // Datagram is complete; let's send it to higher level If.
             return allocate_and_call(if_can()->dispatcher(),
                                      STATE(datagram_complete));
@@ -596,8 +785,8 @@ public:
     }
 
 private:
-    /// A local buffer that owns the datagram payload bytes after we took the
-    /// entry from the pending buffers map.
+    /// A local buffer that owns the payload bytes of the completed datagram
+    /// until it is moved into the outgoing message.
     DatagramPayload localBuffer_;
 
     Node *dstNode_;
@@ -607,19 +796,19 @@ private:
     /// be forwarded to the upper layer in this case.
     uint16_t errorCode_;
 
-    /** Open datagram buffers. Keyed by (dstid | srcid), value is a datagram
-     * payload. When a payload is finished, it should be moved into the final
-     * datagram message using swap() to avoid memory copies.
-     * @TODO(balazs.racz) we need some kind of timeout-based release mechanism
-     * in here. */
-    StlMap<uint64_t, DatagramPayload> pendingBuffers_;
+    /** Open datagram buffers. Keyed by (dstid | srcid). When a payload is
+     * finished, it is copied into localBuffer_ and the slot is released. */
+    DatagramReassemblyTable pendingBuffers_{
+        (unsigned)config_can_datagram_reassembly_slots(),
+        MSEC_TO_NSEC(config_can_datagram_reassembly_timeout_msec())};
 };
 CanDatagramService::CanDatagramService(IfCan *iface,
                                        int num_registry_entries,
                                        int num_clients)
     : DatagramService(iface, num_registry_entries)
 {
-    if_can()->add_owned_flow(new CanDatagramParser(if_can()));
+    parser_ = new CanDatagramParser(if_can());
+    if_can()->add_owned_flow(parser_);
     for (int i = 0; i < num_clients; ++i)
     {
         auto *client_flow = new CanDatagramClient(if_can());
@@ -637,6 +826,11 @@ CanDatagramService::~CanDatagramService()
 {
 }
 
+const DatagramReassemblyStats &CanDatagramService::reassembly_stats()
+{
+    return parser_->stats();
+}
+
 CanDatagramParser::CanDatagramParser(IfCan *iface)
     : CanFrameStateFlow(iface)
 {
@@ -41,6 +41,22 @@
 namespace openlcb
 {
 
+class CanDatagramParser;
+
+/// Counters about reassembling multi-frame datagrams from the CAN bus.
+struct DatagramReassemblyStats
+{
+    /// Number of datagrams whose first frame arrived but the last did not
+    /// yet.
+    unsigned inFlight{0};
+    /// Number of partial datagrams dropped because the last frame did not
+    /// arrive in time.
+    unsigned expired{0};
+    /// Number of datagrams rejected because all reassembly slots were in
+    /// use.
+    unsigned rejected{0};
+};
+
 /// Implementation of the DatagramService with the CANbus-specific OpenLCB
 /// datagram protocol. This service is responsible for fragmenting outgoing
 /// datagram messages to the CANbus, assembling incoming datagram frames into
@@ -61,6 +77,13 @@ public:
     {
         return static_cast<IfCan *>(iface());
     }
+
+    /// @return counters of the incoming datagram reassembly.
+    const DatagramReassemblyStats &reassembly_stats();
+
+private:
+    /// Assembles incoming datagram frames. Owned by the interface.
+    CanDatagramParser *parser_;
 };
 
 /// Creates a CAN datagram parser flow. Exposed for testing only.
@@ -85,5 +85,7 @@ R"cdi(<?xml version="1.0"?>
 </cdi>
 )cdi";
 
+extern const uint8_t __attribute__((weak)) CDI_COMPRESSED_DATA[] = {0};
+extern const size_t __attribute__((weak)) CDI_COMPRESSED_SIZE = 0;
 
 } // namespace openlcb
@@ -46,6 +46,18 @@ WriteHelper event_write_helper3;
 WriteHelper event_write_helper4;
 BarrierNotifiable event_barrier;
 
+void send_identified(EventReport *event, WriteHelper *helper, Node *node,
+    Defs::MTI mti, EventId event_id, BarrierNotifiable *done, unsigned flags)
+{
+    if (event && event->batch)
+    {
+        event->batch->add(node, mti, event_id, flags);
+        return;
+    }
+    helper->WriteAsync(node, mti, WriteHelper::global(),
+        eventid_to_buffer(event_id), done->new_child());
+}
+
 EventRegistry::EventRegistry()
 {
     HASSERT(instance_ == nullptr);
@@ -47,6 +47,7 @@ namespace openlcb
 typedef uint64_t EventId;
 class Node;
 class EventHandler;
+class EventIdentifyBatch;
 
 /*enum EventMask {
   EVENT_EXACT_MASK = 1,
@@ -75,8 +76,48 @@ typedef struct
     /// producer/consumer as the sender of the message
     /// (valid/invalid/unknown/reserved).
     EventState state;
+    /// For identify all messages (handle_identify_global): if not nullptr,
+    /// the handler should append its identified messages here instead of
+    /// sending them through the event write helpers. Always nullptr for the
+    /// other calls. See @ref send_identified.
+    EventIdentifyBatch *batch{nullptr};
 } EventReport;
 
+/// Collects the producer / consumer identified messages that the event
+/// handlers generate for an Identify Events (global or addressed) message.
+/// The event service sends them to the interface in batches, with flow
+/// control against the transmit queue, instead of one write helper call per
+/// event.
+class EventIdentifyBatch
+{
+public:
+    /// Flags for add().
+    enum
+    {
+        /// The handler permits announcing this event in a range identified
+        /// message together with contiguous events of the same node and kind
+        /// (producer / consumer). Range identified messages carry no event
+        /// state.
+        RANGE_OK = 1,
+    };
+
+    /// Queues an identified message for sending. Must be called from the
+    /// handle_identify_global call of the event handler.
+    ///
+    /// @param node the node that sends the message.
+    /// @param mti one of the producer / consumer identified MTIs, including
+    /// the range identified ones.
+    /// @param event the event ID, or the encoded range for range messages.
+    /// @param flags bitmask of the flags above.
+    virtual void add(
+        Node *node, Defs::MTI mti, EventId event, unsigned flags = 0) = 0;
+
+protected:
+    virtual ~EventIdentifyBatch()
+    {
+    }
+};
+
 /// Structure used in registering event handlers.
 class EventRegistryEntry
 {
@@ -114,6 +155,22 @@ extern WriteHelper event_write_helper2;
 extern WriteHelper event_write_helper3;
 extern WriteHelper event_write_helper4;
 
+/// Sends a producer or consumer identified message in response to an event
+/// handler call. If the call is for an identify all message that the event
+/// service batches, appends the message to the batch, otherwise sends it
+/// through a write helper.
+///
+/// @param event the report given to the event handler, or nullptr.
+/// @param helper the write helper to use when there is no batch.
+/// @param node the node that sends the message.
+/// @param mti the identified MTI.
+/// @param event_id the event ID or encoded range.
+/// @param done a child of this is taken for the write helper; not notified.
+/// @param flags bitmask of EventIdentifyBatch flags.
+void send_identified(EventReport *event, WriteHelper *helper, Node *node,
+    Defs::MTI mti, EventId event_id, BarrierNotifiable *done,
+    unsigned flags = 0);
+
 /// Abstract base class for all event handlers. Instances of this class can
 /// get registered with the event service to receive notifications of incoming
 /// event messages from the bus.
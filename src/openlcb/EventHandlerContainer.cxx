@@ -51,12 +51,16 @@ void TreeEventHandlers::unregister_handler(EventHandler *handler)
     set_dirty();
     bool found = false;
     for (auto r = handlers_.begin(); r != handlers_.end(); ++r) {
-        for (auto it = r->second.begin(); it != r->second.end(); ++it) {
+        for (auto it = r->second.begin(); it != r->second.end();) {
             if (it->handler == handler)
             {
-                r->second.erase(it);
+                it = r->second.erase(it);
                 found = true;
             }
+            else
+            {
+                ++it;
+            }
         }
     }
     if (found) return;
@@ -32,8 +32,12 @@
  * @date 6 November 2013
  */
 
-#include <unistd.h>
+#include <string.h>
 
+#include <deque>
+#include <vector>
+
+#include "utils/Atomic.hxx"
 #include "utils/logging.h"
 #include "openlcb/EventHandlerTemplates.hxx"
 #include "openlcb/EventService.hxx"
@@ -61,6 +65,208 @@ __attribute__((weak)) const string &GetNameForEvent(uint64_t)
 namespace openlcb
 {
 
+/// Sends an event report directly to the interface's global write flow,
+/// without going through a WriteHelper.
+///
+/// @param node is the originating node.
+/// @param event is the event ID to produce.
+/// @param done if not NULL, a child of it will be notified when the message
+/// is enqueued to the physical layer.
+static void send_event_report(
+    Node *node, uint64_t event, BarrierNotifiable *done)
+{
+    if (!node->is_initialized())
+    {
+        return;
+    }
+    auto *f = node->iface()->global_message_write_flow();
+    auto *b = f->alloc();
+    b->data()->reset(
+        Defs::MTI_EVENT_REPORT, node->node_id(), eventid_to_buffer(event));
+    if (done)
+    {
+        b->set_done(done->new_child());
+    }
+    f->send(b, b->data()->priority());
+}
+
+/// Produces the event reports for the bulk updates of a range event handler.
+/// Every update is queued as the list of event IDs to report, computed when
+/// the update is made, and the updates are reported in the order they were
+/// queued. Buffers are allocated asynchronously, and after every batch of
+/// event reports the flow waits until they are enqueued to the physical
+/// layer. Owned by the handler, which calls shutdown() instead of deleting
+/// it.
+class RangeEventReportFlow : public StateFlowBase, private Atomic
+{
+public:
+    /// How many event reports to send before waiting for them to be
+    /// enqueued to the physical layer.
+    static constexpr unsigned BATCH_SIZE = 8;
+
+    /// Constructor. The flow is idle until the first update is added.
+    ///
+    /// @param node is the originating node.
+    RangeEventReportFlow(Node *node)
+        : StateFlowBase(node->iface())
+        , node_(node)
+    {
+        reset_flow(STATE(next_update));
+    }
+
+    /// Queues the event reports of an update.
+    ///
+    /// @param events are the event IDs to report, in order.
+    /// @param done if not NULL, will be notified when all event reports have
+    /// been enqueued to the physical layer, or dropped by shutdown().
+    void add(std::vector<uint64_t> events, BarrierNotifiable *done)
+    {
+        bool wakeup;
+        {
+            AtomicHolder h(this);
+            HASSERT(!shutdown_);
+            pending_.push_back({std::move(events), done});
+            wakeup = idle_;
+            idle_ = false;
+        }
+        if (wakeup)
+        {
+            notify();
+        }
+    }
+
+    /// Drops the updates not started yet, notifying their done, and makes
+    /// the flow delete itself once the batch in progress is enqueued.
+    void shutdown()
+    {
+        std::deque<Update> dropped;
+        bool wakeup;
+        {
+            AtomicHolder h(this);
+            dropped.swap(pending_);
+            shutdown_ = true;
+            wakeup = idle_;
+            idle_ = false;
+        }
+        for (auto &u : dropped)
+        {
+            if (u.done)
+            {
+                u.done->notify();
+            }
+        }
+        if (wakeup)
+        {
+            notify();
+        }
+    }
+
+private:
+    /// Event reports of one bulk update.
+    struct Update
+    {
+        /// Event IDs to report.
+        std::vector<uint64_t> events;
+        /// Notified when all of them are enqueued. May be NULL.
+        BarrierNotifiable *done;
+    };
+
+    Action next_update()
+    {
+        bool stop;
+        {
+            AtomicHolder h(this);
+            stop = shutdown_;
+            if (!stop && pending_.empty())
+            {
+                idle_ = true;
+                return wait_and_call(STATE(next_update));
+            }
+            if (!stop)
+            {
+                current_ = std::move(pending_.front());
+                pending_.pop_front();
+            }
+        }
+        if (stop)
+        {
+            return delete_this();
+        }
+        next_ = 0;
+        return call_immediately(STATE(next_batch));
+    }
+
+    Action next_batch()
+    {
+        bn_.reset(this);
+        inBatch_ = 0;
+        return call_immediately(STATE(next_entry));
+    }
+
+    Action next_entry()
+    {
+        bool stop;
+        {
+            AtomicHolder h(this);
+            stop = shutdown_;
+        }
+        if (stop || next_ >= current_.events.size() ||
+            !node_->is_initialized())
+        {
+            bn_.notify();
+            return wait_and_call(STATE(update_done));
+        }
+        if (inBatch_ >= BATCH_SIZE)
+        {
+            bn_.notify();
+            return wait_and_call(STATE(next_batch));
+        }
+        return allocate_and_call(
+            node_->iface()->global_message_write_flow(), STATE(send_report));
+    }
+
+    Action send_report()
+    {
+        auto *f = node_->iface()->global_message_write_flow();
+        auto *b = get_allocation_result(f);
+        b->data()->reset(Defs::MTI_EVENT_REPORT, node_->node_id(),
+            eventid_to_buffer(current_.events[next_++]));
+        b->set_done(bn_.new_child());
+        f->send(b, b->data()->priority());
+        ++inBatch_;
+        return call_immediately(STATE(next_entry));
+    }
+
+    Action update_done()
+    {
+        if (current_.done)
+        {
+            current_.done->notify();
+        }
+        current_.events.clear();
+        current_.done = nullptr;
+        return call_immediately(STATE(next_update));
+    }
+
+    /// Originating node.
+    Node *node_;
+    /// Updates not started yet. Protected by the Atomic.
+    std::deque<Update> pending_;
+    /// True if the flow waits for an update to be added. Protected by the
+    /// Atomic.
+    bool idle_{true};
+    /// True if the owning handler is gone. Protected by the Atomic.
+    bool shutdown_{false};
+    /// The update we are currently sending event reports for.
+    Update current_{{}, nullptr};
+    /// Offset in current_.events of the next event to report.
+    size_t next_{0};
+    /// How many event reports we sent in the current batch.
+    unsigned inBatch_{0};
+    /// Notified when the current batch is enqueued.
+    BarrierNotifiable bn_;
+};
+
 BitRangeEventPC::BitRangeEventPC(Node *node, uint64_t event_base,
                                  uint32_t *backing_store, unsigned size)
     : event_base_(event_base)
@@ -76,6 +282,10 @@ BitRangeEventPC::BitRangeEventPC(Node *node, uint64_t event_base,
 BitRangeEventPC::~BitRangeEventPC()
 {
     EventRegistry::instance()->unregister_handler(this);
+    if (reportFlow_)
+    {
+        reportFlow_->shutdown();
+    }
 }
 
 void BitRangeEventPC::GetBitAndMask(unsigned bit, uint32_t **data,
@@ -133,22 +343,15 @@ void BitRangeEventPC::Set(unsigned bit, bool new_value, WriteHelper *writer,
         uint64_t event = event_base_ + bit * 2;
         if (!new_value)
             event++;
-        writer->WriteAsync(node_, Defs::MTI_EVENT_REPORT, WriteHelper::global(),
-                           eventid_to_buffer(event), done);
-#ifndef TARGET_LPC11Cxx
-        if (!done)
+        if (done)
         {
-            // We wait for the sent-out event to come back. Otherwise there is a
-            // race
-            // condition where the automata processing could have gone further,
-            // but
-            // the "set" message will arrive.
-            while (EventService::instance->event_processing_pending())
-            {
-                usleep(100);
-            }
+            writer->WriteAsync(node_, Defs::MTI_EVENT_REPORT,
+                WriteHelper::global(), eventid_to_buffer(event), done);
+        }
+        else
+        {
+            send_event_report(node_, event, nullptr);
         }
-#endif
     }
     else
     {
@@ -165,6 +368,53 @@ void BitRangeEventPC::Set(unsigned bit, bool new_value, WriteHelper *writer,
     }
 }
 
+unsigned BitRangeEventPC::SetAll(const uint32_t *new_data,
+                                 BarrierNotifiable *done)
+{
+    unsigned num_words = (size_ + 31) >> 5;
+    std::vector<uint64_t> events;
+    for (unsigned w = 0; w < num_words; ++w)
+    {
+        uint32_t diff = data_[w] ^ new_data[w];
+        if (!diff)
+        {
+            continue;
+        }
+        if (w == num_words - 1 && (size_ & 31))
+        {
+            // Bits beyond size_ are not ours.
+            diff &= (1U << (size_ & 31)) - 1;
+        }
+        data_[w] ^= diff;
+        for (; diff; diff &= diff - 1)
+        {
+            unsigned bit = __builtin_ctz(diff);
+            uint64_t event = event_base_ + (((w << 5) | bit) << 1);
+            if (!(data_[w] & (1U << bit)))
+            {
+                event++;
+            }
+            events.push_back(event);
+        }
+    }
+    unsigned count = events.size();
+    LOG(VERBOSE, "BitRange: bulk set changed %u bits", count);
+    if (!count)
+    {
+        if (done)
+        {
+            done->notify();
+        }
+        return 0;
+    }
+    if (!reportFlow_)
+    {
+        reportFlow_ = new RangeEventReportFlow(node_);
+    }
+    reportFlow_->add(std::move(events), done);
+    return count;
+}
+
 void BitRangeEventPC::handle_event_report(const EventRegistryEntry& entry, EventReport *event,
                                         BarrierNotifiable *done)
 {
@@ -267,12 +517,10 @@ void BitRangeEventPC::handle_identify_global(const EventRegistryEntry& entry, Ev
         return done->notify();
     }
     uint64_t range = EncodeRange(event_base_, size_ * 2);
-    event_write_helper1.WriteAsync(node_, Defs::MTI_PRODUCER_IDENTIFIED_RANGE,
-                                   WriteHelper::global(),
-                                   eventid_to_buffer(range), done->new_child());
-    event_write_helper2.WriteAsync(node_, Defs::MTI_CONSUMER_IDENTIFIED_RANGE,
-                                   WriteHelper::global(),
-                                   eventid_to_buffer(range), done->new_child());
+    send_identified(event, &event_write_helper1, node_,
+                    Defs::MTI_PRODUCER_IDENTIFIED_RANGE, range, done);
+    send_identified(event, &event_write_helper2, node_,
+                    Defs::MTI_CONSUMER_IDENTIFIED_RANGE, range, done);
     done->maybe_done();
 }
 
@@ -364,9 +612,8 @@ void ByteRangeEventC::handle_identify_global(const EventRegistryEntry& entry, Ev
         return done->notify();
     }
     uint64_t range = EncodeRange(event_base_, size_ * 256);
-    event_write_helper1.WriteAsync(node_, Defs::MTI_CONSUMER_IDENTIFIED_RANGE,
-                                   WriteHelper::global(),
-                                   eventid_to_buffer(range), done->new_child());
+    send_identified(event, &event_write_helper1, node_,
+                    Defs::MTI_CONSUMER_IDENTIFIED_RANGE, range, done);
     done->maybe_done();
 }
 
@@ -384,6 +631,14 @@ ByteRangeEventP::ByteRangeEventP(Node *node, uint64_t event_base,
 {
 }
 
+ByteRangeEventP::~ByteRangeEventP()
+{
+    if (reportFlow_)
+    {
+        reportFlow_->shutdown();
+    }
+}
+
 void ByteRangeEventP::handle_event_report(const EventRegistryEntry& entry, EventReport *event,
                                         BarrierNotifiable *done)
 {
@@ -431,9 +686,9 @@ void ByteRangeEventP::handle_identify_global(const EventRegistryEntry& entry, Ev
         return done->notify();
     }
     uint64_t range = EncodeRange(event_base_, size_ * 256);
-    event_write_helper1.WriteAsync(node_, Defs::MTI_PRODUCER_IDENTIFIED_RANGE,
-                                   WriteHelper::global(),
-                                   eventid_to_buffer(range), done);
+    send_identified(event, &event_write_helper1, node_,
+                    Defs::MTI_PRODUCER_IDENTIFIED_RANGE, range, done);
+    done->maybe_done();
 }
 
 void ByteRangeEventP::SendIdentified(WriteHelper *writer,
@@ -453,6 +708,50 @@ void ByteRangeEventP::Update(unsigned byte, WriteHelper *writer,
                        eventid_to_buffer(CurrentEventId(byte)), done);
 }
 
+unsigned ByteRangeEventP::SetAll(const uint8_t *new_data,
+                                 BarrierNotifiable *done)
+{
+    std::vector<uint64_t> events;
+    unsigned ofs = 0;
+    while (ofs < size_)
+    {
+        // Skips over unchanged bytes a word at a time.
+        if (ofs + 4 <= size_)
+        {
+            uint32_t a, b;
+            memcpy(&a, data_ + ofs, 4);
+            memcpy(&b, new_data + ofs, 4);
+            if (a == b)
+            {
+                ofs += 4;
+                continue;
+            }
+        }
+        if (data_[ofs] != new_data[ofs])
+        {
+            data_[ofs] = new_data[ofs];
+            events.push_back(CurrentEventId(ofs));
+        }
+        ++ofs;
+    }
+    unsigned count = events.size();
+    LOG(VERBOSE, "ByteRange: bulk set changed %u bytes", count);
+    if (!count)
+    {
+        if (done)
+        {
+            done->notify();
+        }
+        return 0;
+    }
+    if (!reportFlow_)
+    {
+        reportFlow_ = new RangeEventReportFlow(node_);
+    }
+    reportFlow_->add(std::move(events), done);
+    return count;
+}
+
 // Responses to possible queries.
 void ByteRangeEventP::handle_consumer_identified(const EventRegistryEntry& entry, EventReport *event,
                                                BarrierNotifiable *done)
@@ -555,30 +854,28 @@ void BitEventHandler::unregister_handler()
     EventRegistry::instance()->unregister_handler(this);
 }
 
-void BitEventHandler::SendProducerIdentified(BarrierNotifiable *done)
+void BitEventHandler::SendProducerIdentified(
+    BarrierNotifiable *done, EventReport *event)
 {
     EventState state = bit_->get_current_state();
     Defs::MTI mti = Defs::MTI_PRODUCER_IDENTIFIED_VALID + state;
-    event_write_helper1.WriteAsync(bit_->node(), mti, WriteHelper::global(),
-                                   eventid_to_buffer(bit_->event_on()),
-                                   done->new_child());
+    send_identified(event, &event_write_helper1, bit_->node(), mti,
+                    bit_->event_on(), done);
     mti = Defs::MTI_PRODUCER_IDENTIFIED_VALID + invert_event_state(state);
-    event_write_helper2.WriteAsync(bit_->node(), mti, WriteHelper::global(),
-                                   eventid_to_buffer(bit_->event_off()),
-                                   done->new_child());
+    send_identified(event, &event_write_helper2, bit_->node(), mti,
+                    bit_->event_off(), done);
 }
 
-void BitEventHandler::SendConsumerIdentified(BarrierNotifiable *done)
+void BitEventHandler::SendConsumerIdentified(
+    BarrierNotifiable *done, EventReport *event)
 {
     EventState state = bit_->get_current_state();
     Defs::MTI mti = Defs::MTI_CONSUMER_IDENTIFIED_VALID + state;
-    event_write_helper3.WriteAsync(bit_->node(), mti, WriteHelper::global(),
-                                   eventid_to_buffer(bit_->event_on()),
-                                   done->new_child());
+    send_identified(event, &event_write_helper3, bit_->node(), mti,
+                    bit_->event_on(), done);
     mti = Defs::MTI_CONSUMER_IDENTIFIED_VALID + invert_event_state(state);
-    event_write_helper4.WriteAsync(bit_->node(), mti, WriteHelper::global(),
-                                   eventid_to_buffer(bit_->event_off()),
-                                   done->new_child());
+    send_identified(event, &event_write_helper4, bit_->node(), mti,
+                    bit_->event_off(), done);
 }
 
 void BitEventHandler::SendEventReport(WriteHelper *writer, Notifiable *done)
@@ -693,7 +990,7 @@ void BitEventProducer::handle_identify_global(const EventRegistryEntry& entry, E
     {
         return done->notify();
     }
-    SendProducerIdentified(done);
+    SendProducerIdentified(done, event);
     done->maybe_done();
 }
 
@@ -722,7 +1019,7 @@ void BitEventConsumer::handle_identify_global(const EventRegistryEntry& entry, E
     {
         return done->notify();
     }
-    SendConsumerIdentified(done);
+    SendConsumerIdentified(done, event);
     done->maybe_done();
 }
 
@@ -740,8 +1037,8 @@ void BitEventPC::handle_identify_global(const EventRegistryEntry& entry, EventRe
     {
         return done->notify();
     }
-    SendProducerIdentified(done);
-    SendConsumerIdentified(done);
+    SendProducerIdentified(done, event);
+    SendConsumerIdentified(done, event);
     done->maybe_done();
 }
 
@@ -499,20 +499,24 @@ protected:
     /// Sends off two packets using event_write_helper{1,2} of
     /// ProducerIdentified
     /// for handling a global identify events message. Allocates children from
-    /// barrier done (but does not notify it).
+    /// barrier done (but does not notify it). If event is given and carries
+    /// an identify batch, the packets go to the batch instead.
     ///
     /// @TODO: for consistency of API this function should be changed to notify
     /// the barrier. The caller should always use new_child.
-    void SendProducerIdentified(BarrierNotifiable *done);
+    void SendProducerIdentified(
+        BarrierNotifiable *done, EventReport *event = nullptr);
 
     /// Sends off two packets using event_write_helper{3,4} of
     /// ConsumerIdentified
     /// for handling a global identify events message. Allocates children from
-    /// barrier done (but does not notify it).
+    /// barrier done (but does not notify it). If event is given and carries
+    /// an identify batch, the packets go to the batch instead.
     ///
     /// @TODO: for consistency of API this function should be changed to notify
     /// the barrier. The caller should always use new_child.
-    void SendConsumerIdentified(BarrierNotifiable *done);
+    void SendConsumerIdentified(
+        BarrierNotifiable *done, EventReport *event = nullptr);
 
     /// Checks if the event in the report is something we are interested in, and
     /// if so, sends off a {Producer|Consumer}Identified{Valid|Invalid} message
@@ -676,6 +680,8 @@ public:
                                   BarrierNotifiable *done) override;
 };
 
+class RangeEventReportFlow;
+
 /// Producer-Consumer event handler for a sequence of bits represented by a
 /// dense block of consecutive event IDs.
 class BitRangeEventPC : public SimpleEventHandler
@@ -703,11 +709,29 @@ public:
     ///
     /// @param writer is the output flow to be used.
     ///
-    /// @param done is the notification callback. If it is NULL, the writer will
-    /// be invoked inline and potentially block the calling thread.
+    /// @param done is the notification callback. If it is NULL, the event
+    /// report is queued directly to the interface's write flow and the call
+    /// returns without waiting for it to be sent; writer is not used then.
     void Set(unsigned bit, bool new_value, WriteHelper *writer,
              BarrierNotifiable *done);
 
+    /// Updates all bits at once. The new values are compared to the backing
+    /// store a word at a time and the backing store is updated. An event
+    /// report is then produced for every bit that changed, by a flow that
+    /// allocates the buffers asynchronously and sends them in small batches
+    /// to the interface. The reports carry the values of this call, and are
+    /// sent after those of the earlier calls. Reports not yet sent when the
+    /// handler is destroyed are dropped.
+    ///
+    /// @param new_data points to the new bit values, in the same layout as
+    /// the backing store (size bits, rounded up to a multiple of 32).
+    ///
+    /// @param done will be notified when all event reports have been enqueued
+    /// to the physical layer. May be NULL.
+    ///
+    /// @return the number of bits that changed.
+    unsigned SetAll(const uint32_t *new_data, BarrierNotifiable *done);
+
     /// @returns the value of a given bit. 0 <= bit < size_.
     bool Get(unsigned bit) const;
 
@@ -738,6 +762,8 @@ private:
     Node *node_;
     uint32_t *data_;
     unsigned size_; //< number of bits stored.
+    /// Sends the event reports of SetAll. Created on first use.
+    RangeEventReportFlow *reportFlow_{nullptr};
 };
 
 /// Consumer event handler for a sequence of bytes represented by a dense block
@@ -802,6 +828,7 @@ public:
     /// 1 to value zero, event_base + 257 will set byte 1 to value 1, etc.
     ByteRangeEventP(Node *node, uint64_t event_base, uint8_t *backing_store,
                     unsigned size);
+    ~ByteRangeEventP();
 
     /// Requests the event associated with the current value of a specific byte
     /// to
@@ -814,6 +841,22 @@ public:
     /// @param done is the notification callback. Must not be NULL.
     void Update(unsigned byte, WriteHelper *writer, BarrierNotifiable *done);
 
+    /// Updates all bytes at once. The new values are compared to the backing
+    /// store a word at a time and the backing store is updated. The current
+    /// value event is then produced for every byte that changed, by a flow
+    /// that allocates the buffers asynchronously and sends them in small
+    /// batches to the interface. The reports carry the values of this call,
+    /// and are sent after those of the earlier calls. Reports not yet sent
+    /// when the handler is destroyed are dropped.
+    ///
+    /// @param new_data points to size bytes of new values.
+    ///
+    /// @param done will be notified when all event reports have been enqueued
+    /// to the physical layer. May be NULL.
+    ///
+    /// @return the number of bytes that changed.
+    unsigned SetAll(const uint8_t *new_data, BarrierNotifiable *done);
+
     /// Sends out a ProducerRangeIdentified.
     void SendIdentified(WriteHelper *writer, BarrierNotifiable *done);
 
@@ -841,6 +884,9 @@ public:
 private:
     /// Creates the eventid of the currently valid value of a given byte.
     uint64_t CurrentEventId(unsigned byte);
+
+    /// Sends the event reports of SetAll. Created on first use.
+    RangeEventReportFlow *reportFlow_{nullptr};
 };
 
 } // namespace openlcb
@@ -5,6 +5,7 @@
 #include <vector>
 #include <endian.h>
 
+#include "nmranet_config.h"
 #include "openlcb/EventService.hxx"
 
 #include "openlcb/EventServiceImpl.hxx"
@@ -47,12 +48,21 @@ void EventService::register_interface(If *iface)
     impl()->ownedFlows_.emplace_back(new InlineEventIteratorFlow(
         iface, this, EventService::Impl::MTI_VALUE_EVENT,
         EventService::Impl::MTI_MASK_EVENT));
-    impl()->ownedFlows_.emplace_back(new EventIteratorFlow(
+    // The identify all flows call the handlers inline, in batches, instead
+    // of allocating a buffer and going through the caller flow for every
+    // single handler. Handlers that use send_identified() hand their
+    // identified messages to the flow's IdentifyBatchWriter, which sends
+    // them a window at a time; the others still use their WriteHelpers.
+    impl()->ownedFlows_.emplace_back(new InlineEventIteratorFlow(
         iface, this, EventService::Impl::MTI_VALUE_GLOBAL,
-        EventService::Impl::MTI_MASK_GLOBAL));
-    impl()->ownedFlows_.emplace_back(new EventIteratorFlow(
+        EventService::Impl::MTI_MASK_GLOBAL,
+        config_event_identify_batch_size(),
+        config_event_identify_write_window()));
+    impl()->ownedFlows_.emplace_back(new InlineEventIteratorFlow(
         iface, this, EventService::Impl::MTI_VALUE_ADDRESSED_ALL,
-        EventService::Impl::MTI_MASK_ADDRESSED_ALL));
+        EventService::Impl::MTI_MASK_ADDRESSED_ALL,
+        config_event_identify_batch_size(),
+        config_event_identify_write_window()));
 }
 
 EventService::Impl::Impl(EventService *service) : callerFlow_(service)
@@ -251,31 +261,35 @@ StateFlowBase::Action EventIteratorFlow::iterate_next()
     EventRegistryEntry *entry = iterator_->next_entry();
     if (!entry)
     {
-        no_more_matches();
-        if (incomingDone_)
-        {
-            incomingDone_->notify();
-            incomingDone_ = nullptr;
-        }
+        return no_more_matches();
+    }
+    return dispatch_event(entry);
+}
+
+StateFlowBase::Action EventIteratorFlow::iteration_done()
+{
+    if (incomingDone_)
+    {
+        incomingDone_->notify();
+        incomingDone_ = nullptr;
+    }
 
 #ifdef DEBUG_EVENT_PERFORMANCE
-        long long len = os_get_time_monotonic() - currentProcessStart_;
-        numProcessNsec_ += len;
-        countEvents_++;
-        if (countEvents_ >= REPORT_COUNT)
-        {
-            //long msec = numProcessNsec_ / 1000000;
-            //printf("event perf for mti %04x: %ld msec for %d events\n",
-            //       mtiValue_, msec, REPORT_COUNT);
-            countEvents_ = 0;
-            numProcessNsec_ = 0;
-        }
+    long long len = os_get_time_monotonic() - currentProcessStart_;
+    numProcessNsec_ += len;
+    countEvents_++;
+    if (countEvents_ >= REPORT_COUNT)
+    {
+        //long msec = numProcessNsec_ / 1000000;
+        //printf("event perf for mti %04x: %ld msec for %d events\n",
+        //       mtiValue_, msec, REPORT_COUNT);
+        countEvents_ = 0;
+        numProcessNsec_ = 0;
+    }
 
 #endif
 
-        return exit();
-    }
-    return dispatch_event(entry);
+    return exit();
 }
 
 StateFlowBase::Action EventIteratorFlow::dispatch_event(const EventRegistryEntry *entry)
@@ -296,9 +310,17 @@ StateFlowBase::Action
 InlineEventIteratorFlow::dispatch_event(const EventRegistryEntry *entry)
 {
     currentEntry_ = entry;
+    if (holdingEventMutex_ && maxBatch_ && ++batchCount_ >= maxBatch_)
+    {
+        // Gives other event traffic a chance to grab the mutex. The iterator
+        // stays valid; epoch changes are detected in iterate_next.
+        event_caller_mutex.Unlock();
+        holdingEventMutex_ = false;
+    }
     if (!holdingEventMutex_)
     {
         holdingEventMutex_ = true; // will be true when we get called again
+        batchCount_ = 0;
         return allocate_and_call(STATE(perform_call), &event_caller_mutex);
     }
     else
@@ -307,13 +329,19 @@ InlineEventIteratorFlow::dispatch_event(const EventRegistryEntry *entry)
     }
 }
 
-void InlineEventIteratorFlow::no_more_matches()
+StateFlowBase::Action InlineEventIteratorFlow::no_more_matches()
 {
     if (holdingEventMutex_)
     {
         event_caller_mutex.Unlock();
         holdingEventMutex_ = false;
     }
+    if (writer_)
+    {
+        writer_->flush(this);
+        return wait_and_call(STATE(iteration_done));
+    }
+    return call_immediately(STATE(iteration_done));
 }
 
 StateFlowBase::Action InlineEventIteratorFlow::perform_call()
@@ -325,13 +353,138 @@ StateFlowBase::Action InlineEventIteratorFlow::perform_call()
     if (n_.abort_if_almost_done())
     {
         // Aborted. Event handler did not do any asynchronous action.
-        return call_immediately(STATE(iterate_next));
+        return call_immediately(STATE(call_done));
     }
     else
     {
         c->notify();
+        return wait_and_call(STATE(call_done));
+    }
+}
+
+StateFlowBase::Action InlineEventIteratorFlow::call_done()
+{
+    if (writer_ && writer_->full())
+    {
+        // Flow control: the handlers are not called again until this window
+        // of identified messages has left the interface.
+        writer_->flush(this);
         return wait_and_call(STATE(iterate_next));
     }
+    return call_immediately(STATE(iterate_next));
+}
+
+void IdentifyBatchWriter::add(
+    Node *node, Defs::MTI mti, EventId event, unsigned flags)
+{
+    bool range_ok = (flags & RANGE_OK) && is_single_identified(mti);
+    if (range_ok && runLength_ && node == runNode_ &&
+        (mti & ~3) == (runFirstMti_ & ~3) && event == runStart_ + runLength_)
+    {
+        ++runLength_;
+        runLastMti_ = mti;
+        return;
+    }
+    close_run();
+    if (range_ok)
+    {
+        runNode_ = node;
+        runFirstMti_ = runLastMti_ = mti;
+        runStart_ = event;
+        runLength_ = 1;
+    }
+    else
+    {
+        pending_.push_back({node, mti, event});
+    }
+}
+
+void IdentifyBatchWriter::close_run()
+{
+    EventId start = runStart_;
+    unsigned left = runLength_;
+    Defs::MTI range_mti = (runFirstMti_ & ~3) ==
+            Defs::MTI_PRODUCER_IDENTIFIED_VALID
+        ? Defs::MTI_PRODUCER_IDENTIFIED_RANGE
+        : Defs::MTI_CONSUMER_IDENTIFIED_RANGE;
+    while (left)
+    {
+        // Largest power-of-two block that is aligned at start and fits.
+        uint64_t size = start ? (start & -start) : (1ULL << 63);
+        while (size > left)
+        {
+            size >>= 1;
+        }
+        if (size == 1)
+        {
+            // Single events can only be at the two ends of the run.
+            pending_.push_back({runNode_,
+                start == runStart_ ? runFirstMti_ : runLastMti_, start});
+        }
+        else
+        {
+            // The bit above the block decides whether the mask is encoded
+            // by trailing ones or trailing zeros.
+            EventId range = (start & size) ? start : (start | (size - 1));
+            pending_.push_back({runNode_, range_mti, range});
+        }
+        start += size;
+        left -= size;
+    }
+    runNode_ = nullptr;
+    runLength_ = 0;
+}
+
+void IdentifyBatchWriter::flush(Notifiable *done)
+{
+    close_run();
+    if (pending_.empty())
+    {
+        done->notify();
+        return;
+    }
+    done_ = done;
+    next_ = 0;
+    sent_.reset(this);
+    start_flow(STATE(send_next));
+}
+
+StateFlowBase::Action IdentifyBatchWriter::send_next()
+{
+    while (next_ < pending_.size() && !pending_[next_].node->is_initialized())
+    {
+        // Same as WriteHelper: uninitialized nodes do not send messages.
+        ++next_;
+    }
+    if (next_ >= pending_.size())
+    {
+        sent_.notify();
+        return wait_and_call(STATE(all_sent));
+    }
+    return allocate_and_call(
+        pending_[next_].node->iface()->global_message_write_flow(),
+        STATE(fill_message));
+}
+
+StateFlowBase::Action IdentifyBatchWriter::fill_message()
+{
+    const Entry &e = pending_[next_];
+    auto *f = e.node->iface()->global_message_write_flow();
+    auto *b = get_allocation_result(f);
+    b->data()->reset(e.mti, e.node->node_id(), eventid_to_buffer(e.event));
+    b->set_done(sent_.new_child());
+    f->send(b, b->data()->priority());
+    ++next_;
+    return call_immediately(STATE(send_next));
+}
+
+StateFlowBase::Action IdentifyBatchWriter::all_sent()
+{
+    pending_.clear();
+    Notifiable *d = done_;
+    done_ = nullptr;
+    d->notify();
+    return exit();
 }
 
 } /* namespace openlcb */
@@ -119,6 +119,94 @@ public:
     };
 };
 
+/// Collects the identified messages of the event handlers for an Identify
+/// Events message (see @ref EventIdentifyBatch) and sends them to the
+/// interface. The messages are sent in windows: after sending a window of
+/// messages the writer waits until every one of them was enqueued to the
+/// physical layer (for CAN: until the frames left the transmit queue) before
+/// the event handlers are called again. Contiguous events of the same node
+/// and kind whose handler passed RANGE_OK are sent as range identified
+/// messages covering power-of-two aligned blocks.
+///
+/// Runs on the executor of the event service. The caller must not add()
+/// while a flush() is in progress.
+class IdentifyBatchWriter : public StateFlowBase, public EventIdentifyBatch
+{
+public:
+    /// Constructor.
+    ///
+    /// @param service the event service.
+    /// @param window how many messages to collect before the caller has to
+    /// flush().
+    IdentifyBatchWriter(Service *service, unsigned window)
+        : StateFlowBase(service)
+        , window_(window)
+    {
+        pending_.reserve(window);
+    }
+
+    void add(Node *node, Defs::MTI mti, EventId event,
+        unsigned flags = 0) OVERRIDE;
+
+    /// @return true if the caller should flush() before calling more event
+    /// handlers.
+    bool full()
+    {
+        return pending_.size() >= window_;
+    }
+
+    /// Sends every message collected so far.
+    ///
+    /// @param done notified when all messages were enqueued to the physical
+    /// layer.
+    void flush(Notifiable *done);
+
+private:
+    /// One message to send.
+    struct Entry
+    {
+        Node *node;
+        Defs::MTI mti;
+        EventId event;
+    };
+
+    /// @return true if this MTI can be part of a collapsed range. @param mti
+    /// is the MTI of the message.
+    static bool is_single_identified(Defs::MTI mti)
+    {
+        return (mti & ~3) == Defs::MTI_PRODUCER_IDENTIFIED_VALID ||
+            (mti & ~3) == Defs::MTI_CONSUMER_IDENTIFIED_VALID;
+    }
+
+    /// Turns the open run of contiguous events into messages in pending_.
+    void close_run();
+
+    Action send_next();
+    Action fill_message();
+    Action all_sent();
+
+    /// Messages waiting to be sent.
+    std::vector<Entry> pending_;
+    /// Index in pending_ of the next message to send.
+    unsigned next_{0};
+    /// Flush threshold.
+    unsigned window_;
+    /// Node of the open run; nullptr if there is no open run.
+    Node *runNode_{nullptr};
+    /// MTI of the first event in the open run.
+    Defs::MTI runFirstMti_;
+    /// MTI of the last event in the open run.
+    Defs::MTI runLastMti_;
+    /// First event of the open run.
+    EventId runStart_;
+    /// Number of events in the open run.
+    unsigned runLength_{0};
+    /// Children are held by the messages being sent.
+    BarrierNotifiable sent_;
+    /// Notified when the flush is complete.
+    Notifiable *done_{nullptr};
+};
+
 /** Flow to receive incoming messages of event protocol, and dispatch them to
  * the registered event handler. This flow runs on the executor of the event
  * service (and not necessarily the interface). Its main job is to iterate
@@ -133,12 +221,17 @@ public:
 protected:
     Action entry() OVERRIDE;
     Action iterate_next();
+    /// Completes the processing of the incoming message.
+    Action iteration_done();
 
 private:
     virtual Action dispatch_event(const EventRegistryEntry *entry);
     /// Called when there will be no more dispatch_event calls for this
-    /// iteration.
-    virtual void no_more_matches() {};
+    /// iteration. @return the next action; has to end in iteration_done.
+    virtual Action no_more_matches()
+    {
+        return call_immediately(STATE(iteration_done));
+    }
 
 protected:
     EventService *eventService_;
@@ -179,22 +272,51 @@ protected:
 class InlineEventIteratorFlow : public EventIteratorFlow
 {
 public:
+    /// Constructor.
+    ///
+    /// @param iface interface to listen on
+    /// @param event_service the owning event service
+    /// @param mti_value message ID to register for
+    /// @param mti_mask mask for the message ID registration
+    /// @param max_batch if nonzero, the event handler mutex will be released
+    /// after calling this many event handlers to let other event traffic
+    /// through. Zero means hold the mutex until the iteration is done.
+    /// @param write_window if nonzero, the event handlers get an
+    /// IdentifyBatchWriter in the report that sends their identified
+    /// messages this many at a time. Only for the identify all messages.
     InlineEventIteratorFlow(If *iface, EventService *event_service,
-                            unsigned mti_value, unsigned mti_mask)
+        unsigned mti_value, unsigned mti_mask, unsigned max_batch = 0,
+        unsigned write_window = 0)
         : EventIteratorFlow(iface, event_service, mti_value, mti_mask)
+        , maxBatch_(max_batch)
     {
+        if (write_window)
+        {
+            writer_.reset(new IdentifyBatchWriter(event_service, write_window));
+            eventReport_.batch = writer_.get();
+        }
     }
 
 private:
     Action dispatch_event(const EventRegistryEntry *entry) OVERRIDE;
-    void no_more_matches() OVERRIDE;
+    Action no_more_matches() OVERRIDE;
 
     Action perform_call();
+    /// Flushes the identified messages if the writer is full, then proceeds
+    /// to the next handler.
+    Action call_done();
 
     /// True if we are already holding the event handler mutex.
     bool holdingEventMutex_{false};
+    /// How many handlers we called since acquiring the event handler mutex.
+    unsigned batchCount_{0};
+    /// How many handlers to call before releasing the event handler mutex;
+    /// zero for unlimited.
+    unsigned maxBatch_;
     /// The handler we need to call.
     const EventRegistryEntry *currentEntry_{nullptr};
+    /// Sends the identified messages; nullptr if not batching.
+    std::unique_ptr<IdentifyBatchWriter> writer_;
 };
 
 } // namespace openlcb
@@ -244,6 +244,24 @@ struct GenMessage
 /// to receive incoming NMRAnet messages.
 typedef FlowInterface<Buffer<GenMessage>> MessageHandler;
 
+/// Receives requests for node IDs that are not registered as local nodes on
+/// an interface. Used for hosting virtual nodes that are only created when
+/// someone on the bus is looking for them (see @ref VirtualNodeHost).
+class LocalNodeProvider
+{
+public:
+    virtual ~LocalNodeProvider()
+    {
+    }
+
+    /** Called on the interface's executor when an incoming message is looking
+     * for a node ID that is not a local node (yet).
+     *
+     * @param id is the 48-bit NMRAnet node ID that was asked for.
+     */
+    virtual void node_requested(NodeID id) = 0;
+};
+
 /// Abstract class representing an OpenLCB Interface. All interaction between
 /// the local software stack and the physical bus has to go through this
 /// class. The API that's not specific to the wire protocol appears here. The
@@ -371,6 +389,31 @@ public:
         return it->second;
     }
 
+    /** Sets the object that will be asked to create local nodes on demand.
+     * @param provider is the new provider, or nullptr to disable. */
+    void set_local_node_provider(LocalNodeProvider *provider)
+    {
+        localNodeProvider_ = provider;
+    }
+
+    /** @return the object that creates local nodes on demand, or nullptr if
+     * there is none. */
+    LocalNodeProvider *local_node_provider()
+    {
+        return localNodeProvider_;
+    }
+
+    /** Notifies the local node provider (if any) that a node ID not present
+     * in the local nodes was asked for. Must be called from the interface's
+     * executor. @param id is the node ID being looked for. */
+    void local_node_requested(NodeID id)
+    {
+        if (localNodeProvider_)
+        {
+            localNodeProvider_->node_requested(id);
+        }
+    }
+
     /** @returns true if the two node handles match as far as we can tell
      * without doing any network traffic. */
     virtual bool matching_node(NodeHandle expected,
@@ -397,6 +440,9 @@ private:
     /// Local virtual nodes registered on this interface.
     VNodeMap localNodes_;
 
+    /// Creates local nodes on demand. May be null.
+    LocalNodeProvider *localNodeProvider_;
+
     friend class VerifyNodeIdHandler;
 
     DISALLOW_COPY_AND_ASSIGN(If);
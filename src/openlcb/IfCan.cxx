@@ -298,6 +298,10 @@ public:
         NodeAlias local_alias = if_can()->local_aliases()->lookup(node_id);
         if (!node_id || !local_alias)
         {
+            if (node_id && !if_can()->lookup_local_node(node_id))
+            {
+                if_can()->local_node_requested(node_id);
+            }
             return release_and_exit();
         }
         auto* b = reinterpret_cast<Buffer<CanHubData>*>(transfer_message());
@@ -174,7 +174,10 @@ public:
             srcNode_ = iface()->lookup_local_node(id);
             if (!srcNode_)
             {
-                // Someone looking for a node that's not on this interface.
+                // Someone looking for a node that's not on this interface. It
+                // might be a virtual node that is created on demand; it will
+                // announce itself with Initialization Complete.
+                iface()->local_node_requested(id);
                 return release_and_exit();
             }
 #ifndef SIMPLE_NODE_ONLY
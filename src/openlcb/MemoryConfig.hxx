@@ -39,6 +39,7 @@
 #include "openlcb/DatagramHandlerDefault.hxx"
 #include "openlcb/MemoryConfig.hxx"
 #include "utils/Destructable.hxx"
+#include "utils/Lzss.hxx"
 #include "utils/ConfigUpdateService.hxx"
 
 class Notifiable;
@@ -321,6 +322,47 @@ private:
     const address_t len_; //< Length of block to serve.
 };
 
+/// Memory space implementation that exports a block of data that is stored
+/// LZSS-compressed in memory (typically flash). The data is decompressed on
+/// the fly as it is read. Sequential reads (which is how configuration tools
+/// download the CDI) cost O(1) per byte; a read before the previous read
+/// position restarts the decompression from the beginning.
+class CompressedMemoryBlock : public MemorySpace
+{
+public:
+    /** Initializes the memory block.
+     * @param data is the output of lzss_compress (with header). Must stay
+     * alive as long as this object is alive.
+     * @param len is the number of bytes in data. */
+    CompressedMemoryBlock(const void *data, size_t len)
+        : decoder_(data, len)
+    {
+    }
+
+    address_t max_address() OVERRIDE
+    {
+        return decoder_.size() - 1;
+    }
+
+    size_t read(address_t source, uint8_t *dst, size_t len, errorcode_t *error,
+                Notifiable *again) OVERRIDE
+    {
+        if (source >= decoder_.size()) {
+            *error = MemoryConfigDefs::ERROR_OUT_OF_BOUNDS;
+            return 0;
+        }
+        if (source < decoder_.position())
+        {
+            decoder_.reset();
+        }
+        decoder_.skip(source - decoder_.position());
+        return decoder_.decode(dst, len);
+    }
+
+private:
+    LzssDecoder decoder_; //< Streaming decompressor for the data.
+};
+
 /// Memory space implementation that exports a some memory-mapped data as a
 /// read-write memory space. The data must be given as a void* pointer pointing
 /// to RAM (or other memory-mapped structures).
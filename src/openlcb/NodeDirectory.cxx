@@ -0,0 +1,483 @@
+/** \copyright
+ * Copyright (c) 2026, agent
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *  - Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ *  - Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ * \file NodeDirectory.cxx
+ *
+ * Cache of the protocol and identification information of the nodes on the
+ * network.
+ *
+ * @author agent
+ * @date 19 Oct 2026
+ */
+
+#include "openlcb/NodeDirectory.hxx"
+
+#include <stdio.h>
+#include <unistd.h>
+
+namespace openlcb
+{
+
+/// First bytes of a saved directory file.
+static const char DIRECTORY_FILE_MAGIC[] = "OpenMRN node directory 1\n";
+
+class NodeDirectory::Fetcher : public StateFlowBase
+{
+public:
+    /// @param parent is the owning directory.
+    Fetcher(NodeDirectory *parent)
+        : StateFlowBase(parent->node_->iface())
+        , parent_(parent)
+        , pip_(parent->node_->iface())
+        , snip_(parent->node_->iface())
+    {
+    }
+
+    /// Starts fetching a node. The fetcher must be idle.
+    /// @param dst is the node to fetch.
+    /// @param generation is the generation of the node's entry.
+    void start(NodeHandle dst, unsigned generation)
+    {
+        set(dst, generation);
+        start_flow(STATE(fetch_pip));
+    }
+
+    /// Makes the PIP or SNIP request in progress finish now. Must be called
+    /// on the interface's executor.
+    void cancel()
+    {
+        pip_.cancel();
+        snip_.cancel();
+    }
+
+private:
+    /// Sets up the state for fetching a new node.
+    /// @param dst is the node to fetch.
+    /// @param generation is the generation of the node's entry.
+    void set(NodeHandle dst, unsigned generation)
+    {
+        dst_ = dst;
+        generation_ = generation;
+        result_ = NodeDirectoryEntry();
+        result_.id = dst.id;
+    }
+
+    Action fetch_pip()
+    {
+        pip_.request(dst_, parent_->node_, this);
+        return wait_and_call(STATE(pip_done));
+    }
+
+    Action pip_done()
+    {
+        if (parent_->is_shutdown())
+        {
+            return call_immediately(STATE(finish));
+        }
+        if (pip_.error_code() == PIPClient::OPERATION_SUCCESS)
+        {
+            result_.protocols = pip_.response();
+            result_.flags |= NodeDirectoryEntry::HAS_PIP;
+            if ((result_.protocols & Defs::SIMPLE_NODE_INFORMATION) == 0)
+            {
+                return call_immediately(STATE(finish));
+            }
+        }
+        // If PIP failed, we still try SNIP; older nodes may not know PIP.
+        snip_.request(dst_, parent_->node_, this);
+        return wait_and_call(STATE(snip_done));
+    }
+
+    Action snip_done()
+    {
+        if (snip_.error_code() == SNIPClient::OPERATION_SUCCESS)
+        {
+            decode_snip_response(snip_.response(), &result_.snip);
+            result_.flags |= NodeDirectoryEntry::HAS_SNIP;
+        }
+        else if (!(result_.flags & NodeDirectoryEntry::HAS_PIP))
+        {
+            result_.flags |= NodeDirectoryEntry::FAILED;
+        }
+        return call_immediately(STATE(finish));
+    }
+
+    Action finish()
+    {
+        NodeHandle next;
+        unsigned next_generation;
+        if (parent_->fetch_done(
+                this, result_, generation_, &next, &next_generation))
+        {
+            set(next, next_generation);
+            return call_immediately(STATE(fetch_pip));
+        }
+        return exit();
+    }
+
+    /// Owning directory.
+    NodeDirectory *parent_;
+    /// Queries the protocols.
+    PIPClient pip_;
+    /// Queries the simple node information.
+    SNIPClient snip_;
+    /// Node being fetched.
+    NodeHandle dst_;
+    /// Generation of the directory entry when the fetch started.
+    unsigned generation_;
+    /// Information collected so far.
+    NodeDirectoryEntry result_;
+};
+
+class NodeDirectory::Learner : public MessageHandler
+{
+public:
+    /// @param parent is the owning directory.
+    Learner(NodeDirectory *parent)
+        : parent_(parent)
+    {
+        iface()->dispatcher()->register_handler(
+            this, Defs::MTI_INITIALIZATION_COMPLETE, Defs::MTI_EXACT ^ 1);
+        iface()->dispatcher()->register_handler(
+            this, Defs::MTI_VERIFIED_NODE_ID_NUMBER, Defs::MTI_EXACT ^ 1);
+    }
+
+    ~Learner()
+    {
+        iface()->dispatcher()->unregister_handler_all(this);
+    }
+
+    void send(Buffer<GenMessage> *message, unsigned priority) override
+    {
+        AutoReleaseBuffer<GenMessage> rb(message);
+        NodeHandle h = message->data()->src;
+        if (message->data()->payload.size() >= 6)
+        {
+            h.id = data_to_node_id(message->data()->payload.data());
+        }
+        if (!h.id || iface()->lookup_local_node(h.id))
+        {
+            return;
+        }
+        bool reinit = (message->data()->mti | 1) ==
+            (Defs::MTI_INITIALIZATION_COMPLETE | 1);
+        parent_->learn(h, reinit);
+    }
+
+private:
+    /// @return the interface we are listening on.
+    If *iface()
+    {
+        return parent_->node_->iface();
+    }
+
+    /// Owning directory.
+    NodeDirectory *parent_;
+};
+
+NodeDirectory::NodeDirectory(Node *node, unsigned concurrency)
+    : node_(node)
+{
+    HASSERT(concurrency > 0);
+    for (unsigned i = 0; i < concurrency; ++i)
+    {
+        fetchers_.emplace_back(new Fetcher(this));
+        idle_.push_back(fetchers_.back().get());
+    }
+    learner_.reset(new Learner(this));
+}
+
+NodeDirectory::~NodeDirectory()
+{
+    learner_.reset();
+    {
+        OSMutexLock h(&lock_);
+        shutdown_ = true;
+        pending_.clear();
+    }
+    // The fetchers and their PIP and SNIP clients refer to us, so we have to
+    // wait until they are all idle. A fetcher may still be allocating a
+    // buffer for its request when we cancel, hence the loop.
+    bool completed = false;
+    while (!completed)
+    {
+        node_->iface()->executor()->sync_run([this, &completed]()
+            {
+                for (auto &f : fetchers_)
+                {
+                    f->cancel();
+                }
+                OSMutexLock h(&lock_);
+                completed = (inFlight_ == 0);
+            });
+    }
+}
+
+bool NodeDirectory::is_shutdown()
+{
+    OSMutexLock h(&lock_);
+    return shutdown_;
+}
+
+void NodeDirectory::discover()
+{
+    auto *b = node_->iface()->global_message_write_flow()->alloc();
+    b->data()->reset(
+        Defs::MTI_VERIFY_NODE_ID_GLOBAL, node_->node_id(), EMPTY_PAYLOAD);
+    node_->iface()->global_message_write_flow()->send(b);
+}
+
+void NodeDirectory::add_node(NodeHandle node)
+{
+    learn(node, false);
+}
+
+void NodeDirectory::learn(NodeHandle node, bool reinit)
+{
+    OSMutexLock h(&lock_);
+    auto it = entries_.find(node.id);
+    if (it == entries_.end())
+    {
+        Entry &e = entries_[node.id];
+        e.info.id = node.id;
+        queue_locked(&e, node);
+    }
+    else if (reinit)
+    {
+        Entry &e = it->second;
+        ++e.generation;
+        e.info = NodeDirectoryEntry();
+        e.info.id = node.id;
+        if (!e.queued)
+        {
+            queue_locked(&e, node);
+        }
+    }
+    start_fetchers_locked();
+}
+
+void NodeDirectory::queue_locked(Entry *e, NodeHandle node)
+{
+    e->queued = true;
+    pending_.push_back(node);
+}
+
+void NodeDirectory::start_fetchers_locked()
+{
+    while (!idle_.empty() && !pending_.empty())
+    {
+        Fetcher *f = idle_.back();
+        idle_.pop_back();
+        NodeHandle node = pending_.front();
+        pending_.pop_front();
+        ++inFlight_;
+        f->start(node, entries_[node.id].generation);
+    }
+}
+
+bool NodeDirectory::fetch_done(Fetcher *f, const NodeDirectoryEntry &result,
+    unsigned generation, NodeHandle *next, unsigned *next_generation)
+{
+    OSMutexLock h(&lock_);
+    Entry &e = entries_[result.id];
+    if (e.generation == generation)
+    {
+        e.info = result;
+        e.queued = false;
+    }
+    else if (!shutdown_)
+    {
+        // The node initialized again while we were fetching it; the alias
+        // may have changed too.
+        pending_.push_back(NodeHandle(result.id));
+    }
+    if (!pending_.empty())
+    {
+        *next = pending_.front();
+        pending_.pop_front();
+        *next_generation = entries_[next->id].generation;
+        return true;
+    }
+    --inFlight_;
+    idle_.push_back(f);
+    return false;
+}
+
+bool NodeDirectory::lookup(NodeID id, NodeDirectoryEntry *entry)
+{
+    OSMutexLock h(&lock_);
+    auto it = entries_.find(id);
+    if (it == entries_.end())
+    {
+        return false;
+    }
+    if (entry)
+    {
+        *entry = it->second.info;
+    }
+    return true;
+}
+
+std::vector<NodeID> NodeDirectory::nodes()
+{
+    OSMutexLock h(&lock_);
+    std::vector<NodeID> ret;
+    ret.reserve(entries_.size());
+    for (auto &e : entries_)
+    {
+        ret.push_back(e.first);
+    }
+    return ret;
+}
+
+size_t NodeDirectory::pending()
+{
+    OSMutexLock h(&lock_);
+    return pending_.size() + inFlight_;
+}
+
+/// Appends a zero-terminated string to the file contents. @param s is the
+/// string. @param output is the file contents.
+static void append_string(const string &s, string *output)
+{
+    output->append(s.c_str(), strlen(s.c_str()) + 1);
+}
+
+bool NodeDirectory::save(const string &path)
+{
+    string data(DIRECTORY_FILE_MAGIC);
+    {
+        OSMutexLock h(&lock_);
+        for (auto &it : entries_)
+        {
+            const NodeDirectoryEntry &e = it.second.info;
+            if (!(e.flags &
+                    (NodeDirectoryEntry::HAS_PIP | NodeDirectoryEntry::HAS_SNIP)))
+            {
+                continue;
+            }
+            data += node_id_to_buffer(e.id);
+            data += node_id_to_buffer(e.protocols);
+            data.push_back(e.flags);
+            append_string(e.snip.manufacturer_name, &data);
+            append_string(e.snip.model_name, &data);
+            append_string(e.snip.hardware_version, &data);
+            append_string(e.snip.software_version, &data);
+            append_string(e.snip.user_name, &data);
+            append_string(e.snip.user_description, &data);
+        }
+    }
+    // Writes to a temporary file first so that a crash does not leave a
+    // truncated snapshot behind.
+    string tmp = path + ".tmp";
+    FILE *f = fopen(tmp.c_str(), "wb");
+    if (!f)
+    {
+        return false;
+    }
+    bool ok = fwrite(data.data(), 1, data.size(), f) == data.size();
+    ok = (fclose(f) == 0) && ok;
+    if (!ok || rename(tmp.c_str(), path.c_str()) != 0)
+    {
+        unlink(tmp.c_str());
+        return false;
+    }
+    return true;
+}
+
+/// Reads a zero-terminated string from the file contents.
+/// @param data is the file contents.
+/// @param pos is the offset to read from; will be moved after the string.
+/// @param output is the string read.
+/// @return false if there is no terminated string at pos.
+static bool read_string(const string &data, size_t *pos, string *output)
+{
+    size_t end = data.find('\0', *pos);
+    if (end == string::npos)
+    {
+        return false;
+    }
+    output->assign(data, *pos, end - *pos);
+    *pos = end + 1;
+    return true;
+}
+
+bool NodeDirectory::load(const string &path)
+{
+    FILE *f = fopen(path.c_str(), "rb");
+    if (!f)
+    {
+        return false;
+    }
+    string data;
+    char buf[1024];
+    size_t nr;
+    while ((nr = fread(buf, 1, sizeof(buf), f)) > 0)
+    {
+        data.append(buf, nr);
+    }
+    fclose(f);
+    const size_t magic_len = sizeof(DIRECTORY_FILE_MAGIC) - 1;
+    if (data.compare(0, magic_len, DIRECTORY_FILE_MAGIC) != 0)
+    {
+        return false;
+    }
+    std::vector<NodeDirectoryEntry> loaded;
+    size_t pos = magic_len;
+    while (pos < data.size())
+    {
+        if (pos + 13 > data.size())
+        {
+            return false;
+        }
+        NodeDirectoryEntry e;
+        e.id = data_to_node_id(&data[pos]);
+        e.protocols = data_to_node_id(&data[pos + 6]);
+        e.flags = data[pos + 12];
+        pos += 13;
+        if (!read_string(data, &pos, &e.snip.manufacturer_name) ||
+            !read_string(data, &pos, &e.snip.model_name) ||
+            !read_string(data, &pos, &e.snip.hardware_version) ||
+            !read_string(data, &pos, &e.snip.software_version) ||
+            !read_string(data, &pos, &e.snip.user_name) ||
+            !read_string(data, &pos, &e.snip.user_description))
+        {
+            return false;
+        }
+        loaded.push_back(e);
+    }
+    OSMutexLock h(&lock_);
+    for (auto &e : loaded)
+    {
+        if (entries_.find(e.id) == entries_.end())
+        {
+            entries_[e.id].info = e;
+        }
+    }
+    return true;
+}
+
+} // namespace openlcb
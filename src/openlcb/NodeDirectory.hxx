@@ -0,0 +1,214 @@
+/** \copyright
+ * Copyright (c) 2026, agent
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *  - Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ *  - Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ * \file NodeDirectory.hxx
+ *
+ * Cache of the protocol and identification information of the nodes on the
+ * network.
+ *
+ * @author agent
+ * @date 19 Oct 2026
+ */
+
+#ifndef _OPENLCB_NODEDIRECTORY_HXX_
+#define _OPENLCB_NODEDIRECTORY_HXX_
+
+#include <deque>
+#include <map>
+#include <memory>
+#include <vector>
+
+#include "executor/StateFlow.hxx"
+#include "openlcb/If.hxx"
+#include "openlcb/PIPClient.hxx"
+#include "openlcb/SNIPClient.hxx"
+#include "openlcb/SimpleNodeInfo.hxx"
+#include "os/OS.hxx"
+
+namespace openlcb
+{
+
+/// What the NodeDirectory knows about a node.
+struct NodeDirectoryEntry
+{
+    /// Bits of the flags field.
+    enum Flags
+    {
+        /// The protocols field is valid.
+        HAS_PIP = 1,
+        /// The snip field is valid.
+        HAS_SNIP = 2,
+        /// Fetching the information failed; will retry when the node
+        /// initializes again.
+        FAILED = 4,
+    };
+
+    /// Node ID of the node.
+    NodeID id{0};
+    /// Protocol support bits (Defs::Protocols) from the PIP reply.
+    uint64_t protocols{0};
+    /// Decoded SNIP reply. Empty if the node does not support SNIP.
+    SnipDecodedData snip;
+    /// Bitmask of Flags.
+    uint8_t flags{0};
+};
+
+/// Keeps a directory of the nodes on the network with their Protocol
+/// Identification and Simple Node Information. Nodes are learned passively
+/// from the Initialization Complete and Verified Node ID messages that go
+/// around on the bus, and their information is fetched by a small number of
+/// parallel fetcher flows. When a node sends Initialization Complete again
+/// (e.g. after a reboot or a firmware update), its information is dropped and
+/// fetched again.
+///
+/// Lookups are answered from memory. The directory can be saved to a file and
+/// loaded at startup, so that a tool does not need to query every node again
+/// on every start.
+///
+/// Usage: create an instance with a local node to send the queries from, and
+/// optionally load() a snapshot. Call discover() to make all nodes on the
+/// network announce themselves.
+class NodeDirectory
+{
+public:
+    /// Constructor.
+    ///
+    /// @param node is the local node to send the queries from.
+    /// @param concurrency is how many nodes to query in parallel.
+    NodeDirectory(Node *node, unsigned concurrency = 4);
+
+    /// Cancels the fetches in progress and waits until the fetchers have
+    /// stopped. Must not be called on the interface's executor.
+    ~NodeDirectory();
+
+    /// Sends a global Verify Node ID message so that every node on the
+    /// network responds, and thus gets into the directory. May be called
+    /// from any thread.
+    void discover();
+
+    /// Adds a node to the directory, and fetches its information if it is
+    /// not known yet. Must be called on the interface's executor.
+    /// @param node is the node to add. The alias is used if known.
+    void add_node(NodeHandle node);
+
+    /// Looks up a node in the directory. May be called from any thread.
+    /// @param id is the node to look up.
+    /// @param entry if not null, will be filled with the information.
+    /// @return true if the node is known.
+    bool lookup(NodeID id, NodeDirectoryEntry *entry);
+
+    /// @return the IDs of all known nodes. May be called from any thread.
+    std::vector<NodeID> nodes();
+
+    /// @return how many nodes are waiting for their information to be
+    /// fetched or are being fetched now. May be called from any thread.
+    size_t pending();
+
+    /// Writes the known node information to a file. May be called from any
+    /// thread. @param path is the name of the file. @return false if the file
+    /// could not be written.
+    bool save(const string &path);
+
+    /// Loads node information from a file written by save(). Loaded nodes
+    /// are not queried again unless they initialize again. Nodes that are
+    /// already in the directory are not overwritten. May be called from any
+    /// thread.
+    /// @param path is the name of the file.
+    /// @return false if the file could not be read or was malformed.
+    bool load(const string &path);
+
+private:
+    /// Fetches the information of one node at a time.
+    class Fetcher;
+    /// Receives the Initialization Complete and Verified Node ID messages.
+    class Learner;
+    friend class Fetcher;
+    friend class Learner;
+
+    /// Directory entry with the bookkeeping.
+    struct Entry
+    {
+        /// Public information.
+        NodeDirectoryEntry info;
+        /// Incremented on every reinitialization of the node.
+        unsigned generation{0};
+        /// True if the node is in pending_ or being fetched.
+        bool queued{false};
+    };
+
+    /// Called from the Learner. @param node is the node seen. @param reinit
+    /// is true if the node has just initialized.
+    void learn(NodeHandle node, bool reinit);
+
+    /// Called from a Fetcher when it finished with a node. Stores the result
+    /// and hands out the next node to fetch.
+    /// @param f is the fetcher.
+    /// @param result is the fetched information.
+    /// @param generation is the generation of the entry when the fetch
+    /// started.
+    /// @param next will be filled with the next node to fetch.
+    /// @param next_generation will be filled with the generation of the next
+    /// node's entry.
+    /// @return true if there is a next node to fetch; false if the fetcher
+    /// became idle.
+    bool fetch_done(Fetcher *f, const NodeDirectoryEntry &result,
+        unsigned generation, NodeHandle *next, unsigned *next_generation);
+
+    /// Queues a node for fetching. Must be called with lock_ held.
+    /// @param e is the directory entry. @param node is the node to fetch.
+    void queue_locked(Entry *e, NodeHandle node);
+
+    /// Hands out pending nodes to idle fetchers. Must be called with lock_
+    /// held.
+    void start_fetchers_locked();
+
+    /// @return true if the directory is being destroyed.
+    bool is_shutdown();
+
+    /// Local node to send the queries from.
+    Node *node_;
+    /// Protects entries_, pending_, idle_, inFlight_ and shutdown_.
+    OSMutex lock_;
+    /// Known nodes.
+    std::map<NodeID, Entry> entries_;
+    /// Nodes to fetch, with the alias they were seen with.
+    std::deque<NodeHandle> pending_;
+    /// Fetchers; owned.
+    std::vector<std::unique_ptr<Fetcher>> fetchers_;
+    /// Fetchers that are not working on a node.
+    std::vector<Fetcher *> idle_;
+    /// Message handler for learning nodes.
+    std::unique_ptr<Learner> learner_;
+    /// Number of nodes being fetched now.
+    unsigned inFlight_{0};
+    /// True if the directory is being destroyed; fetchers stop at the next
+    /// step.
+    bool shutdown_{false};
+};
+
+} // namespace openlcb
+
+#endif // _OPENLCB_NODEDIRECTORY_HXX_
@@ -82,6 +82,15 @@ public:
         start_flow(STATE(request_buffer));
     }
 
+    /** Stops waiting for the response to the current request; done is then
+     * notified with a TIMEOUT error. Does nothing if the request is not
+     * waiting for the response (yet). Must be called on the interface's
+     * executor. */
+    void cancel()
+    {
+        timer_.ensure_triggered();
+    }
+
     /** @return the error code of the last request, or one of the internal
      * error codes from \ref PIPClient::ResultCodes */
     uint32_t error_code()
@@ -0,0 +1,130 @@
+/** \copyright
+ * Copyright (c) 2026, agent
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *  - Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ *  - Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ * \file SNIPClient.cxx
+ *
+ * A client library for talking to an arbitrary openlcb Node and ask it for the
+ * Simple Node Ident Info data.
+ *
+ * @author agent
+ * @date 19 Oct 2026
+ */
+
+#include "openlcb/SNIPClient.hxx"
+
+namespace openlcb
+{
+
+long long SNIP_CLIENT_TIMEOUT_NSEC = SEC_TO_NSEC(4);
+
+/// Skips a zero-terminated string in a SNIP payload.
+/// @param payload is the SNIP payload.
+/// @param pos is the offset of the string start, or npos.
+/// @return the offset after the terminating zero, or npos if there is no
+/// terminating zero.
+static size_t skip_string(const Payload &payload, size_t pos)
+{
+    if (pos == string::npos)
+    {
+        return pos;
+    }
+    pos = payload.find('\0', pos);
+    return pos == string::npos ? pos : pos + 1;
+}
+
+bool SNIPClient::is_complete(const Payload &payload)
+{
+    if (payload.empty())
+    {
+        return false;
+    }
+    // Same rules as in decode_snip_response().
+    int sys_ver = (uint8_t)payload[0];
+    size_t pos = 1;
+    for (int i = 0; i < 4 || i < sys_ver; ++i)
+    {
+        pos = skip_string(payload, pos);
+    }
+    if (pos == string::npos || pos >= payload.size())
+    {
+        return false;
+    }
+    // Skips the user version byte.
+    pos = skip_string(payload, pos + 1);
+    pos = skip_string(payload, pos);
+    return pos != string::npos;
+}
+
+void SNIPClient::handle_response(Buffer<GenMessage> *message)
+{
+    AutoReleaseBuffer<GenMessage> rb(message);
+    if (!(errorCode_ & OPERATION_PENDING))
+    {
+        // Late reply after we have finished.
+        return;
+    }
+    if (src_ != message->data()->dstNode ||
+        !iface()->matching_node(dst_, message->data()->src))
+    {
+        // Not from the right place.
+        return;
+    }
+    if (message->data()->mti == Defs::MTI_OPTIONAL_INTERACTION_REJECTED ||
+        message->data()->mti == Defs::MTI_TERMINATE_DUE_TO_ERROR)
+    {
+        uint16_t mti, error_code;
+        buffer_to_error(message->data()->payload, &error_code, &mti, nullptr);
+        if (mti && mti != Defs::MTI_IDENT_INFO_REQUEST)
+        {
+            // Got error response for a different interaction. Ignore.
+            return;
+        }
+        errorCode_ = error_code;
+    }
+    else if (message->data()->mti == Defs::MTI_IDENT_INFO_REPLY)
+    {
+        response_ += message->data()->payload;
+        if (!is_complete(response_))
+        {
+            // Waits for more reply messages.
+            return;
+        }
+        errorCode_ = OPERATION_SUCCESS;
+    }
+    else
+    {
+        // Dunno what this MTI is. Ignore.
+        LOG(INFO, "Unexpected MTI for SNIP response handler: %04x",
+            message->data()->mti);
+        return;
+    }
+
+    // Wakes up parent flow.
+    errorCode_ &= ~OPERATION_PENDING;
+    timer_.trigger();
+}
+
+} // namespace openlcb
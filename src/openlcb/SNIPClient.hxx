@@ -0,0 +1,214 @@
+/** \copyright
+ * Copyright (c) 2026, agent
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *  - Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ *  - Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ * \file SNIPClient.hxx
+ *
+ * A client library for talking to an arbitrary openlcb Node and ask it for the
+ * Simple Node Ident Info data.
+ *
+ * @author agent
+ * @date 19 Oct 2026
+ */
+
+#ifndef _OPENLCB_SNIPCLIENT_HXX_
+#define _OPENLCB_SNIPCLIENT_HXX_
+
+#include "executor/StateFlow.hxx"
+#include "openlcb/Defs.hxx"
+#include "openlcb/If.hxx"
+#include "os/os.h"
+
+namespace openlcb
+{
+
+/** Specifies how long to wait for a SNIP request to get a response. Writable
+ * for unittesting purposes. Defaults to 4 seconds. */
+extern long long SNIP_CLIENT_TIMEOUT_NSEC;
+
+/// State flow to request SNIP information from a remote node on the OpenLCB
+/// network.
+///
+/// Usage:
+///
+/// Create a global or local instance of this flow. Call the @ref request()
+/// function with the arguments, supplying as notifiable the calling flow or a
+/// sync notifiable for blocking operation on a thread. Wait for the
+/// notification. Check that @ref error_code() == OPEATION_SUCCESS, then access
+/// the returned payload via the @ref response() accessor, for example with
+/// decode_snip_response().
+///
+/// The response is collected from any number of reply messages, until all
+/// the fields have arrived. This supports nodes that do not use the
+/// continuation bits to mark multi-frame replies.
+class SNIPClient : public StateFlowBase
+{
+public:
+    SNIPClient(If *iface)
+        : StateFlowBase(iface)
+    {
+    }
+
+    /** Sends a SNIP request to the specified node.
+     *
+     * @param dst is the target node to query
+     * @param src is the source node from which to send query
+     * @param done will be notified if the request succeeds or fails or
+     * timeouts)
+     */
+    void request(NodeHandle dst, Node *src, Notifiable *done)
+    {
+        src_ = src;
+        dst_ = dst;
+        done_ = done;
+        errorCode_ = OPERATION_PENDING;
+        response_.clear();
+        start_flow(STATE(request_buffer));
+    }
+
+    /** Stops waiting for the response to the current request; done is then
+     * notified with a TIMEOUT error. Does nothing if the request is not
+     * waiting for the response (yet). Must be called on the interface's
+     * executor. */
+    void cancel()
+    {
+        timer_.ensure_triggered();
+    }
+
+    /** @return the error code of the last request, or one of the internal
+     * error codes from \ref SNIPClient::ResultCodes */
+    uint32_t error_code()
+    {
+        return errorCode_;
+    }
+
+    /** Returns the response payload of the last request, or unspecified if
+     * the last request has not succeeded. */
+    const Payload &response()
+    {
+        return response_;
+    }
+
+    enum ResultCodes
+    {
+        // Internal error codes generated by the send flow
+        OPERATION_SUCCESS = 0x10000, //< set when the complete reply arrives
+        OPERATION_PENDING = 0x20000, //< cleared when done is called.
+        TIMEOUT = 0x80000,           //< Timeout waiting for the reply.
+
+        IDLE = 0xFFFF0000, //< The current flow is not in use.
+    };
+
+    /** @return true if the payload contains every field of a SNIP reply.
+     * @param payload is the (partial) reply. */
+    static bool is_complete(const Payload &payload);
+
+private:
+    enum
+    {
+        MTI_1a = Defs::MTI_TERMINATE_DUE_TO_ERROR,
+        MTI_1b = Defs::MTI_OPTIONAL_INTERACTION_REJECTED,
+        MASK_1 = ~(MTI_1a ^ MTI_1b),
+        MTI_1 = MTI_1a,
+
+        MTI_2 = Defs::MTI_IDENT_INFO_REPLY,
+        MASK_2 = Defs::MTI_EXACT,
+    };
+
+    Action request_buffer()
+    {
+        return allocate_and_call(
+            iface()->addressed_message_write_flow(), STATE(write_request));
+    }
+
+    Action write_request()
+    {
+        auto *b =
+            get_allocation_result(iface()->addressed_message_write_flow());
+        b->data()->reset(Defs::MTI_IDENT_INFO_REQUEST, src_->node_id(), dst_,
+            EMPTY_PAYLOAD);
+
+        iface()->dispatcher()->register_handler(
+            &responseHandler_, MTI_1, MASK_1);
+        iface()->dispatcher()->register_handler(
+            &responseHandler_, MTI_2, MASK_2);
+
+        iface()->addressed_message_write_flow()->send(b);
+
+        return sleep_and_call(
+            &timer_, SNIP_CLIENT_TIMEOUT_NSEC, STATE(response_came));
+    }
+
+    // Callback from the response handler.
+    void handle_response(Buffer<GenMessage> *message);
+
+    Action response_came()
+    {
+        if (errorCode_ & OPERATION_PENDING)
+        {
+            errorCode_ = TIMEOUT;
+        }
+        iface()->dispatcher()->unregister_handler_all(&responseHandler_);
+        done_->notify();
+        return exit();
+    }
+
+    /// Message handler for incoming SNIP responses. Gets registered in the
+    /// input inteface's dispatcher and proxies an incoming SNIP response to
+    /// wake up the parent flow.
+    class SNIPResponseHandler : public MessageHandler
+    {
+    public:
+        SNIPResponseHandler(SNIPClient *parent)
+            : parent_(parent)
+        {
+        }
+
+        void send(Buffer<GenMessage> *message, unsigned priority) OVERRIDE
+        {
+            parent_->handle_response(message);
+        }
+
+    private:
+        SNIPClient *parent_;
+    };
+
+    If *iface()
+    {
+        return static_cast<If *>(service());
+    }
+
+    StateFlowTimer timer_{this};
+    Node *src_;
+    Notifiable *done_;
+    NodeHandle dst_;
+    Payload response_;
+    uint32_t errorCode_{IDLE};
+    SNIPResponseHandler responseHandler_{this};
+};
+
+} // namespace openlcb
+
+#endif // _OPENLCB_SNIPCLIENT_HXX_
@@ -37,9 +37,13 @@
 
 #include <fcntl.h>
 #include <unistd.h>
+#include <atomic>
+#include <vector>
 
 #include "openlcb/If.hxx"
 #include "executor/StateFlow.hxx"
+#include "utils/ConfigUpdateListener.hxx"
+#include "utils/ConfigUpdateService.hxx"
 
 namespace openlcb
 {
@@ -124,6 +128,11 @@ typedef StateFlow<Buffer<SimpleInfoResponse>, QList<1>> SimpleInfoFlowBase;
 /// pointer. The SimpleInfoFlow will assemble, fragment and send the response
 /// message.
 ///
+/// If a ConfigUpdateService exists when the flow is created, the assembled
+/// response is cached per descriptor array, and served from memory for later
+/// requests. The cache is dropped when the configuration is updated (the
+/// user data files may have changed) or when invalidate_cache() is called.
+///
 /// Example: see @SNIPHandler.
 class SimpleInfoFlow : public SimpleInfoFlowBase
 {
@@ -146,11 +155,24 @@ public:
         , maxBytesPerMessage_(
               max_bytes_per_message > 255 ? 255 : max_bytes_per_message)
         , useContinueBits_(use_continue_bits ? 1 : 0)
+        , cacheEnabled_(Singleton<ConfigUpdateService>::exists() ? 1 : 0)
+        , generation_(0)
+        , invalidator_(this)
     {
+        if (cacheEnabled_)
+        {
+            Singleton<ConfigUpdateService>::instance()
+                ->register_update_listener(&invalidator_);
+        }
     }
 
     ~SimpleInfoFlow()
     {
+        if (cacheEnabled_)
+        {
+            Singleton<ConfigUpdateService>::instance()
+                ->unregister_update_listener(&invalidator_);
+        }
         if (fd_ >= 0) {
             ::close(fd_);
             fd_ = -1;
@@ -158,16 +180,110 @@ public:
         }
     }
 
+    /// Drops the cached responses. Call this after changing the data that
+    /// the descriptors point to, unless the change is followed by a
+    /// configuration update. May be called from any thread.
+    void invalidate_cache()
+    {
+        ++generation_;
+    }
+
 private:
+    /// Invalidates the response cache when the configuration is updated.
+    class CacheInvalidator : public ConfigUpdateListener
+    {
+    public:
+        /// @param parent is the flow whose cache to invalidate.
+        CacheInvalidator(SimpleInfoFlow *parent)
+            : parent_(parent)
+        {
+        }
+
+        UpdateAction apply_configuration(
+            int fd, bool initial_load, BarrierNotifiable *done) override
+        {
+            AutoNotify n(done);
+            parent_->invalidate_cache();
+            return UPDATED;
+        }
+
+        void factory_reset(int fd) override
+        {
+            parent_->invalidate_cache();
+        }
+
+    private:
+        SimpleInfoFlow *parent_;
+    };
+
+    /// An assembled response.
+    struct CacheEntry
+    {
+        /// Which descriptor array this response belongs to.
+        const SimpleInfoDescriptor *descriptor;
+        /// Value of generation_ when the response was assembled.
+        unsigned generation;
+        /// Response payload.
+        string payload;
+    };
+
     Action entry() OVERRIDE
     {
         HASSERT(message()->data()->src);
         HASSERT(message()->data()->descriptor);
+        isFirstMessage_ = 1;
+        responseOffset_ = 0;
+        response_ = &assembled_response();
+        return call_immediately(STATE(continue_send));
+    }
+
+    /// @return the response payload for the current message's descriptor,
+    /// from the cache if possible.
+    const string &assembled_response()
+    {
+        const SimpleInfoDescriptor *d = message()->data()->descriptor;
+        if (!cacheEnabled_)
+        {
+            assemble(&uncachedResponse_);
+            return uncachedResponse_;
+        }
+        unsigned gen = generation_;
+        CacheEntry *e = nullptr;
+        for (auto &c : cache_)
+        {
+            if (c.descriptor == d)
+            {
+                e = &c;
+                break;
+            }
+        }
+        if (!e)
+        {
+            cache_.emplace_back();
+            e = &cache_.back();
+            e->descriptor = d;
+        }
+        else if (e->generation == gen)
+        {
+            return e->payload;
+        }
+        assemble(&e->payload);
+        e->generation = gen;
+        return e->payload;
+    }
+
+    /// Assembles the response for the current message's descriptor.
+    /// @param output will be filled with the response payload.
+    void assemble(string *output)
+    {
+        output->clear();
         entryOffset_ = 0;
         byteOffset_ = 0;
-        isFirstMessage_ = 1;
         update_for_next_entry();
-        return call_immediately(STATE(continue_send));
+        for (; !is_eof(); step_byte())
+        {
+            output->push_back(current_byte());
+        }
     }
 
     const SimpleInfoDescriptor &current_descriptor()
@@ -344,7 +460,7 @@ private:
 
     Action continue_send()
     {
-        if (is_eof())
+        if (responseOffset_ >= response_->size())
         {
             return release_and_exit();
         }
@@ -360,16 +476,15 @@ private:
                                             ->src->iface()
                                             ->addressed_message_write_flow());
         const SimpleInfoResponse &r = *message()->data();
-        b->data()->reset(r.mti, r.src->node_id(), r.dst, EMPTY_PAYLOAD);
-        for (uint8_t offset = 0; offset < maxBytesPerMessage_ && !is_eof();
-             ++offset, step_byte())
-        {
-            b->data()->payload.push_back(current_byte());
-        }
+        size_t len = std::min(
+            (size_t)maxBytesPerMessage_, response_->size() - responseOffset_);
+        b->data()->reset(r.mti, r.src->node_id(), r.dst,
+            response_->substr(responseOffset_, len));
+        responseOffset_ += len;
         b->data()->set_flag_dst(GenMessage::WAIT_FOR_LOCAL_LOOPBACK);
         if (useContinueBits_)
         {
-            if (!is_eof())
+            if (responseOffset_ < response_->size())
             {
                 b->data()->set_flag_dst(
                     GenMessage::DSTFLAG_NOT_LAST_MESSAGE);
@@ -401,8 +516,8 @@ private:
     unsigned isFirstMessage_ : 1;
     /** Tells which descriptor entry we are processing. */
     unsigned entryOffset_ : 5;
-#pragma clang diagnostic ignored "-Wunused-private-field"
-    unsigned reserved_ : 1; // for alignment
+    /** 1 if the responses are cached. */
+    unsigned cacheEnabled_ : 1;
 
     /** Byte offset within a descriptor entry. */
     unsigned byteOffset_ : 8;
@@ -415,6 +530,19 @@ private:
     /// fd of the last file we opened.
     int fd_{-1};
 
+    /// Incremented on every invalidation of the cache.
+    std::atomic<unsigned> generation_;
+    /// Registered for configuration updates if the cache is enabled.
+    CacheInvalidator invalidator_;
+    /// Assembled responses by descriptor.
+    std::vector<CacheEntry> cache_;
+    /// The response being assembled when the cache is disabled.
+    string uncachedResponse_;
+    /// The response being sent; points to the cache or uncachedResponse_.
+    const string *response_{nullptr};
+    /// How many bytes of the response were sent already.
+    size_t responseOffset_{0};
+
     BarrierNotifiable n_;
 };
 
@@ -57,6 +57,37 @@
 namespace openlcb
 {
 
+namespace
+{
+
+/// Memory space for the SNIP user data that drops the cached SNIP responses
+/// when written.
+class SnipUserMemorySpace : public FileMemorySpace
+{
+public:
+    /// @param info_flow is the flow caching the SNIP responses.
+    SnipUserMemorySpace(SimpleInfoFlow *info_flow)
+        : FileMemorySpace(
+              SNIP_DYNAMIC_FILENAME, sizeof(SimpleNodeDynamicValues))
+        , infoFlow_(info_flow)
+    {
+    }
+
+    size_t write(address_t destination, const uint8_t *data, size_t len,
+        errorcode_t *error, Notifiable *again) override
+    {
+        size_t ret =
+            FileMemorySpace::write(destination, data, len, error, again);
+        infoFlow_->invalidate_cache();
+        return ret;
+    }
+
+private:
+    SimpleInfoFlow *infoFlow_;
+};
+
+} // namespace
+
 SimpleCanStackBase::SimpleCanStackBase(const openlcb::NodeID node_id)
 {
     AddAliasAllocator(node_id, &ifCan_);
@@ -77,7 +108,8 @@ void SimpleCanStackBase::start_stack(bool delay_start)
 
     if (!delay_start) {
         // Bootstraps the alias allocation process.
-        ifCan_.alias_allocator()->send(ifCan_.alias_allocator()->alloc());
+        seed_alias_allocator(ifCan_.alias_allocator(), mainBufferPool,
+            config_reserved_alias_pool_size());
     }
 
     // Adds memory spaces.
@@ -104,8 +136,7 @@ void SimpleCanStackBase::default_start_node()
         additionalComponents_.emplace_back(space);
     }
     {
-        auto *space = new FileMemorySpace(
-            SNIP_DYNAMIC_FILENAME, sizeof(SimpleNodeDynamicValues));
+        auto *space = new SnipUserMemorySpace(&infoFlow_);
         memoryConfigHandler_.registry()->insert(
             node(), MemoryConfigDefs::SPACE_ACDI_USR, space);
         additionalComponents_.emplace_back(space);
@@ -119,6 +150,22 @@ void SimpleCanStackBase::default_start_node()
             node(), MemoryConfigDefs::SPACE_CDI, space);
         additionalComponents_.emplace_back(space);
     }
+    else if (CDI_COMPRESSED_SIZE > 0)
+    {
+        auto *space =
+            new CompressedMemoryBlock(CDI_COMPRESSED_DATA, CDI_COMPRESSED_SIZE);
+        memoryConfigHandler_.registry()->insert(
+            node(), MemoryConfigDefs::SPACE_CDI, space);
+        additionalComponents_.emplace_back(space);
+        if (config_compressed_cdi_space() != 0)
+        {
+            auto *raw_space = new ReadOnlyMemoryBlock(
+                CDI_COMPRESSED_DATA, CDI_COMPRESSED_SIZE);
+            memoryConfigHandler_.registry()->insert(
+                node(), config_compressed_cdi_space(), raw_space);
+            additionalComponents_.emplace_back(raw_space);
+        }
+    }
     if (CONFIG_FILENAME != nullptr)
     {
         auto *space = new FileMemorySpace(CONFIG_FILENAME, CONFIG_FILE_SIZE);
@@ -149,7 +196,8 @@ void SimpleTrainCanStack::start_node()
 void SimpleCanStackBase::start_after_delay()
 {
     // Bootstraps the alias allocation process.
-    ifCan_.alias_allocator()->send(ifCan_.alias_allocator()->alloc());
+    seed_alias_allocator(ifCan_.alias_allocator(), mainBufferPool,
+        config_reserved_alias_pool_size());
 }
 
 void SimpleCanStackBase::restart_stack()
@@ -170,7 +218,8 @@ void SimpleCanStackBase::restart_stack()
     }
 
     // Bootstraps the fresh alias allocation process.
-    ifCan_.alias_allocator()->send(ifCan_.alias_allocator()->alloc());
+    seed_alias_allocator(ifCan_.alias_allocator(), mainBufferPool,
+        config_reserved_alias_pool_size());
     extern void StartInitializationFlow(Node * node);
     StartInitializationFlow(node());
 }
@@ -58,6 +58,7 @@
 #include "utils/HubDevice.hxx"
 #include "utils/HubDeviceNonBlock.hxx"
 #include "utils/HubDeviceSelect.hxx"
+#include "utils/HubDeviceShm.hxx"
 
 namespace openlcb
 {
@@ -65,6 +66,15 @@ namespace openlcb
 /// This symbol contains the embedded text of the CDI xml file.
 extern const char CDI_DATA[];
 
+/// This symbol contains the LZSS-compressed CDI xml file, when the CDI was
+/// compiled with compression (see CompileCdiMain.cxx). In that case CDI_DATA
+/// is empty.
+extern const uint8_t CDI_COMPRESSED_DATA[];
+
+/// Number of bytes in CDI_COMPRESSED_DATA, or zero if the CDI is not
+/// compressed.
+extern const size_t CDI_COMPRESSED_SIZE;
+
 /// This symbol must be defined by the application to tell which file to open
 /// for the configuration listener.
 extern const char *const CONFIG_FILENAME;
@@ -211,6 +221,29 @@ public:
         create_gc_port_for_can_hub(&canHub0_, fd);
     }
 
+#if defined(__linux__)
+    /// Starts listening on a unix domain socket for other OpenMRN processes
+    /// on the same host. Each connecting process will be attached to the CAN
+    /// hub via shared memory, which is much cheaper than the TCP gridconnect
+    /// hub.
+    /// @param path file system path of the socket to create.
+    void start_shm_hub_server(const char *path)
+    {
+        HASSERT(!shmHub_);
+        shmHub_.reset(new ShmCanHub(&canHub0_, path));
+    }
+
+    /// Connects to the shared memory CAN hub of another process on the same
+    /// host (see start_shm_hub_server()).
+    /// @param path file system path of the socket the other process listens
+    /// on.
+    void connect_shm_hub(const char *path)
+    {
+        HubDeviceShm *port = connect_shm_can_hub(&canHub0_, path);
+        HASSERT(port);
+    }
+#endif
+
     /// Causes all CAN packets to be printed to stdout.
     void print_all_packets(bool timestamped = false)
     {
@@ -333,6 +366,11 @@ protected:
     /// Bridge between canHub_ and gcHub_. Lazily initialized.
     std::unique_ptr<GCAdapterBase> gcAdapter_;
 
+#if defined(__linux__)
+    /// Shared memory hub server. Lazily initialized.
+    std::unique_ptr<ShmCanHub> shmHub_;
+#endif
+
     /// Stores and keeps ownership of optional components.
     std::vector<std::unique_ptr<Destructable>> additionalComponents_;
 };
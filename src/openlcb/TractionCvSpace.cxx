@@ -47,6 +47,9 @@ static const int READ_RETRY_COUNT_ON_UNKNOWN = 10;
 // Maximum time we keep trying to read or write a given CV.
 static const int RAILCOM_POM_OP_TIMEOUT_MSEC = 2000;
 
+// How long we wait for the railcom feedback after the last packet was sent.
+static const int RAILCOM_POM_FEEDBACK_MSEC = 500;
+
 
 namespace openlcb
 {
@@ -70,7 +73,7 @@ TractionCvSpace::TractionCvSpace(MemoryConfigHandler *parent,
 TractionCvSpace::~TractionCvSpace()
 {
     parent_->registry()->erase(nullptr, spaceId_, this);
-    if (errorCode_ == ERROR_PENDING)
+    if (errorCode_ == ERROR_PENDING || batchActive_)
     {
         timer_.cancel();
     }
@@ -93,6 +96,10 @@ bool TractionCvSpace::set_node(Node *node)
         {
             dccAddress_ = new_address;
             errorCode_ = ERROR_NOOP;
+            if (!batchActive_)
+            {
+                batchSize_ = 0;
+            }
         }
         return true;
     }
@@ -116,6 +123,7 @@ size_t TractionCvSpace::read(address_t source, uint8_t *dst, size_t len,
         if (len > 3) dst[3] = lastcv[0];
         return std::min(len, size_t(4));
     }
+    bool indirect = false;
     if (source == OFFSET_CV_VALUE) {
         if (dccAddress_ != lastIndexedNode_) {
             *error = Defs::ERROR_PERMANENT;
@@ -123,6 +131,7 @@ size_t TractionCvSpace::read(address_t source, uint8_t *dst, size_t len,
         }
         // Translate from user-visible CV to wire protocol CV.
         source = lastIndexedCv_ - 1;
+        indirect = true;
         // fall through to regular processing
     }
     LOG(INFO, "cv read %" PRId32, source);
@@ -132,6 +141,20 @@ size_t TractionCvSpace::read(address_t source, uint8_t *dst, size_t len,
         errorCode_ = ERROR_NOOP;
         return 0;
     }
+    if (batchSize_ && !batchActive_ && source >= batch_[0].cv &&
+        source < batch_[0].cv + batchSize_)
+    {
+        return read_from_batch(source, dst, len, error);
+    }
+    batchSize_ = 0;
+    if (len > 1 && !indirect)
+    {
+        done_ = again;
+        start_batch(source, std::min(size_t(MAX_BATCH),
+                                std::min(len, size_t(MAX_CV + 1 - source))));
+        *error = ERROR_AGAIN;
+        return 0;
+    }
     if (source == cvNumber_) {
         if (errorCode_ == ERROR_OK) {
             *dst = cvData_;
@@ -163,26 +186,33 @@ StateFlowBase::Action TractionCvSpace::try_write1()
     return allocate_and_call(track_, STATE(fill_write1_packet));
 }
 
-StateFlowBase::Action TractionCvSpace::fill_read1_packet()
+void TractionCvSpace::fill_pom_packet(
+    dcc::Packet *pkt, unsigned cv, uint32_t key)
 {
-    auto *b = get_allocation_result(track_);
-    b->data()->start_dcc_packet();
+    pkt->start_dcc_packet();
     /** @TODO(balazs.racz) here we make bad assumptions about how to decide
      * between long and short addresses */
     if (dccAddress_ >= 0x80)
     {
-        b->data()->add_dcc_address(dcc::DccLongAddress(dccAddress_));
+        pkt->add_dcc_address(dcc::DccLongAddress(dccAddress_));
     }
     else
     {
-        b->data()->add_dcc_address(dcc::DccShortAddress(dccAddress_));
+        pkt->add_dcc_address(dcc::DccShortAddress(dccAddress_));
     }
-    b->data()->add_dcc_pom_read1(cvNumber_);
-    b->data()->feedback_key = reinterpret_cast<size_t>(this);
+    pkt->add_dcc_pom_read1(cv);
+    pkt->feedback_key = key;
+}
+
+StateFlowBase::Action TractionCvSpace::fill_read1_packet()
+{
+    auto *b = get_allocation_result(track_);
+    fill_pom_packet(b->data(), cvNumber_, feedback_key(this));
     railcomHub_->register_port(this);
     errorCode_ = ERROR_PENDING;
     track_->send(b);
-    return sleep_and_call(&timer_, MSEC_TO_NSEC(500), STATE(read_returned));
+    return sleep_and_call(&timer_, MSEC_TO_NSEC(RAILCOM_POM_FEEDBACK_MSEC),
+        STATE(read_returned));
 }
 
 StateFlowBase::Action TractionCvSpace::read_returned()
@@ -242,6 +272,7 @@ size_t TractionCvSpace::write(address_t destination, const uint8_t *src,
         errorCode_ = ERROR_NOOP;
         return 0;
     }
+    batchSize_ = 0;
     if (errorCode_ == ERROR_OK && destination == cvNumber_)
     {
         errorCode_ = ERROR_NOOP;
@@ -279,11 +310,12 @@ StateFlowBase::Action TractionCvSpace::fill_write1_packet()
         b->data()->add_dcc_address(dcc::DccShortAddress(dccAddress_));
     }
     b->data()->add_dcc_pom_write1(cvNumber_, cvData_);
-    b->data()->feedback_key = reinterpret_cast<size_t>(this);
+    b->data()->feedback_key = feedback_key(this);
     railcomHub_->register_port(this);
     errorCode_ = ERROR_PENDING;
     track_->send(b);
-    return sleep_and_call(&timer_, MSEC_TO_NSEC(500), STATE(write_returned));
+    return sleep_and_call(&timer_, MSEC_TO_NSEC(RAILCOM_POM_FEEDBACK_MSEC),
+        STATE(write_returned));
 }
 
 StateFlowBase::Action TractionCvSpace::write_returned()
@@ -324,22 +356,134 @@ void TractionCvSpace::record_railcom_status(unsigned code)
     railcomHub_->unregister_port(this);
 }
 
-void TractionCvSpace::send(Buffer<dcc::RailcomHubData> *b, unsigned priority)
+void TractionCvSpace::start_batch(unsigned first_cv, unsigned count)
 {
-    AutoReleaseBuffer<dcc::RailcomHubData> ar(b);
-    if (errorCode_ != ERROR_PENDING)
-        return;
-    const dcc::Feedback &f = *b->data();
-    if (f.feedbackKey != reinterpret_cast<size_t>(this) || f.channel == 0xff)
+    LOG(INFO, "cv batch read %u..%u", first_cv, first_cv + count - 1);
+    errorCode_ = ERROR_NOOP;
+    for (unsigned i = 0; i < count; ++i)
     {
-        // Skip railcom from other packets; also skip the railcom-based
-        // occupancy information packets.
-        return;
+        batch_[i].cv = first_cv + i;
+        batch_[i].value = 0;
+        batch_[i].status = ERROR_NOOP;
+        batch_[i].numTry = 0;
     }
-    LOG(INFO, "CV railcom feedback ch=%d: %s", f.channel, railcom_debug(f).c_str());
+    batchSize_ = count;
+    batchNext_ = 0;
+    batchPending_ = 0;
+    batchActive_ = true;
+    deadline_ =
+        os_get_time_monotonic() + MSEC_TO_NSEC(RAILCOM_POM_OP_TIMEOUT_MSEC);
+    railcomHub_->register_port(this);
+    start_flow(STATE(send_batch));
+}
+
+StateFlowBase::Action TractionCvSpace::send_batch()
+{
+    while (batchNext_ < batchSize_ && batch_[batchNext_].status != ERROR_NOOP)
+    {
+        ++batchNext_;
+    }
+    if (batchNext_ >= batchSize_)
+    {
+        if (!batchPending_)
+        {
+            return call_immediately(STATE(batch_returned));
+        }
+        return sleep_and_call(&timer_,
+            MSEC_TO_NSEC(RAILCOM_POM_FEEDBACK_MSEC), STATE(batch_returned));
+    }
+    return allocate_and_call(track_, STATE(fill_batch_packet));
+}
+
+StateFlowBase::Action TractionCvSpace::fill_batch_packet()
+{
+    auto *b = get_allocation_result(track_);
+    BatchSlot *slot = &batch_[batchNext_++];
+    fill_pom_packet(b->data(), slot->cv, feedback_key(slot));
+    slot->status = ERROR_PENDING;
+    ++batchPending_;
+    track_->send(b);
+    return call_immediately(STATE(send_batch));
+}
+
+StateFlowBase::Action TractionCvSpace::batch_returned()
+{
+    bool retry = false;
+    bool expired = os_get_time_monotonic() > deadline_;
+    for (unsigned i = 0; i < batchSize_; ++i)
+    {
+        BatchSlot *slot = &batch_[i];
+        switch (slot->status)
+        {
+            case ERROR_OK:
+            case _ERROR_TIMEOUT:
+                break;
+            case ERROR_PENDING:
+                slot->status = _ERROR_TIMEOUT;
+                break;
+            case _ERROR_BUSY:
+                if (expired)
+                {
+                    slot->status = _ERROR_TIMEOUT;
+                    break;
+                }
+                slot->status = ERROR_NOOP;
+                retry = true;
+                break;
+            default:
+                if (slot->numTry >= READ_RETRY_COUNT_ON_UNKNOWN)
+                {
+                    slot->status = _ERROR_TIMEOUT;
+                    break;
+                }
+                slot->numTry++;
+                slot->status = ERROR_NOOP;
+                retry = true;
+                break;
+        }
+    }
+    batchPending_ = 0;
+    if (retry)
+    {
+        batchNext_ = 0;
+        return call_immediately(STATE(send_batch));
+    }
+    LOG(INFO, "cv batch read done");
+    batchActive_ = false;
+    railcomHub_->unregister_port(this);
+    done_->notify();
+    return exit();
+}
+
+size_t TractionCvSpace::read_from_batch(
+    unsigned cv, uint8_t *dst, size_t len, errorcode_t *error)
+{
+    unsigned ofs = cv - batch_[0].cv;
+    size_t count = 0;
+    while (count < len && ofs + count < batchSize_ &&
+        batch_[ofs + count].status == ERROR_OK)
+    {
+        dst[count] = batch_[ofs + count].value;
+        ++count;
+    }
+    if (!count)
+    {
+        *error = Defs::ERROR_OPENLCB_TIMEOUT;
+    }
+    if (!count || ofs + count >= batchSize_)
+    {
+        // Every value of the batch was handed out.
+        batchSize_ = 0;
+    }
+    return count;
+}
+
+unsigned TractionCvSpace::parse_feedback(
+    const dcc::Feedback &f, uint8_t *value)
+{
     if (!f.ch2Size)
     {
-        return record_railcom_status(ERROR_NO_RAILCOM_CH2_DATA);
+        return ERROR_NO_RAILCOM_CH2_DATA;
     }
     dcc::parse_railcom_data(f, &interpretedResponse_);
     unsigned new_status = ERROR_PENDING;
@@ -367,7 +511,7 @@ void TractionCvSpace::send(Buffer<dcc::RailcomHubData> *b, unsigned priority)
             }
             break;
         case dcc::RailcomPacket::MOB_POM:
-            cvData_ = e.argument;
+            *value = e.argument;
             new_status = ERROR_OK;
             break;
         default:
@@ -377,7 +521,53 @@ void TractionCvSpace::send(Buffer<dcc::RailcomHubData> *b, unsigned priority)
             break;
         }
     }
-    return record_railcom_status(new_status);
+    return new_status;
+}
+
+void TractionCvSpace::send(Buffer<dcc::RailcomHubData> *b, unsigned priority)
+{
+    AutoReleaseBuffer<dcc::RailcomHubData> ar(b);
+    const dcc::Feedback &f = *b->data();
+    if (batchActive_)
+    {
+        if (f.channel == 0xff)
+        {
+            return;
+        }
+        for (unsigned i = 0; i < batchSize_; ++i)
+        {
+            BatchSlot *slot = &batch_[i];
+            if (f.feedbackKey != feedback_key(slot) ||
+                slot->status != ERROR_PENDING)
+            {
+                continue;
+            }
+            LOG(INFO, "CV %u railcom feedback ch=%d: %s", slot->cv, f.channel,
+                railcom_debug(f).c_str());
+            slot->status = parse_feedback(f, &slot->value);
+            if (slot->status == ERROR_PENDING)
+            {
+                // Only channel 1 data; may be retried.
+                slot->status = ERROR_UNKNOWN_RESPONSE;
+            }
+            if (--batchPending_ == 0 && batchNext_ >= batchSize_)
+            {
+                timer_.trigger();
+            }
+            return;
+        }
+        return;
+    }
+    if (errorCode_ != ERROR_PENDING)
+        return;
+    if (f.feedbackKey != feedback_key(this) || f.channel == 0xff)
+    {
+        // Skip railcom from other packets; also skip the railcom-based
+        // occupancy information packets.
+        return;
+    }
+    LOG(INFO, "CV railcom feedback ch=%d: %s", f.channel, railcom_debug(f).c_str());
+    return record_railcom_status(parse_feedback(f, &cvData_));
 }
 
 } // namespace openlcb
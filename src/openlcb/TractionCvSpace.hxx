@@ -52,6 +52,12 @@ namespace openlcb
 /// into POM-mode CV write packets, and the Railcom feedback is evaluated for
 /// success acknowledgement.
 ///
+/// Reads of more than one byte are pipelined: a POM read packet is queued for
+/// each of (up to MAX_BATCH) consecutive CVs, and the Railcom responses are
+/// matched to the CVs by their feedback keys. CVs that returned busy or an
+/// unknown response are retried without re-reading the others. The read
+/// values are then returned to the memory config protocol in one call.
+///
 /// A single instance of this class works for all DCC locomotives, assuming
 /// that the memory configuration handler was registered for all virtual nodes
 /// of the given interface.
@@ -76,6 +82,8 @@ public:
 
 private:
     static const unsigned MAX_CV = 1023;
+    /// How many CVs a batched read may have in flight.
+    static const unsigned MAX_BATCH = 16;
 
     bool set_node(Node *node) OVERRIDE;
 
@@ -104,6 +112,42 @@ private:
     Action fill_write1_packet();
     Action write_returned();
 
+    // Batched read states.
+    Action send_batch();
+    Action fill_batch_packet();
+    Action batch_returned();
+
+    /// Starts a batched read. @param first_cv is the wire CV number of the
+    /// first CV to read. @param count is how many CVs to read (at most
+    /// MAX_BATCH).
+    void start_batch(unsigned first_cv, unsigned count);
+
+    /// Returns the results of a finished batched read.
+    /// @param cv is the wire CV number to start from; must be in the batch.
+    /// @param dst is where to copy the CV values to.
+    /// @param len is the number of bytes requested.
+    /// @param error is set if the first requested CV could not be read.
+    /// @return the number of bytes filled in.
+    size_t read_from_batch(
+        unsigned cv, uint8_t *dst, size_t len, errorcode_t *error);
+
+    /// Adds the address and a POM read instruction to a DCC packet.
+    /// @param pkt is the packet to fill. @param cv is the wire CV number.
+    /// @param key is the railcom feedback key for the packet.
+    void fill_pom_packet(dcc::Packet *pkt, unsigned cv, uint32_t key);
+
+    /// @return the railcom feedback key for packets tagged with ptr.
+    static uint32_t feedback_key(const void *ptr)
+    {
+        return (uint32_t)reinterpret_cast<uintptr_t>(ptr);
+    }
+
+    /// Interprets the channel 2 data of a railcom feedback.
+    /// @param f is the feedback. @param value will be set to the CV value if
+    /// the decoder sent one.
+    /// @return the resulting status (ERROR_* enum).
+    unsigned parse_feedback(const dcc::Feedback &f, uint8_t *value);
+
 
     // Railcom feedback
     void send(Buffer<dcc::RailcomHubData> *b, unsigned priority) OVERRIDE;
@@ -145,6 +189,29 @@ private:
     StateFlowTimer timer_;
     long long deadline_;  //< time when we should give up and return error.
     vector<dcc::RailcomPacket> interpretedResponse_;
+
+    /// One CV of a batched read.
+    struct BatchSlot
+    {
+        /// Wire CV number.
+        uint16_t cv;
+        /// Value read.
+        uint8_t value;
+        /// ERROR_* enum; ERROR_NOOP means the packet needs to be sent.
+        uint8_t status : 4;
+        /// How many times we retried due to an unknown response.
+        uint8_t numTry : 4;
+    };
+    /// CVs of the current or last batched read.
+    BatchSlot batch_[MAX_BATCH];
+    /// Number of valid entries in batch_; 0 if there is no batch.
+    uint8_t batchSize_{0};
+    /// Next slot to look at when sending packets.
+    uint8_t batchNext_{0};
+    /// Number of slots waiting for railcom feedback.
+    uint8_t batchPending_{0};
+    /// True while the batched read is in progress.
+    bool batchActive_{false};
 };
 
 } // namespace openlcb
@@ -35,6 +35,8 @@
 #ifndef _NMRANET_TRACTIONTHROTTLE_HXX_
 #define _NMRANET_TRACTIONTHROTTLE_HXX_
 
+#include <vector>
+
 #include "openlcb/TractionClient.hxx"
 #include "openlcb/TractionDefs.hxx"
 #include "openlcb/TrainInterface.hxx"
@@ -156,6 +158,11 @@ struct TractionThrottleInput : public CallableFlowRequestBase
 
 /** Interface for a single throttle for running a train node.
  *
+ * Set speed and set function commands are coalesced: while a command of the
+ * same kind is waiting to go out to the bus, only the newest value is kept and
+ * sent once the previous message is done. The throttle may be destroyed while
+ * such a message is in flight; it has to be destroyed on the executor of the
+ * interface, or while that executor is not running.
  */
 class TractionThrottle
     : public CallableFlow<TractionThrottleInput>,
@@ -172,6 +179,12 @@ public:
     }
 
     ~TractionThrottle() {
+        clear_assigned();
+        // A set message may still be in the write flow, or its callback may
+        // be waiting on the executor; the barrier lives on and cleans up
+        // after itself.
+        speedSent_->detach();
+        fnSent_->detach();
     }
 
     using Command = TractionThrottleInput::Command;
@@ -188,10 +201,27 @@ public:
         ERROR_UNASSIGNED = 0x4000000,
     };
 
+    /// Sends a set speed command to the train. If the previous set speed
+    /// command is still waiting to go out to the bus, it will be sent with
+    /// the newest speed instead of sending every intermediate value.
     void set_speed(SpeedType speed) override
     {
-        send_traction_message(TractionDefs::speed_set_payload(speed));
         lastSetSpeed_ = speed;
+        {
+            AtomicHolder h(this);
+            if (speedInFlight_)
+            {
+                if (speedPending_)
+                {
+                    ++droppedSpeedCount_;
+                }
+                speedPending_ = true;
+                pendingSpeed_ = speed;
+                return;
+            }
+            speedInFlight_ = true;
+        }
+        send_set_message(TractionDefs::speed_set_payload(speed), speedSent_);
     }
 
     SpeedType get_speed() override
@@ -201,16 +231,55 @@ public:
         return lastSetSpeed_;
     }
 
+    /// Sends an emergency stop command to the train. It goes out in order
+    /// with the set speed commands: a speed set before that did not go out
+    /// yet is dropped, and a speed set afterwards is sent after it.
     void set_emergencystop() override
     {
-        send_traction_message(TractionDefs::estop_set_payload());
         lastSetSpeed_.set_mph(0);
+        {
+            AtomicHolder h(this);
+            if (speedPending_)
+            {
+                ++droppedSpeedCount_;
+                speedPending_ = false;
+            }
+            if (speedInFlight_)
+            {
+                estopPending_ = true;
+                return;
+            }
+            speedInFlight_ = true;
+        }
+        send_set_message(TractionDefs::estop_set_payload(), speedSent_);
     }
 
+    /// Sends a set function command to the train. Function commands are
+    /// sent one at a time; while one is waiting to go out to the bus, later
+    /// commands are queued, and a newer value for the same function replaces
+    /// the queued one.
     void set_fn(uint32_t address, uint16_t value) override
     {
-        send_traction_message(TractionDefs::fn_set_payload(address, value));
         lastKnownFn_[address] = value;
+        {
+            AtomicHolder h(this);
+            if (fnInFlight_)
+            {
+                for (auto &e : pendingFn_)
+                {
+                    if (e.first == address)
+                    {
+                        e.second = value;
+                        ++droppedFnCount_;
+                        return;
+                    }
+                }
+                pendingFn_.push_back(std::make_pair(address, value));
+                return;
+            }
+            fnInFlight_ = true;
+        }
+        send_set_message(TractionDefs::fn_set_payload(address, value), fnSent_);
     }
 
     uint16_t get_fn(uint32_t address) override
@@ -249,6 +318,21 @@ public:
     openlcb::NodeID target_node() {
         return dst_;
     }
+
+    /// @return how many set speed commands were not sent to the train
+    /// because a newer speed was set before they went out to the bus.
+    unsigned dropped_speed_count()
+    {
+        return droppedSpeedCount_;
+    }
+
+    /// @return how many set function commands were not sent to the train
+    /// because a newer value for the same function was set before they went
+    /// out to the bus.
+    unsigned dropped_fn_count()
+    {
+        return droppedFnCount_;
+    }
     
 private:
     Action entry() override
@@ -561,6 +645,101 @@ private:
         return return_ok();
     }
 
+    /// Barrier of the in-flight set message of one command kind. When the
+    /// message left the write flow, calls a member function of the throttle
+    /// on the throttle's executor. Allocated separately from the throttle, so
+    /// that the throttle can be destroyed while a message is still in
+    /// flight; whichever of the two finishes last deletes this object.
+    class SentNotifiable : public Executable, private Atomic
+    {
+    public:
+        /// Constructor. @param parent is the throttle. @param fn is the
+        /// function to call after the message left the write flow.
+        SentNotifiable(TractionThrottle *parent, void (TractionThrottle::*fn)())
+            : parent_(parent)
+            , fn_(fn)
+            , executor_(parent->service()->executor())
+        {
+        }
+
+        /// @return the barrier to put into the buffer of the next message.
+        BarrierNotifiable *new_barrier()
+        {
+            AtomicHolder h(this);
+            inFlight_ = true;
+            return barrier_.reset(this);
+        }
+
+        /// Called by the barrier, on any thread.
+        void notify() override
+        {
+            bool attached;
+            {
+                AtomicHolder h(this);
+                inFlight_ = false;
+                attached = parent_ != nullptr;
+                scheduled_ = attached;
+            }
+            if (attached)
+            {
+                executor_->add(this);
+            }
+            else
+            {
+                // The throttle is gone.
+                delete this;
+            }
+        }
+
+        /// Runs the callback on the throttle's executor.
+        void run() override
+        {
+            TractionThrottle *parent;
+            {
+                AtomicHolder h(this);
+                scheduled_ = false;
+                parent = parent_;
+            }
+            if (!parent)
+            {
+                delete this;
+                return;
+            }
+            (parent->*fn_)();
+        }
+
+        /// Called by the throttle destructor, on the throttle's executor.
+        /// Deletes this object, or, if a message is in flight or the
+        /// callback is scheduled, leaves it to notify() or run() to do so.
+        void detach()
+        {
+            {
+                AtomicHolder h(this);
+                parent_ = nullptr;
+                if (inFlight_ || scheduled_)
+                {
+                    return;
+                }
+            }
+            delete this;
+        }
+
+    private:
+        /// Owns the barrier of the in-flight message.
+        BarrierNotifiable barrier_;
+        /// Throttle to call back, or nullptr after detach().
+        TractionThrottle *parent_;
+        /// Callback in the throttle.
+        void (TractionThrottle::*fn_)();
+        /// Executor of the throttle; the callback runs here.
+        ExecutorBase *executor_;
+        /// True while barrier_ is given out with a message.
+        bool inFlight_{false};
+        /// True while this object is waiting on executor_ to run the
+        /// callback.
+        bool scheduled_{false};
+    };
+
     /** Allocates (synchronously) an outgoing openlcb buffer with traction
      * request MTI and the given payload and sends off the message to the bus
      * for dst_. */
@@ -573,6 +752,75 @@ private:
         iface()->addressed_message_write_flow()->send(b);
     }
 
+    /** Sends a set speed, emergency stop or set function message to dst_.
+     * Only the owner of the in-flight flag of the command kind may call this.
+     * @param payload is the message payload.
+     * @param sent will be called when the message left the write flow. */
+    void send_set_message(const Payload &payload, SentNotifiable *sent)
+    {
+        HASSERT(dst_ != 0);
+        auto *b = iface()->addressed_message_write_flow()->alloc();
+        b->data()->reset(Defs::MTI_TRACTION_CONTROL_COMMAND, node_->node_id(),
+            NodeHandle(dst_), payload);
+        b->set_done(sent->new_barrier());
+        iface()->addressed_message_write_flow()->send(b);
+    }
+
+    /// Called when a set speed or emergency stop message left the write
+    /// flow. Sends the pending emergency stop, then the pending speed. Since
+    /// only one of these messages is in flight at a time, and it is sent by
+    /// whoever set speedInFlight_, they go out in the order they were set.
+    void speed_sent()
+    {
+        bool estop = false;
+        SpeedType speed;
+        {
+            AtomicHolder h(this);
+            if (estopPending_)
+            {
+                estopPending_ = false;
+                estop = true;
+            }
+            else if (speedPending_)
+            {
+                speedPending_ = false;
+                speed = pendingSpeed_;
+            }
+            else
+            {
+                speedInFlight_ = false;
+                return;
+            }
+        }
+        if (estop)
+        {
+            send_set_message(TractionDefs::estop_set_payload(), speedSent_);
+        }
+        else
+        {
+            send_set_message(TractionDefs::speed_set_payload(speed), speedSent_);
+        }
+    }
+
+    /// Called when a set function message left the write flow. Sends the
+    /// oldest pending function value if there is one.
+    void fn_sent()
+    {
+        std::pair<uint32_t, uint16_t> fn;
+        {
+            AtomicHolder h(this);
+            if (pendingFn_.empty())
+            {
+                fnInFlight_ = false;
+                return;
+            }
+            fn = pendingFn_.front();
+            pendingFn_.erase(pendingFn_.begin());
+        }
+        send_set_message(
+            TractionDefs::fn_set_payload(fn.first, fn.second), fnSent_);
+    }
+
     void set_assigned()
     {
         iface()->dispatcher()->register_handler(&speedReplyHandler_, Defs::MTI_TRACTION_CONTROL_REPLY, Defs::MTI_EXACT);
@@ -593,6 +841,10 @@ private:
     {
         lastSetSpeed_ = nan_to_speed();
         lastKnownFn_.clear();
+        AtomicHolder h(this);
+        speedPending_ = false;
+        estopPending_ = false;
+        pendingFn_.clear();
     }
 
     TractionThrottleInput *input()
@@ -623,6 +875,33 @@ private:
     SpeedType lastSetSpeed_;
     /// Cache: all known function values.
     std::map<uint32_t, uint16_t> lastKnownFn_;
+
+    /// True while a set speed or emergency stop message is waiting in the
+    /// write flow.
+    bool speedInFlight_{false};
+    /// True if pendingSpeed_ needs to be sent after the in-flight message.
+    bool speedPending_{false};
+    /// True if an emergency stop needs to be sent after the in-flight
+    /// message. Goes out before the pending speed.
+    bool estopPending_{false};
+    /// True while a set function message is waiting in the write flow.
+    bool fnInFlight_{false};
+    /// Newest speed that was set while a set speed message was in flight.
+    SpeedType pendingSpeed_;
+    /// Function values (address, value) set while a set function message was
+    /// in flight, in the order they were set.
+    std::vector<std::pair<uint32_t, uint16_t>> pendingFn_;
+    /// Calls speed_sent() when the set speed or emergency stop message left
+    /// the write flow.
+    SentNotifiable *speedSent_{
+        new SentNotifiable(this, &TractionThrottle::speed_sent)};
+    /// Calls fn_sent() when the set function message left the write flow.
+    SentNotifiable *fnSent_{
+        new SentNotifiable(this, &TractionThrottle::fn_sent)};
+    /// Number of set speed commands dropped by coalescing.
+    unsigned droppedSpeedCount_{0};
+    /// Number of set function commands dropped by coalescing.
+    unsigned droppedFnCount_{0};
 };
 
 } // namespace openlcb
@@ -36,6 +36,8 @@
 
 #include "openlcb/TractionTrain.hxx"
 
+#include <map>
+
 #include "utils/logging.h"
 #include "openlcb/If.hxx"
 
@@ -52,9 +54,6 @@ TrainNode::TrainNode(TrainService *service, TrainImpl *train)
 
 TrainNode::~TrainNode()
 {
-    while (!consistSlaves_.empty()) {
-        delete consistSlaves_.pop_front();
-    }
 }
 
 TrainNodeForProxy::TrainNodeForProxy(TrainService *service, TrainImpl *train)
@@ -113,7 +112,123 @@ struct TrainService::Impl
                 this, Defs::MTI_TRACTION_CONTROL_COMMAND, 0xffff);
         }
 
+        /// Enqueues an incoming traction command. Set speed and set function
+        /// commands are coalesced: if an earlier command of the same kind
+        /// (and function number) for the same train from the same sender is
+        /// still waiting in the queue, the new value overwrites it in place
+        /// and the new buffer is dropped. This way a train that cannot keep
+        /// up with a throttle only applies the newest state.
+        /// @param msg is the incoming message.
+        /// @param priority is the queue priority.
+        void send(Buffer<GenMessage> *msg, unsigned priority = UINT_MAX) OVERRIDE
+        {
+            GenMessage *m = msg->data();
+            bool dropped = false;
+            if (m->dstNode)
+            {
+                AtomicHolder h(this);
+                PendingKey key;
+                if (!pending_key(m, &key))
+                {
+                    // All other commands keep their order relative to the
+                    // set commands around them.
+                    forget_pending(m->dstNode);
+                }
+                else
+                {
+                    auto it = pending_.find(key);
+                    if (it != pending_.end() &&
+                        it->second->data()->src.id == m->src.id &&
+                        it->second->data()->src.alias == m->src.alias)
+                    {
+                        it->second->data()->payload.swap(m->payload);
+                        if (key.second == SPEED_KEY)
+                        {
+                            ++droppedSpeedCount_;
+                        }
+                        else
+                        {
+                            ++droppedFnCount_;
+                        }
+                        dropped = true;
+                    }
+                    else
+                    {
+                        pending_[key] = msg;
+                    }
+                }
+            }
+            if (dropped)
+            {
+                msg->unref();
+                return;
+            }
+            IncomingMessageStateFlow::send(msg, priority);
+        }
+
+        /// @return the number of set speed commands that were overwritten by
+        /// a newer one before being applied.
+        unsigned dropped_speed_count()
+        {
+            return droppedSpeedCount_;
+        }
+
+        /// @return the number of set function commands that were overwritten
+        /// by a newer one before being applied.
+        unsigned dropped_fn_count()
+        {
+            return droppedFnCount_;
+        }
+
     protected:
+        /// Identifies a coalescable command: the train node and the function
+        /// number, or SPEED_KEY for the set speed command.
+        typedef std::pair<Node *, uint32_t> PendingKey;
+
+        enum : uint32_t
+        {
+            /// Key of the set speed command. Function numbers are 24 bits,
+            /// thus this can not collide.
+            SPEED_KEY = 0xFFFFFFFFu
+        };
+
+        /// Decides whether a message can be coalesced.
+        /// @param m is the incoming message.
+        /// @param key will be filled in for a set speed or set function
+        /// command.
+        /// @return true if the message is a set speed or set function
+        /// command.
+        static bool pending_key(GenMessage *m, PendingKey *key)
+        {
+            const uint8_t *p =
+                reinterpret_cast<const uint8_t *>(m->payload.data());
+            if (m->payload.size() >= 3 && p[0] == TractionDefs::REQ_SET_SPEED)
+            {
+                *key = PendingKey(m->dstNode, SPEED_KEY);
+                return true;
+            }
+            if (m->payload.size() >= 6 && p[0] == TractionDefs::REQ_SET_FN)
+            {
+                uint32_t address = p[1];
+                address <<= 8;
+                address |= p[2];
+                address <<= 8;
+                address |= p[3];
+                *key = PendingKey(m->dstNode, address);
+                return true;
+            }
+            return false;
+        }
+
+        /// Stops coalescing into the queued commands of a train. Must be
+        /// called with the lock held. @param node is the train node.
+        void forget_pending(Node *node)
+        {
+            pending_.erase(pending_.lower_bound(PendingKey(node, 0)),
+                pending_.upper_bound(PendingKey(node, SPEED_KEY)));
+        }
+
+
         TrainNode *train_node()
         {
             return static_cast<TrainNode *>(nmsg()->dstNode);
@@ -143,6 +258,20 @@ struct TrainService::Impl
 
         Action entry() OVERRIDE
         {
+            if (nmsg()->dstNode)
+            {
+                // From here on the payload of this message must not change.
+                AtomicHolder h(this);
+                PendingKey key;
+                if (pending_key(nmsg(), &key))
+                {
+                    auto it = pending_.find(key);
+                    if (it != pending_.end() && it->second == message())
+                    {
+                        pending_.erase(it);
+                    }
+                }
+            }
             // If the message is not for a local node, ignore.
             if (!nmsg()->dstNode)
             {
@@ -177,7 +306,6 @@ struct TrainService::Impl
                 {
                     SpeedType sp = fp16_to_speed(payload() + 1);
                     train_node()->train()->set_speed(sp);
-                    nextConsistIndex_ = 0;
                     return call_immediately(STATE(maybe_forward_consist));
                 }
                 case TractionDefs::REQ_SET_FN:
@@ -191,7 +319,6 @@ struct TrainService::Impl
                     value <<= 8;
                     value |= payload()[5];
                     train_node()->train()->set_fn(address, value);
-                    nextConsistIndex_ = 0;
                     return call_immediately(STATE(maybe_forward_consist));
                 }
                 case TractionDefs::REQ_EMERGENCY_STOP:
@@ -408,24 +535,26 @@ struct TrainService::Impl
             }
         }
 
-        Action maybe_forward_consist()
+        /// Decides whether the current message needs to be forwarded to a
+        /// consist member.
+        /// @param idx is the offset of the consist member.
+        /// @param dst will be filled with the node ID of the member.
+        /// @param flip_speed will be set to true if the speed command needs to
+        /// be reversed for this member.
+        /// @return true if the message should be forwarded.
+        bool consist_target(unsigned idx, NodeID *dst, bool *flip_speed)
         {
-            auto* train_node = this->train_node();
-            unsigned count = train_node->query_consist_length();
-            if (count <= nextConsistIndex_)
-                return release_and_exit();
             uint8_t flags = 0;
-            NodeID dst = train_node->query_consist(nextConsistIndex_, &flags);
-            if (iface()->matching_node(nmsg()->src, NodeHandle(dst)))
+            *dst = train_node()->query_consist(idx, &flags);
+            *flip_speed = false;
+            if (!*dst || iface()->matching_node(nmsg()->src, NodeHandle(*dst)))
             {
-                ++nextConsistIndex_;
-                return again();
+                return false;
             }
             uint8_t cmd = payload()[0];
-            bool flip_speed = false;
             if (cmd == TractionDefs::REQ_SET_SPEED) {
                 if (flags & TractionDefs::CNSTFLAGS_REVERSE) {
-                    flip_speed = true;
+                    *flip_speed = true;
                 }
             } else if (cmd == TractionDefs::REQ_SET_FN) {
                 uint32_t address = payload()[1];
@@ -435,61 +564,67 @@ struct TrainService::Impl
                 address |= payload()[3];
                 if (address == 0) {
                     if ((flags & TractionDefs::CNSTFLAGS_LINKF0) == 0) {
-                        // skip
-                        ++nextConsistIndex_;
-                        return again();
+                        return false;
                     }
                 } else {
                     if ((flags & TractionDefs::CNSTFLAGS_LINKFN) == 0) {
-                        // skip
-                        ++nextConsistIndex_;
-                        return again();
+                        return false;
                     }
                 }
             }
-            if (count == nextConsistIndex_ + 1u)
-            {
-                // last node: we can transfer the message.
-                auto *b = transfer_message();
-                b->data()->src = NodeHandle(train_node->node_id());
-                b->data()->dst = NodeHandle(dst);
-                b->data()->dstNode = nullptr;
-                if (flip_speed) {
-                    b->data()->payload[1] ^= 0x80;
-                }
-                iface()->addressed_message_write_flow()->send(b);
-                return exit();
-            }
-            else
-            {
-                return allocate_and_call(
-                    iface()->addressed_message_write_flow(),
-                    STATE(forward_consist));
-            }
+            return true;
         }
 
-        Action forward_consist()
+        /// Forwards the current message to every consist member in one
+        /// pass. Every member but the last gets a copy whose done notifiable
+        /// is a child of the incoming message's, the last gets the incoming
+        /// buffer itself. Thus the incoming message completes when all
+        /// forwarded messages are processed.
+        Action maybe_forward_consist()
         {
-            auto *b =
-                get_allocation_result(iface()->addressed_message_write_flow());
-            uint8_t flags;
-            NodeID dst = train_node()->query_consist(nextConsistIndex_, &flags);
-            if (!dst)
+            auto *train_node = this->train_node();
+            auto *write_flow = iface()->addressed_message_write_flow();
+            unsigned count = train_node->query_consist_length();
+            // The target that is found but not sent to yet.
+            NodeID last_dst = 0;
+            bool last_flip = false;
+            for (unsigned i = 0; i < count; ++i)
+            {
+                NodeID dst;
+                bool flip;
+                if (!consist_target(i, &dst, &flip))
+                {
+                    continue;
+                }
+                if (last_dst)
+                {
+                    auto *b = write_flow->alloc();
+                    b->set_done(message()->new_child());
+                    b->data()->reset(message()->data()->mti,
+                        train_node->node_id(), NodeHandle(last_dst),
+                        message()->data()->payload);
+                    if (last_flip) {
+                        b->data()->payload[1] ^= 0x80;
+                    }
+                    write_flow->send(b);
+                }
+                last_dst = dst;
+                last_flip = flip;
+            }
+            if (!last_dst)
             {
-                // Strange. The consist destination should exist and never be
-                // zero once we got here.
-                b->unref();
                 return release_and_exit();
             }
-            b->data()->reset(message()->data()->mti, train_node()->node_id(),
-                             NodeHandle(dst), message()->data()->payload);
-            if ((payload()[0] == TractionDefs::REQ_SET_SPEED) &&
-                (flags & TractionDefs::CNSTFLAGS_REVERSE)) {
+            // last node: we can transfer the message.
+            auto *b = transfer_message();
+            b->data()->src = NodeHandle(train_node->node_id());
+            b->data()->dst = NodeHandle(last_dst);
+            b->data()->dstNode = nullptr;
+            if (last_flip) {
                 b->data()->payload[1] ^= 0x80;
             }
-            iface()->addressed_message_write_flow()->send(b);
-            ++nextConsistIndex_;
-            return call_immediately(STATE(maybe_forward_consist));
+            write_flow->send(b);
+            return exit();
         }
 
         Action handle_traction_mgmt()
@@ -589,11 +724,16 @@ struct TrainService::Impl
     private:
         /// error code for reject_permanent().
         unsigned errorCode_ : 16;
-        unsigned nextConsistIndex_ : 8;
         /// 1 if the voluntary lock protocol has set this train to be reserved.
         unsigned reserved_ : 1;
         TrainService *trainService_;
         Buffer<GenMessage> *response_;
+        /// Set commands in the queue that newer commands can be merged into.
+        std::map<PendingKey, Buffer<GenMessage> *> pending_;
+        /// Number of set speed commands dropped by coalescing.
+        unsigned droppedSpeedCount_{0};
+        /// Number of set function commands dropped by coalescing.
+        unsigned droppedFnCount_{0};
     };
 
     TractionRequestFlow traction_;
@@ -611,6 +751,16 @@ TrainService::~TrainService()
     delete impl_;
 }
 
+unsigned TrainService::dropped_speed_count()
+{
+    return impl_->traction_.dropped_speed_count();
+}
+
+unsigned TrainService::dropped_fn_count()
+{
+    return impl_->traction_.dropped_fn_count();
+}
+
 void TrainService::register_train(TrainNode *node)
 {
     iface_->add_local_node(node);
@@ -622,4 +772,12 @@ void TrainService::register_train(TrainNode *node)
     HASSERT(nodes_.find(node) != nodes_.end());
 }
 
+void TrainService::unregister_train(TrainNode *node)
+{
+    iface_->delete_local_node(node);
+    AtomicHolder h(this);
+    nodes_.erase(node);
+    LOG(VERBOSE, "Unregistered node %p from traction.", node);
+}
+
 } // namespace openlcb
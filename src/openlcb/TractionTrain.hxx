@@ -36,6 +36,7 @@
 #define _NMRANET_TRACTIONTRAIN_HXX_
 
 #include <set>
+#include <vector>
 
 #include "executor/Service.hxx"
 #include "openlcb/Node.hxx"
@@ -48,9 +49,8 @@ namespace openlcb
 
 class TrainService;
 
-/// Linked list entry for all registered consist clients for a given train
-/// node.
-struct ConsistEntry : public QMember {
+/// Entry for all registered consist clients for a given train node.
+struct ConsistEntry {
     ConsistEntry(NodeID s, uint8_t flags) : payload((s << 8) | flags) {}
     NodeID get_slave() const {
         return payload >> 8;
@@ -138,7 +138,7 @@ public:
                 return true;
             }
         }
-        consistSlaves_.push_front(new ConsistEntry(tgt, flags));
+        consistSlaves_.push_back(ConsistEntry(tgt, flags));
         return true;
     }
 
@@ -150,9 +150,7 @@ public:
         {
             if (it->get_slave() == tgt)
             {
-                auto* p = it.operator->();
                 consistSlaves_.erase(it);
-                delete p;
                 return true;
             }
         }
@@ -160,31 +158,24 @@ public:
     }
 
     /** Returns the consist target with offset id, or NodeID(0) if there are
-     * fewer than id consist targets. id is zero-based. */
+     * fewer than id consist targets. id is zero-based; the most recently added
+     * target is at offset 0. */
     NodeID query_consist(int id, uint8_t* flags)
     {
-        int k = 0;
-        for (auto it = consistSlaves_.begin();
-             it != consistSlaves_.end(); ++it, ++k)
+        if (id < 0 || (unsigned)id >= consistSlaves_.size())
         {
-            if (k == id)
-            {
-                if (flags) *flags = it->get_flags();
-                return it->get_slave();
-            }
+            return 0;
         }
-        return 0;
+        // Stored in the order of adding.
+        const ConsistEntry &e = consistSlaves_[consistSlaves_.size() - 1 - id];
+        if (flags) *flags = e.get_flags();
+        return e.get_slave();
     }
 
     /** Returns the number of slaves in this consist. */
     int query_consist_length()
     {
-        int ret = 0;
-        for (auto it = consistSlaves_.begin(); it != consistSlaves_.end();
-             ++it, ++ret)
-        {
-        }
-        return ret;
+        return consistSlaves_.size();
     }
 
 protected:
@@ -196,7 +187,8 @@ private:
 
     /// Controller node that is assigned to run this train. 0 if none.
     NodeHandle controllerNodeId_;
-    TypedQueue<ConsistEntry> consistSlaves_;
+    /// Consist targets in the order they were added.
+    std::vector<ConsistEntry> consistSlaves_;
 };
 
 
@@ -242,6 +234,20 @@ public:
         initialization flow for the train. */
     void register_train(TrainNode *node);
 
+    /** Removes a train from the train service and from the interface, for
+        example when a virtual train node is evicted. The node object is not
+        freed. Must be called on the interface's executor. */
+    void unregister_train(TrainNode *node);
+
+    /** @return how many set speed commands were dropped because a newer set
+        speed command for the same train arrived before they were applied. */
+    unsigned dropped_speed_count();
+
+    /** @return how many set function commands were dropped because a newer
+        command for the same train and function arrived before they were
+        applied. */
+    unsigned dropped_fn_count();
+
 private:
     struct Impl;
     /** Implementation flows. */
@@ -37,6 +37,7 @@
 #include <cmath>
 #include <cstdint>
 
+#include "utils/Float16.hxx"
 #include "utils/macros.h"
 
 extern "C" {
@@ -50,10 +51,6 @@ int halfp2singles(void *target, const void *source, int numel);
 /** Conversion factor for MPH. 1 mph = this many m/s. */
 #define MPH_FACTOR 0.44704f
 
-/** This type represents how velocity is seen on the wire (16 bit float).
- */
-typedef uint16_t float16_t;
-
 namespace openlcb
 {
 
@@ -123,7 +120,7 @@ public:
      * @param value starting value for Velocity as IEEE half precision float.
      */
     Velocity(float16_t value)
-        : velocity(halfp2singles(&velocity, &value, 1))
+        : velocity(halfp_to_float(value))
     {
     }
 
@@ -283,9 +280,7 @@ public:
      */
     float16_t get_wire() const
     {
-        float16_t result;
-        singles2halfp(&result, &velocity, 1);
-        return result;
+        return float_to_halfp(velocity);
     }
     
     /** Set the value based on the wire version of velocity.
@@ -293,7 +288,7 @@ public:
      */
     void set_wire(float16_t value)
     {
-        halfp2singles(&velocity, &value, 1);
+        velocity = halfp_to_float(value);
     }
 
     /** Overloaded addition operator. */
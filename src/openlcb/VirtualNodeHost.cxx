@@ -0,0 +1,203 @@
+/** \copyright
+ * Copyright (c) 2026, agent
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are  permitted provided that the following conditions are met:
+ *
+ *  - Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ *  - Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ * \file VirtualNodeHost.cxx
+ *
+ * Hosts a large space of virtual nodes that are only created when someone on
+ * the bus is looking for them.
+ *
+ * @author agent
+ * @date 19 Oct 2026
+ */
+
+#include "openlcb/VirtualNodeHost.hxx"
+
+#include "utils/logging.h"
+
+namespace openlcb
+{
+
+VirtualNodeHost::VirtualNodeHost(If *iface, VirtualNodeFactory *factory,
+    unsigned init_batch, long long init_period_nsec,
+    long long idle_timeout_nsec)
+    : iface_(iface)
+    , factory_(factory)
+    , initBatch_(init_batch)
+    , initPeriod_(init_period_nsec)
+    , idleTimeout_(idle_timeout_nsec)
+{
+    HASSERT(initBatch_ > 0);
+    iface_->set_local_node_provider(this);
+    iface_->dispatcher()->register_handler(
+        this, Defs::MTI_ADDRESS_MASK, Defs::MTI_ADDRESS_MASK);
+    if (idleTimeout_ > 0)
+    {
+        // Idle nodes are evicted between 1x and 1.25x the idle timeout.
+        evictTimer_.start(idleTimeout_ / 4);
+    }
+}
+
+VirtualNodeHost::~VirtualNodeHost()
+{
+    iface_->dispatcher()->unregister_handler(
+        this, Defs::MTI_ADDRESS_MASK, Defs::MTI_ADDRESS_MASK);
+    if (iface_->local_node_provider() == this)
+    {
+        iface_->set_local_node_provider(nullptr);
+    }
+    if (initTimerRunning_)
+    {
+        initTimer_.cancel();
+    }
+    if (idleTimeout_ > 0)
+    {
+        evictTimer_.cancel();
+    }
+    for (auto &it : nodes_)
+    {
+        if (it.second.node)
+        {
+            factory_->destroy_node(it.second.node);
+        }
+    }
+}
+
+Node *VirtualNodeHost::lookup(NodeID id)
+{
+    auto it = nodes_.find(id);
+    if (it == nodes_.end())
+    {
+        return nullptr;
+    }
+    return it->second.node;
+}
+
+void VirtualNodeHost::node_requested(NodeID id)
+{
+    if (nodes_.find(id) != nodes_.end())
+    {
+        // Already exists or is pending.
+        return;
+    }
+    if (iface_->lookup_local_node(id) || !factory_->is_hosted(id))
+    {
+        return;
+    }
+    nodes_[id] = {nullptr, os_get_time_monotonic()};
+    pending_.push_back(id);
+    create_pending();
+    if (!pending_.empty())
+    {
+        ++stats_.delayed;
+    }
+}
+
+void VirtualNodeHost::create_pending()
+{
+    unsigned num_done = 0;
+    while (num_done < pending_.size() && createdInPeriod_ < initBatch_)
+    {
+        NodeID id = pending_[num_done++];
+        Node *n = factory_->create_node(id);
+        if (!n)
+        {
+            LOG(WARNING, "Failed to create virtual node %012" PRIx64, id);
+            nodes_.erase(id);
+            continue;
+        }
+        nodes_[id] = {n, os_get_time_monotonic()};
+        ++createdInPeriod_;
+        ++stats_.created;
+    }
+    pending_.erase(pending_.begin(), pending_.begin() + num_done);
+    if (createdInPeriod_ && !initTimerRunning_)
+    {
+        initTimerRunning_ = true;
+        initTimer_.start(initPeriod_);
+    }
+}
+
+long long VirtualNodeHost::init_timeout()
+{
+    createdInPeriod_ = 0;
+    create_pending();
+    if (createdInPeriod_ == 0)
+    {
+        // Nothing happened in this period, the next request can go
+        // immediately.
+        initTimerRunning_ = false;
+        return ::Timer::NONE;
+    }
+    return ::Timer::RESTART;
+}
+
+void VirtualNodeHost::evict_idle()
+{
+    long long now = os_get_time_monotonic();
+    std::vector<Node *> evicted;
+    for (auto it = nodes_.begin(); it != nodes_.end();)
+    {
+        Node *n = it->second.node;
+        if (n && n->is_initialized() &&
+            now - it->second.lastUsed >= idleTimeout_ &&
+            factory_->can_evict(n))
+        {
+            evicted.push_back(n);
+            it = nodes_.erase(it);
+        }
+        else
+        {
+            ++it;
+        }
+    }
+    for (Node *n : evicted)
+    {
+        factory_->destroy_node(n);
+        ++stats_.evicted;
+    }
+}
+
+void VirtualNodeHost::send(Buffer<GenMessage> *message, unsigned priority)
+{
+    GenMessage *m = message->data();
+    if (m->dstNode)
+    {
+        auto it = nodes_.find(m->dstNode->node_id());
+        if (it != nodes_.end())
+        {
+            it->second.lastUsed = os_get_time_monotonic();
+        }
+    }
+    else if (m->dst.id)
+    {
+        // Addressed message for a node ID that is not materialized. This
+        // happens on interfaces that address by node ID.
+        node_requested(m->dst.id);
+    }
+    message->unref();
+}
+
+} // namespace openlcb
@@ -0,0 +1,241 @@
+/** \copyright
+ * Copyright (c) 2026, agent
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are  permitted provided that the following conditions are met:
+ *
+ *  - Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ *  - Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ * \file VirtualNodeHost.hxx
+ *
+ * Hosts a large space of virtual nodes that are only created when someone on
+ * the bus is looking for them.
+ *
+ * @author agent
+ * @date 19 Oct 2026
+ */
+
+#ifndef _OPENLCB_VIRTUALNODEHOST_HXX_
+#define _OPENLCB_VIRTUALNODEHOST_HXX_
+
+#include <map>
+#include <vector>
+
+#include "executor/Timer.hxx"
+#include "openlcb/If.hxx"
+
+namespace openlcb
+{
+
+/// Creates and destroys the nodes for a @ref VirtualNodeHost. All calls come
+/// on the interface's executor.
+class VirtualNodeFactory
+{
+public:
+    virtual ~VirtualNodeFactory()
+    {
+    }
+
+    /** @return true if the given node ID belongs to the space of nodes we
+     * host. @param id is the node ID someone asked for. */
+    virtual bool is_hosted(NodeID id) = 0;
+
+    /** Creates a node. The node has to be registered with the interface and
+     * its initialization flow started, the way the constructor of DefaultNode
+     * or TrainService::register_train does it.
+     * @param id is the node ID, for which is_hosted returned true.
+     * @return the new node, or nullptr if it could not be created. */
+    virtual Node *create_node(NodeID id) = 0;
+
+    /** @return true if the node may be removed now. Called only after the
+     * node was idle for the configured amount of time. @param node is the
+     * node to evict. */
+    virtual bool can_evict(Node *node)
+    {
+        return true;
+    }
+
+    /** Removes a node from the interface (e.g. via If::delete_local_node,
+     * which returns its alias) and frees it. @param node is the node to
+     * destroy. */
+    virtual void destroy_node(Node *node) = 0;
+};
+
+/// Hosts virtual nodes that are materialized only when addressed. Instead of
+/// registering every potential node (e.g. a train node for every DCC address)
+/// at startup, the nodes are created when a Verify Node ID, an AME frame or an
+/// addressed message is looking for their node ID. Creations are rate-limited
+/// to a given number per time period, so that a burst of requests will not
+/// flood the bus with initialization messages. Nodes that did not receive any
+/// addressed message for a configured time are evicted, which returns their
+/// alias.
+///
+/// All methods must be called on the interface's executor.
+class VirtualNodeHost : public LocalNodeProvider, private MessageHandler
+{
+public:
+    /** Constructor. Registers the host with the interface.
+     *
+     * @param iface is the interface to host the nodes on.
+     * @param factory creates and destroys the nodes. Not owned.
+     * @param init_batch is how many nodes to create at most in one
+     * init_period.
+     * @param init_period_nsec is the length of the rate limiting period.
+     * @param idle_timeout_nsec is after how much time without an incoming
+     * addressed message a node is evicted. Zero disables eviction.
+     */
+    VirtualNodeHost(If *iface, VirtualNodeFactory *factory,
+        unsigned init_batch = 4, long long init_period_nsec = MSEC_TO_NSEC(50),
+        long long idle_timeout_nsec = 0);
+
+    /// Destructor. Destroys all materialized nodes.
+    ~VirtualNodeHost();
+
+    /** Asks for a node to be created. Called by the interface, but may also be
+     * called by the application for example when a throttle selects a train
+     * in a different protocol. @param id is the node ID. */
+    void node_requested(NodeID id) override;
+
+    /** @return the materialized node with the given ID or nullptr if it does
+     * not exist (yet). @param id is the node ID to look up. */
+    Node *lookup(NodeID id);
+
+    /// @return the number of nodes currently materialized.
+    size_t size()
+    {
+        return nodes_.size() - pending_.size();
+    }
+
+    /// @return the number of nodes that are requested but not yet created.
+    size_t pending()
+    {
+        return pending_.size();
+    }
+
+    /// Counters about the hosted nodes.
+    struct Stats
+    {
+        /// Total number of nodes created.
+        unsigned created{0};
+        /// Total number of nodes evicted.
+        unsigned evicted{0};
+        /// Number of requests that had to wait for the rate limit.
+        unsigned delayed{0};
+    };
+
+    /// @return counters.
+    const Stats &stats()
+    {
+        return stats_;
+    }
+
+    /** Runs the eviction check immediately instead of waiting for the
+     * eviction timer. */
+    void evict_idle();
+
+private:
+    /// What we know about a node ID in the hosted space.
+    struct Entry
+    {
+        /// The node object. nullptr while the node is waiting to be created.
+        Node *node;
+        /// Time (os_get_time_monotonic) of the last addressed message.
+        long long lastUsed;
+    };
+
+    /// Rate limiting timer for node creation.
+    class InitTimer : public ::Timer
+    {
+    public:
+        InitTimer(VirtualNodeHost *parent)
+            : Timer(parent->iface_->executor()->active_timers())
+            , parent_(parent)
+        {
+        }
+
+        long long timeout() override
+        {
+            return parent_->init_timeout();
+        }
+
+    private:
+        VirtualNodeHost *parent_;
+    };
+
+    /// Periodic timer for evicting idle nodes.
+    class EvictTimer : public ::Timer
+    {
+    public:
+        EvictTimer(VirtualNodeHost *parent)
+            : Timer(parent->iface_->executor()->active_timers())
+            , parent_(parent)
+        {
+        }
+
+        long long timeout() override
+        {
+            parent_->evict_idle();
+            return RESTART;
+        }
+
+    private:
+        VirtualNodeHost *parent_;
+    };
+
+    /// Incoming addressed message. Updates the idle time of the destination
+    /// node, or requests it if it does not exist.
+    void send(Buffer<GenMessage> *message, unsigned priority) override;
+
+    /// Creates pending nodes as long as the rate limit allows.
+    void create_pending();
+
+    /// Called by the init timer. @return next timer period.
+    long long init_timeout();
+
+    /// Interface we are hosting the nodes on.
+    If *iface_;
+    /// Creates the nodes.
+    VirtualNodeFactory *factory_;
+    /// Max number of node creations per period.
+    unsigned initBatch_;
+    /// Number of nodes created in the current rate limiting period.
+    unsigned createdInPeriod_{0};
+    /// True while the init timer is running.
+    bool initTimerRunning_{false};
+    /// Period of the rate limit.
+    long long initPeriod_;
+    /// Nodes not addressed for this long are evicted.
+    long long idleTimeout_;
+    /// All node IDs of the hosted space we know about.
+    std::map<NodeID, Entry> nodes_;
+    /// Node IDs waiting to be created, in the order of requests.
+    std::vector<NodeID> pending_;
+    /// Counters.
+    Stats stats_;
+    /// Rate limits the node creation.
+    InitTimer initTimer_{this};
+    /// Evicts idle nodes.
+    EvictTimer evictTimer_{this};
+};
+
+} // namespace openlcb
+
+#endif // _OPENLCB_VIRTUALNODEHOST_HXX_
@@ -42,6 +42,14 @@ DEFAULT_CONST(local_alias_cache_size, 3);
 /** Maximum number of local nodes */
 DEFAULT_CONST(local_nodes_count, 2);
 
+/** How many alias reservations may be in their 200 msec waiting period at
+ * the same time. */
+DEFAULT_CONST(alias_reservation_window, 8);
+
+/** How many aliases the SimpleStack keeps reserved in advance. Gateways
+ * creating many virtual nodes should raise this. */
+DEFAULT_CONST(reserved_alias_pool_size, 1);
+
 /** Number of datagram registry entries. This is how many datagram handlers can
  * be registered (e.g. memory config protocol is one). */
 DEFAULT_CONST(num_datagram_registry_entries, 2);
@@ -50,6 +58,14 @@ DEFAULT_CONST(num_datagram_registry_entries, 2);
  * happen concurrently. */
 DEFAULT_CONST(num_datagram_clients, 2);
 
+/** Number of multi-frame datagrams that can be reassembled concurrently from
+ * the CAN bus. Each takes about 90 bytes, allocated at startup. */
+DEFAULT_CONST(can_datagram_reassembly_slots, 8);
+
+/** A partially received multi-frame datagram is dropped if its last frame has
+ * not arrived this many milliseconds after the first frame. */
+DEFAULT_CONST(can_datagram_reassembly_timeout_msec, 3000);
+
 /** Maximum number of memory spaces that can be registered for the MemoryConfig
  * datagram handler. */
 DEFAULT_CONST(num_memory_spaces, 5);
@@ -63,3 +79,15 @@ DEFAULT_CONST_FALSE(enable_all_memory_space);
  * identified messages at boot time. This is required by the OpenLCB
  * standard. */
 DEFAULT_CONST_TRUE(node_init_identify);
+
+/** How many event handlers to call for an Identify Events message before
+ * letting other event messages through. */
+DEFAULT_CONST(event_identify_batch_size, 16);
+
+/** How many identified messages to send for an Identify Events message before
+ * waiting for them to leave the interface. Zero disables batching. */
+DEFAULT_CONST(event_identify_write_window, 8);
+
+/** Memory space number at which the SimpleStack exports the raw compressed
+ * CDI blob (if the CDI was compiled in compressed form). Zero disables. */
+DEFAULT_CONST(compressed_cdi_space, 0);
@@ -0,0 +1,885 @@
+/** \copyright
+ * Copyright (c) 2026, agent
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are  permitted provided that the following conditions are met:
+ *
+ *  - Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ *  - Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ * \file AsyncLog.cxx
+ *
+ * Asynchronous backend for the LOG macro. The calling thread only copies the
+ * format pointer and the raw arguments into a per-thread ring; a background
+ * thread does the printf formatting and the writing.
+ *
+ * @author agent
+ * @date 19 Oct 2026
+ */
+
+#include "utils/AsyncLog.hxx"
+
+#ifdef LOG_ASYNC_SUPPORTED
+
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <stdarg.h>
+#include <stdint.h>
+#include <string.h>
+#include <thread>
+
+namespace async_log
+{
+
+/// True when the LOG macro should go to the asynchronous backend.
+static std::atomic<bool> g_enabled{false};
+
+/// Longest string argument that is copied. Longer strings are truncated.
+static constexpr unsigned MAX_STRING_ARG = 255;
+/// Longest packed argument list. LOG calls with more argument data are
+/// formatted synchronously.
+static constexpr unsigned MAX_ARGS_SIZE = 1024;
+/// Longest conversion specification (e.g. "%-08.3lx") we handle.
+static constexpr unsigned MAX_SPEC = 24;
+
+/// How a conversion reads its argument from the variadic list.
+enum ArgType : uint8_t
+{
+    /// %%; no argument.
+    ARG_NONE,
+    ARG_INT,
+    ARG_LONG,
+    ARG_LONG_LONG,
+    ARG_INTMAX,
+    ARG_SIZE,
+    ARG_PTRDIFF,
+    ARG_DOUBLE,
+    ARG_LONG_DOUBLE,
+    /// %p.
+    ARG_POINTER,
+    /// %s; the characters are copied.
+    ARG_STRING,
+};
+
+/// A parsed printf conversion specification.
+struct Spec
+{
+    /// One past the conversion character.
+    const char *end;
+    /// How many '*' width or precision arguments precede the value.
+    unsigned stars;
+    /// Type of the value argument.
+    ArgType type;
+};
+
+/// Parses a printf conversion specification. @param p points to the '%'.
+/// @param s is filled in. @return false if the conversion cannot be captured
+/// (%n, %m, %ls, positional arguments, or something unknown).
+static bool parse_spec(const char *p, Spec *s)
+{
+    const char *q = p + 1;
+    s->stars = 0;
+    while (*q && strchr("-+ #0'", *q))
+    {
+        ++q;
+    }
+    if (*q == '*')
+    {
+        ++s->stars;
+        ++q;
+    }
+    while (*q >= '0' && *q <= '9')
+    {
+        ++q;
+    }
+    if (*q == '.')
+    {
+        ++q;
+        if (*q == '*')
+        {
+            ++s->stars;
+            ++q;
+        }
+        while (*q >= '0' && *q <= '9')
+        {
+            ++q;
+        }
+    }
+    const char *length = q;
+    ArgType int_type = ARG_INT;
+    bool long_double = false;
+    switch (*q)
+    {
+        case 'h':
+            ++q;
+            if (*q == 'h')
+            {
+                ++q;
+            }
+            break;
+        case 'l':
+            ++q;
+            int_type = ARG_LONG;
+            if (*q == 'l')
+            {
+                ++q;
+                int_type = ARG_LONG_LONG;
+            }
+            break;
+        case 'q':
+            ++q;
+            int_type = ARG_LONG_LONG;
+            break;
+        case 'L':
+            ++q;
+            long_double = true;
+            break;
+        case 'j':
+            ++q;
+            int_type = ARG_INTMAX;
+            break;
+        case 'z':
+            ++q;
+            int_type = ARG_SIZE;
+            break;
+        case 't':
+            ++q;
+            int_type = ARG_PTRDIFF;
+            break;
+        default:
+            break;
+    }
+    bool has_length = q != length;
+    switch (*q)
+    {
+        case '%':
+            if (q != p + 1)
+            {
+                return false;
+            }
+            s->type = ARG_NONE;
+            break;
+        case 'd':
+        case 'i':
+        case 'o':
+        case 'u':
+        case 'x':
+        case 'X':
+        case 'c':
+            if (long_double)
+            {
+                return false;
+            }
+            s->type = int_type;
+            break;
+        case 'e':
+        case 'E':
+        case 'f':
+        case 'F':
+        case 'g':
+        case 'G':
+        case 'a':
+        case 'A':
+            s->type = long_double ? ARG_LONG_DOUBLE : ARG_DOUBLE;
+            break;
+        case 'p':
+            if (has_length)
+            {
+                return false;
+            }
+            s->type = ARG_POINTER;
+            break;
+        case 's':
+            if (has_length)
+            {
+                return false;
+            }
+            s->type = ARG_STRING;
+            break;
+        default:
+            return false;
+    }
+    s->end = q + 1;
+    return s->end - p < (int)MAX_SPEC;
+}
+
+/// Appends values to a buffer of packed arguments.
+struct Packer
+{
+    /// Where the next value goes.
+    uint8_t *p;
+    /// End of the buffer.
+    uint8_t *end;
+
+    /// Appends a value. @param v is the value. @return false if it does not
+    /// fit.
+    template <typename T> bool put(T v)
+    {
+        if (end - p < (ptrdiff_t)sizeof(v))
+        {
+            return false;
+        }
+        memcpy(p, &v, sizeof(v));
+        p += sizeof(v);
+        return true;
+    }
+
+    /// Appends a string as a 16-bit length, the characters and a terminating
+    /// zero. @param s is the string, may be null. @return false if it does
+    /// not fit.
+    bool put_string(const char *s)
+    {
+        if (!s)
+        {
+            s = "(null)";
+        }
+        uint16_t len = 0;
+        while (len < MAX_STRING_ARG && s[len])
+        {
+            ++len;
+        }
+        if (end - p < 2 + len + 1 || !put(len))
+        {
+            return false;
+        }
+        memcpy(p, s, len);
+        p[len] = 0;
+        p += len + 1;
+        return true;
+    }
+};
+
+/// Copies the arguments of a LOG call as the format reads them. @param buf
+/// is where to pack them, @param size is the length of buf, @param fmt is the
+/// printf format, @param ap is the argument list. @return the packed length,
+/// or -1 if the call has to be formatted synchronously.
+static int pack_args(uint8_t *buf, unsigned size, const char *fmt, va_list ap)
+{
+    Packer pk{buf, buf + size};
+    for (const char *f = strchr(fmt, '%'); f; f = strchr(f, '%'))
+    {
+        Spec s;
+        if (!parse_spec(f, &s))
+        {
+            return -1;
+        }
+        f = s.end;
+        bool ok = true;
+        for (unsigned i = 0; i < s.stars; ++i)
+        {
+            ok = ok && pk.put(va_arg(ap, int));
+        }
+        switch (s.type)
+        {
+            case ARG_NONE:
+                break;
+            case ARG_INT:
+                ok = ok && pk.put(va_arg(ap, int));
+                break;
+            case ARG_LONG:
+                ok = ok && pk.put(va_arg(ap, long));
+                break;
+            case ARG_LONG_LONG:
+                ok = ok && pk.put(va_arg(ap, long long));
+                break;
+            case ARG_INTMAX:
+                ok = ok && pk.put(va_arg(ap, intmax_t));
+                break;
+            case ARG_SIZE:
+                ok = ok && pk.put(va_arg(ap, size_t));
+                break;
+            case ARG_PTRDIFF:
+                ok = ok && pk.put(va_arg(ap, ptrdiff_t));
+                break;
+            case ARG_DOUBLE:
+                ok = ok && pk.put(va_arg(ap, double));
+                break;
+            case ARG_LONG_DOUBLE:
+                ok = ok && pk.put(va_arg(ap, long double));
+                break;
+            case ARG_POINTER:
+                ok = ok && pk.put(va_arg(ap, const void *));
+                break;
+            case ARG_STRING:
+                // Whatever pointer type the caller passed (e.g. uint8_t *),
+                // the characters are copied.
+                ok = ok && pk.put_string(va_arg(ap, const char *));
+                break;
+        }
+        if (!ok)
+        {
+            return -1;
+        }
+    }
+    return pk.p - buf;
+}
+
+/// Reads back a value stored by Packer::put. @param p is advanced past it.
+/// @return the value.
+template <typename T> static T get_arg(const uint8_t **p)
+{
+    T v;
+    memcpy(&v, *p, sizeof(v));
+    *p += sizeof(v);
+    return v;
+}
+
+/// Formats a single conversion. @param buf and @param size are the output
+/// buffer, @param spec is the conversion specification, @param stars is how
+/// many width and precision arguments it has, @param w are their values,
+/// @param v is the value. @return what snprintf returns.
+template <typename T>
+static int format_one(char *buf, size_t size, const char *spec,
+    unsigned stars, const int *w, T v)
+{
+    switch (stars)
+    {
+        case 0:
+            return snprintf(buf, size, spec, v);
+        case 1:
+            return snprintf(buf, size, spec, w[0], v);
+        default:
+            return snprintf(buf, size, spec, w[0], w[1], v);
+    }
+}
+
+/// Formats a captured record. @param buf is the output buffer, @param size
+/// is the length of buf, @param fmt is the printf format of the LOG call,
+/// @param args is the packed arguments. @return the number of characters
+/// written, not counting the terminating zero.
+static int render(char *buf, size_t size, const char *fmt, const uint8_t *args)
+{
+    size_t pos = 0;
+    buf[0] = 0;
+    while (*fmt && pos + 1 < size)
+    {
+        const char *pct = strchr(fmt, '%');
+        size_t lit = pct ? pct - fmt : strlen(fmt);
+        if (lit)
+        {
+            if (lit > size - 1 - pos)
+            {
+                lit = size - 1 - pos;
+            }
+            memcpy(buf + pos, fmt, lit);
+            pos += lit;
+            buf[pos] = 0;
+            fmt += lit;
+            continue;
+        }
+        Spec s;
+        parse_spec(fmt, &s);
+        char spec[MAX_SPEC];
+        memcpy(spec, fmt, s.end - fmt);
+        spec[s.end - fmt] = 0;
+        fmt = s.end;
+        int w[2] = {0, 0};
+        for (unsigned i = 0; i < s.stars; ++i)
+        {
+            w[i] = get_arg<int>(&args);
+        }
+        char *out = buf + pos;
+        size_t room = size - pos;
+        int len = 0;
+        switch (s.type)
+        {
+            case ARG_NONE:
+                out[0] = '%';
+                out[1] = 0;
+                len = 1;
+                break;
+            case ARG_INT:
+                len = format_one(out, room, spec, s.stars, w,
+                    get_arg<int>(&args));
+                break;
+            case ARG_LONG:
+                len = format_one(out, room, spec, s.stars, w,
+                    get_arg<long>(&args));
+                break;
+            case ARG_LONG_LONG:
+                len = format_one(out, room, spec, s.stars, w,
+                    get_arg<long long>(&args));
+                break;
+            case ARG_INTMAX:
+                len = format_one(out, room, spec, s.stars, w,
+                    get_arg<intmax_t>(&args));
+                break;
+            case ARG_SIZE:
+                len = format_one(out, room, spec, s.stars, w,
+                    get_arg<size_t>(&args));
+                break;
+            case ARG_PTRDIFF:
+                len = format_one(out, room, spec, s.stars, w,
+                    get_arg<ptrdiff_t>(&args));
+                break;
+            case ARG_DOUBLE:
+                len = format_one(out, room, spec, s.stars, w,
+                    get_arg<double>(&args));
+                break;
+            case ARG_LONG_DOUBLE:
+                len = format_one(out, room, spec, s.stars, w,
+                    get_arg<long double>(&args));
+                break;
+            case ARG_POINTER:
+                len = format_one(out, room, spec, s.stars, w,
+                    get_arg<const void *>(&args));
+                break;
+            case ARG_STRING:
+            {
+                uint16_t slen = get_arg<uint16_t>(&args);
+                len = format_one(
+                    out, room, spec, s.stars, w, (const char *)args);
+                args += slen + 1;
+                break;
+            }
+        }
+        if (len < 0)
+        {
+            return len;
+        }
+        pos += (size_t)len < room ? len : room - 1;
+    }
+    return pos;
+}
+
+/// Header of a record in the ring. The packed arguments follow.
+struct RecordHeader
+{
+    /// Total length of the record in bytes, including this header, rounded
+    /// up to a multiple of RECORD_ALIGN.
+    uint32_t size;
+    /// Global order of the record, used to merge the rings.
+    uint32_t seq;
+    /// printf format; nullptr for the padding at the end of the ring.
+    const char *fmt;
+};
+
+/// Records start at multiples of this, so that even the padding at the end of
+/// the ring has room for a full header.
+static constexpr uint32_t RECORD_ALIGN = 32;
+static_assert(sizeof(RecordHeader) <= RECORD_ALIGN, "record alignment");
+
+/// Single-producer single-consumer ring of variable-length records. The
+/// producer is the thread owning the ring, the consumer is the writer thread.
+struct Ring
+{
+    /// Size of the ring in bytes. Must be a power of two.
+    static constexpr uint32_t SIZE = 32768;
+    /// Longest record accepted.
+    static constexpr uint32_t MAX_RECORD = SIZE / 4;
+
+    /// Byte offset (modulo 2^32) where the next record will be written.
+    /// Written only by the producer.
+    std::atomic<uint32_t> head{0};
+    /// Byte offset of the oldest record not yet consumed. Written only by the
+    /// consumer.
+    std::atomic<uint32_t> tail{0};
+    /// Number of records dropped because the ring was full.
+    std::atomic<uint32_t> dropped{0};
+    /// Set when the owning thread exited; the ring is freed once empty.
+    std::atomic<bool> orphaned{false};
+    /// Producer only: head after the record currently being filled.
+    uint32_t pendingHead{0};
+    /// Producer only: the record currently being filled.
+    RecordHeader *pendingRecord{nullptr};
+    /// Next ring in the list of all rings.
+    Ring *next{nullptr};
+    /// Record storage.
+    alignas(8) uint8_t data[SIZE];
+
+    /// @return the first record of the ring, skipping the padding at the end,
+    /// or nullptr if empty. Called only by the consumer.
+    RecordHeader *front()
+    {
+        uint32_t t = tail.load(std::memory_order_relaxed);
+        while (t != head.load(std::memory_order_acquire))
+        {
+            RecordHeader *r = (RecordHeader *)(data + (t & (SIZE - 1)));
+            if (r->fmt)
+            {
+                return r;
+            }
+            t += r->size;
+            tail.store(t, std::memory_order_release);
+        }
+        return nullptr;
+    }
+
+    /// Releases the record returned by front(). Called only by the consumer.
+    void pop_front()
+    {
+        uint32_t t = tail.load(std::memory_order_relaxed);
+        RecordHeader *r = (RecordHeader *)(data + (t & (SIZE - 1)));
+        tail.store(t + r->size, std::memory_order_release);
+    }
+};
+
+/// Counter for ordering the records across threads. A record takes its
+/// number when it is committed, and it gets published right after, so every
+/// number taken belongs to a record that is (or is about to be) visible to
+/// the writer.
+static std::atomic<uint32_t> g_seq{0};
+/// Number of records written out by the writer thread. Since the records are
+/// written in sequence number order, this is also the sequence number of the
+/// next record to write.
+static uint32_t g_written = 0;
+/// Total number of dropped records.
+static std::atomic<unsigned> g_dropped{0};
+/// Protects g_rings, g_written and the lifecycle of the writer thread.
+static std::mutex g_rings_lock;
+/// Wakes up the writer thread. Used with g_rings_lock.
+static std::condition_variable g_writer_wakeup;
+/// Signaled by the writer thread after it wrote some records. Used with
+/// g_rings_lock.
+static std::condition_variable g_written_cond;
+/// Set by the writer thread before it waits for g_writer_wakeup. The logging
+/// threads only notify the writer if they find this set, so a busy logger
+/// does not take the lock for every record.
+static std::atomic<bool> g_writer_sleeping{false};
+/// All rings.
+static Ring *g_rings = nullptr;
+/// The writer thread.
+static std::thread *g_writer = nullptr;
+/// Tells the writer thread to exit once everything is written.
+static std::atomic<bool> g_stop{false};
+/// Where the batches are written to.
+static std::atomic<void (*)(const char *, size_t)> g_output{nullptr};
+
+/// Owns the ring of a thread; marks the ring orphaned when the thread exits.
+struct ThreadRing
+{
+    ~ThreadRing()
+    {
+        if (ring)
+        {
+            ring->orphaned.store(true, std::memory_order_release);
+        }
+    }
+
+    /// The ring of this thread, or nullptr if it did not log yet.
+    Ring *ring{nullptr};
+};
+
+static thread_local ThreadRing t_ring;
+
+/// @return the ring of the calling thread.
+static Ring *get_ring()
+{
+    Ring *r = t_ring.ring;
+    if (!r)
+    {
+        r = new Ring;
+        std::lock_guard<std::mutex> l(g_rings_lock);
+        r->next = g_rings;
+        g_rings = r;
+        t_ring.ring = r;
+    }
+    return r;
+}
+
+/// Starts a new record in the calling thread's ring. @param len is the
+/// packed size of the arguments, @param fmt is the printf format. @return
+/// where to copy the arguments to, or nullptr if the ring is full (the record
+/// is counted as dropped).
+static uint8_t *begin_record(unsigned len, const char *fmt)
+{
+    Ring *r = get_ring();
+    uint32_t total =
+        (sizeof(RecordHeader) + len + RECORD_ALIGN - 1) & ~(RECORD_ALIGN - 1);
+    uint32_t h = r->head.load(std::memory_order_relaxed);
+    uint32_t ofs = h & (Ring::SIZE - 1);
+    // Records are contiguous; if this one does not fit before the end of
+    // the ring, the rest of the ring is filled with padding.
+    uint32_t pad = ofs + total > Ring::SIZE ? Ring::SIZE - ofs : 0;
+    if (total > Ring::MAX_RECORD ||
+        h + pad + total - r->tail.load(std::memory_order_acquire) >
+            Ring::SIZE)
+    {
+        r->dropped.fetch_add(1, std::memory_order_relaxed);
+        return nullptr;
+    }
+    if (pad)
+    {
+        RecordHeader *p = (RecordHeader *)(r->data + ofs);
+        p->size = pad;
+        p->fmt = nullptr;
+        h += pad;
+        ofs = 0;
+    }
+    RecordHeader *rec = (RecordHeader *)(r->data + ofs);
+    rec->size = total;
+    rec->fmt = fmt;
+    // The padding is published together with the record.
+    r->pendingHead = h + total;
+    r->pendingRecord = rec;
+    return (uint8_t *)(rec + 1);
+}
+
+/// Publishes the record started by the last begin_record to the writer.
+static void commit_record()
+{
+    Ring *r = t_ring.ring;
+    r->pendingRecord->seq = g_seq.fetch_add(1, std::memory_order_relaxed);
+    r->head.store(r->pendingHead, std::memory_order_seq_cst);
+    if (g_writer_sleeping.load(std::memory_order_seq_cst))
+    {
+        std::lock_guard<std::mutex> l(g_rings_lock);
+        g_writer_wakeup.notify_one();
+    }
+}
+
+/// Writes a batch of lines to the output.
+static void output(const char *buf, size_t size)
+{
+    if (!size)
+    {
+        return;
+    }
+    auto fn = g_output.load();
+    if (fn)
+    {
+        fn(buf, size);
+        return;
+    }
+    // Synchronous LOG calls (e.g. from C code) go out under the same lock,
+    // so lines never get mixed.
+    LOCK_LOG;
+    fwrite(buf, size, 1, stderr);
+    UNLOCK_LOG;
+}
+
+/// @return true if any ring has a record to write. Called with
+/// g_rings_lock held.
+static bool have_records()
+{
+    for (Ring *r = g_rings; r; r = r->next)
+    {
+        if (r->front())
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+/// Body of the writer thread. Merges the rings in the order of the records'
+/// sequence numbers, formats the records into a batch buffer and writes out
+/// the batch when it is full or when there is nothing more to format.
+static void writer_main()
+{
+    static constexpr unsigned BATCH_SIZE = 16384;
+    static constexpr unsigned MAX_LINE = 1024;
+    char *batch = new char[BATCH_SIZE + 1];
+    unsigned pos = 0;
+    std::unique_lock<std::mutex> l(g_rings_lock);
+    while (true)
+    {
+        bool stopping = g_stop.load(std::memory_order_acquire);
+        unsigned done = 0;
+        // true if the next record in sequence is not published yet.
+        bool gap = false;
+        while (true)
+        {
+            Ring *best = nullptr;
+            RecordHeader *best_rec = nullptr;
+            for (Ring *r = g_rings; r; r = r->next)
+            {
+                RecordHeader *rec = r->front();
+                if (rec &&
+                    (!best_rec || (int32_t)(rec->seq - best_rec->seq) < 0))
+                {
+                    best = r;
+                    best_rec = rec;
+                }
+            }
+            if (!best)
+            {
+                break;
+            }
+            if (best_rec->seq != g_written + done)
+            {
+                // A thread took the next sequence number but did not publish
+                // the record yet.
+                gap = true;
+                break;
+            }
+            if (BATCH_SIZE - pos < MAX_LINE + 1)
+            {
+                output(batch, pos);
+                pos = 0;
+            }
+            int len = render(batch + pos, MAX_LINE + 1, best_rec->fmt,
+                (const uint8_t *)(best_rec + 1));
+            if (len > (int)MAX_LINE)
+            {
+                len = MAX_LINE;
+            }
+            if (len > 0)
+            {
+                pos += len;
+                batch[pos++] = '\n';
+            }
+            best->pop_front();
+            ++done;
+        }
+        unsigned dropped = 0;
+        Ring **rp = &g_rings;
+        while (*rp)
+        {
+            Ring *r = *rp;
+            dropped += r->dropped.exchange(0, std::memory_order_relaxed);
+            if (r->orphaned.load(std::memory_order_acquire) && !r->front())
+            {
+                *rp = r->next;
+                delete r;
+                continue;
+            }
+            rp = &r->next;
+        }
+        if (dropped)
+        {
+            g_dropped.fetch_add(dropped);
+            pos += snprintf(batch + pos, BATCH_SIZE - pos,
+                "Async logging: %u log records dropped\n", dropped);
+        }
+        output(batch, pos);
+        pos = 0;
+        if (done)
+        {
+            g_written += done;
+            g_written_cond.notify_all();
+            continue;
+        }
+        if (gap)
+        {
+            // The missing record is a few instructions away from being
+            // published.
+            l.unlock();
+            std::this_thread::yield();
+            l.lock();
+            continue;
+        }
+        if (stopping)
+        {
+            break;
+        }
+        g_writer_sleeping.store(true, std::memory_order_seq_cst);
+        if (!have_records() && !g_stop.load())
+        {
+            g_writer_wakeup.wait(l);
+        }
+        g_writer_sleeping.store(false, std::memory_order_relaxed);
+    }
+    l.unlock();
+    delete[] batch;
+}
+
+} // namespace async_log
+
+using namespace async_log;
+
+bool log_async_push(const char *fmt, ...)
+{
+    if (!g_enabled.load(std::memory_order_relaxed))
+    {
+        return false;
+    }
+    uint8_t args[MAX_ARGS_SIZE];
+    va_list ap;
+    va_start(ap, fmt);
+    int len = pack_args(args, sizeof(args), fmt, ap);
+    va_end(ap);
+    if (len < 0)
+    {
+        return false;
+    }
+    uint8_t *p = begin_record(len, fmt);
+    if (p)
+    {
+        memcpy(p, args, len);
+        commit_record();
+    }
+    return true;
+}
+
+void log_async_start()
+{
+    std::lock_guard<std::mutex> l(g_rings_lock);
+    if (g_writer)
+    {
+        return;
+    }
+    static bool atexit_registered = false;
+    if (!atexit_registered)
+    {
+        atexit_registered = true;
+        atexit(&log_async_stop);
+    }
+    g_stop.store(false);
+    g_writer = new std::thread(&writer_main);
+    g_enabled.store(true);
+}
+
+void log_async_stop()
+{
+    std::thread *t;
+    {
+        std::lock_guard<std::mutex> l(g_rings_lock);
+        t = g_writer;
+        g_writer = nullptr;
+        if (!t)
+        {
+            return;
+        }
+        g_enabled.store(false);
+        g_stop.store(true, std::memory_order_release);
+        g_writer_wakeup.notify_one();
+    }
+    t->join();
+    delete t;
+    std::lock_guard<std::mutex> l(g_rings_lock);
+    g_written_cond.notify_all();
+}
+
+void log_async_flush()
+{
+    std::unique_lock<std::mutex> l(g_rings_lock);
+    if (!g_writer)
+    {
+        return;
+    }
+    uint32_t target = g_seq.load(std::memory_order_acquire);
+    g_written_cond.wait(l, [target]() {
+        return !g_writer || (int32_t)(g_written - target) >= 0;
+    });
+}
+
+unsigned log_async_dropped()
+{
+    return g_dropped.load();
+}
+
+void log_async_set_output(void (*fn)(const char *buf, size_t size))
+{
+    g_output.store(fn);
+}
+
+#endif // LOG_ASYNC_SUPPORTED
@@ -0,0 +1,73 @@
+/** \copyright
+ * Copyright (c) 2026, agent
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are  permitted provided that the following conditions are met:
+ *
+ *  - Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ *  - Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ * \file AsyncLog.hxx
+ *
+ * Asynchronous backend for the LOG macro. The calling thread only copies the
+ * format pointer and the raw arguments into a per-thread ring; a background
+ * thread does the printf formatting and the writing.
+ *
+ * @author agent
+ * @date 19 Oct 2026
+ */
+
+#ifndef _UTILS_ASYNCLOG_HXX_
+#define _UTILS_ASYNCLOG_HXX_
+
+#include <stddef.h>
+
+#include "utils/logging.h"
+
+#ifdef LOG_ASYNC_SUPPORTED
+
+/// Starts the background thread and switches the LOG macro to asynchronous
+/// logging. Log lines are batched and written to stderr. At process exit the
+/// pending records are flushed.
+///
+/// The LOG call walks its format string and copies each argument as the
+/// conversion reads it. Every %s argument is copied as a string, truncated
+/// to 255 characters, whatever its pointer type, because the pointed string
+/// may be gone by the time the record is formatted. LOG calls with %n, %m,
+/// %ls or positional arguments are formatted synchronously.
+void log_async_start();
+
+/// Writes out all pending records, stops the background thread and switches
+/// the LOG macro back to synchronous logging. The threads that are logging
+/// concurrently with this call may lose some records.
+void log_async_stop();
+
+/// @return how many records were dropped in total, because the ring of the
+/// logging thread was full.
+unsigned log_async_dropped();
+
+/// Replaces where the batches of log lines are written to. Used by tests.
+/// @param fn is called from the background thread with a buffer of one or
+/// more lines, each terminated by \n; nullptr restores writing to stderr.
+void log_async_set_output(void (*fn)(const char *buf, size_t size));
+
+#endif // LOG_ASYNC_SUPPORTED
+
+#endif // _UTILS_ASYNCLOG_HXX_
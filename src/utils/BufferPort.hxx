@@ -26,8 +26,8 @@
  *
  * \file BufferPort.hxx
  *
- * Wrapper for a string-valued Hub port. Uses a time delay to buffer string
- * output up to a certain size before sending off to a target port.
+ * Wrapper for a string-valued Hub port. Uses an adaptive time delay to buffer
+ * string output up to a certain size before sending off to a target port.
  *
  * @author Balazs Racz
  * @date 20 Jun 2016
@@ -36,9 +36,23 @@
 #ifndef _UTILS_BUFFERPORT_HXX_
 #define _UTILS_BUFFERPORT_HXX_
 
-/// A wrapper class around a string-based Hub Port that buffersthe outgoing
-/// bytes for a specified delay timer before sending the data off. This helps
-/// accumulate more data per TCP packet and increase transmission efficiency.
+#include <algorithm>
+
+#include "utils/Ewma.hxx"
+#include "utils/Hub.hxx"
+
+/// A wrapper class around a string-based Hub Port that buffers the outgoing
+/// bytes before sending the data off. This helps accumulate more data per TCP
+/// packet and increase transmission efficiency.
+///
+/// The buffering adapts to the traffic. A packet arriving after an idle period
+/// is sent off immediately. When packets are arriving in a stream, they are
+/// collected into one buffer, which is flushed when it is full, when the
+/// stream pauses (no packet arrived for twice the average gap between
+/// packets), or when the first byte has been waiting for the latency budget,
+/// whichever comes first. The collected bytes are appended to the string of
+/// the first packet's buffer, which is then handed off downstream without
+/// further copying.
 ///
 // Added by default on GridConnect bridges.
 class BufferPort : public HubPort
@@ -50,24 +64,20 @@ public:
     /// as the calling Hub's executor.
     /// @param downstream where to send the (buffered) data onwards.
     /// @param buffer_bytes how many bytes to buffer up max.
-    /// @param delay_nsec how many nanoseconds long we should buffer the output
-    /// data max.
+    /// @param delay_nsec latency budget: how many nanoseconds long we should
+    /// buffer the output data max.
     BufferPort(Service *service, HubPortInterface *downstream,
         unsigned buffer_bytes, long long delay_nsec)
         : HubPort(service)
         , downstream_(downstream)
         , delayNsec_(delay_nsec)
-        , sendBuf_(new char[buffer_bytes])
         , bufSize_(buffer_bytes)
-        , bufEnd_(0)
         , timerPending_(0)
     {
-        HASSERT(sendBuf_);
     }
 
     ~BufferPort()
     {
-        delete [] sendBuf_;
     }
 
     bool shutdown() {
@@ -80,63 +90,84 @@ public:
         }
         return true;
     }
-    
+
 private:
     Action entry() override
     {
-        if (msg().size() < (bufSize_ - bufEnd_))
+        long long now = os_get_time_monotonic();
+        long long gap = now - lastArrivalNsec_;
+        lastArrivalNsec_ = now;
+        // A long idle period is counted as one budget worth, so that the
+        // average recovers quickly when a stream starts.
+        gapNsec_.add_value(std::min(gap, delayNsec_));
+
+        if (tgtBuf_ && tgtBuf_->data()->size() + msg().size() > bufSize_)
+        {
+            // Does not fit.
+            flush_buffer();
+        }
+        if (msg().size() >= bufSize_ || (!tgtBuf_ && gap >= delayNsec_))
         {
-            // Fits into the buffer.
-            memcpy(sendBuf_ + bufEnd_, msg().data(), msg().size());
-            bufEnd_ += msg().size();
+            // Cannot buffer, or the line was idle: send off directly.
+            downstream_->send(transfer_message(), priority());
+            return exit();
+        }
+        if (!tgtBuf_)
+        {
+            // Will ensure we keep track of the skipMember_ inside as well.
+            tgtBuf_ = transfer_message();
+            // Invokes the caller's notify in case there is one set.
+            tgtBuf_->set_done(nullptr);
+            tgtBuf_->data()->reserve(bufSize_);
+            firstArrivalNsec_ = now;
             if (!timerPending_)
             {
                 timerPending_ = 1;
-                bufferTimer_.start(delayNsec_);
-            }
-            if (!tgtBuf_) {
-                // Will ensure we keep track of the skipMember_ inside as well.
-                tgtBuf_ = transfer_message();
-                // Invokes the caller's notify in case there is one set.
-                tgtBuf_->set_done(nullptr);
+                bufferTimer_.start(std::max(flush_deadline() - now, 2LL));
             }
-            return release_and_exit();
+            return exit();
         }
-        else
+        tgtBuf_->data()->append(msg());
+        if (tgtBuf_->data()->size() >= bufSize_)
         {
             flush_buffer();
         }
+        return release_and_exit();
+    }
 
-        if (msg().size() >= bufSize_)
-        {
-            // Cannot buffer: send off directly.
-            downstream_->send(transfer_message(), priority());
-            return exit();
-        }
-        else
-        {
-            // After flushing the buffers this will fit.
-            return again();
-        }
+    /// @return the absolute time when the buffered data should be sent off.
+    long long flush_deadline()
+    {
+        return std::min(firstArrivalNsec_ + delayNsec_,
+            lastArrivalNsec_ + 2 * (long long)gapNsec_.avg());
     }
 
     /// Sends off any data we may have accumulated in the buffer to the
     /// downstream consumer.
     void flush_buffer()
     {
-        if (!bufEnd_) return; // nothing to do
+        if (!tgtBuf_) return; // nothing to do
         auto *b = tgtBuf_;
         tgtBuf_ = nullptr;
-        b->data()->assign(sendBuf_, bufEnd_);
-        bufEnd_ = 0;
         downstream_->send(b);
     }
 
-    /// Callback from the timer.
-    void timeout()
+    /// Callback from the timer. @return the new timer period, or NONE.
+    long long timeout()
     {
+        if (tgtBuf_)
+        {
+            long long now = os_get_time_monotonic();
+            long long deadline = flush_deadline();
+            if (deadline > now)
+            {
+                // More data arrived since the timer was started.
+                return std::max(deadline - now, 2LL);
+            }
+            flush_buffer();
+        }
         timerPending_ = 0;
-        flush_buffer();
+        return ::Timer::NONE;
     }
 
     /// @return the current message that we are processing.
@@ -159,26 +190,27 @@ private:
 
         long long timeout() override
         {
-            parent_->timeout();
-            return NONE;
+            return parent_->timeout();
         }
 
     private:
         BufferPort *parent_; ///< what to notify upon timeout.
     } bufferTimer_{this}; ///< timer instance.
 
-    /// Caches one output buffer to fill in the buffer flush method.
+    /// The buffer being filled; its string collects the outgoing data.
     Buffer<HubData> *tgtBuf_{nullptr};
     /// Where to send output data to.
     HubPortInterface* downstream_;
     /// How long maximum we should buffer the input data.
     long long delayNsec_;
-    /// Temporarily stores outgoing data.
-    char *sendBuf_;
-    /// How many bytes are there in the send buffer.
+    /// When the last packet arrived.
+    long long lastArrivalNsec_{0};
+    /// When the first packet in tgtBuf_ arrived.
+    long long firstArrivalNsec_{0};
+    /// Average time between incoming packets, capped at delayNsec_.
+    AbsEwma gapNsec_{0.8};
+    /// How many bytes we buffer up max.
     unsigned bufSize_;
-    /// Offset in sendBuf_ of the first unused byte.
-    unsigned bufEnd_ : 24;
     /// 1 if the timer is running and there will be a timer callback coming in
     /// the future.
     unsigned timerPending_ : 1;
@@ -4,6 +4,8 @@
 // avoid dependency on hand-written fileio stuff.
 #define _FREERTOS_DRIVERS_COMMON_EEPROM_HXX_
 
+struct File;
+
 class EEPROM
 {
 public:
@@ -44,6 +46,35 @@ public:
         return fileSize;
     }
 
+    /// Writes all data that the driver buffered in RAM to the storage.
+    void sync()
+    {
+        OSMutexLock l(&lock_);
+        flush_buffers();
+    }
+
+    /// Same as the fsync() of the real device.
+    /// @return 0
+    int fsync(File *file)
+    {
+        sync();
+        return 0;
+    }
+
+    /// Same as the real device does when the last file handle is closed.
+    void disable()
+    {
+        flush_buffers();
+    }
+
+protected:
+    /// Writes data buffered in RAM to the storage. Called with lock_ held.
+    virtual void flush_buffers()
+    {
+    }
+
+    OSMutex lock_; ///< protects internal structures.
+
 private:
     size_t fileSize; ///< size of the eeprom.
 };
@@ -151,6 +182,18 @@ protected:
     /// @param payload what to write
     ///
     void write_to(unsigned ofs, const string &payload)
+    {
+        ee()->write(ofs, payload.data(), payload.size());
+        e->sync();
+    }
+
+    /// Helper function to write to the test eeprom without flushing the write
+    /// cache.
+    ///
+    /// @param ofs where to write
+    /// @param payload what to write
+    ///
+    void write_nosync(unsigned ofs, const string &payload)
     {
         ee()->write(ofs, payload.data(), payload.size());
     }
@@ -0,0 +1,196 @@
+#include "utils/EEPROMEmuTest.hxx"
+
+// Tests of the write cache of the EEPROM emulation. Included from the test
+// files that set WRITE_CACHE_BLOCKS (and SHADOW_IN_RAM) for the test binary.
+
+TEST_F(EepromTest, cache_read_before_sync) {
+    create();
+    write_nosync(13, "abcd");
+    EXPECT_EQ(3u, e->dirty_blocks());
+    // Nothing was written to flash yet.
+    EXPECT_SLOT(3, 2*0xFFFF, "\xFF\xFF");
+    EXPECT_AT(13, "abcd");
+    EXPECT_AT(12, "\xFF""abcd\xFF");
+
+    e->sync();
+    EXPECT_EQ(0u, e->dirty_blocks());
+    EXPECT_SLOT(3, 12, "\xFF""a");
+    EXPECT_SLOT(4, 14, "bc");
+    EXPECT_SLOT(5, 16, "d\xFF");
+    EXPECT_AT(13, "abcd");
+
+    // Reboot MCU
+    create(false);
+    EXPECT_AT(13, "abcd");
+}
+
+TEST_F(EepromTest, cache_coalesce) {
+    create();
+    // Byte-by-byte overwrite of 16 bytes, as a sequence of small config
+    // writes would do.
+    string payload = "0123456789abcdef";
+    for (unsigned i = 0; i < payload.size(); ++i)
+    {
+        write_nosync(40 + i, payload.substr(i, 1));
+    }
+    EXPECT_EQ(8u, e->dirty_blocks());
+    EXPECT_EQ(8u, e->stats().blocksCoalesced);
+    EXPECT_AT(40, payload);
+    write_nosync(44, "XY");
+    EXPECT_AT(40, "0123XY6789abcdef");
+    e->sync();
+    EXPECT_EQ(8u, e->stats().blocksWritten);
+    EXPECT_EQ(1u, e->stats().flushes);
+    create(false);
+    EXPECT_AT(40, "0123XY6789abcdef");
+}
+
+TEST_F(EepromTest, cache_full) {
+    create();
+    string payload(40, 'x');
+    write_nosync(100, payload);
+    // 20 blocks do not fit into the 16-entry cache.
+    EXPECT_EQ(1u, e->stats().flushes);
+    EXPECT_EQ(16u, e->stats().blocksWritten);
+    EXPECT_EQ(4u, e->dirty_blocks());
+    EXPECT_AT(100, payload);
+    e->sync();
+    EXPECT_EQ(20u, e->stats().blocksWritten);
+    create(false);
+    EXPECT_AT(100, payload);
+}
+
+TEST_F(EepromTest, cache_unchanged_not_written) {
+    create();
+    write_to(20, "abcd");
+    unsigned written = e->stats().blocksWritten;
+    write_nosync(20, "abcd");
+    EXPECT_EQ(0u, e->dirty_blocks());
+    e->sync();
+    EXPECT_EQ(written, e->stats().blocksWritten);
+}
+
+TEST_F(EepromTest, cache_overflow_sector) {
+    create();
+    write_to(13, "abcd");
+    overflow_block();
+    EXPECT_EQ(1, e->activeSector_);
+    EXPECT_EQ(1u, e->stats().compactions);
+    EXPECT_EQ(1u, e->stats().sectorErases);
+    // Fills the remaining sector with dirty data, then forces a compaction
+    // in the middle of a flush.
+    for (unsigned i = 0; e->avail() > 4; ++i)
+    {
+        write_to(200 + (i % 100) * 2, StringPrintf("%02x", i & 0xff));
+    }
+    string payload = "0123456789abcdefghijklmnopqrstuv";
+    write_nosync(600, payload);
+    e->sync();
+    EXPECT_EQ(2u, e->stats().compactions);
+    EXPECT_AT(13, "abcd");
+    EXPECT_AT(600, payload);
+    create(false);
+    EXPECT_AT(13, "abcd");
+    EXPECT_AT(600, payload);
+}
+
+TEST_F(EepromTest, cache_journal_usage) {
+    // Compares the flash wear of a factory-reset-like workload (rewriting a
+    // table of unaligned 8-byte event IDs with 4-byte writes) with and
+    // without the write cache.
+    create();
+    for (unsigned i = 0; i < 64; ++i)
+    {
+        write_to(301 + i * 8, "\x05\x01\x01\x01");
+        write_to(301 + i * 8 + 4, StringPrintf("\x22\x01%c%c", 'a', 'A' + i));
+    }
+    unsigned written_direct = e->stats().blocksWritten;
+
+    create();
+    for (unsigned i = 0; i < 64; ++i)
+    {
+        write_nosync(301 + i * 8, "\x05\x01\x01\x01");
+        write_nosync(
+            301 + i * 8 + 4, StringPrintf("\x22\x01%c%c", 'a', 'A' + i));
+    }
+    e->sync();
+    unsigned written_cached = e->stats().blocksWritten;
+    EXPECT_GT(written_direct, written_cached + 100);
+    EXPECT_AT(301 + 8 * 5, "\x05\x01\x01\x01\x22\x01" "aF");
+}
+
+TEST_F(EepromTest, cache_fsync) {
+    create();
+    write_nosync(13, "abcd");
+    EXPECT_EQ(3u, e->dirty_blocks());
+    EXPECT_SLOT(3, 2*0xFFFF, "\xFF\xFF");
+    EXPECT_EQ(0, e->fsync(nullptr));
+    EXPECT_EQ(0u, e->dirty_blocks());
+    EXPECT_SLOT(3, 12, "\xFF""a");
+    EXPECT_SLOT(5, 16, "d\xFF");
+    create(false);
+    EXPECT_AT(13, "abcd");
+}
+
+TEST_F(EepromTest, cache_close) {
+    create();
+    write_nosync(13, "abcd");
+    // Closing the last file handle writes the pending data to flash instead
+    // of dropping it.
+    e->disable();
+    EXPECT_EQ(0u, e->dirty_blocks());
+    EXPECT_EQ(1u, e->stats().flushes);
+    EXPECT_SLOT(3, 12, "\xFF""a");
+    EXPECT_SLOT(5, 16, "d\xFF");
+    create(false);
+    EXPECT_AT(13, "abcd");
+}
+
+TEST_F(EepromTest, cache_lost_without_sync) {
+    create();
+    write_to(13, "abcd");
+    write_nosync(13, "wxyz");
+    EXPECT_AT(13, "wxyz");
+    // Reboot MCU without writing out the cache.
+    create(false);
+    EXPECT_EQ(0u, e->dirty_blocks());
+    EXPECT_AT(13, "abcd");
+}
+
+/// Fires the flush timer of the eeprom under test, as if the delay had
+/// expired.
+#define FIRE_FLUSH_TIMER()                                                     \
+    g_executor.sync_run([this]() { e->flushFlow_->timer_.trigger(); });       \
+    wait_for_main_executor()
+
+TEST_F(EepromTest, cache_flush_timer) {
+    create();
+    // The delay never expires during the test; the test fires the timer
+    // instead.
+    e->start_flush_timer(&g_service, 3600 * 1000);
+    wait_for_main_executor();
+    write_nosync(13, "abcd");
+    write_nosync(40, "xy");
+    wait_for_main_executor();
+    // The timer is running, nothing is written yet.
+    EXPECT_EQ(4u, e->dirty_blocks());
+    EXPECT_EQ(0u, e->stats().flushes);
+    EXPECT_SLOT(3, 2*0xFFFF, "\xFF\xFF");
+    FIRE_FLUSH_TIMER();
+    EXPECT_EQ(0u, e->dirty_blocks());
+    EXPECT_EQ(1u, e->stats().flushes);
+    EXPECT_SLOT(3, 12, "\xFF""a");
+
+    // The timer starts again on the next write.
+    write_nosync(100, "pq");
+    wait_for_main_executor();
+    EXPECT_EQ(1u, e->dirty_blocks());
+    FIRE_FLUSH_TIMER();
+    EXPECT_EQ(0u, e->dirty_blocks());
+    EXPECT_EQ(2u, e->stats().flushes);
+
+    create(false);
+    EXPECT_AT(13, "abcd");
+    EXPECT_AT(40, "xy");
+    EXPECT_AT(100, "pq");
+}
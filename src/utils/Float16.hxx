@@ -0,0 +1,191 @@
+/** \copyright
+ * Copyright (c) 2026, agent
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are  permitted provided that the following conditions are met:
+ *
+ *  - Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ *  - Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ * \file Float16.hxx
+ *
+ * Branch-free conversion between IEEE half precision (float16) and float.
+ *
+ * @author agent
+ * @date 19 Oct 2026
+ */
+
+#ifndef _UTILS_FLOAT16_HXX_
+#define _UTILS_FLOAT16_HXX_
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+
+#ifdef __F16C__
+#include <immintrin.h>
+#endif
+
+/** This type represents how velocity is seen on the wire (16 bit float).
+ */
+typedef uint16_t float16_t;
+
+// The conversions give bit for bit the same results as halfp2singles and
+// singles2halfp in ieeehalfprecision.c, including the non-IEEE corner cases
+// that the OpenLCB code depends on:
+//
+// - float to float16 rounds halfway cases away from zero (not to even).
+// - a NaN is converted by keeping the top 16 bits of the value, in both
+//   directions. This way the wire value 0xFFFF (speed not available) survives
+//   a round trip.
+// - float denormals convert to a signed zero.
+//
+// Hardware conversion instructions are only used where they agree with these
+// rules: float16 to float with F16C on x86 or the FP16 extension on ARM,
+// fixing up the NaNs.
+
+/// @return the bits of a float. @param f is the float.
+static inline uint32_t float_to_bits(float f)
+{
+    uint32_t r;
+    memcpy(&r, &f, sizeof(r));
+    return r;
+}
+
+/// @return the float from its bits. @param b is the bits of the float.
+static inline float bits_to_float(uint32_t b)
+{
+    float r;
+    memcpy(&r, &b, sizeof(r));
+    return r;
+}
+
+/// Converts a float16 to the bits of a float without using floating point
+/// instructions.
+/// @param h is the float16 value.
+/// @return the bits of the float value.
+static inline uint32_t halfp_to_float_bits(float16_t h)
+{
+    uint32_t sign = ((uint32_t)h & 0x8000u) << 16;
+    uint32_t em = h & 0x7FFFu;
+    // Normal number: rebias the exponent.
+    uint32_t normal = (em << 13) + ((127u - 15u) << 23);
+    // Denormal: normalizes the mantissa. shift is 1..10 for a nonzero
+    // mantissa.
+    uint32_t m = em & 0x3FFu;
+    uint32_t shift = __builtin_clz(m | 1u) - 21;
+    uint32_t denormal =
+        (((m << shift) & 0x3FFu) << 13) | ((127u - 15u + 1u - shift) << 23);
+    uint32_t r = em >= 0x0400u ? normal : denormal;
+    r = em == 0 ? 0 : r;
+    r = em >= 0x7C00u ? 0x7F800000u : r;
+    return em > 0x7C00u ? (uint32_t)h << 16 : (sign | r);
+}
+
+/// Converts a float (given by its bits) to float16 without using floating
+/// point instructions.
+/// @param x is the bits of the float value.
+/// @return the float16 value.
+static inline float16_t float_bits_to_halfp(uint32_t x)
+{
+    uint32_t sign = (x >> 16) & 0x8000u;
+    uint32_t abs = x & 0x7FFFFFFFu;
+    int hes = (int)(abs >> 23) - 127 + 15;
+    // Normal result: rebias the exponent, round half up on the magnitude. An
+    // overflow of the mantissa correctly carries into the exponent.
+    uint32_t normal = (abs + 0x1000u - ((127u - 15u) << 23)) >> 13;
+    // Denormal result, or zero when everything is shifted out.
+    int s = 14 - hes;
+    s = s < 1 ? 1 : s;
+    s = s > 31 ? 31 : s;
+    uint32_t mant = (abs & 0x007FFFFFu) | 0x00800000u;
+    uint32_t denormal = (mant + (1u << (s - 1))) >> s;
+    uint32_t r = hes > 0 ? normal : denormal;
+    r = hes >= 0x1F ? 0x7C00u : r;
+    return abs > 0x7F800000u ? (float16_t)(x >> 16) : (float16_t)(sign | r);
+}
+
+/// Converts a float16 to float.
+/// @param h is the float16 value.
+/// @return the value as float.
+static inline float halfp_to_float(float16_t h)
+{
+#if defined(__F16C__)
+    uint32_t r = float_to_bits(_cvtsh_ss(h));
+    return bits_to_float((h & 0x7FFFu) > 0x7C00u ? (uint32_t)h << 16 : r);
+#elif defined(__ARM_FP16_FORMAT_IEEE) && defined(__ARM_FP) && (__ARM_FP & 2)
+    __fp16 v;
+    memcpy(&v, &h, sizeof(v));
+    uint32_t r = float_to_bits(v);
+    return bits_to_float((h & 0x7FFFu) > 0x7C00u ? (uint32_t)h << 16 : r);
+#else
+    return bits_to_float(halfp_to_float_bits(h));
+#endif
+}
+
+/// Converts a float to float16.
+/// @param f is the float value.
+/// @return the value as float16.
+static inline float16_t float_to_halfp(float f)
+{
+    return float_bits_to_halfp(float_to_bits(f));
+}
+
+/// Converts an array of float16 values to float.
+/// @param dst is where to write the floats.
+/// @param src is the float16 values.
+/// @param count is the number of values to convert.
+static inline void halfp_to_floats(float *dst, const float16_t *src,
+    size_t count)
+{
+    size_t i = 0;
+#if defined(__F16C__)
+    const __m128i mask = _mm_set1_epi32(0x7FFF);
+    const __m128i inf = _mm_set1_epi32(0x7C00);
+    for (; i + 4 <= count; i += 4)
+    {
+        __m128i h = _mm_loadl_epi64((const __m128i *)(src + i));
+        __m128 f = _mm_cvtph_ps(h);
+        __m128i h32 = _mm_cvtepu16_epi32(h);
+        __m128i nan = _mm_cmpgt_epi32(_mm_and_si128(h32, mask), inf);
+        __m128 fix = _mm_castsi128_ps(_mm_slli_epi32(h32, 16));
+        _mm_storeu_ps(dst + i, _mm_blendv_ps(f, fix, _mm_castsi128_ps(nan)));
+    }
+#endif
+    for (; i < count; ++i)
+    {
+        dst[i] = halfp_to_float(src[i]);
+    }
+}
+
+/// Converts an array of floats to float16.
+/// @param dst is where to write the float16 values.
+/// @param src is the float values.
+/// @param count is the number of values to convert.
+static inline void floats_to_halfp(float16_t *dst, const float *src,
+    size_t count)
+{
+    for (size_t i = 0; i < count; ++i)
+    {
+        dst[i] = float_to_halfp(src[i]);
+    }
+}
+
+#endif // _UTILS_FLOAT16_HXX_
@@ -0,0 +1,501 @@
+/** \copyright
+ * Copyright (c) 2026, agent
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are  permitted provided that the following conditions are met:
+ *
+ *  - Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ *  - Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ * \file HubDeviceShm.cxx
+ *
+ * CAN hub port connecting processes on the same host via shared memory.
+ *
+ * @author agent
+ * @date 19 Oct 2026
+ */
+
+#if defined(__linux__)
+
+#include "utils/HubDeviceShm.hxx"
+
+#include <fcntl.h>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "utils/logging.h"
+#include "utils/macros.h"
+
+/// How many frames the read flow forwards to the hub before yielding the
+/// executor.
+static const unsigned kMaxReadBatch = 32;
+
+HubDeviceShm::HubDeviceShm(CanHubFlow *hub, ShmCanSegment *segment,
+    bool is_server, int rx_fd, int tx_fd, int ctrl_fd, Notifiable *on_exit)
+    : CanHubPort(hub->service())
+    , hub_(hub)
+    , segment_(segment)
+    , tx_(is_server ? &segment->toClient : &segment->toServer)
+    , rx_(is_server ? &segment->toServer : &segment->toClient)
+    , rxFd_(rx_fd)
+    , txFd_(tx_fd)
+    , ctrlFd_(ctrl_fd)
+    , onExit_(on_exit)
+{
+    hub_->register_port(this);
+}
+
+HubDeviceShm::~HubDeviceShm()
+{
+    ::munmap(segment_, sizeof(ShmCanSegment));
+    ::close(rxFd_);
+    ::close(txFd_);
+    ::close(ctrlFd_);
+}
+
+void HubDeviceShm::shutdown()
+{
+    if (shutdown_)
+    {
+        return;
+    }
+    shutdown_ = true;
+    readFlow_.shutdown();
+    ctrlFlow_.shutdown();
+    // Makes the peer notice that we are gone.
+    ::shutdown(ctrlFd_, SHUT_RDWR);
+    hub_->unregister_port(this);
+    if (writeBlocked_)
+    {
+        writeBlocked_ = false;
+        notify();
+    }
+    /* We put an empty message at the end of the queue. This will wait until
+     * all pending messages are dealt with, and then ping the barrier. */
+    auto *b = alloc();
+    b->set_done(&barrier_);
+    send(b);
+}
+
+StateFlowBase::Action HubDeviceShm::entry()
+{
+    if (shutdown_)
+    {
+        return release_and_exit();
+    }
+    if (!tx_->push(message()->data()->frame()))
+    {
+        // The peer is not keeping up. Asks it to wake us up when it took
+        // frames out of the ring, then checks again to avoid missing the
+        // space that appeared in between.
+        tx_->producerWaiting.store(1);
+        if (!tx_->has_space())
+        {
+            writeBlocked_ = true;
+            return wait_and_call(STATE(entry));
+        }
+        tx_->producerWaiting.store(0);
+        return call_immediately(STATE(entry));
+    }
+    ring_doorbell();
+    return release_and_exit();
+}
+
+void HubDeviceShm::ring_doorbell()
+{
+    if (tx_->consumerSleeping.exchange(0))
+    {
+        write_doorbell();
+    }
+}
+
+void HubDeviceShm::write_doorbell()
+{
+    uint64_t one = 1;
+    int ret = ::write(txFd_, &one, sizeof(one));
+    if (ret < 0 && errno != EAGAIN)
+    {
+        LOG_ERROR("shm hub: error writing doorbell: %s", strerror(errno));
+    }
+}
+
+HubDeviceShm::ReadFlow::ReadFlow(HubDeviceShm *port)
+    : StateFlowBase(port->service())
+    , port_(port)
+{
+    port_->barrier_.new_child();
+    start_flow(STATE(drain));
+}
+
+void HubDeviceShm::ReadFlow::shutdown()
+{
+    // If we are not waiting for the doorbell, then the flow is scheduled on
+    // the executor and will notice the shutdown in drain().
+    auto *e = service()->executor();
+    if (e->is_selected(&selectHelper_))
+    {
+        e->unselect(&selectHelper_);
+        set_terminated();
+        notify_barrier();
+    }
+}
+
+void HubDeviceShm::ReadFlow::notify_barrier()
+{
+    if (barrierOwned_)
+    {
+        barrierOwned_ = false;
+        port_->barrier_.notify();
+    }
+}
+
+StateFlowBase::Action HubDeviceShm::ReadFlow::drain()
+{
+    if (port_->shutdown_)
+    {
+        set_terminated();
+        notify_barrier();
+        return exit();
+    }
+    // Our doorbell also rings when the peer took frames out of our outgoing
+    // ring.
+    port_->wake_writer();
+    ShmCanRing *rx = port_->rx_;
+    for (unsigned i = 0; i < kMaxReadBatch; ++i)
+    {
+        if (rx->producerWaiting.load() && rx->producerWaiting.exchange(0))
+        {
+            // The peer's writer is waiting for the space we freed up.
+            port_->write_doorbell();
+        }
+        if (rx->empty())
+        {
+            // Tells the producer to ring the doorbell, then checks again to
+            // avoid missing a frame that arrived in between.
+            rx->consumerSleeping.store(1);
+            if (!rx->empty())
+            {
+                rx->consumerSleeping.store(0);
+                return yield_and_call(STATE(drain));
+            }
+            return read_single(&selectHelper_, port_->rxFd_, &doorbell_,
+                sizeof(doorbell_), STATE(woken));
+        }
+        auto *b = port_->hub_->alloc();
+        b->data()->skipMember_ = port_;
+        rx->pop(b->data()->mutable_frame());
+        port_->hub_->send(b, 0);
+    }
+    // Lets the hub process what we sent so far.
+    return yield_and_call(STATE(drain));
+}
+
+StateFlowBase::Action HubDeviceShm::ReadFlow::woken()
+{
+    if (selectHelper_.hasError_)
+    {
+        LOG_ERROR("shm hub: error reading doorbell.");
+        set_terminated();
+        notify_barrier();
+        port_->shutdown();
+        return exit();
+    }
+    return call_immediately(STATE(drain));
+}
+
+HubDeviceShm::CtrlFlow::CtrlFlow(HubDeviceShm *port)
+    : StateFlowBase(port->service())
+    , port_(port)
+{
+    port_->barrier_.new_child();
+    start_flow(STATE(read_done));
+}
+
+void HubDeviceShm::CtrlFlow::shutdown()
+{
+    auto *e = service()->executor();
+    if (e->is_selected(&selectHelper_))
+    {
+        e->unselect(&selectHelper_);
+        set_terminated();
+        notify_barrier();
+    }
+}
+
+void HubDeviceShm::CtrlFlow::notify_barrier()
+{
+    if (barrierOwned_)
+    {
+        barrierOwned_ = false;
+        port_->barrier_.notify();
+    }
+}
+
+StateFlowBase::Action HubDeviceShm::CtrlFlow::read_done()
+{
+    if (port_->shutdown_ || selectHelper_.hasError_)
+    {
+        // EOF or error: the peer is gone.
+        set_terminated();
+        notify_barrier();
+        port_->shutdown();
+        return exit();
+    }
+    // The peer does not send anything on this socket after the handshake; we
+    // are only waiting for it to be closed.
+    return read_single(
+        &selectHelper_, port_->ctrlFd_, &buf_, 1, STATE(read_done));
+}
+
+void HubDeviceShm::Deleter::notify()
+{
+    // We cannot delete the port inline; we might be called from one of its
+    // flows.
+    port_->service()->executor()->add(this);
+}
+
+void HubDeviceShm::Deleter::run()
+{
+    LOG(INFO, "shm hub: link %d closed.", port_->ctrlFd_);
+    Notifiable *on_exit = port_->onExit_;
+    delete port_;
+    if (on_exit)
+    {
+        on_exit->notify();
+    }
+}
+
+/// Number of file descriptors passed in the handshake: shared memory,
+/// doorbell to the client, doorbell to the server.
+static const unsigned kHandshakeFds = 3;
+
+/// Sends file descriptors over a unix domain socket.
+/// @param sock connected unix domain socket.
+/// @param fds array of kHandshakeFds file descriptors.
+/// @return true on success.
+static bool send_fds(int sock, const int *fds)
+{
+    char payload = 'S';
+    struct iovec iov = {&payload, 1};
+    char ctrl[CMSG_SPACE(sizeof(int) * kHandshakeFds)];
+    memset(ctrl, 0, sizeof(ctrl));
+    struct msghdr msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = ctrl;
+    msg.msg_controllen = sizeof(ctrl);
+    struct cmsghdr *c = CMSG_FIRSTHDR(&msg);
+    c->cmsg_level = SOL_SOCKET;
+    c->cmsg_type = SCM_RIGHTS;
+    c->cmsg_len = CMSG_LEN(sizeof(int) * kHandshakeFds);
+    memcpy(CMSG_DATA(c), fds, sizeof(int) * kHandshakeFds);
+    return ::sendmsg(sock, &msg, MSG_NOSIGNAL) == 1;
+}
+
+/// Receives file descriptors sent by send_fds.
+/// @param sock connected unix domain socket.
+/// @param fds array of kHandshakeFds entries to fill in.
+/// @return true on success.
+static bool recv_fds(int sock, int *fds)
+{
+    char payload;
+    struct iovec iov = {&payload, 1};
+    char ctrl[CMSG_SPACE(sizeof(int) * kHandshakeFds)];
+    struct msghdr msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = ctrl;
+    msg.msg_controllen = sizeof(ctrl);
+    if (::recvmsg(sock, &msg, MSG_CMSG_CLOEXEC) != 1)
+    {
+        return false;
+    }
+    struct cmsghdr *c = CMSG_FIRSTHDR(&msg);
+    if (!c || c->cmsg_level != SOL_SOCKET || c->cmsg_type != SCM_RIGHTS ||
+        c->cmsg_len != CMSG_LEN(sizeof(int) * kHandshakeFds))
+    {
+        return false;
+    }
+    memcpy(fds, CMSG_DATA(c), sizeof(int) * kHandshakeFds);
+    return true;
+}
+
+/// Maps a shared memory segment.
+/// @param fd shared memory file descriptor.
+/// @return the mapping, or nullptr on failure.
+static ShmCanSegment *map_segment(int fd)
+{
+    void *m = ::mmap(nullptr, sizeof(ShmCanSegment), PROT_READ | PROT_WRITE,
+        MAP_SHARED, fd, 0);
+    if (m == MAP_FAILED)
+    {
+        return nullptr;
+    }
+    return static_cast<ShmCanSegment *>(m);
+}
+
+HubDeviceShm *create_shm_port_for_can_hub(
+    CanHubFlow *can_hub, int fd, Notifiable *on_exit)
+{
+    static unsigned count = 0;
+    char name[64];
+    snprintf(name, sizeof(name), "/openmrn_shmcan_%d_%u", (int)getpid(),
+        __atomic_fetch_add(&count, 1, __ATOMIC_RELAXED));
+    int fds[kHandshakeFds];
+    fds[0] = ::shm_open(name, O_RDWR | O_CREAT | O_EXCL | O_CLOEXEC, 0600);
+    if (fds[0] < 0)
+    {
+        LOG_ERROR("shm hub: shm_open: %s", strerror(errno));
+        ::close(fd);
+        return nullptr;
+    }
+    // The segment stays alive as long as someone has it mapped.
+    ::shm_unlink(name);
+    ShmCanSegment *seg = nullptr;
+    if (::ftruncate(fds[0], sizeof(ShmCanSegment)) == 0)
+    {
+        seg = map_segment(fds[0]);
+    }
+    fds[1] = ::eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    fds[2] = ::eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    bool ok = seg && fds[1] >= 0 && fds[2] >= 0;
+    if (ok)
+    {
+        // ftruncate zero-fills, which is a valid empty state for the rings.
+        seg->magic = ShmCanSegment::MAGIC;
+        ok = send_fds(fd, fds);
+    }
+    ::close(fds[0]);
+    if (!ok)
+    {
+        LOG_ERROR("shm hub: handshake failed: %s", strerror(errno));
+        if (seg)
+        {
+            ::munmap(seg, sizeof(ShmCanSegment));
+        }
+        ::close(fds[1]);
+        ::close(fds[2]);
+        ::close(fd);
+        return nullptr;
+    }
+    ::fcntl(fd, F_SETFL, O_RDWR | O_NONBLOCK);
+    return new HubDeviceShm(can_hub, seg, true, fds[2], fds[1], fd, on_exit);
+}
+
+HubDeviceShm *connect_shm_can_hub(
+    CanHubFlow *can_hub, const char *path, Notifiable *on_exit)
+{
+    struct sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strncpy(addr.sun_path, path, sizeof(addr.sun_path) - 1);
+    int fd = ::socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0)
+    {
+        return nullptr;
+    }
+    int fds[kHandshakeFds];
+    if (::connect(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0 ||
+        !recv_fds(fd, fds))
+    {
+        LOG_ERROR("shm hub: could not connect to %s: %s", path,
+            strerror(errno));
+        ::close(fd);
+        return nullptr;
+    }
+    ShmCanSegment *seg = map_segment(fds[0]);
+    ::close(fds[0]);
+    if (!seg || seg->magic != ShmCanSegment::MAGIC)
+    {
+        LOG_ERROR("shm hub: invalid shared memory segment from %s", path);
+        if (seg)
+        {
+            ::munmap(seg, sizeof(ShmCanSegment));
+        }
+        ::close(fds[1]);
+        ::close(fds[2]);
+        ::close(fd);
+        return nullptr;
+    }
+    ::fcntl(fd, F_SETFL, O_RDWR | O_NONBLOCK);
+    return new HubDeviceShm(can_hub, seg, false, fds[1], fds[2], fd, on_exit);
+}
+
+ShmCanHub::ShmCanHub(CanHubFlow *can_hub, const char *path)
+    : StateFlowBase(can_hub->service())
+    , canHub_(can_hub)
+    , path_(path)
+{
+    struct sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    HASSERT(path_.size() < sizeof(addr.sun_path));
+    strcpy(addr.sun_path, path);
+    ERRNOCHECK("socket",
+        fd_ = ::socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0));
+    ::unlink(path);
+    ERRNOCHECK("bind", ::bind(fd_, (struct sockaddr *)&addr, sizeof(addr)));
+    ERRNOCHECK("listen", ::listen(fd_, 5));
+    LOG(INFO, "shm hub: listening on %s", path);
+    start_flow(STATE(wait_for_conn));
+}
+
+ShmCanHub::~ShmCanHub()
+{
+    service()->executor()->sync_run([this]() {
+        auto *e = service()->executor();
+        if (e->is_selected(&selectHelper_))
+        {
+            e->unselect(&selectHelper_);
+        }
+        set_terminated();
+    });
+    ::close(fd_);
+    ::unlink(path_.c_str());
+}
+
+StateFlowBase::Action ShmCanHub::wait_for_conn()
+{
+    return listen_and_call(&selectHelper_, fd_, STATE(accept_conn));
+}
+
+StateFlowBase::Action ShmCanHub::accept_conn()
+{
+    int fd = ::accept4(fd_, nullptr, nullptr, SOCK_CLOEXEC);
+    if (fd < 0)
+    {
+        if (errno != EAGAIN && errno != EINTR)
+        {
+            LOG_ERROR("shm hub: accept: %s", strerror(errno));
+        }
+        return call_immediately(STATE(wait_for_conn));
+    }
+    LOG(INFO, "shm hub: incoming connection, fd %d.", fd);
+    create_shm_port_for_can_hub(canHub_, fd);
+    return call_immediately(STATE(wait_for_conn));
+}
+
+#endif // __linux__
@@ -0,0 +1,351 @@
+/** \copyright
+ * Copyright (c) 2026, agent
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are  permitted provided that the following conditions are met:
+ *
+ *  - Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ *  - Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ * \file HubDeviceShm.hxx
+ *
+ * CAN hub port connecting processes on the same host via shared memory.
+ *
+ * @author agent
+ * @date 19 Oct 2026
+ */
+
+#ifndef _UTILS_HUBDEVICESHM_HXX_
+#define _UTILS_HUBDEVICESHM_HXX_
+
+#if defined(__linux__)
+
+#include <atomic>
+
+#include "executor/StateFlow.hxx"
+#include "utils/Hub.hxx"
+
+/// Lock-free single-producer single-consumer ring of CAN frames. Lives in
+/// memory shared between two processes; one of them only pushes, the other
+/// only pops.
+struct ShmCanRing
+{
+    /// Number of frames in the ring. Must be a power of two.
+    static constexpr unsigned SIZE = 1024;
+
+    /// Adds a frame to the ring. Called only by the producer.
+    /// @param frame is the frame to add.
+    /// @return false if the ring is full.
+    bool push(const struct can_frame &frame)
+    {
+        uint32_t h = head.load(std::memory_order_relaxed);
+        if (h - tail.load(std::memory_order_acquire) >= SIZE)
+        {
+            return false;
+        }
+        frames[h & (SIZE - 1)] = frame;
+        head.store(h + 1, std::memory_order_seq_cst);
+        return true;
+    }
+
+    /// Removes a frame from the ring. Called only by the consumer.
+    /// @param frame will be filled with the oldest frame.
+    /// @return false if the ring was empty.
+    bool pop(struct can_frame *frame)
+    {
+        uint32_t t = tail.load(std::memory_order_relaxed);
+        if (t == head.load(std::memory_order_acquire))
+        {
+            return false;
+        }
+        *frame = frames[t & (SIZE - 1)];
+        tail.store(t + 1, std::memory_order_seq_cst);
+        return true;
+    }
+
+    /// @return true if a push would succeed.
+    bool has_space()
+    {
+        return head.load(std::memory_order_relaxed) -
+            tail.load(std::memory_order_seq_cst) < SIZE;
+    }
+
+    /// @return true if there is no frame in the ring.
+    bool empty()
+    {
+        return tail.load(std::memory_order_seq_cst) ==
+            head.load(std::memory_order_seq_cst);
+    }
+
+    /// Index of the next frame the producer will write. Only written by the
+    /// producer.
+    alignas(64) std::atomic<uint32_t> head;
+    /// Index of the next frame the consumer will read. Only written by the
+    /// consumer.
+    alignas(64) std::atomic<uint32_t> tail;
+    /// Set to 1 by the consumer before it goes to sleep on the doorbell. The
+    /// producer only rings the doorbell when it finds this set, so a busy
+    /// link costs no system calls per frame.
+    std::atomic<uint32_t> consumerSleeping;
+    /// Set to 1 by the producer when it found the ring full. The consumer
+    /// rings the producer's doorbell after taking frames out of the ring
+    /// when it finds this set.
+    std::atomic<uint32_t> producerWaiting;
+    /// Frame storage.
+    alignas(64) struct can_frame frames[SIZE];
+};
+
+static_assert(ATOMIC_INT_LOCK_FREE == 2,
+    "shared memory ring needs lock-free atomics");
+
+/// Layout of the shared memory segment of one link.
+struct ShmCanSegment
+{
+    /// Value of the magic field for a valid segment.
+    static constexpr uint32_t MAGIC = 0x4f4d4353; // "OMCS"
+
+    /// Set to MAGIC by the creator of the segment.
+    uint32_t magic;
+    /// Frames going from the server (listener) to the client.
+    ShmCanRing toClient;
+    /// Frames going from the client to the server (listener).
+    ShmCanRing toServer;
+};
+
+/// HubPort connecting a CAN hub to a peer process via a shared memory
+/// segment. Frames are exchanged in binary form in two SPSC rings; each side
+/// has an eventfd doorbell that the other side rings only when the reader is
+/// about to sleep, or when the writer is waiting for space in the ring. All
+/// processing happens on the hub's executor.
+///
+/// The port is torn down when the peer closes the control socket (e.g. by
+/// exiting) or when shutdown() is called. It deletes itself afterwards.
+///
+/// Instances are created by @ref ShmCanHub and @ref connect_shm_can_hub().
+class HubDeviceShm : public CanHubPort
+{
+public:
+    /// Constructor. Registers the port to the hub.
+    ///
+    /// @param hub is the CAN hub to attach to.
+    /// @param segment is the mapped shared memory segment. Ownership is
+    /// transferred.
+    /// @param is_server true if we are the listener side of the link.
+    /// @param rx_fd eventfd that the peer rings when there is data for us.
+    /// @param tx_fd eventfd to ring when we have data for the peer.
+    /// @param ctrl_fd connected unix socket to the peer. Its closing marks the
+    /// end of the link.
+    /// @param on_exit will be notified (if not null) after the port is torn
+    /// down.
+    HubDeviceShm(CanHubFlow *hub, ShmCanSegment *segment, bool is_server,
+        int rx_fd, int tx_fd, int ctrl_fd, Notifiable *on_exit);
+
+    ~HubDeviceShm();
+
+    /// Starts tearing down the link. Must be called on the hub's executor.
+    /// The object will be deleted asynchronously.
+    void shutdown();
+
+    /// Executes a write: copies the frame into the outgoing ring.
+    Action entry() override;
+
+private:
+    /// Reads frames from the incoming ring and forwards them to the hub.
+    class ReadFlow : public StateFlowBase
+    {
+    public:
+        /// Constructor. @param port is the parent.
+        ReadFlow(HubDeviceShm *port);
+
+        /// Stops waiting for the doorbell.
+        void shutdown();
+
+    private:
+        /// Forwards all frames from the ring to the hub. @return next state.
+        Action drain();
+        /// Called when the doorbell was rung. @return next state.
+        Action woken();
+        /// Notifies the parent's barrier once.
+        void notify_barrier();
+
+        /// @return the parent port.
+        HubDeviceShm *port()
+        {
+            return port_;
+        }
+
+        /// Parent.
+        HubDeviceShm *port_;
+        /// true if we still need to notify the parent's barrier.
+        bool barrierOwned_{true};
+        /// Target buffer for reading the eventfd.
+        uint64_t doorbell_;
+        /// Helper for waiting on the eventfd.
+        StateFlowSelectHelper selectHelper_{this};
+    };
+
+    /// Waits for the control socket to be closed by the peer.
+    class CtrlFlow : public StateFlowBase
+    {
+    public:
+        /// Constructor. @param port is the parent.
+        CtrlFlow(HubDeviceShm *port);
+
+        /// Stops waiting for the socket.
+        void shutdown();
+
+    private:
+        /// Called when the socket became readable. @return next state.
+        Action read_done();
+        /// Notifies the parent's barrier once.
+        void notify_barrier();
+
+        /// Parent.
+        HubDeviceShm *port_;
+        /// true if we still need to notify the parent's barrier.
+        bool barrierOwned_{true};
+        /// Target buffer for reading the socket.
+        uint8_t buf_;
+        /// Helper for waiting on the socket.
+        StateFlowSelectHelper selectHelper_{this};
+    };
+
+    /// Called when the port is torn down; deletes the parent.
+    class Deleter : public Executable
+    {
+    public:
+        /// Constructor. @param port is the parent.
+        Deleter(HubDeviceShm *port)
+            : port_(port)
+        {
+        }
+
+        /// Called by the barrier.
+        void notify() override;
+        /// Deletes the port.
+        void run() override;
+
+    private:
+        /// Parent.
+        HubDeviceShm *port_;
+    };
+
+    /// Wakes up the peer's reader if it is sleeping.
+    void ring_doorbell();
+
+    /// Wakes up the peer unconditionally.
+    void write_doorbell();
+
+    /// Called by the read flow. Wakes up the write flow if it is waiting for
+    /// space in the outgoing ring and there is space now.
+    void wake_writer()
+    {
+        if (writeBlocked_ && tx_->has_space())
+        {
+            writeBlocked_ = false;
+            notify();
+        }
+    }
+
+    /// Hub we are registered to.
+    CanHubFlow *hub_;
+    /// Shared memory.
+    ShmCanSegment *segment_;
+    /// Ring that we write.
+    ShmCanRing *tx_;
+    /// Ring that we read.
+    ShmCanRing *rx_;
+    /// Doorbell to wait on.
+    int rxFd_;
+    /// Doorbell of the peer.
+    int txFd_;
+    /// Control socket.
+    int ctrlFd_;
+    /// true after shutdown() was called.
+    bool shutdown_{false};
+    /// true if the write flow is waiting for space in the outgoing ring.
+    bool writeBlocked_{false};
+    /// Notified after teardown.
+    Notifiable *onExit_;
+    /// Deletes *this when all flows are done.
+    Deleter deleter_{this};
+    /// Children are the read flow, the control flow and the last queued
+    /// message of the write flow.
+    BarrierNotifiable barrier_{&deleter_};
+    /// Incoming data.
+    ReadFlow readFlow_{this};
+    /// Peer liveness.
+    CtrlFlow ctrlFlow_{this};
+};
+
+/// Listens on a unix domain socket; every process connecting to it will be
+/// attached to the CAN hub via a shared memory link. This is the
+/// shared-memory counterpart of GcTcpHub for processes on the same host.
+class ShmCanHub : private StateFlowBase
+{
+public:
+    /// Constructor. Starts listening.
+    ///
+    /// @param can_hub is the CAN hub to attach the incoming links to.
+    /// @param path is the file system path of the unix domain socket to
+    /// create. An existing file at this path will be removed.
+    ShmCanHub(CanHubFlow *can_hub, const char *path);
+
+    ~ShmCanHub();
+
+private:
+    /// Waits for an incoming connection. @return next state.
+    Action wait_for_conn();
+    /// Accepts an incoming connection. @return next state.
+    Action accept_conn();
+
+    /// Hub to attach the links to.
+    CanHubFlow *canHub_;
+    /// Path of the listening socket.
+    string path_;
+    /// Listening socket.
+    int fd_;
+    /// Helper for waiting on the listening socket.
+    StateFlowSelectHelper selectHelper_{this};
+};
+
+/// Creates the shared memory link on a freshly accepted connection of a
+/// ShmCanHub.
+///
+/// @param can_hub is the hub to attach to.
+/// @param fd is the connected unix domain socket.
+/// @param on_exit will be notified (if not null) when the link is closed.
+/// @return the new port, or nullptr if the handshake failed.
+HubDeviceShm *create_shm_port_for_can_hub(
+    CanHubFlow *can_hub, int fd, Notifiable *on_exit = nullptr);
+
+/// Connects a CAN hub to a ShmCanHub of another process on the same host.
+///
+/// @param can_hub is the hub to attach to.
+/// @param path is the path of the unix domain socket the ShmCanHub listens
+/// on.
+/// @param on_exit will be notified (if not null) when the link is closed.
+/// @return the new port, or nullptr if the connection failed.
+HubDeviceShm *connect_shm_can_hub(
+    CanHubFlow *can_hub, const char *path, Notifiable *on_exit = nullptr);
+
+#endif // __linux__
+
+#endif // _UTILS_HUBDEVICESHM_HXX_
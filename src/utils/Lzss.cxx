@@ -0,0 +1,152 @@
+/** \copyright
+ * Copyright (c) 2026, agent
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *  - Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ *  - Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ * \file Lzss.cxx
+ *
+ * A tiny LZSS compressor and a streaming decompressor with a fixed-size
+ * window.
+ *
+ * @author agent
+ * @date 19 Oct 2026
+ */
+
+#include "utils/Lzss.hxx"
+
+void lzss_compress(const void *data, size_t len, std::string *output)
+{
+    const uint8_t *in = static_cast<const uint8_t *>(data);
+    output->clear();
+    output->push_back((len >> 24) & 0xff);
+    output->push_back((len >> 16) & 0xff);
+    output->push_back((len >> 8) & 0xff);
+    output->push_back(len & 0xff);
+    size_t flag_ofs = 0;
+    unsigned flag_bit = 8;
+    size_t pos = 0;
+    while (pos < len)
+    {
+        if (flag_bit >= 8)
+        {
+            flag_ofs = output->size();
+            output->push_back(0);
+            flag_bit = 0;
+        }
+        // Greedy longest-match search over the window. This runs on the host
+        // at build time, so we do not bother with hash chains.
+        unsigned best_len = 0;
+        unsigned best_dist = 0;
+        size_t max_len = len - pos;
+        if (max_len > LZSS_MAX_MATCH)
+        {
+            max_len = LZSS_MAX_MATCH;
+        }
+        size_t start = pos > LZSS_WINDOW_SIZE ? pos - LZSS_WINDOW_SIZE : 0;
+        for (size_t cand = start; cand < pos; ++cand)
+        {
+            unsigned l = 0;
+            while (l < max_len && in[cand + l] == in[pos + l])
+            {
+                ++l;
+            }
+            if (l >= best_len)
+            {
+                // Prefers the closest match among equal lengths.
+                best_len = l;
+                best_dist = pos - cand;
+            }
+        }
+        if (best_len >= LZSS_MIN_MATCH)
+        {
+            uint16_t token =
+                ((best_dist - 1) << 6) | (best_len - LZSS_MIN_MATCH);
+            output->push_back(token >> 8);
+            output->push_back(token & 0xff);
+            pos += best_len;
+        }
+        else
+        {
+            (*output)[flag_ofs] |= (1 << flag_bit);
+            output->push_back(in[pos]);
+            ++pos;
+        }
+        ++flag_bit;
+    }
+}
+
+size_t LzssDecoder::decode(uint8_t *dst, size_t len)
+{
+    size_t produced = 0;
+    while (produced < len && outOfs_ < size_)
+    {
+        if (matchLeft_)
+        {
+            emit(window_[(outOfs_ - matchDist_) & (LZSS_WINDOW_SIZE - 1)],
+                &dst);
+            --matchLeft_;
+            ++produced;
+            continue;
+        }
+        if (!flagBits_)
+        {
+            if (inOfs_ >= len_)
+            {
+                break;
+            }
+            flags_ = data_[inOfs_++];
+            flagBits_ = 8;
+        }
+        bool literal = flags_ & 1;
+        flags_ >>= 1;
+        --flagBits_;
+        if (literal)
+        {
+            if (inOfs_ >= len_)
+            {
+                break;
+            }
+            emit(data_[inOfs_++], &dst);
+            ++produced;
+        }
+        else
+        {
+            if (inOfs_ + 2 > len_)
+            {
+                break;
+            }
+            uint16_t token = (data_[inOfs_] << 8) | data_[inOfs_ + 1];
+            inOfs_ += 2;
+            matchDist_ = (token >> 6) + 1;
+            matchLeft_ = (token & 63) + LZSS_MIN_MATCH;
+            if (matchDist_ > outOfs_)
+            {
+                // Corrupt stream: reference before the beginning.
+                matchLeft_ = 0;
+                break;
+            }
+        }
+    }
+    return produced;
+}
@@ -0,0 +1,168 @@
+/** \copyright
+ * Copyright (c) 2026, agent
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *  - Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ *  - Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ * \file Lzss.hxx
+ *
+ * A tiny LZSS compressor and a streaming decompressor with a fixed-size
+ * window. Used for storing large read-only blobs (such as the CDI XML) in
+ * compressed form in flash.
+ *
+ * Stream format: a 4-byte big-endian uncompressed length header, followed by
+ * groups of one flag byte and eight tokens. Flag bits are consumed LSB
+ * first. A set bit means a literal byte follows; a cleared bit means a
+ * two-byte big-endian back-reference follows, with the upper 10 bits holding
+ * (distance - 1) and the lower 6 bits holding (length - LZSS_MIN_MATCH).
+ *
+ * @author agent
+ * @date 19 Oct 2026
+ */
+
+#ifndef _UTILS_LZSS_HXX_
+#define _UTILS_LZSS_HXX_
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string>
+
+#include "utils/macros.h"
+
+/// Size of the history window in bytes. The decoder needs this much RAM.
+static const unsigned LZSS_WINDOW_SIZE = 1024;
+/// Shortest back-reference that is emitted.
+static const unsigned LZSS_MIN_MATCH = 3;
+/// Longest back-reference that fits into a token.
+static const unsigned LZSS_MAX_MATCH = LZSS_MIN_MATCH + 63;
+/// Number of bytes in the stream header.
+static const unsigned LZSS_HEADER_SIZE = 4;
+
+/** Compresses a block of data.
+ * @param data is the input to compress.
+ * @param len is the number of bytes in data.
+ * @param output will be overwritten with the compressed stream (including
+ * header). */
+void lzss_compress(const void *data, size_t len, std::string *output);
+
+/// Streaming decompressor for data produced by @ref lzss_compress. Keeps only
+/// the history window in RAM; the compressed input can be in flash. Decoding
+/// is strictly sequential; seeking backwards requires a reset().
+class LzssDecoder
+{
+public:
+    /// @param data is the compressed stream (with header). Must stay alive as
+    /// long as this object is used.
+    /// @param len is the number of bytes in the compressed stream.
+    LzssDecoder(const void *data, size_t len)
+        : data_(static_cast<const uint8_t *>(data))
+        , len_(len)
+    {
+        if (len_ >= LZSS_HEADER_SIZE)
+        {
+            size_ = (uint32_t(data_[0]) << 24) | (uint32_t(data_[1]) << 16) |
+                (uint32_t(data_[2]) << 8) | data_[3];
+        }
+        else
+        {
+            size_ = 0;
+        }
+        reset();
+    }
+
+    /// Restarts decoding from the beginning of the stream.
+    void reset()
+    {
+        inOfs_ = LZSS_HEADER_SIZE;
+        outOfs_ = 0;
+        flags_ = 0;
+        flagBits_ = 0;
+        matchLeft_ = 0;
+        matchDist_ = 0;
+    }
+
+    /// @return the total number of bytes in the uncompressed data.
+    size_t size()
+    {
+        return size_;
+    }
+
+    /// @return the offset (in the uncompressed data) of the next byte that
+    /// decode() will return.
+    size_t position()
+    {
+        return outOfs_;
+    }
+
+    /// Decompresses the next bytes.
+    /// @param dst where to write the output. May be nullptr to skip data.
+    /// @param len how many bytes to produce at most.
+    /// @return number of bytes produced; less than len only at the end of
+    /// the data or when the compressed stream is corrupt.
+    size_t decode(uint8_t *dst, size_t len);
+
+    /// Skips forward in the uncompressed data.
+    /// @param len number of bytes to skip.
+    /// @return number of bytes skipped.
+    size_t skip(size_t len)
+    {
+        return decode(nullptr, len);
+    }
+
+private:
+    /// Appends one decoded byte to the history and the output.
+    void emit(uint8_t b, uint8_t **dst)
+    {
+        window_[outOfs_ & (LZSS_WINDOW_SIZE - 1)] = b;
+        ++outOfs_;
+        if (*dst)
+        {
+            *(*dst)++ = b;
+        }
+    }
+
+    /// Compressed data.
+    const uint8_t *data_;
+    /// Length of the compressed data.
+    size_t len_;
+    /// Uncompressed size from the header.
+    size_t size_;
+    /// Offset of the next unread byte in data_.
+    size_t inOfs_;
+    /// Offset of the next produced byte in the uncompressed data.
+    size_t outOfs_;
+    /// Remaining flag bits of the current token group.
+    uint8_t flags_;
+    /// How many bits of flags_ are still valid.
+    uint8_t flagBits_;
+    /// Bytes still to be copied from the current back-reference.
+    uint8_t matchLeft_;
+    /// Distance of the current back-reference.
+    uint16_t matchDist_;
+    /// History window (ring buffer indexed by outOfs_).
+    uint8_t window_[LZSS_WINDOW_SIZE];
+
+    DISALLOW_COPY_AND_ASSIGN(LzssDecoder);
+};
+
+#endif // _UTILS_LZSS_HXX_
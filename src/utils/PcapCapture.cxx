@@ -0,0 +1,571 @@
+/** \copyright
+ * Copyright (c) 2026, agent
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are  permitted provided that the following conditions are met:
+ *
+ *  - Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ *  - Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ * \file PcapCapture.cxx
+ *
+ * Port for a hub that writes every packet into pcapng capture files, for
+ * viewing in Wireshark.
+ *
+ * @author agent
+ * @date 19 Oct 2026
+ */
+
+#include "utils/PcapCapture.hxx"
+
+#include <algorithm>
+#include <deque>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <vector>
+
+#include "can_frame.h"
+#include "os/OS.hxx"
+#include "utils/logging.h"
+
+/// pcapng block types and link types.
+enum PcapConstants : uint32_t
+{
+    SECTION_HEADER_BLOCK = 0x0A0D0D0A,
+    INTERFACE_DESCRIPTION_BLOCK = 1,
+    ENHANCED_PACKET_BLOCK = 6,
+    BYTE_ORDER_MAGIC = 0x1A2B3C4D,
+    LINKTYPE_USER0 = 147,
+    LINKTYPE_CAN_SOCKETCAN = 227,
+    /// Option code of the timestamp resolution in the interface description.
+    OPTION_IF_TSRESOL = 9,
+    /// Length of an enhanced packet block without the packet data.
+    PACKET_BLOCK_OVERHEAD = 32,
+    /// Length of the SocketCAN packet of a CAN frame.
+    SOCKETCAN_FRAME_LEN = 16,
+    /// Longer packets of a string hub are truncated to this length.
+    MAX_CAPTURE_LEN = 4096,
+};
+
+/// Writes a 16-bit value in host byte order. @param p is where to write.
+/// @param value is what to write.
+static inline void put16(uint8_t *p, uint16_t value)
+{
+    memcpy(p, &value, 2);
+}
+
+/// Writes a 32-bit value in host byte order. @param p is where to write.
+/// @param value is what to write.
+static inline void put32(uint8_t *p, uint32_t value)
+{
+    memcpy(p, &value, 4);
+}
+
+/// @return a 32-bit value in host byte order. @param p is where to read.
+static inline uint32_t get32(const uint8_t *p)
+{
+    uint32_t value;
+    memcpy(&value, p, 4);
+    return value;
+}
+
+/// @return the timestamp of a packet in nanoseconds.
+static long long capture_time()
+{
+#if defined(__linux__) || defined(__MACH__)
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+#else
+    return os_get_time_monotonic();
+#endif
+}
+
+/// @return the timestamp of an enhanced packet block. @param block is the
+/// start of the block.
+static long long block_time(const uint8_t *block)
+{
+    return (((long long)get32(block + 12)) << 32) | get32(block + 16);
+}
+
+/// Implementation of the capture. The hub ports append the packets to fill_
+/// on the hub thread; the writer thread swaps fill_ with drain_ and writes
+/// drain_ out.
+struct PcapCapture::Impl : public OSThread,
+                           public CanHubPortInterface,
+                           public HubPortInterface
+{
+    /// Size of each of the two buffers.
+    static constexpr size_t BUFFER_SIZE = 65536;
+    /// How often the writer thread looks at the buffer at the latest.
+    static constexpr long long FLUSH_PERIOD_NSEC = MSEC_TO_NSEC(100);
+
+    /// Constructor. @param link_type is the pcapng link type. @param path is
+    /// the output file (streaming mode). @param rotate_bytes is the size limit
+    /// of a file. @param keep_files is how many files to keep. @param keep_sec
+    /// is non-zero for flight recorder mode.
+    Impl(uint32_t link_type, const string &path, size_t rotate_bytes,
+        unsigned keep_files, unsigned keep_sec)
+        : linkType_(link_type)
+        , path_(path)
+        , rotateBytes_(rotate_bytes)
+        , keepFiles_(keep_files)
+        , keepNsec_(SEC_TO_NSEC((long long)keep_sec))
+    {
+        fill_.reserve(BUFFER_SIZE);
+        drain_.reserve(BUFFER_SIZE);
+        if (!keepNsec_)
+        {
+            open_file();
+        }
+        start("pcap_writer", 0, 2048);
+    }
+
+    /// Stops the writer thread. The ports must be unregistered already.
+    void stop()
+    {
+        {
+            OSMutexLock l(&lock_);
+            exit_ = true;
+        }
+        wakeup_.post();
+        exited_.wait();
+        if (file_)
+        {
+            fclose(file_);
+            file_ = nullptr;
+        }
+    }
+
+    /// Captures a CAN frame.
+    void send(Buffer<CanHubData> *message, unsigned priority) override
+    {
+        AutoReleaseBuffer<CanHubData> b(message);
+        const struct can_frame &f = message->data()->frame();
+        uint32_t id;
+        if (IS_CAN_FRAME_EFF(f))
+        {
+            id = GET_CAN_FRAME_ID_EFF(f) | 0x80000000U;
+        }
+        else
+        {
+            id = GET_CAN_FRAME_ID(f);
+        }
+        if (IS_CAN_FRAME_RTR(f))
+        {
+            id |= 0x40000000U;
+        }
+        if (IS_CAN_FRAME_ERR(f))
+        {
+            id |= 0x20000000U;
+        }
+        // The SocketCAN link type has the identifier in network byte order.
+        uint8_t d[SOCKETCAN_FRAME_LEN] = {(uint8_t)(id >> 24),
+            (uint8_t)(id >> 16), (uint8_t)(id >> 8), (uint8_t)id, f.can_dlc};
+        memcpy(d + 8, f.data, 8);
+        append(d, SOCKETCAN_FRAME_LEN, SOCKETCAN_FRAME_LEN);
+    }
+
+    /// Captures a packet of a string hub.
+    void send(Buffer<HubData> *message, unsigned priority) override
+    {
+        AutoReleaseBuffer<HubData> b(message);
+        const string &s = *message->data();
+        append((const uint8_t *)s.data(),
+            std::min(s.size(), (size_t)MAX_CAPTURE_LEN), s.size());
+    }
+
+    /// Adds an enhanced packet block to the fill buffer.
+    /// @param data is the packet. @param len is the captured length. @param
+    /// orig_len is the original length of the packet.
+    void append(const uint8_t *data, size_t len, size_t orig_len)
+    {
+        long long ts = capture_time();
+        size_t padded = (len + 3) & ~3;
+        size_t total = PACKET_BLOCK_OVERHEAD + padded;
+        OSMutexLock l(&lock_);
+        size_t ofs = fill_.size();
+        if (ofs + total > BUFFER_SIZE)
+        {
+            ++dropped_;
+            return;
+        }
+        fill_.resize(ofs + total);
+        uint8_t *p = &fill_[ofs];
+        put32(p, ENHANCED_PACKET_BLOCK);
+        put32(p + 4, total);
+        put32(p + 8, 0); // interface id
+        put32(p + 12, ts >> 32);
+        put32(p + 16, ts);
+        put32(p + 20, len);
+        put32(p + 24, orig_len);
+        memcpy(p + 28, data, len);
+        memset(p + 28 + len, 0, padded - len);
+        put32(p + 28 + padded, total);
+        if (!wakeupPosted_ && fill_.size() > BUFFER_SIZE / 2)
+        {
+            wakeupPosted_ = true;
+            wakeup_.post();
+        }
+    }
+
+    /// Waits until everything appended before the call is processed by the
+    /// writer thread.
+    void flush()
+    {
+        OSMutexLock l(&lock_);
+        unsigned target = ++flushRequests_;
+        wakeup_.post();
+        while ((int)(flushDone_ - target) < 0)
+        {
+            ++flushWaiters_;
+            lock_.unlock();
+            flushed_.wait();
+            lock_.lock();
+        }
+    }
+
+    /// Writer thread.
+    void *entry() override
+    {
+        while (true)
+        {
+            wakeup_.timedwait(FLUSH_PERIOD_NSEC);
+            unsigned flush_req;
+            bool exiting;
+            {
+                OSMutexLock l(&lock_);
+                fill_.swap(drain_);
+                wakeupPosted_ = false;
+                flush_req = flushRequests_;
+                exiting = exit_;
+            }
+            if (keepNsec_)
+            {
+                store_chunk();
+            }
+            else
+            {
+                write_file();
+            }
+            {
+                OSMutexLock l(&lock_);
+                flushDone_ = flush_req;
+                // Every waiting flush() gets one post and checks again.
+                for (; flushWaiters_; --flushWaiters_)
+                {
+                    flushed_.post();
+                }
+            }
+            if (exiting)
+            {
+                break;
+            }
+        }
+        exited_.post();
+        return nullptr;
+    }
+
+    /// @return the name of a file in the rotation. @param index is the
+    /// sequence number of the file.
+    string file_name(unsigned index)
+    {
+        if (!index)
+        {
+            return path_;
+        }
+        char suffix[12];
+        snprintf(suffix, sizeof(suffix), ".%u", index);
+        return path_ + suffix;
+    }
+
+    /// Writes the section header and the interface description to a new
+    /// file. @param f is the file. @return the number of bytes written.
+    size_t write_header(FILE *f)
+    {
+        uint8_t h[60];
+        put32(h, SECTION_HEADER_BLOCK);
+        put32(h + 4, 28);
+        put32(h + 8, BYTE_ORDER_MAGIC);
+        put16(h + 12, 1); // version 1.0
+        put16(h + 14, 0);
+        put32(h + 16, 0xFFFFFFFFU); // section length unknown
+        put32(h + 20, 0xFFFFFFFFU);
+        put32(h + 24, 28);
+        put32(h + 28, INTERFACE_DESCRIPTION_BLOCK);
+        put32(h + 32, 32);
+        put16(h + 36, linkType_);
+        put16(h + 38, 0);
+        put32(h + 40, 0); // no snap length
+        // if_tsresol = 9: nanosecond timestamps.
+        put16(h + 44, OPTION_IF_TSRESOL);
+        put16(h + 46, 1);
+        // The value is a single byte, so it does not depend on the byte
+        // order; the rest is padding.
+        h[48] = 9;
+        h[49] = h[50] = h[51] = 0;
+        put32(h + 52, 0); // end of options
+        put32(h + 56, 32);
+        return fwrite(h, 1, sizeof(h), f);
+    }
+
+    /// Opens the next file of the rotation. Removes the files that are
+    /// too old.
+    void open_file()
+    {
+        string name = file_name(fileIndex_);
+        file_ = fopen(name.c_str(), "wb");
+        if (!file_)
+        {
+            LOG_ERROR("Could not open capture file %s", name.c_str());
+            return;
+        }
+        fileBytes_ = write_header(file_);
+        if (keepFiles_ && fileIndex_ >= keepFiles_)
+        {
+            unlink(file_name(fileIndex_ - keepFiles_).c_str());
+        }
+    }
+
+    /// Writes drain_ to the current file, rotating as needed.
+    void write_file()
+    {
+        if (drain_.empty())
+        {
+            return;
+        }
+        if (!file_ && rotateBytes_)
+        {
+            ++fileIndex_;
+            open_file();
+        }
+        if (file_)
+        {
+            fileBytes_ += fwrite(drain_.data(), 1, drain_.size(), file_);
+            fflush(file_);
+            if (rotateBytes_ && fileBytes_ >= rotateBytes_)
+            {
+                fclose(file_);
+                file_ = nullptr;
+            }
+        }
+        drain_.clear();
+    }
+
+    /// Flight recorder mode: appends drain_ to the list of chunks and drops
+    /// the chunks that are too old. The packets are added to the last chunk
+    /// as long as it has room, so a new chunk is only needed for every
+    /// BUFFER_SIZE bytes of traffic.
+    void store_chunk()
+    {
+        std::vector<uint8_t> spare;
+        OSMutexLock l(&chunksLock_);
+        if (!drain_.empty())
+        {
+            if (chunks_.empty() ||
+                chunks_.back().size() + drain_.size() > BUFFER_SIZE)
+            {
+                chunks_.emplace_back();
+                chunks_.back().swap(drain_);
+            }
+            else
+            {
+                chunks_.back().insert(
+                    chunks_.back().end(), drain_.begin(), drain_.end());
+                drain_.clear();
+            }
+        }
+        long long cutoff = capture_time() - keepNsec_;
+        while (!chunks_.empty() && last_time(chunks_.front()) < cutoff)
+        {
+            spare.swap(chunks_.front());
+            chunks_.pop_front();
+        }
+        if (drain_.capacity() < BUFFER_SIZE)
+        {
+            if (spare.capacity() >= BUFFER_SIZE)
+            {
+                drain_.swap(spare);
+                drain_.clear();
+            }
+            else
+            {
+                drain_.reserve(BUFFER_SIZE);
+            }
+        }
+    }
+
+    /// @return the timestamp of the last packet in a chunk. @param chunk is a
+    /// non-empty sequence of enhanced packet blocks.
+    static long long last_time(const std::vector<uint8_t> &chunk)
+    {
+        const uint8_t *end = chunk.data() + chunk.size();
+        // The total length is repeated at the end of each block.
+        return block_time(end - get32(end - 4));
+    }
+
+    /// Flight recorder mode: writes the recent packets to a file. @param path
+    /// is the file name. @return true on success.
+    bool persist(const string &path)
+    {
+        HASSERT(keepNsec_);
+        flush();
+        FILE *f = fopen(path.c_str(), "wb");
+        if (!f)
+        {
+            return false;
+        }
+        bool ok = write_header(f) == 60;
+        long long cutoff = capture_time() - keepNsec_;
+        OSMutexLock l(&chunksLock_);
+        for (const auto &chunk : chunks_)
+        {
+            const uint8_t *p = chunk.data();
+            const uint8_t *end = p + chunk.size();
+            // Skips the packets that are too old.
+            while (p < end && block_time(p) < cutoff)
+            {
+                p += get32(p + 4);
+            }
+            if (p < end)
+            {
+                ok = ok && fwrite(p, 1, end - p, f) == (size_t)(end - p);
+            }
+        }
+        return (fclose(f) == 0) && ok;
+    }
+
+    /// pcapng link type of the interface.
+    uint32_t linkType_;
+    /// Output file name (streaming mode).
+    string path_;
+    /// Size limit of a file, 0 for no rotation.
+    size_t rotateBytes_;
+    /// How many files to keep, 0 for all.
+    unsigned keepFiles_;
+    /// Flight recorder mode: how long to keep the packets. 0 in streaming
+    /// mode.
+    long long keepNsec_;
+
+    /// Protects the fields below up to chunksLock_.
+    OSMutex lock_;
+    /// Buffer the ports append to.
+    std::vector<uint8_t> fill_;
+    /// Number of packets dropped.
+    unsigned dropped_{0};
+    /// Incremented by each call to flush().
+    unsigned flushRequests_{0};
+    /// Value of flushRequests_ when the writer took the last buffer.
+    unsigned flushDone_{0};
+    /// Number of flush() calls waiting for flushed_.
+    unsigned flushWaiters_{0};
+    /// True if the writer thread was woken up due to the buffer filling up.
+    bool wakeupPosted_{false};
+    /// Tells the writer thread to exit.
+    bool exit_{false};
+
+    /// Protects chunks_.
+    OSMutex chunksLock_;
+    /// Flight recorder mode: the recent buffers.
+    std::deque<std::vector<uint8_t>> chunks_;
+
+    /// Buffer being written by the writer thread.
+    std::vector<uint8_t> drain_;
+    /// Current output file; nullptr if not open.
+    FILE *file_{nullptr};
+    /// Sequence number of the current output file.
+    unsigned fileIndex_{0};
+    /// Bytes written to the current output file.
+    size_t fileBytes_{0};
+    /// Wakes up the writer thread.
+    OSSem wakeup_;
+    /// Posted by the writer thread for the waiting flush() calls after it
+    /// processed a buffer.
+    OSSem flushed_;
+    /// Posted when the writer thread exits.
+    OSSem exited_;
+    /// CAN hub we are registered to.
+    CanHubFlow *canHub_{nullptr};
+    /// String hub we are registered to.
+    HubFlow *hub_{nullptr};
+};
+
+PcapCapture::PcapCapture(CanHubFlow *hub, const string &path,
+    size_t rotate_bytes, unsigned keep_files)
+    : impl_(new Impl(LINKTYPE_CAN_SOCKETCAN, path, rotate_bytes, keep_files, 0))
+{
+    impl_->canHub_ = hub;
+    hub->register_port(impl_.get());
+}
+
+PcapCapture::PcapCapture(
+    HubFlow *hub, const string &path, size_t rotate_bytes, unsigned keep_files)
+    : impl_(new Impl(LINKTYPE_USER0, path, rotate_bytes, keep_files, 0))
+{
+    impl_->hub_ = hub;
+    hub->register_port(impl_.get());
+}
+
+PcapCapture::PcapCapture(CanHubFlow *hub, unsigned keep_sec)
+    : impl_(new Impl(LINKTYPE_CAN_SOCKETCAN, "", 0, 0, keep_sec))
+{
+    HASSERT(keep_sec);
+    impl_->canHub_ = hub;
+    hub->register_port(impl_.get());
+}
+
+PcapCapture::PcapCapture(HubFlow *hub, unsigned keep_sec)
+    : impl_(new Impl(LINKTYPE_USER0, "", 0, 0, keep_sec))
+{
+    HASSERT(keep_sec);
+    impl_->hub_ = hub;
+    hub->register_port(impl_.get());
+}
+
+PcapCapture::~PcapCapture()
+{
+    if (impl_->canHub_)
+    {
+        impl_->canHub_->unregister_port(impl_.get());
+    }
+    if (impl_->hub_)
+    {
+        impl_->hub_->unregister_port(impl_.get());
+    }
+    impl_->stop();
+}
+
+void PcapCapture::flush()
+{
+    impl_->flush();
+}
+
+bool PcapCapture::persist(const string &path)
+{
+    return impl_->persist(path);
+}
+
+unsigned PcapCapture::dropped()
+{
+    OSMutexLock l(&impl_->lock_);
+    return impl_->dropped_;
+}
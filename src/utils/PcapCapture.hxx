@@ -0,0 +1,109 @@
+/** \copyright
+ * Copyright (c) 2026, agent
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are  permitted provided that the following conditions are met:
+ *
+ *  - Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ *  - Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ * \file PcapCapture.hxx
+ *
+ * Port for a hub that writes every packet into pcapng capture files, for
+ * viewing in Wireshark.
+ *
+ * @author agent
+ * @date 19 Oct 2026
+ */
+
+#ifndef _UTILS_PCAPCAPTURE_HXX_
+#define _UTILS_PCAPCAPTURE_HXX_
+
+#include <memory>
+#include <string>
+
+#include "utils/Hub.hxx"
+
+/// Captures the traffic of a hub into pcapng files with nanosecond
+/// timestamps. CAN hubs are written with the SocketCAN link type; string hubs
+/// (e.g. gridconnect) with the USER0 link type, one packet per hub buffer.
+///
+/// The hub thread only copies the packet into a memory buffer; a background
+/// thread writes the full buffers to the file. When the writer cannot keep up
+/// and both buffers are full, packets are dropped and counted.
+///
+/// In streaming mode the packets are written to a file, optionally rotating
+/// to a new file after a given size. In flight recorder mode the packets are
+/// only kept in memory for a given time, and written to a file by persist().
+class PcapCapture
+{
+public:
+    /// Streaming mode: captures a CAN hub into files.
+    ///
+    /// @param hub is the hub to capture.
+    /// @param path is the output file name.
+    /// @param rotate_bytes when the file reaches this size, the capture
+    /// continues in a new file; 0 to never rotate. The files are named path,
+    /// path.1, path.2, ...
+    /// @param keep_files how many of the newest files to keep when rotating;
+    /// 0 to keep all.
+    PcapCapture(CanHubFlow *hub, const string &path, size_t rotate_bytes = 0,
+        unsigned keep_files = 0);
+
+    /// Streaming mode: captures a string hub into files. See above for the
+    /// arguments.
+    PcapCapture(HubFlow *hub, const string &path, size_t rotate_bytes = 0,
+        unsigned keep_files = 0);
+
+    /// Flight recorder mode: keeps the packets of a CAN hub in memory.
+    ///
+    /// @param hub is the hub to capture.
+    /// @param keep_sec how many seconds of traffic to keep.
+    PcapCapture(CanHubFlow *hub, unsigned keep_sec);
+
+    /// Flight recorder mode: keeps the packets of a string hub in memory.
+    /// See above for the arguments.
+    PcapCapture(HubFlow *hub, unsigned keep_sec);
+
+    /// Unregisters from the hub. In streaming mode writes out all packets.
+    ~PcapCapture();
+
+    /// Waits until every packet captured so far is written to the file (in
+    /// flight recorder mode: is available for persist()).
+    void flush();
+
+    /// Writes the packets of the last keep_sec seconds to a file. Only in
+    /// flight recorder mode.
+    /// @param path is the output file name.
+    /// @return false if the file could not be written.
+    bool persist(const string &path);
+
+    /// @return how many packets were dropped so far because the writer
+    /// could not keep up.
+    unsigned dropped();
+
+private:
+    /// pImpl class.
+    struct Impl;
+    /// pImpl object.
+    std::unique_ptr<Impl> impl_;
+};
+
+#endif // _UTILS_PCAPCAPTURE_HXX_
@@ -124,10 +124,16 @@ public:
         container_.push_back(d);
     }
 
-    /// Removes an entry from the vector, pointed by an iterator.
-    void erase(const iterator &it)
+    /// Removes an entry from the vector, pointed by an iterator. @return
+    /// iterator to the entry after the removed one.
+    iterator erase(const iterator &it)
     {
-        container_.erase(it);
+        if (size_t(it - container_.begin()) < sortedCount_)
+        {
+            // The sorted prefix stays sorted, but gets shorter.
+            --sortedCount_;
+        }
+        return container_.erase(it);
     }
 
     /// Removes all entries.
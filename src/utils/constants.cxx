@@ -116,8 +116,9 @@
 
 /** @var _sym_gridconnect_buffer_delay_usec
  *
- * @brief How many microseconds we should delay outgoing gridconnect bytes in
- * the hope that we can complete the buffers.
+ * @brief Latency budget: how many microseconds we may delay outgoing
+ * gridconnect bytes in the hope that we can complete the buffers. Bytes
+ * arriving after an idle period are not delayed.
  */
 
 /**
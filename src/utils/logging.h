@@ -71,6 +71,27 @@ extern os_mutex_t g_log_mutex;
 #define UNLOCK_LOG
 #endif
 
+#if defined(__linux__) && defined(__cplusplus) && !defined(NO_ASYNC_LOGGING)
+#define LOG_ASYNC_SUPPORTED
+/// Captures a LOG call for the asynchronous backend (see utils/AsyncLog.hxx).
+/// @param fmt is the printf format; it is not copied, so it must be a string
+/// literal. @return false if the backend is not running or the format cannot
+/// be captured; then the caller has to log synchronously.
+bool log_async_push(const char *fmt, ...);
+/// Blocks until every record logged before this call has been written.
+void log_async_flush();
+/// Hands a log call to the asynchronous backend (see log_async_start()).
+/// Evaluates to false if the message has to be logged synchronously.
+#define LOG_ASYNC(message...) ::log_async_push(message)
+/// Writes out the pending asynchronous log records.
+#define LOG_ASYNC_FLUSH ::log_async_flush()
+#else
+/// Asynchronous logging is available only for C++ code on linux.
+#define LOG_ASYNC(message...) 0
+/// Asynchronous logging is available only for C++ code on linux.
+#define LOG_ASYNC_FLUSH
+#endif
+
 #ifdef __cplusplus
 #define GLOBAL_LOG_OUTPUT ::log_output
 #else
@@ -94,6 +115,11 @@ extern os_mutex_t g_log_mutex;
 /// the code wverywhere.
 /// @param message is a printf format argument and possibly more arguments that
 /// are referenced from the printf format.
+///
+/// In C++ code on linux, after log_async_start() was called, the message is
+/// not formatted by the caller; the arguments are copied into a per-thread
+/// ring and a background thread formats and writes them. %s arguments are
+/// copied as strings.
 #define LOG(level, message...)                                                 \
     do                                                                         \
     {                                                                          \
@@ -103,10 +129,11 @@ extern os_mutex_t g_log_mutex;
         }                                                                      \
         else if (level == FATAL)                                               \
         {                                                                      \
+            LOG_ASYNC_FLUSH;                                                   \
             fprintf(stderr, message);                                          \
             abort();                                                           \
         }                                                                      \
-        else if (LOGLEVEL >= level)                                            \
+        else if (LOGLEVEL >= level && !LOG_ASYNC(message))                     \
         {                                                                      \
             LOCK_LOG;                                                          \
             int sret = snprintf(logbuffer, sizeof(logbuffer), message);        \